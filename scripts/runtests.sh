@@ -73,4 +73,174 @@ for reference_results in ../ref/results/*.res; do
     rm -f "$results"
 done
 
+# The reference results above only cover widths 1 and 2 with a 32-entry ROB.
+# The remaining tests run other configurations on the first instructions of
+# some traces: in lockstep with the reference engine of -verify, and with and
+# without -skipidle and each -wakeup engine, whose results must not change.
+prefix_insts=500000
+record_bytes=48
+prefix_dir="$(mktemp -d)"
+trap 'rm -rf "$prefix_dir"' EXIT
+for trace_name in gcc mcf; do
+    zcat "../traces/$trace_name.ptr.gz" | head -c $((prefix_insts * record_bytes)) > "$prefix_dir/$trace_name.ptr" || true
+done
+
+check_configs=(
+    '-pipewidth 4 -schedpolicy 1 -loadlatency 4 -robsize 48'
+    '-pipewidth 8 -schedpolicy 1 -loadlatency 20 -robsize 100'
+    '-pipewidth 3 -schedpolicy 0 -loadlatency 10 -robsize 33'
+    '-pipewidth 8 -schedpolicy 1 -loadlatency 50 -robsize 160'
+    '-pipewidth 5 -schedpolicy 1 -loadlatency 1 -robsize 64'
+)
+verify_flags=(
+    ''
+    '-skipidle'
+    '-wakeup scan'
+    '-wakeup simd -skipidle'
+    '-wakeup scan -skipidle'
+)
+
+for trace_name in gcc mcf; do
+    for c in "${!check_configs[@]}"; do
+        test_name="V$((c + 1)).$trace_name"
+        read -r -a test_args <<< "${check_configs[$c]} ${verify_flags[$c]}"
+
+        total_tests=$((total_tests + 1))
+        echo -n 'Running test '"$test_name"' ('"${test_args[*]}"' -verify)...'
+
+        output="$(mktemp)"
+        if ../src/sim -verify "${test_args[@]}" "$prefix_dir/$trace_name.ptr" > "$output" 2>&1 &&
+           grep -q '^All '"$prefix_insts"' commits matched' "$output"; then
+            echo " $green"'passed'"$reset"
+            passed_tests=$((passed_tests + 1))
+        else
+            echo " $red"'failed'"$reset"
+            tail -n 20 "$output" | sed 's/^/    /'
+        fi
+        rm -f "$output"
+    done
+
+    for c in "${!check_configs[@]}"; do
+        test_name="E$((c + 1)).$trace_name"
+        read -r -a test_args <<< "${check_configs[$c]}"
+
+        total_tests=$((total_tests + 1))
+        echo -n 'Running test '"$test_name"' ('"${test_args[*]}"' -skipidle/-wakeup)...'
+
+        expected="$(mktemp)"
+        results="$(mktemp)"
+        ../src/sim "${test_args[@]}" -wakeup deplist "$prefix_dir/$trace_name.ptr" | grep '^LAB3_' > "$expected"
+        passed=true
+        for flags in '-skipidle -wakeup simd' '-wakeup scan'; do
+            read -r -a extra_args <<< "$flags"
+            ../src/sim "${test_args[@]}" "${extra_args[@]}" "$prefix_dir/$trace_name.ptr" | grep '^LAB3_' > "$results"
+            if ! diff -q "$results" "$expected" > /dev/null; then
+                if $passed; then
+                    echo " $red"'failed'"$reset"
+                fi
+                passed=false
+                echo "  $blue"'Differences with '"$flags"':'"$reset"
+                diff "$expected" "$results" | sed 's/^/    /' || true
+            fi
+        done
+        if $passed; then
+            echo " $green"'passed'"$reset"
+            passed_tests=$((passed_tests + 1))
+        fi
+        rm -f "$expected" "$results"
+    done
+done
+
+# The R tests run the check configurations through the other ways of getting
+# a trace into a pipeline, or a pipeline through a run: each must give the
+# same LAB3_ lines as the plain runs of the E tests. Each way writes one
+# <variant>.res file into the scratch directory given, holding the results
+# of every configuration in order.
+round_trips=(checkpoint tcache sweep batch stream)
+
+run_round_trip() {
+    local mode="$1" trace_name="$2" scratch="$3"
+    local trace="$prefix_dir/$trace_name.ptr"
+    local c test_args
+    case "$mode" in
+        checkpoint)
+            for c in "${!check_configs[@]}"; do
+                read -r -a test_args <<< "${check_configs[$c]}"
+                ../src/sim "${test_args[@]}" -checkpoint-at $((prefix_insts / 2)) "$scratch/$c.ckpt" "$trace" | grep '^LAB3_' >> "$scratch/checkpoint-at.res" || true
+                ../src/sim -restore "$scratch/$c.ckpt" "$trace" | grep '^LAB3_' >> "$scratch/restore.res" || true
+            done
+            ;;
+        tcache)
+            ../src/sim -mktracecache "$trace" "$scratch/$trace_name.tc" > /dev/null
+            for c in "${!check_configs[@]}"; do
+                read -r -a test_args <<< "${check_configs[$c]}"
+                ../src/sim "${test_args[@]}" "$scratch/$trace_name.tc" | grep '^LAB3_' >> "$scratch/tcache.res" || true
+            done
+            ;;
+        sweep)
+            printf '%s\n' "${check_configs[@]}" > "$scratch/sweep"
+            ../src/sim -sweep "$scratch/sweep" "$trace" | grep '^LAB3_' > "$scratch/sweep.res" || true
+            ;;
+        batch)
+            {
+                echo "trace $trace_name $trace"
+                for c in "${!check_configs[@]}"; do
+                    echo "config R$((c + 1)) ${check_configs[$c]}"
+                done
+            } > "$scratch/jobs"
+            ../src/sim -batch "$scratch/jobs" -batchout "$scratch/out" > /dev/null || true
+            for c in "${!check_configs[@]}"; do
+                grep '^LAB3_' "$scratch/out/R$((c + 1)).$trace_name.res" >> "$scratch/batch.res" || true
+            done
+            ;;
+        stream)
+            # A gzip stream on standard input, and a raw one through a FIFO.
+            gzip -c "$trace" > "$scratch/$trace_name.ptr.gz"
+            mkfifo "$scratch/fifo"
+            for c in "${!check_configs[@]}"; do
+                read -r -a test_args <<< "${check_configs[$c]}"
+                ../src/sim "${test_args[@]}" - < "$scratch/$trace_name.ptr.gz" | grep '^LAB3_' >> "$scratch/stdin.res" || true
+                cat "$trace" > "$scratch/fifo" &
+                ../src/sim "${test_args[@]}" "$scratch/fifo" | grep '^LAB3_' >> "$scratch/fifo.res" || true
+                wait
+            done
+            ;;
+    esac
+}
+
+for trace_name in gcc mcf; do
+    expected="$(mktemp)"
+    for c in "${!check_configs[@]}"; do
+        read -r -a test_args <<< "${check_configs[$c]}"
+        ../src/sim "${test_args[@]}" "$prefix_dir/$trace_name.ptr" | grep '^LAB3_' >> "$expected"
+    done
+
+    for m in "${!round_trips[@]}"; do
+        test_name="R$((m + 1)).$trace_name"
+
+        total_tests=$((total_tests + 1))
+        echo -n 'Running test '"$test_name"' ('"${round_trips[$m]}"')...'
+
+        scratch="$(mktemp -d)"
+        run_round_trip "${round_trips[$m]}" "$trace_name" "$scratch"
+        passed=true
+        for results in "$scratch"/*.res; do
+            if ! diff -q "$results" "$expected" > /dev/null 2>&1; then
+                if $passed; then
+                    echo " $red"'failed'"$reset"
+                fi
+                passed=false
+                echo "  $blue"'Differences with '"$(basename "$results" .res)"':'"$reset"
+                diff "$expected" "$results" 2>&1 | sed 's/^/    /' || true
+            fi
+        done
+        if $passed; then
+            echo " $green"'passed'"$reset"
+            passed_tests=$((passed_tests + 1))
+        fi
+        rm -rf "$scratch"
+    done
+    rm -f "$expected"
+done
+
 echo "$blue"'Passed '"$passed_tests"'/'"$total_tests"' tests'"$reset"
@@ -0,0 +1,592 @@
+// batch.cpp
+// Implements the batch mode.
+
+#include "batch.h"
+#include "report.h"
+#include "sim.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+/** [Internal] A trace named in a jobs file. */
+typedef struct BatchTraceStruct
+{
+    /** The name used in result file names. */
+    std::string name;
+    /** The trace file. */
+    std::string filename;
+} BatchTrace;
+
+/** [Internal] A configuration named in a jobs file. */
+typedef struct BatchConfigStruct
+{
+    /** The name used in result file names. */
+    std::string name;
+    /** The configuration. */
+    PipelineConfig config;
+} BatchConfig;
+
+/** [Internal] One (trace, configuration) job and its results. */
+typedef struct BatchJobStruct
+{
+    /** The trace to simulate. */
+    const BatchTrace *trace;
+    /** The configuration to simulate. */
+    const BatchConfig *config;
+    /** The expected length of the job, in arbitrary but comparable units. */
+    double cost;
+    /** 0 once the job has succeeded, nonzero if it failed. */
+    int status;
+    /** The number of instructions retired. */
+    uint64_t retired_inst;
+    /** The number of cycles simulated. */
+    uint64_t num_cycles;
+    /** The number of commit slots left unused for each StallReason. */
+    uint64_t stall_slots[NUM_STALL_REASONS];
+    /** The number of cycles the issue stage stalled on a full ROB. */
+    uint64_t rob_stall_cycles;
+    /** The ROB occupancy histogram, taken over from the pipeline, or NULL. */
+    uint64_t *rob_occupancy;
+    /** The EXEQ occupancy histogram, taken over from the pipeline, or NULL. */
+    uint64_t *exeq_occupancy;
+    /** The host metrics of the job; wall_seconds covers the whole job. */
+    HostStats host;
+} BatchJob;
+
+/** [Internal] The state shared by the workers of a batch. */
+typedef struct BatchPoolStruct
+{
+    /** The directory to write the result files to. */
+    const char *out_dir;
+    /** The number of threads each job decompresses BGZF traces with. */
+    unsigned int gz_threads;
+    /** Whether the pipelines fast-forward through idle cycles. */
+    bool skip_idle;
+    /** Protects queues and num_done, and serializes progress output. */
+    std::mutex lock;
+    /** The jobs not yet started, one queue per worker, longest first. */
+    std::vector<std::deque<BatchJob *>> queues;
+    /** The number of jobs finished. */
+    unsigned int num_done;
+    /** The total number of jobs. */
+    unsigned int num_jobs;
+} BatchPool;
+
+/**
+ * Read a jobs file.
+ *
+ * @return 0 on success, nonzero if the file could not be read or parsed
+ */
+static int batch_read_jobs(const char *filename, const PipelineConfig *defaults,
+                           std::vector<BatchTrace> *traces,
+                           std::vector<BatchConfig> *configs)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        perror("Couldn't open jobs file");
+        return 1;
+    }
+
+    char line[1024];
+    unsigned int line_num = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_num++;
+
+        // Split the line into words.
+        char *words[64];
+        int num_words = 0;
+        for (char *word = strtok(line, " \t\r\n"); word != NULL && num_words < 64;
+             word = strtok(NULL, " \t\r\n"))
+        {
+            words[num_words++] = word;
+        }
+        if (num_words == 0 || words[0][0] == '#')
+        {
+            continue;
+        }
+
+        if (strcmp(words[0], "trace") == 0 && num_words == 3)
+        {
+            BatchTrace trace;
+            trace.name = words[1];
+            trace.filename = words[2];
+            traces->push_back(trace);
+        }
+        else if (strcmp(words[0], "config") == 0 && num_words >= 2)
+        {
+            BatchConfig config;
+            config.name = words[1];
+            config.config = *defaults;
+            for (int i = 2; i < num_words && status == 0; i++)
+            {
+                status = parse_config_option(num_words, words, &i, &config.config);
+                if (status < 0)
+                {
+                    fprintf(stderr, "Error: unrecognized option: %s\n", words[i]);
+                }
+            }
+            configs->push_back(config);
+        }
+        else
+        {
+            status = 2;
+        }
+
+        if (status != 0)
+        {
+            fprintf(stderr, "Error: %s:%u: expected \"trace <name> <file>\" or "
+                            "\"config <name> <options>\"\n",
+                    filename, line_num);
+        }
+    }
+    fclose(file);
+    if (status != 0)
+    {
+        return 2;
+    }
+
+    if (traces->empty() || configs->empty())
+    {
+        fprintf(stderr, "Error: %s needs at least one trace and one config\n",
+                filename);
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * Build the key identifying a job in a previous batch report.
+ */
+static std::string batch_history_key(const char *trace_filename,
+                                     unsigned int pipe_width,
+                                     const char *sched_policy,
+                                     unsigned int load_exe_cycles,
+                                     unsigned int num_rob_entries)
+{
+    char key[64];
+    snprintf(key, sizeof(key), ",%u,%s,%u,%u", pipe_width, sched_policy,
+             load_exe_cycles, num_rob_entries);
+    return std::string(trace_filename) + key;
+}
+
+/**
+ * Read the simulation time of every job in a previous batch report.
+ *
+ * @param filename the report to read; a missing report is no error
+ * @param history receives the time of each job, by batch_history_key
+ */
+static void batch_read_history(const char *filename,
+                               std::map<std::string, double> *history)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    // Rows start: trace,pipe_width,sched_policy,load_exe_cycles,
+    // num_rob_entries,num_inst,num_cycles,cpi,wall_seconds,sim_seconds. Quoted
+    // trace names are skipped.
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *fields[10];
+        int num_fields = 0;
+        for (char *p = line; num_fields < 10; p++)
+        {
+            fields[num_fields++] = p;
+            p = strchr(p, ',');
+            if (p == NULL)
+            {
+                break;
+            }
+            *p = '\0';
+        }
+        if (num_fields < 10 || fields[0][0] == '"' || strcmp(fields[0], "trace") == 0)
+        {
+            continue;
+        }
+
+        std::string key = batch_history_key(fields[0], atoi(fields[1]), fields[2],
+                                            atoi(fields[3]), atoi(fields[4]));
+        (*history)[key] = atof(fields[9]);
+    }
+    fclose(file);
+}
+
+/**
+ * Estimate how long every job will take, from the previous batch report
+ * where it has the job and from the size of the trace file otherwise.
+ */
+static void batch_estimate_costs(const char *out_dir, std::vector<BatchJob> *jobs)
+{
+    std::map<std::string, double> history;
+    batch_read_history((std::string(out_dir) + "/" + BATCH_REPORT_FILENAME).c_str(),
+                       &history);
+
+    // Scale file sizes by the seconds per byte of the jobs with a history, so
+    // that both kinds of estimate can be compared.
+    std::vector<double> sizes(jobs->size());
+    std::vector<bool> known(jobs->size());
+    double known_seconds = 0.0;
+    double known_bytes = 0.0;
+    for (size_t i = 0; i < jobs->size(); i++)
+    {
+        BatchJob *job = &(*jobs)[i];
+        const PipelineConfig *config = &job->config->config;
+        struct stat st;
+        sizes[i] = stat(job->trace->filename.c_str(), &st) == 0 ? st.st_size : 0;
+
+        std::string key = batch_history_key(
+            job->trace->filename.c_str(), config->pipe_width,
+            config->sched_policy == SCHED_IN_ORDER ? "in-order" : "out-of-order",
+            config->load_exe_cycles, config->num_rob_entries);
+        std::map<std::string, double>::const_iterator it = history.find(key);
+        known[i] = it != history.end();
+        if (known[i])
+        {
+            job->cost = it->second;
+            known_seconds += it->second;
+            known_bytes += sizes[i];
+        }
+    }
+
+    double seconds_per_byte = known_bytes > 0.0 ? known_seconds / known_bytes : 1.0;
+    for (size_t i = 0; i < jobs->size(); i++)
+    {
+        if (!known[i])
+        {
+            (*jobs)[i].cost = sizes[i] * seconds_per_byte;
+        }
+    }
+}
+
+/**
+ * Take the next job for a worker: the longest job left in its own queue, or
+ * else the longest job left in the fullest other queue.
+ *
+ * @return the job, or NULL if every queue is empty
+ */
+static BatchJob *batch_take_job(BatchPool *pool, unsigned int worker)
+{
+    std::lock_guard<std::mutex> guard(pool->lock);
+    std::deque<BatchJob *> *queue = &pool->queues[worker];
+    if (queue->empty())
+    {
+        for (size_t i = 0; i < pool->queues.size(); i++)
+        {
+            if (pool->queues[i].size() > queue->size())
+            {
+                queue = &pool->queues[i];
+            }
+        }
+        if (queue->empty())
+        {
+            return NULL;
+        }
+    }
+
+    BatchJob *job = queue->front();
+    queue->pop_front();
+    return job;
+}
+
+/**
+ * Simulate one job and write its result file.
+ */
+static void batch_run_job(BatchPool *pool, BatchJob *job)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const char *trace_filename = job->trace->filename.c_str();
+    std::string res_filename = std::string(pool->out_dir) + "/" +
+                               job->config->name + "." + job->trace->name + ".res";
+
+    job->status = 1;
+
+    FILE *res = fopen(res_filename.c_str(), "w");
+    if (res == NULL)
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        perror(("Couldn't open " + res_filename).c_str());
+        return;
+    }
+
+    fprintf(res, "Opening trace file: %s\n", trace_filename);
+    InstSource *src = open_trace_file(trace_filename, pool->gz_threads);
+    if (src == NULL)
+    {
+        fclose(res);
+        return;
+    }
+
+    fprintf(res, "\n** PIPELINE IS %u WIDE **\n\n", job->config->config.pipe_width);
+    Pipeline *p = pipe_init(&job->config->config, src);
+    if (p == NULL)
+    {
+        source_free(src);
+        fclose(res);
+        return;
+    }
+    p->skip_idle = pool->skip_idle;
+    job->status = run_pipeline(p, false);
+    job->host.sim_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    report_collect_host(&job->host, trace_filename, src);
+    source_free(src);
+
+    if (job->status == 0)
+    {
+        fprint_stats(res, p);
+    }
+    else
+    {
+        fprintf(res, "Error: pipeline is deadlocked\n");
+    }
+    if (fclose(res) != 0)
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        perror(("Couldn't write " + res_filename).c_str());
+        job->status = 1;
+    }
+
+    job->retired_inst = p->stat_retired_inst;
+    job->num_cycles = p->stat_num_cycle;
+    memcpy(job->stall_slots, p->stat_stall_slots, sizeof(job->stall_slots));
+    job->rob_stall_cycles = p->stat_rob_stall_cycles;
+    job->rob_occupancy = p->stat_rob_occupancy;
+    job->exeq_occupancy = p->stat_exeq_occupancy;
+    p->stat_rob_occupancy = NULL;
+    p->stat_exeq_occupancy = NULL;
+    pipe_free(p);
+    job->host.wall_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Run jobs on the calling worker thread until there are none left.
+ */
+static void batch_worker(BatchPool *pool, unsigned int worker)
+{
+    BatchJob *job;
+    while ((job = batch_take_job(pool, worker)) != NULL)
+    {
+        batch_run_job(pool, job);
+
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->num_done++;
+        printf("[%3u/%u] %s.%s", pool->num_done, pool->num_jobs,
+               job->config->name.c_str(), job->trace->name.c_str());
+        if (job->status == 0)
+        {
+            printf(": CPI %.3f in %.2fs\n",
+                   (double)job->num_cycles / (double)job->retired_inst,
+                   job->host.wall_seconds);
+        }
+        else
+        {
+            printf(": failed\n");
+        }
+        fflush(stdout);
+    }
+}
+
+/**
+ * Write the aggregated report of every job that succeeded.
+ *
+ * @return 0 on success, nonzero if the report could not be written
+ */
+static int batch_write_report(const char *out_dir, const std::vector<BatchJob> &jobs)
+{
+    std::string filename = std::string(out_dir) + "/" + BATCH_REPORT_FILENAME;
+    FILE *out = fopen(filename.c_str(), "w");
+    if (out == NULL)
+    {
+        perror("Couldn't open batch report");
+        return 1;
+    }
+
+    bool header = true;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const BatchJob *job = &jobs[i];
+        if (job->status != 0)
+        {
+            continue;
+        }
+
+        // report_write only reads the statistics of the pipeline.
+        Pipeline p;
+        p.stat_retired_inst = job->retired_inst;
+        p.stat_num_cycle = job->num_cycles;
+        memcpy(p.stat_stall_slots, job->stall_slots, sizeof(p.stat_stall_slots));
+        p.stat_rob_stall_cycles = job->rob_stall_cycles;
+        p.stat_rob_occupancy = job->rob_occupancy;
+        p.stat_exeq_occupancy = job->exeq_occupancy;
+        report_write(out, REPORT_CSV, header, job->trace->filename.c_str(),
+                     &job->config->config, &p, &job->host);
+        header = false;
+    }
+
+    if (fclose(out) != 0)
+    {
+        perror("Couldn't write batch report");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Create a directory and any missing parents, like mkdir -p.
+ *
+ * @param dir the directory
+ * @return 0 on success, nonzero if the directory could not be created (an
+ *         error has been printed)
+ */
+static int batch_make_dir(const char *dir)
+{
+    std::string path(dir);
+    for (size_t end = path.find('/', 1); ; end = path.find('/', end + 1))
+    {
+        std::string prefix = path.substr(0, end);
+        if (mkdir(prefix.c_str(), 0777) != 0 && errno != EEXIST)
+        {
+            perror(("Couldn't create " + prefix).c_str());
+            return 1;
+        }
+        if (end == std::string::npos)
+        {
+            break;
+        }
+    }
+
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "Error: %s is not a directory\n", dir);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Run every job of a jobs file.
+ *
+ * @param jobs_filename the jobs file
+ * @param out_dir the directory to write the result files to, which is
+ *                created if it does not exist
+ * @param num_threads the number of worker threads
+ * @param gz_threads the number of threads each job decompresses BGZF traces
+ *                   with
+ * @param skip_idle whether the pipelines fast-forward through idle cycles
+ * @param defaults the configuration each config line starts from
+ * @return 0 if every job succeeded, nonzero otherwise
+ */
+int batch_run(const char *jobs_filename, const char *out_dir,
+              unsigned int num_threads, unsigned int gz_threads,
+              bool skip_idle, const PipelineConfig *defaults)
+{
+    std::vector<BatchTrace> traces;
+    std::vector<BatchConfig> configs;
+    int status = batch_read_jobs(jobs_filename, defaults, &traces, &configs);
+    if (status != 0)
+    {
+        return status;
+    }
+
+    status = batch_make_dir(out_dir);
+    if (status != 0)
+    {
+        return status;
+    }
+
+    std::vector<BatchJob> jobs;
+    for (size_t c = 0; c < configs.size(); c++)
+    {
+        for (size_t t = 0; t < traces.size(); t++)
+        {
+            BatchJob job;
+            memset(&job, 0, sizeof(job));
+            job.trace = &traces[t];
+            job.config = &configs[c];
+            job.status = 1;
+            jobs.push_back(job);
+        }
+    }
+
+    // Deal the jobs out longest first, so every queue is longest first.
+    batch_estimate_costs(out_dir, &jobs);
+    std::vector<BatchJob *> order;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        order.push_back(&jobs[i]);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const BatchJob *a, const BatchJob *b) { return a->cost > b->cost; });
+
+    if (num_threads > jobs.size())
+    {
+        num_threads = jobs.size();
+    }
+    BatchPool pool;
+    pool.out_dir = out_dir;
+    pool.gz_threads = gz_threads;
+    pool.skip_idle = skip_idle;
+    pool.queues.resize(num_threads);
+    pool.num_done = 0;
+    pool.num_jobs = jobs.size();
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        pool.queues[i % num_threads].push_back(order[i]);
+    }
+
+    printf("\n** RUNNING %u JOBS ON %u THREADS **\n\n", pool.num_jobs, num_threads);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        workers.push_back(std::thread(batch_worker, &pool, i));
+    }
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        workers[i].join();
+    }
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    unsigned int num_failed = 0;
+    double job_seconds = 0.0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        num_failed += jobs[i].status != 0;
+        job_seconds += jobs[i].host.wall_seconds;
+    }
+
+    status = batch_write_report(out_dir, jobs);
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        free(jobs[i].rob_occupancy);
+        free(jobs[i].exeq_occupancy);
+    }
+    printf("\nRan %u jobs in %.2fs (%.2fs of simulation); %u failed. "
+           "Results are in %s/\n",
+           pool.num_jobs, elapsed, job_seconds, num_failed, out_dir);
+    if (num_failed > 0)
+    {
+        fprintf(stderr, "Error: %u of %u jobs failed\n", num_failed, pool.num_jobs);
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,51 @@
+// batch.h
+// Declares the batch mode, which runs a matrix of (trace, configuration) jobs
+// on a pool of worker threads.
+//
+// A jobs file names the traces and configurations to simulate:
+//
+//     # name   file
+//     trace    gcc    ../traces/gcc.ptr.gz
+//     # name   options, as accepted on the command line
+//     config   B1     -pipewidth 1 -schedpolicy 0 -loadlatency 1
+//
+// and every configuration is simulated on every trace. Each job writes its
+// statistics to <out_dir>/<config>.<trace>.res, and the statistics and host
+// metrics of every job are gathered into <out_dir>/batch.csv. Unlike a sweep,
+// each job reads its own trace, so the traces may differ.
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include "pipeline.h"
+
+/**
+ * The name of the aggregated report written to the output directory.
+ */
+#define BATCH_REPORT_FILENAME "batch.csv"
+
+/**
+ * Run every job of a jobs file.
+ *
+ * Jobs are started longest first: the expected length of a job is its time
+ * in the previous batch.csv of the output directory if there is one, and
+ * otherwise the size of its trace file. The jobs are dealt out to one queue
+ * per worker, and a worker whose queue runs dry steals the longest job left
+ * in the fullest queue.
+ *
+ * @param jobs_filename the jobs file
+ * @param out_dir the directory to write the result files to, which is
+ *                created if it does not exist
+ * @param num_threads the number of worker threads
+ * @param gz_threads the number of threads each job decompresses BGZF traces
+ *                   with
+ * @param skip_idle whether the pipelines fast-forward through idle cycles
+ * @param defaults the configuration each config line starts from
+ * @return 0 if every job succeeded, nonzero otherwise (an error has been
+ *         printed)
+ */
+int batch_run(const char *jobs_filename, const char *out_dir,
+              unsigned int num_threads, unsigned int gz_threads,
+              bool skip_idle, const PipelineConfig *defaults);
+
+#endif
@@ -0,0 +1,542 @@
+// bench.cpp
+// Microbenchmarks for the ROB, RAT, EXEQ, and the full pipe_cycle kernel,
+// run on synthetic instruction streams.
+//
+// Every benchmark is repeated and the fastest repetition is reported, one
+// result per line as CSV (the default) or JSON, so that results can be
+// compared across commits. Build and run with "make bench".
+
+#include "pipeline.h"
+#include "source.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of instructions generated up front for the ROB, RAT, and EXEQ
+ * benchmarks, which cycle through them so that generating instructions is not
+ * part of what they time. A multiple of MAX_ARF_REGS keeps the dependencies
+ * the same across the wrap-around.
+ */
+#define BENCH_RING_INSTS 4096
+
+/** [Internal] Results computed only to keep them from being optimized away. */
+static volatile int bench_sink;
+
+/** The shape of a synthetic instruction stream. */
+typedef struct SynthParamsStruct
+{
+    /**
+     * The distance, in instructions, from each instruction to the producer of
+     * its operand (1 to MAX_ARF_REGS - 1).
+     */
+    unsigned int dep_dist;
+    /** The fraction of instructions that are loads. */
+    double load_frac;
+} SynthParams;
+
+/** [Internal] The state of a synthetic instruction stream. */
+typedef struct SynthStreamStruct
+{
+    /** The shape of the stream. */
+    SynthParams params;
+    /** The number of instructions produced so far. */
+    uint64_t seq;
+    /** The number of instructions left to produce. */
+    uint64_t remaining;
+    /** The state of the random number generator picking the loads. */
+    uint64_t rng;
+} SynthStream;
+
+/** The options selected on the command line. */
+typedef struct BenchOptionsStruct
+{
+    /** The number of instructions (operations) per benchmark. */
+    uint64_t num_insts;
+    /** The number of repetitions of each benchmark. */
+    unsigned int reps;
+    /** Whether to print JSON instead of CSV. */
+    bool json;
+    /** If not NULL, only run the benchmarks whose names start with this. */
+    const char *filter;
+} BenchOptions;
+
+/** One benchmark result. */
+typedef struct BenchResultStruct
+{
+    /** The name of the benchmark. */
+    const char *name;
+    /** The pipeline width (or operations per cycle), or 0 if not used. */
+    unsigned int width;
+    /** The number of ROB entries, or 0 if not used. */
+    unsigned int rob_entries;
+    /** The number of instructions kept in the ROB, or 0 if not controlled. */
+    unsigned int occupancy;
+    /** The wakeup engine of the ROB. */
+    WakeupEngine wakeup;
+    /** The shape of the instruction stream. */
+    SynthParams params;
+    /** The number of operations timed. */
+    uint64_t ops;
+    /** The time taken by the fastest repetition, in nanoseconds. */
+    double best_ns;
+} BenchResult;
+
+/**
+ * Produce the next instruction of a synthetic stream into a trace record.
+ *
+ * Instruction i writes register i % MAX_ARF_REGS and reads the register
+ * written params.dep_dist instructions earlier.
+ */
+static void synth_next_rec(SynthStream *s, TraceRec *rec)
+{
+    memset(rec, 0, sizeof(*rec));
+    uint64_t i = s->seq++;
+
+    // xorshift64 keeps the loads the same from run to run.
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 7;
+    s->rng ^= s->rng << 17;
+    bool load = (double)(s->rng >> 11) / (double)(1ull << 53) < s->params.load_frac;
+
+    rec->op_type = load ? OP_LD : OP_ALU;
+    rec->dest_needed = 1;
+    rec->dest_reg = i % MAX_ARF_REGS;
+    if (i >= s->params.dep_dist)
+    {
+        rec->src1_needed = 1;
+        rec->src1_reg = (i - s->params.dep_dist) % MAX_ARF_REGS;
+    }
+}
+
+/**
+ * Hand out the next instruction of a synthetic stream.
+ */
+static SourceStatus synth_source_next(InstSource *src, InstInfo *inst)
+{
+    SynthStream *s = (SynthStream *)src->ctx;
+    if (s->remaining == 0)
+    {
+        return SOURCE_EOF;
+    }
+    s->remaining--;
+
+    TraceRec rec;
+    synth_next_rec(s, &rec);
+    trace_decode(&rec, inst);
+    return SOURCE_OK;
+}
+
+/**
+ * Start a synthetic stream.
+ */
+static void synth_init(SynthStream *s, const SynthParams *params, uint64_t n)
+{
+    s->params = *params;
+    s->seq = 0;
+    s->remaining = n;
+    s->rng = 0x9e3779b97f4a7c15ull;
+}
+
+/**
+ * Generate the first BENCH_RING_INSTS instructions of a synthetic stream.
+ *
+ * @param params the shape of the stream
+ * @param ring receives the instructions
+ */
+static void synth_fill_ring(const SynthParams *params, InstInfo *ring)
+{
+    SynthStream s;
+    synth_init(&s, params, BENCH_RING_INSTS);
+    for (unsigned int i = 0; i < BENCH_RING_INSTS; i++)
+    {
+        TraceRec rec;
+        synth_next_rec(&s, &rec);
+        trace_decode(&rec, &ring[i]);
+        ring[i].inst_num = i + 1;
+    }
+}
+
+/**
+ * Read the host clock.
+ *
+ * @return the current time, in nanoseconds
+ */
+static double bench_now_ns()
+{
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Time instructions flowing through the ROB at a fixed occupancy: each one is
+ * inserted at the tail (waiting on its producer if that is still in flight),
+ * while the oldest entry is scheduled, woken up, and removed from the head.
+ *
+ * @return the time taken, in nanoseconds
+ */
+static double bench_rob(const PipelineConfig *config, const SynthParams *params,
+                        unsigned int occupancy, uint64_t n)
+{
+    ROB *rob = rob_init(config->num_rob_entries, config->wakeup_engine);
+    if (rob == NULL)
+    {
+        exit(1);
+    }
+    static InstInfo ring[BENCH_RING_INSTS];
+    synth_fill_ring(params, ring);
+
+    // The ROB tag of each instruction still in flight, by register.
+    int producer[MAX_ARF_REGS];
+    for (int r = 0; r < MAX_ARF_REGS; r++)
+    {
+        producer[r] = -1;
+    }
+
+    double start = 0.0;
+    for (uint64_t i = 0; i < n + occupancy; i++)
+    {
+        if (i == occupancy)
+        {
+            start = bench_now_ns();
+        }
+
+        if (i >= occupancy)
+        {
+            // Schedule, complete, and retire the oldest instruction.
+            int tag = rob_find_oldest_pending(rob, false);
+            InstInfo head = rob->insts[tag];
+            rob_mark_exec(rob, &head);
+            rob_wakeup(rob, tag);
+            rob_mark_ready(rob, &head);
+            head = rob_remove_head(rob);
+            if (producer[head.dest_reg] == head.dr_tag)
+            {
+                producer[head.dest_reg] = -1;
+            }
+        }
+
+        const InstInfo &inst = ring[i % BENCH_RING_INSTS];
+        int idx = rob_insert(rob, &inst);
+        rob->insts[idx].dr_tag = idx;
+        if (inst.src1_reg != -1 && producer[inst.src1_reg] != -1)
+        {
+            rob_add_consumer(rob, producer[inst.src1_reg], idx, 0);
+        }
+        else
+        {
+            rob->insts[idx].src1_ready = true;
+        }
+        rob->insts[idx].src2_ready = true;
+        rob_update_ready(rob, idx);
+        producer[inst.dest_reg] = idx;
+    }
+    double elapsed = bench_now_ns() - start;
+
+    rob_free(rob);
+    return elapsed;
+}
+
+/**
+ * Time renaming: each instruction looks up its sources, remaps its
+ * destination, and frees the mapping of the instruction it replaces.
+ *
+ * @return the time taken, in nanoseconds
+ */
+static double bench_rat(const PipelineConfig *config, const SynthParams *params,
+                        uint64_t n)
+{
+    RAT *rat = rat_init();
+    static InstInfo ring[BENCH_RING_INSTS];
+    synth_fill_ring(params, ring);
+
+    // Summing the tags keeps the lookups from being optimized away.
+    int acc = 0;
+    double start = bench_now_ns();
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const InstInfo &inst = ring[i % BENCH_RING_INSTS];
+        int tag = (int)(i % config->num_rob_entries);
+        if (inst.src1_reg != -1)
+        {
+            acc += rat_get_remap(rat, inst.src1_reg);
+        }
+        if (rat_get_remap(rat, inst.dest_reg) == tag)
+        {
+            rat_reset_entry(rat, inst.dest_reg);
+        }
+        rat_set_remap(rat, inst.dest_reg, tag);
+    }
+    double elapsed = bench_now_ns() - start;
+    bench_sink = acc;
+
+    free(rat);
+    return elapsed;
+}
+
+/**
+ * Time the EXEQ the way the exe stage uses it: every cycle, width
+ * instructions are inserted, the queue is cycled, and every instruction that
+ * has finished is removed.
+ *
+ * @return the time taken, in nanoseconds
+ */
+static double bench_exeq(const PipelineConfig *config, const SynthParams *params,
+                         uint64_t n)
+{
+    unsigned int width = config->pipe_width;
+    EXEQ *exeq = exeq_init(config->load_exe_cycles);
+    if (exeq == NULL)
+    {
+        exit(1);
+    }
+    static InstInfo ring[BENCH_RING_INSTS];
+    synth_fill_ring(params, ring);
+
+    uint64_t inserted = 0;
+    double start = bench_now_ns();
+    while (inserted < n || exeq->count > 0)
+    {
+        for (unsigned int i = 0; i < width && inserted < n; i++, inserted++)
+        {
+            exeq_insert(exeq, &ring[inserted % BENCH_RING_INSTS]);
+        }
+        exeq_cycle(exeq);
+        while (exeq_check_done(exeq))
+        {
+            exeq_remove(exeq);
+        }
+    }
+    double elapsed = bench_now_ns() - start;
+
+    exeq_free(exeq);
+    return elapsed;
+}
+
+/**
+ * Time the full pipeline simulating a synthetic stream to completion.
+ *
+ * @return the time taken, in nanoseconds
+ */
+static double bench_pipe(const PipelineConfig *config, const SynthParams *params,
+                         uint64_t n)
+{
+    SynthStream s;
+    synth_init(&s, params, n);
+    InstSource src;
+    src.next = synth_source_next;
+    src.skip = NULL;
+    src.release = NULL;
+    src.stats = NULL;
+    src.ctx = &s;
+
+    Pipeline *p = pipe_init(config, &src);
+    if (p == NULL)
+    {
+        exit(1);
+    }
+    double start = bench_now_ns();
+    while (!p->halt)
+    {
+        pipe_cycle(p);
+    }
+    double elapsed = bench_now_ns() - start;
+
+    pipe_free(p);
+    return elapsed;
+}
+
+/**
+ * Print one result.
+ */
+static void bench_print(const BenchOptions *opts, const BenchResult *res)
+{
+    double ns_per_op = res->best_ns / res->ops;
+    double ops_per_sec = res->ops / (res->best_ns * 1e-9);
+    if (opts->json)
+    {
+        printf("{\"bench\": \"%s\", \"width\": %u, \"rob_entries\": %u, "
+               "\"occupancy\": %u, \"wakeup\": \"%s\", \"dep_dist\": %u, "
+               "\"load_frac\": %.2f, \"ops\": %lu, \"ns_per_op\": %.3f, "
+               "\"ops_per_sec\": %.0f}\n",
+               res->name, res->width, res->rob_entries, res->occupancy,
+               WAKEUP_ENGINE_NAMES[res->wakeup], res->params.dep_dist, res->params.load_frac,
+               (unsigned long)res->ops, ns_per_op, ops_per_sec);
+    }
+    else
+    {
+        printf("%s,%u,%u,%u,%s,%u,%.2f,%lu,%.3f,%.0f\n",
+               res->name, res->width, res->rob_entries, res->occupancy,
+               WAKEUP_ENGINE_NAMES[res->wakeup], res->params.dep_dist, res->params.load_frac,
+               (unsigned long)res->ops, ns_per_op, ops_per_sec);
+    }
+    fflush(stdout);
+}
+
+/**
+ * Run one benchmark opts->reps times and print its fastest repetition.
+ *
+ * The benchmark runs with the default configuration but for the ROB size,
+ * width, and wakeup engine of the result.
+ */
+static void bench_run(const BenchOptions *opts, BenchResult *res)
+{
+    if (opts->filter != NULL &&
+        strncmp(res->name, opts->filter, strlen(opts->filter)) != 0)
+    {
+        return;
+    }
+
+    PipelineConfig config;
+    pipe_default_config(&config);
+    config.pipe_width = res->width > 0 ? res->width : 1;
+    config.num_rob_entries = res->rob_entries > 0 ? res->rob_entries : 32;
+    config.wakeup_engine = res->wakeup;
+
+    res->ops = opts->num_insts;
+    res->best_ns = 0.0;
+    for (unsigned int r = 0; r < opts->reps; r++)
+    {
+        double ns;
+        if (strcmp(res->name, "rob") == 0)
+        {
+            ns = bench_rob(&config, &res->params, res->occupancy, res->ops);
+        }
+        else if (strcmp(res->name, "rat") == 0)
+        {
+            ns = bench_rat(&config, &res->params, res->ops);
+        }
+        else if (strcmp(res->name, "exeq") == 0)
+        {
+            ns = bench_exeq(&config, &res->params, res->ops);
+        }
+        else
+        {
+            ns = bench_pipe(&config, &res->params, res->ops);
+        }
+
+        if (r == 0 || ns < res->best_ns)
+        {
+            res->best_ns = ns;
+        }
+    }
+    bench_print(opts, res);
+}
+
+/**
+ * Print the usage of the benchmark binary.
+ */
+static void bench_usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [options]\n\n", program_name);
+    fprintf(stderr, "Microbenchmarks for the ROB, RAT, EXEQ, and pipeline\n\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "    -insts <num>        Operations per benchmark (default: 200000)\n");
+    fprintf(stderr, "    -reps <num>         Repetitions of each benchmark; the fastest is\n");
+    fprintf(stderr, "                        reported (default: 3)\n");
+    fprintf(stderr, "    -json               Print one JSON object per result instead of CSV\n");
+    fprintf(stderr, "    -filter <name>      Only run benchmarks whose names start with <name>\n");
+    fprintf(stderr, "                        (rob, rat, exeq, pipe)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions opts;
+    opts.num_insts = 200000;
+    opts.reps = 3;
+    opts.json = false;
+    opts.filter = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-insts") == 0 || strcmp(argv[i], "-reps") == 0) &&
+            i + 1 < argc)
+        {
+            long n = atol(argv[i + 1]);
+            if (n < 1)
+            {
+                fprintf(stderr, "Error: invalid argument for %s\n", argv[i]);
+                return 2;
+            }
+            if (strcmp(argv[i], "-insts") == 0)
+            {
+                opts.num_insts = n;
+            }
+            else
+            {
+                opts.reps = n;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "-json") == 0)
+        {
+            opts.json = true;
+        }
+        else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+        {
+            opts.filter = argv[++i];
+        }
+        else
+        {
+            bench_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    static const unsigned int widths[] = {1, 2, 4, 8};
+    static const unsigned int rob_sizes[] = {32, 64, 128, 256};
+    static const unsigned int dep_dists[] = {1, 4, 16};
+    static const double load_fracs[] = {0.0, 0.3};
+
+    if (!opts.json)
+    {
+        printf("bench,width,rob_entries,occupancy,wakeup,dep_dist,load_frac,ops,ns_per_op,ops_per_sec\n");
+    }
+
+    for (unsigned int d : dep_dists)
+    {
+        for (unsigned int rob_size : rob_sizes)
+        {
+            unsigned int occupancies[] = {8, rob_size / 2, rob_size};
+            for (unsigned int occupancy : occupancies)
+            {
+                for (int e = 0; e < NUM_WAKEUP_ENGINES; e++)
+                {
+                    BenchResult res = {"rob", 0, rob_size, occupancy,
+                                       (WakeupEngine)e, {d, 0.0}, 0, 0.0};
+                    bench_run(&opts, &res);
+                }
+            }
+        }
+
+        BenchResult res = {"rat", 0, 0, 0, WAKEUP_DEPLIST, {d, 0.0}, 0, 0.0};
+        bench_run(&opts, &res);
+    }
+
+    for (double load_frac : load_fracs)
+    {
+        for (unsigned int w : widths)
+        {
+            BenchResult res = {"exeq", w, 0, 0, WAKEUP_DEPLIST, {1, load_frac}, 0, 0.0};
+            bench_run(&opts, &res);
+        }
+    }
+
+    for (unsigned int w : widths)
+    {
+        for (unsigned int rob_size : rob_sizes)
+        {
+            for (unsigned int d : dep_dists)
+            {
+                for (double load_frac : load_fracs)
+                {
+                    BenchResult res = {"pipe", w, rob_size, 0, WAKEUP_DEPLIST,
+                                       {d, load_frac}, 0, 0.0};
+                    bench_run(&opts, &res);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+// ckpt.cpp
+// Implements saving and restoring pipeline checkpoints.
+
+#include "ckpt.h"
+#include <string.h>
+
+/** [Internal] The header at the start of a checkpoint. */
+typedef struct CkptHeaderStruct
+{
+    /** CKPT_MAGIC, including the terminating NUL. */
+    char magic[8];
+    /** CKPT_VERSION. */
+    uint32_t version;
+    /** The configuration the pipeline was simulated with. */
+    uint32_t pipe_width;
+    uint32_t num_rob_entries;
+    uint32_t load_exe_cycles;
+    uint32_t sched_policy;
+    /** Reserved; zero. */
+    uint32_t reserved;
+    /** The number of trace records the pipeline had fetched. */
+    uint64_t trace_pos;
+    /**
+     * The fingerprint of the first trace records, up to trace_pos or
+     * CKPT_FINGERPRINT_INSTS of them, whichever is fewer.
+     */
+    uint64_t fingerprint;
+} CkptHeader;
+
+/**
+ * Save the complete state of a pipeline to a checkpoint file.
+ *
+ * @param filename the checkpoint file to write
+ * @param p the pipeline to save
+ * @return 0 on success, nonzero on failure
+ */
+int ckpt_save(const char *filename, Pipeline *p)
+{
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+    {
+        perror("Couldn't open checkpoint for writing");
+        return 1;
+    }
+
+    const PipelineConfig &config = p->config;
+
+    CkptHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC));
+    hdr.version = CKPT_VERSION;
+    hdr.pipe_width = config.pipe_width;
+    hdr.num_rob_entries = config.num_rob_entries;
+    hdr.load_exe_cycles = config.load_exe_cycles;
+    hdr.sched_policy = config.sched_policy;
+    hdr.trace_pos = p->last_inst_num;
+    hdr.fingerprint = p->trace_fingerprint;
+
+    bool ok = ckpt_write(f, &hdr, sizeof(hdr)) && pipe_save(p, f);
+    if (fclose(f) != 0)
+    {
+        ok = false;
+    }
+    if (!ok)
+    {
+        perror("Couldn't write checkpoint");
+        remove(filename);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Recreate a pipeline from a checkpoint file.
+ *
+ * @param filename the checkpoint file to read
+ * @param src the source positioned at the start of the checkpointed trace
+ * @param wakeup_engine the wakeup engine to give the restored pipeline
+ * @return a pointer to the restored pipeline, or NULL on failure
+ */
+Pipeline *ckpt_restore(const char *filename, InstSource *src,
+                       WakeupEngine wakeup_engine)
+{
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+    {
+        perror("Couldn't open checkpoint");
+        return NULL;
+    }
+
+    CkptHeader hdr;
+    if (!ckpt_read(f, &hdr, sizeof(hdr)) ||
+        memcmp(hdr.magic, CKPT_MAGIC, sizeof(CKPT_MAGIC)) != 0 ||
+        hdr.version != CKPT_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a checkpoint from this version of "
+                        "the simulator\n", filename);
+        fclose(f);
+        return NULL;
+    }
+
+    // The pipeline is rebuilt with the configuration it was saved with.
+    PipelineConfig config;
+    config.pipe_width = hdr.pipe_width;
+    config.num_rob_entries = hdr.num_rob_entries;
+    config.load_exe_cycles = hdr.load_exe_cycles;
+    config.sched_policy = (SchedulingPolicy)hdr.sched_policy;
+    config.wakeup_engine = wakeup_engine;
+    if (config.pipe_width < 1 || config.pipe_width > MAX_PIPE_WIDTH ||
+        config.num_rob_entries < 1 || config.num_rob_entries > MAX_ROB_ENTRIES ||
+        config.load_exe_cycles < 1 || config.sched_policy >= NUM_SCHED_POLICIES)
+    {
+        fprintf(stderr, "Error: Invalid checkpoint\n");
+        fclose(f);
+        return NULL;
+    }
+
+    // Move the trace to the first record the pipeline has not fetched,
+    // fingerprinting the records at its start on the way.
+    uint64_t num_hashed = hdr.trace_pos < CKPT_FINGERPRINT_INSTS
+                              ? hdr.trace_pos : CKPT_FINGERPRINT_INSTS;
+    uint64_t fingerprint = CKPT_FINGERPRINT_SEED;
+    SourceStatus status = SOURCE_OK;
+    for (uint64_t i = 0; i < num_hashed && status == SOURCE_OK; i++)
+    {
+        InstInfo inst;
+        status = source_next(src, &inst);
+        fingerprint = ckpt_fingerprint_add(fingerprint, &inst);
+    }
+    uint64_t skipped;
+    if (status == SOURCE_OK)
+    {
+        status = source_skip(src, hdr.trace_pos - num_hashed, &skipped);
+    }
+    if (status != SOURCE_OK)
+    {
+        fprintf(stderr, "Error: the trace ends before the checkpoint's "
+                        "position (%lu instructions)\n",
+                (unsigned long)hdr.trace_pos);
+        fclose(f);
+        return NULL;
+    }
+    if (fingerprint != hdr.fingerprint)
+    {
+        fprintf(stderr, "Error: %s was taken on a different trace\n", filename);
+        fclose(f);
+        return NULL;
+    }
+
+    Pipeline *p = pipe_init(&config, src);
+    if (p == NULL)
+    {
+        fclose(f);
+        return NULL;
+    }
+    bool ok = pipe_load(p, f);
+    fclose(f);
+    if (!ok)
+    {
+        fprintf(stderr, "Error: Invalid checkpoint\n");
+        pipe_free(p);
+        return NULL;
+    }
+    p->trace_fingerprint = fingerprint;
+    return p;
+}
@@ -0,0 +1,141 @@
+// ckpt.h
+// Declares pipeline checkpoints: snapshots of the complete state of a
+// pipeline, including its position in the trace, that a later run can resume
+// from.
+//
+// A checkpoint holds the configuration the pipeline was simulated with (but
+// for its wakeup engine, which leaves the results unchanged), the
+// number of trace records fetched so far, a fingerprint of the start of the
+// trace, and the state of the pipeline, ROB, RAT, and EXEQ as written by their
+// *_save functions. Structures are stored
+// in their in-memory layout, so a checkpoint can only be restored by a build
+// of the simulator with the same CKPT_VERSION on the same kind of host.
+
+#ifndef _CKPT_H_
+#define _CKPT_H_
+
+#include "pipeline.h"
+#include "source.h"
+#include <stdio.h>
+
+/** The magic number at the start of every checkpoint. */
+#define CKPT_MAGIC "PTRCKPT"
+
+/** The version of the checkpoint format. */
+#define CKPT_VERSION 9
+
+/**
+ * The number of instructions at the start of a trace that its fingerprint
+ * covers. A checkpoint can only be restored onto a trace whose first
+ * instructions, up to this many, match those it was taken on.
+ */
+#define CKPT_FINGERPRINT_INSTS 65536
+
+/** The fingerprint of an empty trace (the 64-bit FNV-1a offset basis). */
+#define CKPT_FINGERPRINT_SEED 14695981039346656037ULL
+
+/**
+ * Add an instruction to a trace fingerprint.
+ *
+ * Only the op type and registers are hashed, as every kind of source
+ * (including a trace cache without extra columns) provides them.
+ *
+ * @param fingerprint the fingerprint of the instructions before inst
+ * @param inst the next instruction of the trace
+ * @return the fingerprint including inst
+ */
+static inline uint64_t ckpt_fingerprint_add(uint64_t fingerprint, const InstInfo *inst)
+{
+    const uint8_t fields[4] = {inst->op_type, (uint8_t)inst->dest_reg,
+                               (uint8_t)inst->src1_reg, (uint8_t)inst->src2_reg};
+    for (int i = 0; i < 4; i++)
+    {
+        fingerprint = (fingerprint ^ fields[i]) * 1099511628211ULL;
+    }
+    return fingerprint;
+}
+
+/**
+ * Write a buffer to a checkpoint.
+ *
+ * @param f the checkpoint being written
+ * @param buf the data to write
+ * @param n the number of bytes to write
+ * @return true on success
+ */
+static inline bool ckpt_write(FILE *f, const void *buf, size_t n)
+{
+    return n == 0 || fwrite(buf, n, 1, f) == 1;
+}
+
+/**
+ * Read a buffer from a checkpoint.
+ *
+ * @param f the checkpoint being read
+ * @param buf the buffer to read into
+ * @param n the number of bytes to read
+ * @return true on success
+ */
+static inline bool ckpt_read(FILE *f, void *buf, size_t n)
+{
+    return n == 0 || fread(buf, n, 1, f) == 1;
+}
+
+/**
+ * Check that an index loaded from a checkpoint is in range.
+ *
+ * @param index the index
+ * @param n the number of elements it indexes
+ * @return true if index is -1 (none) or between 0 and n - 1
+ */
+static inline bool ckpt_check_index(int index, unsigned int n)
+{
+    return index >= -1 && index < (int)n;
+}
+
+/**
+ * Check that the tags and registers of an instruction loaded from a
+ * checkpoint are in range, so that they can be used as indices.
+ *
+ * @param inst the instruction
+ * @param num_tags the number of ROB entries
+ * @return true if the instruction can be used
+ */
+static inline bool ckpt_check_inst(const InstInfo *inst, unsigned int num_tags)
+{
+    return inst->op_type < NUM_OP_TYPES &&
+           ckpt_check_index(inst->dr_tag, num_tags) &&
+           ckpt_check_index(inst->src1_tag, num_tags) &&
+           ckpt_check_index(inst->src2_tag, num_tags) &&
+           ckpt_check_index(inst->dest_reg, MAX_ARF_REGS) &&
+           ckpt_check_index(inst->src1_reg, MAX_ARF_REGS) &&
+           ckpt_check_index(inst->src2_reg, MAX_ARF_REGS);
+}
+
+/**
+ * Save the complete state of a pipeline to a checkpoint file.
+ *
+ * @param filename the checkpoint file to write
+ * @param p the pipeline to save
+ * @return 0 on success, nonzero on failure (an error has been printed)
+ */
+int ckpt_save(const char *filename, Pipeline *p);
+
+/**
+ * Recreate a pipeline from a checkpoint file.
+ *
+ * The pipeline is initialized with the checkpoint's configuration, and src is
+ * advanced past the trace records the pipeline had already fetched. The
+ * checkpoint is rejected if the start of src does not match the trace it was
+ * taken on.
+ *
+ * @param filename the checkpoint file to read
+ * @param src the source positioned at the start of the checkpointed trace
+ * @param wakeup_engine the wakeup engine to give the restored pipeline
+ * @return a pointer to the restored pipeline, or NULL on failure (an error
+ *         has been printed)
+ */
+Pipeline *ckpt_restore(const char *filename, InstSource *src,
+                       WakeupEngine wakeup_engine);
+
+#endif
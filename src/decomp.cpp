@@ -0,0 +1,576 @@
+// decomp.cpp
+// Implements the in-process decompression backends for the TraceReader.
+
+#include "decomp.h"
+#include "ingest.h"
+#include <condition_variable>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+/** [Internal] State of a stream inflating a gzip file on the calling thread. */
+typedef struct GzStreamStruct
+{
+    /** The descriptor of the trace file. */
+    int fd;
+    /** The zlib inflate state. */
+    z_stream zs;
+    /** The buffer of compressed input. */
+    uint8_t *in;
+    /** Whether the trace file has been read to its end. */
+    bool in_eof;
+    /** Whether the file is not compressed and is passed through unchanged. */
+    bool passthrough;
+    /** Whether the last gzip member ended and no byte of another was read. */
+    bool at_member_start;
+    /** Whether the last member has been fully inflated. */
+    bool finished;
+} GzStream;
+
+/** [Internal] The location of one BGZF block within the mapped file. */
+typedef struct BgzfBlockStruct
+{
+    /** The offset of the block's gzip header. */
+    size_t offset;
+    /** The size of the whole gzip member, in bytes. */
+    size_t csize;
+    /** The size of the member's uncompressed data, in bytes. */
+    size_t usize;
+} BgzfBlock;
+
+/** [Internal] A run of consecutive BGZF blocks decompressed as one unit. */
+typedef struct BgzfChunkStruct
+{
+    /** The index of the first block of the chunk. */
+    size_t first_block;
+    /** The number of blocks in the chunk. */
+    size_t num_blocks;
+} BgzfChunk;
+
+/** [Internal] A buffer a worker decompresses a chunk into. */
+typedef struct BgzfSlotStruct
+{
+    /** The decompressed data. */
+    uint8_t *buf;
+    /** The number of valid bytes in buf. */
+    size_t len;
+    /** The chunk held, valid once ready is set. */
+    size_t chunk;
+    /** Whether the chunk has been decompressed into this slot. */
+    bool ready;
+    /** Whether the chunk turned out to be corrupt. */
+    bool failed;
+} BgzfSlot;
+
+/** [Internal] State of a stream inflating a BGZF file on worker threads. */
+typedef struct BgzfStreamStruct
+{
+    /** The descriptor of the trace file. */
+    int fd;
+    /** The trace file, mapped into memory. */
+    const uint8_t *map;
+    /** The size of the mapping. */
+    size_t map_size;
+    /** Every block of the file, in order. */
+    std::vector<BgzfBlock> blocks;
+    /** The units of work, in order. */
+    std::vector<BgzfChunk> chunks;
+
+    /** Protects everything below. */
+    std::mutex lock;
+    /** Signalled when a slot becomes ready. */
+    std::condition_variable ready;
+    /** Signalled when the reader frees a slot, or on shutdown. */
+    std::condition_variable freed;
+    /** The decompression buffers; chunk n goes to slots[n % slots.size()]. */
+    std::vector<BgzfSlot> slots;
+    /** The next chunk a worker should claim. */
+    size_t next_chunk;
+    /** The chunk the reader is consuming. */
+    size_t read_chunk;
+    /** The offset within the read chunk's slot of the next byte to return. */
+    size_t read_pos;
+    /** Whether the stream is being closed. */
+    bool shutdown;
+
+    /** The worker threads. */
+    std::vector<std::thread> workers;
+} BgzfStream;
+
+/**
+ * Read the next chunk of compressed input from the trace file.
+ *
+ * @return false if reading failed
+ */
+static bool gz_fill_input(GzStream *gz)
+{
+    while (true)
+    {
+        ssize_t got = read(gz->fd, gz->in, DECOMP_IN_BUF_SIZE);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got < 0)
+        {
+            return false;
+        }
+
+        gz->in_eof = got == 0;
+        gz->zs.next_in = gz->in;
+        gz->zs.avail_in = got;
+        return true;
+    }
+}
+
+/** [Internal] Inflate up to n bytes of trace data. */
+static ssize_t gz_stream_read(ByteStream *stream, void *buf, size_t n)
+{
+    GzStream *gz = (GzStream *)stream->ctx;
+
+    if (gz->passthrough)
+    {
+        // Hand out what was read while sniffing the header first.
+        if (gz->zs.avail_in > 0)
+        {
+            size_t len = n < gz->zs.avail_in ? n : gz->zs.avail_in;
+            memcpy(buf, gz->zs.next_in, len);
+            gz->zs.next_in += len;
+            gz->zs.avail_in -= len;
+            return len;
+        }
+        return read(gz->fd, buf, n);
+    }
+
+    if (gz->finished)
+    {
+        return 0;
+    }
+
+    gz->zs.next_out = (Bytef *)buf;
+    gz->zs.avail_out = n;
+    while (gz->zs.avail_out == n)
+    {
+        if (gz->zs.avail_in == 0)
+        {
+            if (gz->in_eof)
+            {
+                gz->finished = true;
+                if (!gz->at_member_start)
+                {
+                    fprintf(stderr, "\n");
+                    fprintf(stderr, "Error: trace file is truncated\n");
+                    errno = EIO;
+                    return -1;
+                }
+                break;
+            }
+            if (!gz_fill_input(gz))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        gz->at_member_start = false;
+        int ret = inflate(&gz->zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+        {
+            // Another gzip member may follow; anything else is ignored.
+            inflateReset(&gz->zs);
+            gz->at_member_start = true;
+            if (gz->zs.avail_in > 0 && gz->zs.next_in[0] != 0x1f)
+            {
+                gz->finished = true;
+                break;
+            }
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            fprintf(stderr, "\n");
+            fprintf(stderr, "Error: couldn't decompress trace file: %s\n",
+                    gz->zs.msg != NULL ? gz->zs.msg : "corrupt data");
+            gz->finished = true;
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    return n - gz->zs.avail_out;
+}
+
+/** [Internal] Close the trace file of a gzip stream and free it. */
+static void gz_stream_close(ByteStream *stream)
+{
+    GzStream *gz = (GzStream *)stream->ctx;
+    if (!gz->passthrough)
+    {
+        inflateEnd(&gz->zs);
+    }
+    close(gz->fd);
+    free(gz->in);
+    free(gz);
+    free(stream);
+}
+
+/**
+ * Decompress every block of a chunk into a slot.
+ *
+ * @return false if a block is corrupt
+ */
+static bool bgzf_inflate_chunk(BgzfStream *bs, z_stream *zs,
+                               const BgzfChunk *chunk, BgzfSlot *slot)
+{
+    slot->len = 0;
+    for (size_t i = 0; i < chunk->num_blocks; i++)
+    {
+        const BgzfBlock *block = &bs->blocks[chunk->first_block + i];
+        if (block->usize == 0)
+        {
+            // Empty blocks, such as the BGZF EOF marker, hold no data.
+            continue;
+        }
+
+        inflateReset(zs);
+        zs->next_in = (Bytef *)(bs->map + block->offset);
+        zs->avail_in = block->csize;
+        zs->next_out = slot->buf + slot->len;
+        zs->avail_out = block->usize;
+        if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->avail_out != 0)
+        {
+            return false;
+        }
+        slot->len += block->usize;
+    }
+    return true;
+}
+
+/** [Internal] Claim chunks in order and decompress them until none remain. */
+static void bgzf_worker(BgzfStream *bs)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    inflateInit2(&zs, 15 + 16);
+
+    std::unique_lock<std::mutex> guard(bs->lock);
+    while (!bs->shutdown && bs->next_chunk < bs->chunks.size())
+    {
+        size_t chunk = bs->next_chunk++;
+        BgzfSlot *slot = &bs->slots[chunk % bs->slots.size()];
+
+        // Wait for the reader to finish with the slot's previous chunk.
+        while (!bs->shutdown && chunk >= bs->read_chunk + bs->slots.size())
+        {
+            bs->freed.wait(guard);
+        }
+        if (bs->shutdown)
+        {
+            break;
+        }
+
+        guard.unlock();
+        bool ok = bgzf_inflate_chunk(bs, &zs, &bs->chunks[chunk], slot);
+        guard.lock();
+
+        slot->chunk = chunk;
+        slot->failed = !ok;
+        slot->ready = true;
+        bs->ready.notify_all();
+    }
+    guard.unlock();
+
+    inflateEnd(&zs);
+}
+
+/** [Internal] Copy up to n bytes of decompressed chunks out, in order. */
+static ssize_t bgzf_stream_read(ByteStream *stream, void *buf, size_t n)
+{
+    BgzfStream *bs = (BgzfStream *)stream->ctx;
+    uint8_t *out = (uint8_t *)buf;
+    size_t copied = 0;
+
+    while (copied < n && bs->read_chunk < bs->chunks.size())
+    {
+        BgzfSlot *slot = &bs->slots[bs->read_chunk % bs->slots.size()];
+        {
+            std::unique_lock<std::mutex> guard(bs->lock);
+            while (!slot->ready || slot->chunk != bs->read_chunk)
+            {
+                bs->ready.wait(guard);
+            }
+        }
+
+        if (slot->failed)
+        {
+            fprintf(stderr, "\n");
+            fprintf(stderr, "Error: couldn't decompress trace file: corrupt BGZF block\n");
+            errno = EIO;
+            return -1;
+        }
+
+        size_t len = slot->len - bs->read_pos;
+        if (len > n - copied)
+        {
+            len = n - copied;
+        }
+        memcpy(out + copied, slot->buf + bs->read_pos, len);
+        copied += len;
+        bs->read_pos += len;
+
+        if (bs->read_pos == slot->len)
+        {
+            std::lock_guard<std::mutex> guard(bs->lock);
+            slot->ready = false;
+            bs->read_chunk++;
+            bs->read_pos = 0;
+            bs->freed.notify_all();
+        }
+    }
+
+    return copied;
+}
+
+/** [Internal] Stop the workers, unmap the trace file, and free the stream. */
+static void bgzf_stream_close(ByteStream *stream)
+{
+    BgzfStream *bs = (BgzfStream *)stream->ctx;
+    {
+        std::lock_guard<std::mutex> guard(bs->lock);
+        bs->shutdown = true;
+        bs->freed.notify_all();
+    }
+    for (size_t i = 0; i < bs->workers.size(); i++)
+    {
+        bs->workers[i].join();
+    }
+
+    for (size_t i = 0; i < bs->slots.size(); i++)
+    {
+        free(bs->slots[i].buf);
+    }
+    munmap((void *)bs->map, bs->map_size);
+    close(bs->fd);
+    delete bs;
+    free(stream);
+}
+
+/**
+ * Find the total size of the BGZF block starting at the given offset.
+ *
+ * @return the size of the block, or 0 if no valid BGZF block starts there
+ */
+static size_t bgzf_block_size(const uint8_t *map, size_t map_size, size_t offset)
+{
+    const uint8_t *hdr = map + offset;
+    if (map_size - offset < 18 || hdr[0] != 0x1f || hdr[1] != 0x8b ||
+        hdr[2] != 8 || (hdr[3] & 4) == 0)
+    {
+        return 0;
+    }
+
+    // Look for the "BC" extra subfield holding the block size.
+    size_t xlen = hdr[10] | (hdr[11] << 8);
+    size_t pos = 12;
+    while (pos + 4 <= 12 + xlen && offset + pos + 4 <= map_size)
+    {
+        size_t slen = hdr[pos + 2] | (hdr[pos + 3] << 8);
+        if (hdr[pos] == 'B' && hdr[pos + 1] == 'C' && slen == 2 &&
+            offset + pos + 6 <= map_size)
+        {
+            size_t size = (hdr[pos + 4] | (hdr[pos + 5] << 8)) + 1;
+            return offset + size <= map_size && size >= 12 + xlen + 8 ? size : 0;
+        }
+        pos += 4 + slen;
+    }
+    return 0;
+}
+
+/**
+ * Try to open a trace file as BGZF and start decompressing it in parallel.
+ *
+ * @return a pointer to a newly allocated stream, or NULL if the file is not a
+ *         well-formed BGZF file (the descriptor is left open)
+ */
+static ByteStream *bgzf_open(int fd, unsigned int num_threads)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    {
+        return NULL;
+    }
+
+    size_t map_size = st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    // Index every block, grouping them into chunks.
+    BgzfStream *bs = new BgzfStream();
+    bs->fd = fd;
+    bs->map = (const uint8_t *)map;
+    bs->map_size = map_size;
+    size_t chunk_size = 0;
+    for (size_t offset = 0; offset < map_size;)
+    {
+        size_t size = bgzf_block_size(bs->map, map_size, offset);
+        if (size == 0)
+        {
+            munmap(map, map_size);
+            delete bs;
+            return NULL;
+        }
+
+        const uint8_t *isize = bs->map + offset + size - 4;
+        BgzfBlock block;
+        block.offset = offset;
+        block.csize = size;
+        block.usize = isize[0] | (isize[1] << 8) | (isize[2] << 16) |
+                      ((size_t)isize[3] << 24);
+        if (block.usize > 65536)
+        {
+            munmap(map, map_size);
+            delete bs;
+            return NULL;
+        }
+
+        if (bs->chunks.empty() || chunk_size + block.usize > DECOMP_CHUNK_SIZE)
+        {
+            BgzfChunk chunk;
+            chunk.first_block = bs->blocks.size();
+            chunk.num_blocks = 0;
+            bs->chunks.push_back(chunk);
+            chunk_size = 0;
+        }
+        bs->chunks.back().num_blocks++;
+        chunk_size += block.usize;
+        bs->blocks.push_back(block);
+        offset += size;
+    }
+
+    // Let each worker run a couple of chunks ahead of the reader.
+    bs->slots.resize(2 * num_threads);
+    for (size_t i = 0; i < bs->slots.size(); i++)
+    {
+        bs->slots[i].buf = (uint8_t *)malloc(DECOMP_CHUNK_SIZE + 65536);
+        bs->slots[i].len = 0;
+        bs->slots[i].ready = false;
+        bs->slots[i].failed = false;
+    }
+    bs->next_chunk = 0;
+    bs->read_chunk = 0;
+    bs->read_pos = 0;
+    bs->shutdown = false;
+    for (unsigned int i = 0; i < num_threads; i++)
+    {
+        bs->workers.push_back(std::thread(bgzf_worker, bs));
+    }
+
+    ByteStream *stream = (ByteStream *)calloc(1, sizeof(ByteStream));
+    stream->read = bgzf_stream_read;
+    stream->close = bgzf_stream_close;
+    stream->ctx = bs;
+    return stream;
+}
+
+/**
+ * Open a possibly gzip-compressed trace file as a stream of raw trace bytes.
+ *
+ * @param filename the trace file to open, or a stream
+ * @param num_threads the number of threads to decompress BGZF files with
+ * @return a pointer to a newly allocated stream, or NULL if the file could
+ *         not be opened
+ */
+ByteStream *decomp_open(const char *filename, unsigned int num_threads)
+{
+    int fd;
+    if (ingest_is_stream(filename))
+    {
+        fd = ingest_open(filename);
+        if (fd == -1)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        fd = open(filename, O_RDONLY);
+        if (fd == -1)
+        {
+            perror("Couldn't open trace file");
+            return NULL;
+        }
+    }
+
+    if (num_threads > 1)
+    {
+        ByteStream *stream = bgzf_open(fd, num_threads);
+        if (stream != NULL)
+        {
+            return stream;
+        }
+    }
+
+    GzStream *gz = (GzStream *)calloc(1, sizeof(GzStream));
+    gz->fd = fd;
+    gz->in = (uint8_t *)malloc(DECOMP_IN_BUF_SIZE);
+    gz->in_eof = false;
+    gz->at_member_start = true;
+    gz->finished = false;
+    if (!gz_fill_input(gz))
+    {
+        perror("Couldn't read trace file");
+        close(fd);
+        free(gz->in);
+        free(gz);
+        return NULL;
+    }
+
+    // A pipe or socket may hand out less than the magic in its first read.
+    while (gz->zs.avail_in < 2 && !gz->in_eof)
+    {
+        ssize_t got = read(fd, gz->in + gz->zs.avail_in, DECOMP_IN_BUF_SIZE - gz->zs.avail_in);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got < 0)
+        {
+            perror("Couldn't read trace file");
+            close(fd);
+            free(gz->in);
+            free(gz);
+            return NULL;
+        }
+        gz->in_eof = got == 0;
+        gz->zs.avail_in += got;
+    }
+
+    // Pass the file through unchanged unless it starts with the gzip magic.
+    gz->passthrough = gz->zs.avail_in < 2 || gz->in[0] != 0x1f || gz->in[1] != 0x8b;
+    if (!gz->passthrough && inflateInit2(&gz->zs, 15 + 16) != Z_OK)
+    {
+        fprintf(stderr, "Error: couldn't initialize zlib\n");
+        close(fd);
+        free(gz->in);
+        free(gz);
+        return NULL;
+    }
+
+    ByteStream *stream = (ByteStream *)calloc(1, sizeof(ByteStream));
+    stream->read = gz_stream_read;
+    stream->close = gz_stream_close;
+    stream->ctx = gz;
+    return stream;
+}
@@ -0,0 +1,40 @@
+// decomp.h
+// Declares the in-process decompression backends that feed trace bytes to a
+// TraceReader, replacing the gunzip child process.
+//
+// Gzip files (including multi-member files) are inflated with zlib on the
+// calling thread. BGZF files, whose members record their own compressed and
+// uncompressed sizes (as written by bgzip), can also be inflated in parallel
+// on several worker threads. Files that are not gzip-compressed at all are
+// passed through unchanged, straight into the reader's buffer.
+
+#ifndef _DECOMP_H_
+#define _DECOMP_H_
+
+#include "reader.h"
+
+/**
+ * The number of compressed bytes read from the trace file at once.
+ */
+#define DECOMP_IN_BUF_SIZE (1024 * 1024)
+
+/**
+ * The amount of uncompressed data a BGZF worker produces per unit of work,
+ * in bytes. Each chunk holds whole BGZF blocks of at most 64 KiB each.
+ */
+#define DECOMP_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * Open a possibly gzip-compressed trace file as a stream of raw trace bytes.
+ *
+ * @param filename the trace file to open, or a stream (see ingest.h), which
+ *                 is always decompressed on the calling thread
+ * @param num_threads the number of threads to decompress BGZF files with;
+ *                    1 (or a file that is not BGZF) decompresses on the
+ *                    calling thread
+ * @return a pointer to a newly allocated stream, or NULL if the file could
+ *         not be opened (an error has been printed)
+ */
+ByteStream *decomp_open(const char *filename, unsigned int num_threads);
+
+#endif
@@ -0,0 +1,516 @@
+// estimate.cpp
+// Implements the analytical estimate mode.
+//
+// The model is a first-order, interval-style one: every instruction enters
+// the ROB, is scheduled, and commits at the earliest cycle the recurrences of
+// the modelled machine allow, given when its producers were scheduled and
+// when the instructions ahead of it entered and left the ROB. Widths,
+// latencies, and the ROB size enter only through those recurrences, so they
+// are evaluated once per configuration over a synthetic stream drawn from the
+// profile's histograms (statistical simulation), rather than over the trace.
+// Solving the same machine in closed form, from the mean wait of an
+// instruction, badly underestimates out-of-order CPIs: the critical path
+// through the window, and the in-order commit behind it, are set by the
+// longest dependency chains rather than by the average one.
+//
+// The profile is built a batch of instructions at a time: the distances are
+// found in one pass over the batch, which is inherently sequential, and then
+// classified and counted in separate passes over flat arrays, which the
+// compiler can vectorize.
+
+#include "estimate.h"
+#include "rat.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** [Internal] The distance class of the instructions with no producer. */
+#define EST_BIN_NONE (EST_NUM_BINS - 1)
+
+/** [Internal] The seed of the synthetic stream. */
+#define EST_SEED 0x9e3779b97f4a7c15ULL
+
+/**
+ * [Internal] The cycles before the first instruction enters the ROB: one each
+ * to be fetched, decoded, and issued.
+ */
+#define EST_FILL_CYCLES 3
+
+/**
+ * [Internal] The number of cycles whose schedule slots are tracked at once;
+ * more than any instruction can wait to be scheduled.
+ */
+#define EST_SLOT_CYCLES (1 << 20)
+
+/** [Internal] The distance class of each distance up to EST_MAX_DIST + 1. */
+static uint8_t est_dist_bins[EST_MAX_DIST + 2];
+
+/** [Internal] The shortest distance of each distance class. */
+static uint32_t est_bin_lo[EST_NUM_BINS];
+
+/** [Internal] The longest distance of each distance class. */
+static uint32_t est_bin_hi[EST_NUM_BINS];
+
+/**
+ * [Internal] Fill in est_dist_bins, est_bin_lo, and est_bin_hi, if not done
+ * already.
+ */
+static void est_init_bins()
+{
+    static bool initialized = false;
+    if (initialized)
+    {
+        return;
+    }
+    initialized = true;
+
+    est_dist_bins[0] = EST_BIN_NONE;
+    for (unsigned int d = 1; d <= EST_MAX_DIST + 1; d++)
+    {
+        unsigned int bin = EST_BIN_NONE;
+        if (d <= 16)
+        {
+            bin = d - 1;
+        }
+        else if (d <= EST_MAX_DIST)
+        {
+            bin = 16;
+            for (unsigned int hi = 32; d > hi; hi *= 2)
+            {
+                bin++;
+            }
+        }
+        est_dist_bins[d] = bin;
+    }
+
+    for (unsigned int bin = 0; bin < 16; bin++)
+    {
+        est_bin_lo[bin] = bin + 1;
+        est_bin_hi[bin] = bin + 1;
+    }
+    for (unsigned int bin = 16, hi = 32; bin < EST_BIN_NONE; bin++, hi *= 2)
+    {
+        est_bin_lo[bin] = hi / 2 + 1;
+        est_bin_hi[bin] = hi;
+    }
+    est_bin_lo[EST_BIN_NONE] = 0;
+    est_bin_hi[EST_BIN_NONE] = 0;
+}
+
+/**
+ * [Internal] The flat arrays one batch of instructions is profiled through.
+ */
+typedef struct EstBatchStruct
+{
+    /** The op type of each instruction. */
+    uint8_t op_type[EST_BATCH_INSTS];
+    /**
+     * The distance to the nearest non-load producer of each instruction, or
+     * EST_MAX_DIST + 1 if there is none in range.
+     */
+    uint32_t alu_dist[EST_BATCH_INSTS];
+    /** The same for the nearest load producer. */
+    uint32_t load_dist[EST_BATCH_INSTS];
+    /**
+     * The distance to the producer of each operand, or EST_MAX_DIST + 1 if
+     * there is none in range; operands that are not read are skipped.
+     */
+    uint32_t operand_dist[2 * EST_BATCH_INSTS];
+    /** Whether the producer of each operand is a load. */
+    uint8_t operand_load[2 * EST_BATCH_INSTS];
+    /** The joint distance class of each instruction. */
+    uint16_t joint_bin[EST_BATCH_INSTS];
+} EstBatch;
+
+/**
+ * [Internal] Add a batch of instructions to a profile.
+ *
+ * @param prof the profile
+ * @param b the batch; the distances are filled in
+ * @param num_insts the number of instructions in the batch
+ * @param num_operands the number of operands read by the batch
+ */
+static void est_count_batch(EstProfile *prof, EstBatch *b,
+                            unsigned int num_insts, unsigned int num_operands)
+{
+    for (unsigned int t = 0; t < NUM_OP_TYPES; t++)
+    {
+        uint64_t count = 0;
+        for (unsigned int k = 0; k < num_insts; k++)
+        {
+            count += b->op_type[k] == t;
+        }
+        prof->op_counts[t] += count;
+    }
+
+    for (unsigned int k = 0; k < num_insts; k++)
+    {
+        b->joint_bin[k] = (b->op_type[k] == OP_LD) * EST_NUM_BINS * EST_NUM_BINS +
+                          est_dist_bins[b->alu_dist[k]] * EST_NUM_BINS +
+                          est_dist_bins[b->load_dist[k]];
+    }
+    uint64_t *joint = &prof->joint_hist[0][0][0];
+    for (unsigned int k = 0; k < num_insts; k++)
+    {
+        joint[b->joint_bin[k]]++;
+    }
+
+    for (unsigned int k = 0; k < num_operands; k++)
+    {
+        uint64_t *hist = b->operand_load[k] ? prof->load_use_hist
+                                            : prof->dep_hist;
+        hist[b->operand_dist[k]]++;
+    }
+
+    prof->num_insts += num_insts;
+}
+
+int estimate_profile(InstSource *src, EstProfile *prof)
+{
+    est_init_bins();
+    memset(prof, 0, sizeof(EstProfile));
+
+    // The index of the last instruction to write each register, plus one, or
+    // 0 if none has, and whether that instruction was a load.
+    uint64_t last_writer[MAX_ARF_REGS] = {0};
+    bool writer_is_load[MAX_ARF_REGS] = {false};
+
+    EstBatch *b = (EstBatch *)calloc(1, sizeof(EstBatch));
+    uint64_t index = 0;
+    SourceStatus status = SOURCE_OK;
+    while (status == SOURCE_OK)
+    {
+        unsigned int num_insts = 0;
+        unsigned int num_operands = 0;
+        for (; num_insts < EST_BATCH_INSTS; num_insts++)
+        {
+            InstInfo inst;
+            status = source_next(src, &inst);
+            if (status != SOURCE_OK)
+            {
+                break;
+            }
+            index++;
+
+            uint32_t alu_dist = EST_MAX_DIST + 1;
+            uint32_t load_dist = EST_MAX_DIST + 1;
+            int8_t srcs[2] = {inst.src1_reg, inst.src2_reg};
+            for (unsigned int s = 0; s < 2; s++)
+            {
+                if (srcs[s] < 0)
+                {
+                    continue;
+                }
+                uint64_t writer = last_writer[srcs[s]];
+                uint32_t dist = EST_MAX_DIST + 1;
+                if (writer != 0 && index - writer <= EST_MAX_DIST)
+                {
+                    dist = index - writer;
+                }
+                bool is_load = writer != 0 && writer_is_load[srcs[s]];
+                b->operand_dist[num_operands] = dist;
+                b->operand_load[num_operands] = is_load;
+                num_operands++;
+                if (is_load)
+                {
+                    load_dist = dist < load_dist ? dist : load_dist;
+                }
+                else
+                {
+                    alu_dist = dist < alu_dist ? dist : alu_dist;
+                }
+            }
+            b->op_type[num_insts] = inst.op_type;
+            b->alu_dist[num_insts] = alu_dist;
+            b->load_dist[num_insts] = load_dist;
+
+            if (inst.dest_reg >= 0)
+            {
+                last_writer[inst.dest_reg] = index;
+                writer_is_load[inst.dest_reg] = inst.op_type == OP_LD;
+            }
+        }
+        est_count_batch(prof, b, num_insts, num_operands);
+    }
+    free(b);
+
+    if (status == SOURCE_ERROR)
+    {
+        fprintf(stderr, "Error: Could not read the trace: %s\n",
+                strerror(errno));
+        return 1;
+    }
+    if (status == SOURCE_INVALID)
+    {
+        fprintf(stderr, "Error: The trace is truncated or malformed\n");
+        return 1;
+    }
+    return 0;
+}
+
+void estimate_default_configs(std::vector<PipelineConfig> *configs)
+{
+    static const uint32_t widths[] = EST_GRID_WIDTHS;
+    static const uint32_t load_latencies[] = EST_GRID_LOAD_LATENCIES;
+    static const uint32_t rob_sizes[] = EST_GRID_ROB_SIZES;
+
+    PipelineConfig config;
+    pipe_default_config(&config);
+    for (uint32_t width : widths)
+    {
+        for (int policy = 0; policy < NUM_SCHED_POLICIES; policy++)
+        {
+            for (uint32_t load_latency : load_latencies)
+            {
+                for (uint32_t rob_size : rob_sizes)
+                {
+                    config.pipe_width = width;
+                    config.num_rob_entries = rob_size;
+                    config.load_exe_cycles = load_latency;
+                    config.sched_policy = (SchedulingPolicy)policy;
+                    configs->push_back(config);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * [Internal] Draw the next number from a xorshift64* generator.
+ */
+static uint64_t est_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * [Internal] Draw the distance from an instruction of the stream to a
+ * producer of a distance class: the producer of the right kind (load or not)
+ * nearest to a distance drawn uniformly from the class. Keeping the kinds
+ * consistent keeps the chains of loads feeding loads that set the critical
+ * path of the trace.
+ *
+ * @param m the stream, drawn up to instruction i
+ * @param i the index of the consumer
+ * @param bin the distance class
+ * @param is_load whether the producer is a load
+ * @param state the state of the generator
+ * @return the distance, or 0 if bin is EST_BIN_NONE or no instruction in
+ *         range is of the right kind
+ */
+static uint16_t est_draw_dist(const EstModel *m, unsigned int i,
+                              unsigned int bin, bool is_load, uint64_t *state)
+{
+    if (bin == EST_BIN_NONE || est_bin_lo[bin] > i)
+    {
+        return 0;
+    }
+    uint32_t hi = est_bin_hi[bin] < i ? est_bin_hi[bin] : i;
+    uint32_t d = est_bin_lo[bin] + est_random(state) % (hi - est_bin_lo[bin] + 1);
+    uint32_t limit = i < EST_MAX_DIST ? i : EST_MAX_DIST;
+    for (uint32_t delta = 0; d + delta <= limit || delta < d; delta++)
+    {
+        if (d + delta <= limit && m->is_load[i - (d + delta)] == is_load)
+        {
+            return d + delta;
+        }
+        if (delta < d && m->is_load[i - (d - delta)] == is_load)
+        {
+            return d - delta;
+        }
+    }
+    return 0;
+}
+
+EstModel *estimate_model_init(const EstProfile *prof)
+{
+    est_init_bins();
+
+    EstModel *m = (EstModel *)calloc(1, sizeof(EstModel));
+    m->num_insts = prof->num_insts < EST_SYNTH_INSTS ? prof->num_insts
+                                                     : EST_SYNTH_INSTS;
+    m->is_load = (uint8_t *)calloc(m->num_insts, sizeof(uint8_t));
+    m->alu_dist = (uint16_t *)calloc(m->num_insts, sizeof(uint16_t));
+    m->load_dist = (uint16_t *)calloc(m->num_insts, sizeof(uint16_t));
+    if (m->num_insts == 0)
+    {
+        return m;
+    }
+
+    // Draw each instruction's class from the cumulative joint histogram.
+    const unsigned int num_cells = 2 * EST_NUM_BINS * EST_NUM_BINS;
+    const uint64_t *cells = &prof->joint_hist[0][0][0];
+    std::vector<uint64_t> cumulative(num_cells);
+    uint64_t total = 0;
+    for (unsigned int c = 0; c < num_cells; c++)
+    {
+        total += cells[c];
+        cumulative[c] = total;
+    }
+
+    uint64_t state = EST_SEED;
+    for (unsigned int i = 0; i < m->num_insts; i++)
+    {
+        uint64_t r = est_random(&state) % total;
+        unsigned int c = std::upper_bound(cumulative.begin(), cumulative.end(), r) -
+                         cumulative.begin();
+        m->is_load[i] = c / (EST_NUM_BINS * EST_NUM_BINS);
+        m->alu_dist[i] = est_draw_dist(m, i, c / EST_NUM_BINS % EST_NUM_BINS,
+                                       false, &state);
+        m->load_dist[i] = est_draw_dist(m, i, c % EST_NUM_BINS, true, &state);
+    }
+    return m;
+}
+
+void estimate_model_free(EstModel *m)
+{
+    free(m->is_load);
+    free(m->alu_dist);
+    free(m->load_dist);
+    free(m);
+}
+
+double estimate_cpi(const EstModel *m, const PipelineConfig *config)
+{
+    const unsigned int n = m->num_insts;
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    const uint32_t width = config->pipe_width;
+    const uint32_t rob = config->num_rob_entries;
+    const uint32_t load_lat = config->load_exe_cycles;
+    const bool in_order = config->sched_policy == SCHED_IN_ORDER;
+
+    // The cycle each instruction enters the ROB, is scheduled, and commits.
+    uint64_t *issued = (uint64_t *)calloc(n, sizeof(uint64_t));
+    uint64_t *scheduled = (uint64_t *)calloc(n, sizeof(uint64_t));
+    uint64_t *committed = (uint64_t *)calloc(n, sizeof(uint64_t));
+    // The number of instructions scheduled in each cycle, by cycle modulo
+    // EST_SLOT_CYCLES, and the cycle (plus one) each count is for.
+    uint8_t *slot_counts = (uint8_t *)calloc(EST_SLOT_CYCLES, sizeof(uint8_t));
+    uint64_t *slot_cycles = (uint64_t *)calloc(EST_SLOT_CYCLES, sizeof(uint64_t));
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        // Enter the ROB in order, up to width per cycle, once the entry of
+        // the instruction rob places ahead has been committed.
+        uint64_t cycle = 0;
+        if (i >= 1)
+        {
+            cycle = issued[i - 1];
+        }
+        if (i >= width && issued[i - width] + 1 > cycle)
+        {
+            cycle = issued[i - width] + 1;
+        }
+        if (i >= rob && committed[i - rob] > cycle)
+        {
+            cycle = committed[i - rob];
+        }
+        issued[i] = cycle;
+
+        // Be scheduled the cycle after, once the producers have been written
+        // back, and after the instruction ahead if scheduling is in-order.
+        uint64_t ready = cycle + 1;
+        if (m->alu_dist[i] != 0 && m->alu_dist[i] <= i &&
+            scheduled[i - m->alu_dist[i]] + 2 > ready)
+        {
+            ready = scheduled[i - m->alu_dist[i]] + 2;
+        }
+        if (m->load_dist[i] != 0 && m->load_dist[i] <= i &&
+            scheduled[i - m->load_dist[i]] + load_lat + 1 > ready)
+        {
+            ready = scheduled[i - m->load_dist[i]] + load_lat + 1;
+        }
+        if (in_order && i >= 1 && scheduled[i - 1] > ready)
+        {
+            ready = scheduled[i - 1];
+        }
+        while (slot_cycles[ready % EST_SLOT_CYCLES] == ready + 1 &&
+               slot_counts[ready % EST_SLOT_CYCLES] >= width)
+        {
+            ready++;
+        }
+        if (slot_cycles[ready % EST_SLOT_CYCLES] != ready + 1)
+        {
+            slot_cycles[ready % EST_SLOT_CYCLES] = ready + 1;
+            slot_counts[ready % EST_SLOT_CYCLES] = 0;
+        }
+        slot_counts[ready % EST_SLOT_CYCLES]++;
+        scheduled[i] = ready;
+
+        // Commit in order, up to width per cycle, two cycles after executing.
+        uint64_t done = ready + (m->is_load[i] ? load_lat : 1) + 2;
+        if (i >= 1 && committed[i - 1] > done)
+        {
+            done = committed[i - 1];
+        }
+        if (i >= width && committed[i - width] + 1 > done)
+        {
+            done = committed[i - width] + 1;
+        }
+        committed[i] = done;
+    }
+
+    double cpi = (double)(committed[n - 1] + EST_FILL_CYCLES) / n;
+
+    free(issued);
+    free(scheduled);
+    free(committed);
+    free(slot_counts);
+    free(slot_cycles);
+    return cpi;
+}
+
+/**
+ * [Internal] Print the cumulative distribution of a distance histogram at
+ * a few distances.
+ */
+static void est_print_dist(FILE *out, const char *name, const uint64_t *hist)
+{
+    uint64_t total = 0;
+    for (unsigned int d = 0; d <= EST_MAX_DIST + 1; d++)
+    {
+        total += hist[d];
+    }
+    fprintf(out, "%-17s %10" PRIu64, name, total);
+
+    uint64_t within = 0;
+    unsigned int d = 0;
+    for (unsigned int limit = 1; limit <= 64; limit *= 2)
+    {
+        for (; d <= limit; d++)
+        {
+            within += hist[d];
+        }
+        fprintf(out, "  %5.1f%%", total ? 100.0 * within / total : 0.0);
+    }
+    fprintf(out, "\n");
+}
+
+void estimate_print_profile(FILE *out, const EstProfile *prof)
+{
+    static const char *const op_names[NUM_OP_TYPES] =
+        {"ALU", "LD", "ST", "CBR", "OTHER"};
+
+    fprintf(out, "Instructions: %" PRIu64 "\n", prof->num_insts);
+    fprintf(out, "Op mix:");
+    for (unsigned int t = 0; t < NUM_OP_TYPES; t++)
+    {
+        fprintf(out, "  %s %.1f%%", op_names[t],
+                prof->num_insts ? 100.0 * prof->op_counts[t] / prof->num_insts
+                                : 0.0);
+    }
+    fprintf(out, "\n");
+
+    fprintf(out, "%-17s %10s  %6s  %6s  %6s  %6s  %6s  %6s  %6s\n",
+            "Operands within", "count", "1", "2", "4", "8", "16", "32", "64");
+    est_print_dist(out, "Dependency", prof->dep_hist);
+    est_print_dist(out, "Load-to-use", prof->load_use_hist);
+}
@@ -0,0 +1,142 @@
+// estimate.h
+// Declares the analytical estimate mode.
+//
+// One pass over the trace builds a profile of it: the op-type mix, the
+// distances from each instruction to the producers of its operands, and how
+// many of those producers are loads. The CPI of any pipeline configuration
+// is then estimated from the profile alone, with a first-order model of the
+// pipeline rather than a simulation of the trace, so a whole grid of
+// configurations can be estimated in about the time it takes to read the
+// trace once.
+
+#ifndef _ESTIMATE_H_
+#define _ESTIMATE_H_
+
+#include "pipeline.h"
+#include "source.h"
+#include <inttypes.h>
+#include <vector>
+
+/**
+ * The longest dependency distance, in instructions, that the profile tells
+ * apart; producers further back count as not being in flight.
+ */
+#define EST_MAX_DIST 512
+
+/**
+ * The number of distance classes of the joint histogram: one per distance
+ * from 1 to 16, one per power of two up to EST_MAX_DIST, and one for no
+ * producer in flight.
+ */
+#define EST_NUM_BINS 22
+
+/** The number of instructions profiled per batch. */
+#define EST_BATCH_INSTS 1024
+
+/**
+ * The number of instructions in the synthetic stream the model is evaluated
+ * over.
+ */
+#define EST_SYNTH_INSTS (1 << 17)
+
+/** The pipeline widths of the default grid of configurations. */
+#define EST_GRID_WIDTHS {1, 2, 4, 8}
+
+/** The load latencies of the default grid of configurations. */
+#define EST_GRID_LOAD_LATENCIES {1, 4, 10, 20}
+
+/** The ROB sizes of the default grid of configurations. */
+#define EST_GRID_ROB_SIZES {16, 32, 64, 128, 256}
+
+/** The profile of a trace. */
+typedef struct EstProfileStruct
+{
+    /** The number of instructions in the trace. */
+    uint64_t num_insts;
+    /** The number of instructions of each op type. */
+    uint64_t op_counts[NUM_OP_TYPES];
+    /**
+     * The number of operands read from a non-load producer at each distance
+     * (index EST_MAX_DIST + 1 counts those further back).
+     */
+    uint64_t dep_hist[EST_MAX_DIST + 2];
+    /** The same for operands read from a load: the load-to-use distances. */
+    uint64_t load_use_hist[EST_MAX_DIST + 2];
+    /**
+     * The number of instructions by whether they are loads (first index), and
+     * the distance classes of their nearest non-load producer (second index)
+     * and nearest load producer (third index).
+     */
+    uint64_t joint_hist[2][EST_NUM_BINS][EST_NUM_BINS];
+} EstProfile;
+
+/**
+ * The model of a profiled trace: a synthetic stream of instructions drawn
+ * from its joint histogram, which has the same op mix and dependency
+ * distances as the trace but none of its other structure.
+ */
+typedef struct EstModelStruct
+{
+    /** Whether each instruction is a load. */
+    uint8_t *is_load;
+    /** The distance to the non-load producer of each instruction, or 0. */
+    uint16_t *alu_dist;
+    /** The distance to the load producer of each instruction, or 0. */
+    uint16_t *load_dist;
+    /** The number of instructions in the stream. */
+    unsigned int num_insts;
+} EstModel;
+
+/**
+ * Build the profile of a trace by reading it to the end.
+ *
+ * @param src the source to read the trace from
+ * @param prof receives the profile
+ * @return 0 on success, nonzero if the trace could not be read (an error has
+ *         been printed)
+ */
+int estimate_profile(InstSource *src, EstProfile *prof);
+
+/**
+ * List the default grid of configurations: every combination of the
+ * EST_GRID_* values and of the scheduling policies.
+ *
+ * @param configs the vector to append the configurations to
+ */
+void estimate_default_configs(std::vector<PipelineConfig> *configs);
+
+/**
+ * Build the model of a profiled trace. The stream is drawn with a fixed seed,
+ * so the same profile always gives the same estimates.
+ *
+ * @param prof the profile of the trace
+ * @return a pointer to a newly allocated model
+ */
+EstModel *estimate_model_init(const EstProfile *prof);
+
+/**
+ * Free a model.
+ *
+ * @param m the model
+ */
+void estimate_model_free(EstModel *m);
+
+/**
+ * Estimate the CPI of a pipeline configuration on a modelled trace.
+ *
+ * @param m the model of the trace
+ * @param config the configuration
+ * @return the estimated CPI
+ */
+double estimate_cpi(const EstModel *m, const PipelineConfig *config);
+
+/**
+ * Print a summary of a profile: the op-type mix, and the cumulative
+ * distributions of the dependency and load-to-use distances.
+ *
+ * @param out the stream to print to
+ * @param prof the profile
+ */
+void estimate_print_profile(FILE *out, const EstProfile *prof);
+
+#endif
@@ -2,24 +2,94 @@
 // Implements the execution queue.
 
 #include "exeq.h"
+#include "ckpt.h"
+#include "profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 
+/**
+ * Link entries [from, to) of the EXEQ into its free list.
+ * 
+ * @param exeq the EXEQ
+ * @param from the first entry to free
+ * @param to one past the last entry to free
+ */
+static void exeq_free_entries(EXEQ *exeq, unsigned int from, unsigned int to)
+{
+    for (unsigned int i = to; i-- > from;)
+    {
+        exeq->entries[i].valid = false;
+        exeq->entries[i].next = exeq->free_head;
+        exeq->free_head = i;
+    }
+}
+
 /**
  * Allocate and initialize a new EXEQ.
  * 
- * @return a pointer to a newly allocated EXEQ
+ * The wheel is sized for the given load latency, up to EXEQ_MAX_SLOTS slots.
+ * 
+ * @param load_exe_cycles the number of cycles an LD instruction takes to
+ *                        execute
+ * @return a pointer to a newly allocated EXEQ, or NULL if it could not be
+ *         allocated (an error has been printed)
  */
-EXEQ *exeq_init()
+EXEQ *exeq_init(uint32_t load_exe_cycles)
 {
     EXEQ *exeq = (EXEQ *)calloc(1, sizeof(EXEQ));
-    for (unsigned int i = 0; i < MAX_EXEQ_ENTRIES; i++)
+    if (exeq == NULL)
     {
-        exeq->entries[i].valid = false;
+        perror("Couldn't allocate the EXEQ");
+        return NULL;
+    }
+    exeq->load_exe_cycles = load_exe_cycles;
+
+    exeq->num_slots = 2;
+    while (exeq->num_slots <= load_exe_cycles &&
+           exeq->num_slots < EXEQ_MAX_SLOTS)
+    {
+        exeq->num_slots *= 2;
+    }
+    exeq->num_entries = EXEQ_INIT_ENTRIES;
+    exeq->entries = (EXEQEntry *)calloc(exeq->num_entries, sizeof(EXEQEntry));
+    exeq->slot_head = (int *)malloc(exeq->num_slots * sizeof(int));
+    exeq->slot_tail = (int *)malloc(exeq->num_slots * sizeof(int));
+    if (exeq->entries == NULL || exeq->slot_head == NULL ||
+        exeq->slot_tail == NULL)
+    {
+        perror("Couldn't allocate the EXEQ");
+        exeq_free(exeq);
+        return NULL;
     }
+
+    exeq->free_head = -1;
+    exeq_free_entries(exeq, 0, exeq->num_entries);
+    for (unsigned int i = 0; i < exeq->num_slots; i++)
+    {
+        exeq->slot_head[i] = -1;
+        exeq->slot_tail[i] = -1;
+    }
+    exeq->overflow_head = -1;
+    exeq->overflow_tail = -1;
+
+    exeq->now = 0;
+    exeq->count = 0;
     return exeq;
 }
 
+/**
+ * Free an EXEQ and everything it owns.
+ * 
+ * @param exeq the EXEQ
+ */
+void exeq_free(EXEQ *exeq)
+{
+    free(exeq->entries);
+    free(exeq->slot_head);
+    free(exeq->slot_tail);
+    free(exeq);
+}
+
 /**
  * Print out the state of the EXEQ for debugging purposes.
  * 
@@ -28,60 +98,243 @@ EXEQ *exeq_init()
 void exeq_print_state(EXEQ *t)
 {
     printf("Current EXEQ state:\n");
-    printf("Entry  Valid  Inst  Wait Cycles\n");
-    for (unsigned int i = 0; i < MAX_EXEQ_ENTRIES; i++)
+    printf("Entry  Valid  Tag   Wait Cycles\n");
+    for (unsigned int i = 0; i < t->num_entries; i++)
     {
         printf("%5d ::  %d ", i, t->entries[i].valid);
-        printf("%5d \t", (int)t->entries[i].inst.inst_num);
-        printf("%5d \n", t->entries[i].inst.exe_wait_cycles);
+        printf("%5d \t", (int)t->entries[i].tag);
+        printf("%5d \n", t->entries[i].valid ?
+                         (int)(t->entries[i].done_cycle - t->now) : 0);
     }
     printf("\n");
 }
 
 /**
- * Simulate one cycle of the execution queue.
+ * Link an entry into the wheel, after the entries already finishing in the
+ * same cycle.
  * 
  * @param exeq the EXEQ
+ * @param i the entry, which must finish within one turn of the wheel
  */
-void exeq_cycle(EXEQ *exeq)
+static void exeq_link_slot(EXEQ *exeq, int i)
+{
+    exeq->entries[i].next = -1;
+    unsigned int slot = exeq->entries[i].done_cycle & (exeq->num_slots - 1);
+    if (exeq->slot_tail[slot] == -1)
+    {
+        exeq->slot_head[slot] = i;
+    }
+    else
+    {
+        exeq->entries[exeq->slot_tail[slot]].next = i;
+    }
+    exeq->slot_tail[slot] = i;
+}
+
+/**
+ * Link an entry into the overflow list, after the entries finishing in the
+ * same cycle or earlier.
+ * 
+ * Every instruction that overflows is a load with the same latency, so in a
+ * simulation the entry always goes at the tail; only a checkpoint can need
+ * the search.
+ * 
+ * @param exeq the EXEQ
+ * @param i the entry
+ */
+static void exeq_link_overflow(EXEQ *exeq, int i)
 {
-    for (unsigned int i = 0; i < MAX_EXEQ_ENTRIES; i++)
+    uint64_t done_cycle = exeq->entries[i].done_cycle;
+    int prev = exeq->overflow_tail;
+    if (prev != -1 && exeq->entries[prev].done_cycle > done_cycle)
     {
-        if (exeq->entries[i].valid)
+        prev = -1;
+        for (int j = exeq->overflow_head;
+             j != -1 && exeq->entries[j].done_cycle <= done_cycle;
+             j = exeq->entries[j].next)
         {
-            exeq->entries[i].inst.exe_wait_cycles--;
+            prev = j;
         }
     }
+
+    if (prev == -1)
+    {
+        exeq->entries[i].next = exeq->overflow_head;
+        exeq->overflow_head = i;
+    }
+    else
+    {
+        exeq->entries[i].next = exeq->entries[prev].next;
+        exeq->entries[prev].next = i;
+    }
+    if (exeq->entries[i].next == -1)
+    {
+        exeq->overflow_tail = i;
+    }
 }
 
 /**
- * Add an instruction to the execution queue if there is space.
+ * Move the entries of the overflow list that now finish within one turn of
+ * the wheel into the wheel.
+ * 
+ * This runs as soon as the current cycle advances, before anything else can
+ * be filed in the cycles the wheel has just reached, so each slot keeps the
+ * entries in the order they were added.
  * 
  * @param exeq the EXEQ
- * @param inst the instruction to add
- * @return true if the instruction was added, false if the queue was full
  */
-bool exeq_insert(EXEQ *exeq, InstInfo inst)
+static void exeq_drain_overflow(EXEQ *exeq)
 {
-    for (unsigned int i = 0; i < MAX_EXEQ_ENTRIES; i++)
+    while (exeq->overflow_head != -1 &&
+           exeq->entries[exeq->overflow_head].done_cycle - exeq->now <
+           exeq->num_slots)
     {
-        if (!exeq->entries[i].valid)
+        int i = exeq->overflow_head;
+        exeq->overflow_head = exeq->entries[i].next;
+        if (exeq->overflow_head == -1)
         {
-            exeq->entries[i].valid = true;
-            exeq->entries[i].inst = inst;
-            exeq->entries[i].inst.exe_wait_cycles = 1;
+            exeq->overflow_tail = -1;
+        }
+        exeq_link_slot(exeq, i);
+    }
+}
 
-            // Override wait time for LD instructions
-            if (exeq->entries[i].inst.op_type == OP_LD)
-            {
-                exeq->entries[i].inst.exe_wait_cycles = LOAD_EXE_CYCLES;
-            }
+/**
+ * Simulate one cycle of the execution queue.
+ * 
+ * Rather than counting down every entry, this only advances the wheel to the
+ * next cycle.
+ * 
+ * @param exeq the EXEQ
+ */
+void exeq_cycle(EXEQ *exeq)
+{
+    exeq->now++;
+    exeq_drain_overflow(exeq);
+}
 
-            return true;
+/**
+ * File an instruction under the cycle it finishes in, after the instructions
+ * already finishing then, growing the queue if it is full.
+ * 
+ * @param exeq the EXEQ
+ * @param tag the ROB tag of the instruction to add
+ * @param done_cycle the cycle in which the instruction finishes; no earlier
+ *                   than the current cycle
+ */
+static void exeq_file(EXEQ *exeq, int tag, uint64_t done_cycle)
+{
+    if (exeq->free_head == -1)
+    {
+        unsigned int old_entries = exeq->num_entries;
+        exeq->num_entries *= 2;
+        exeq->entries = (EXEQEntry *)realloc(exeq->entries,
+            exeq->num_entries * sizeof(EXEQEntry));
+        exeq_free_entries(exeq, old_entries, exeq->num_entries);
+    }
+
+    int i = exeq->free_head;
+    EXEQEntry *entry = &exeq->entries[i];
+    exeq->free_head = entry->next;
+
+    entry->valid = true;
+    entry->tag = tag;
+    entry->done_cycle = done_cycle;
+    if (done_cycle - exeq->now < exeq->num_slots)
+    {
+        exeq_link_slot(exeq, i);
+    }
+    else
+    {
+        exeq_link_overflow(exeq, i);
+    }
+    exeq->count++;
+}
+
+/**
+ * Add an instruction to the execution queue, growing the queue if it is full.
+ * 
+ * @param exeq the EXEQ
+ * @param inst the instruction to add
+ */
+void exeq_insert(EXEQ *exeq, const InstInfo *inst)
+{
+    uint32_t exe_wait_cycles = 1;
+
+    // Override wait time for LD instructions
+    if (inst->op_type == OP_LD)
+    {
+        exe_wait_cycles = exeq->load_exe_cycles;
+    }
+
+    exeq_file(exeq, inst->dr_tag, exeq->now + exe_wait_cycles);
+}
+
+/**
+ * Write the state of the EXEQ to a checkpoint.
+ * 
+ * Only the instructions in the queue are written, slot by slot starting from
+ * the current cycle and then the overflow list, so that loading them back in
+ * order rebuilds the wheel.
+ * 
+ * @param exeq the EXEQ
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool exeq_save(EXEQ *exeq, FILE *f)
+{
+    bool ok = ckpt_write(f, &exeq->now, sizeof(exeq->now)) &&
+              ckpt_write(f, &exeq->count, sizeof(exeq->count));
+    unsigned int mask = exeq->num_slots - 1;
+    for (unsigned int d = 0; ok && d < exeq->num_slots; d++)
+    {
+        int i = exeq->slot_head[(exeq->now + d) & mask];
+        for (; ok && i != -1; i = exeq->entries[i].next)
+        {
+            ok = ckpt_write(f, &exeq->entries[i].tag, sizeof(int16_t)) &&
+                 ckpt_write(f, &exeq->entries[i].done_cycle, sizeof(uint64_t));
         }
     }
+    for (int i = exeq->overflow_head; ok && i != -1; i = exeq->entries[i].next)
+    {
+        ok = ckpt_write(f, &exeq->entries[i].tag, sizeof(int16_t)) &&
+             ckpt_write(f, &exeq->entries[i].done_cycle, sizeof(uint64_t));
+    }
+    return ok;
+}
 
-    return false;
+/**
+ * Read the state of the EXEQ from a checkpoint written by exeq_save.
+ * 
+ * @param exeq the EXEQ to fill
+ * @param f the checkpoint being read
+ * @param num_tags the number of ROB entries
+ * @return true on success, false if the checkpoint is truncated or holds
+ *         a tag or completion cycle out of range
+ */
+bool exeq_load(EXEQ *exeq, FILE *f, unsigned int num_tags)
+{
+    unsigned int count;
+    if (!ckpt_read(f, &exeq->now, sizeof(exeq->now)) ||
+        !ckpt_read(f, &count, sizeof(count)) || count > num_tags)
+    {
+        return false;
+    }
+
+    for (unsigned int n = 0; n < count; n++)
+    {
+        int16_t tag;
+        uint64_t done_cycle;
+        if (!ckpt_read(f, &tag, sizeof(tag)) ||
+            !ckpt_read(f, &done_cycle, sizeof(done_cycle)) ||
+            tag < 0 || tag >= (int)num_tags || done_cycle < exeq->now ||
+            done_cycle - exeq->now > exeq->load_exe_cycles)
+        {
+            return false;
+        }
+        exeq_file(exeq, tag, done_cycle);
+    }
+    return true;
 }
 
 /**
@@ -92,17 +345,52 @@ bool exeq_insert(EXEQ *exeq, InstInfo inst)
  */
 bool exeq_check_done(EXEQ *exeq)
 {
-    for (unsigned int i = 0; i < MAX_EXEQ_ENTRIES; i++)
+    // Only instructions finishing within one turn are in the wheel, so
+    // everything in the current slot finishes in the current cycle.
+    PROF_COUNT(exeq_checks, 1);
+    return exeq->slot_head[exeq->now & (exeq->num_slots - 1)] != -1;
+}
+
+/**
+ * Find how many cycles of the EXEQ must be simulated before the next
+ * instruction completes execution.
+ * 
+ * @param exeq the EXEQ
+ * @return the number of calls to exeq_cycle after which exeq_check_done will
+ *         next be true, or 0 if the queue is empty or an instruction has
+ *         already completed
+ */
+unsigned int exeq_cycles_to_next_done(EXEQ *exeq)
+{
+    if (exeq->count == 0 || exeq_check_done(exeq))
     {
-        if (exeq->entries[i].valid)
+        return 0;
+    }
+
+    unsigned int mask = exeq->num_slots - 1;
+    for (unsigned int d = 1; d < exeq->num_slots; d++)
+    {
+        if (exeq->slot_head[(exeq->now + d) & mask] != -1)
         {
-            if (exeq->entries[i].inst.exe_wait_cycles == 0)
-            {
-                return true;
-            }
+            return d;
         }
     }
-    return false;
+
+    // Everything left finishes a full turn or more from now, and no later
+    // than the load latency.
+    return exeq->entries[exeq->overflow_head].done_cycle - exeq->now;
+}
+
+/**
+ * Advance the EXEQ by several cycles in which no instruction completes.
+ * 
+ * @param exeq the EXEQ
+ * @param cycles the number of cycles to advance
+ */
+void exeq_skip_cycles(EXEQ *exeq, unsigned int cycles)
+{
+    exeq->now += cycles;
+    exeq_drain_overflow(exeq);
 }
 
 /**
@@ -110,21 +398,29 @@ bool exeq_check_done(EXEQ *exeq)
  * queue.
  * 
  * @param exeq the EXEQ
- * @return an instruction that has completed execution.
+ * @return the ROB tag of an instruction that has completed execution.
  */
-InstInfo exeq_remove(EXEQ *exeq)
+int exeq_remove(EXEQ *exeq)
 {
-    for (unsigned int i = 0; i < MAX_EXEQ_ENTRIES; i++)
+    unsigned int slot = exeq->now & (exeq->num_slots - 1);
+    int i = exeq->slot_head[slot];
+    if (i == -1)
     {
-        if (exeq->entries[i].valid &&
-            exeq->entries[i].inst.exe_wait_cycles == 0)
-        {
-            exeq->entries[i].valid = false;
-            return exeq->entries[i].inst;
-        }
+        fprintf(stderr, "Warning: Trying to remove from empty EXEQ!\n");
+        return -1;
+    }
+
+    PROF_COUNT(exeq_removes, 1);
+    EXEQEntry *entry = &exeq->entries[i];
+    exeq->slot_head[slot] = entry->next;
+    if (exeq->slot_head[slot] == -1)
+    {
+        exeq->slot_tail[slot] = -1;
     }
 
-    fprintf(stderr, "Warning: Trying to remove from empty EXEQ!\n");
-    InstInfo dummy;
-    return dummy;
+    entry->valid = false;
+    entry->next = exeq->free_head;
+    exeq->free_head = i;
+    exeq->count--;
+    return entry->tag;
 }
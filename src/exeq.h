@@ -1,48 +1,130 @@
 // exeq.h
 // Declares the struct for the execution queue.
+//
+// The execution queue is a timing wheel: each instruction is filed under the
+// cycle in which it finishes executing, so each cycle only touches the
+// instructions that complete in it. The queue has no fixed capacity.
+//
+// The wheel has at most EXEQ_MAX_SLOTS slots, so a very long load latency
+// does not cost memory in proportion. Instructions that finish a full turn
+// of the wheel or more in the future wait in an overflow list, sorted by the
+// cycle they finish in, and move into the wheel once it reaches them.
 
 #ifndef _EXEQ_H_
 #define _EXEQ_H_
 
 #include "trace.h"
 #include <inttypes.h>
+#include <stdio.h>
 
 /**
- * The maximum number of instructions that can be in the execution queue at
- * once.
+ * The number of entries the execution queue starts with. It grows as needed.
  */
-#define MAX_EXEQ_ENTRIES 16
+#define EXEQ_INIT_ENTRIES 16
 
 /**
- * The number of cycles an LD instruction should take to execute.
- * 
- * This is used by the code in exeq.cpp to determine how long to wait before
- * considering the execution of an LD instruction done.
+ * The largest number of slots in the timing wheel; a power of two.
  */
-extern uint32_t LOAD_EXE_CYCLES;
+#define EXEQ_MAX_SLOTS 1024
 
 /** An execution queue entry. */
 typedef struct EXEQEntryStruct
 {
     /** If this entry is valid */
     bool valid;
-    /** The instruction to execute. */
-    InstInfo inst;
+    /** The ROB tag of the instruction to execute. */
+    int16_t tag;
+    /** The cycle in which the instruction finishes executing. */
+    uint64_t done_cycle;
+    /**
+     * The next entry in the same wheel slot or in the overflow list if valid,
+     * or the next free entry otherwise; -1 at the end of any list.
+     */
+    int next;
 } EXEQEntry;
 
 /** The execution queue. */
 typedef struct EXEQStruct
 {
     /** An array of execution queue entries. */
-    EXEQEntry entries[MAX_EXEQ_ENTRIES];
+    EXEQEntry *entries;
+    /** The number of entries in the array. */
+    unsigned int num_entries;
+    /** The first free entry, or -1 if all entries are in use. */
+    int free_head;
+
+    /**
+     * For each slot of the wheel, the first entry finishing in a cycle that
+     * maps to the slot, or -1 if the slot is empty.
+     */
+    int *slot_head;
+    /** For each slot of the wheel, the last entry of the slot, or -1. */
+    int *slot_tail;
+    /**
+     * The number of slots in the wheel; a power of two greater than the
+     * longest execution latency, up to EXEQ_MAX_SLOTS.
+     */
+    unsigned int num_slots;
+
+    /**
+     * The first entry finishing a full turn of the wheel or more after the
+     * current cycle, or -1 if there is none. The overflow list is sorted by
+     * done_cycle, and entries finishing in the same cycle keep the order
+     * they were added in.
+     */
+    int overflow_head;
+    /** The last entry of the overflow list, or -1. */
+    int overflow_tail;
+
+    /**
+     * The number of cycles an LD instruction takes to execute; every other
+     * instruction takes one.
+     */
+    uint32_t load_exe_cycles;
+
+    /** The current cycle of the queue. */
+    uint64_t now;
+    /** The number of instructions in the queue. */
+    unsigned int count;
 } EXEQ;
 
 /**
  * Allocate and initialize a new EXEQ.
  * 
- * @return a pointer to a newly allocated EXEQ
+ * @param load_exe_cycles the number of cycles an LD instruction takes to
+ *                        execute
+ * @return a pointer to a newly allocated EXEQ, or NULL if it could not be
+ *         allocated (an error has been printed)
+ */
+EXEQ *exeq_init(uint32_t load_exe_cycles);
+
+/**
+ * Free an EXEQ and everything it owns.
+ * 
+ * @param exeq the EXEQ
+ */
+void exeq_free(EXEQ *exeq);
+
+/**
+ * Write the state of the EXEQ to a checkpoint.
+ * 
+ * @param exeq the EXEQ
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool exeq_save(EXEQ *exeq, FILE *f);
+
+/**
+ * Read the state of the EXEQ from a checkpoint written by exeq_save. The
+ * EXEQ must be empty and sized for the configuration it was saved with.
+ * 
+ * @param exeq the EXEQ to fill
+ * @param f the checkpoint being read
+ * @param num_tags the number of ROB entries
+ * @return true on success, false if the checkpoint is truncated or holds
+ *         a tag or completion cycle out of range
  */
-EXEQ *exeq_init();
+bool exeq_load(EXEQ *exeq, FILE *f, unsigned int num_tags);
 
 /**
  * Print out the state of the EXEQ for debugging purposes.
@@ -59,13 +141,15 @@ void exeq_print_state(EXEQ *exeq);
 void exeq_cycle(EXEQ *exeq);
 
 /**
- * Add an instruction to the execution queue if there is space.
+ * Add an instruction to the execution queue, growing the queue if it is full.
+ * 
+ * Only the instruction's ROB tag is kept; the instruction itself stays in the
+ * ROB.
  * 
  * @param exeq the EXEQ
  * @param inst the instruction to add
- * @return true if the instruction was added, false if the queue was full
  */
-bool exeq_insert(EXEQ *t, InstInfo inst);
+void exeq_insert(EXEQ *exeq, const InstInfo *inst);
 
 /**
  * Check if any instructions have completed execution.
@@ -73,15 +157,35 @@ bool exeq_insert(EXEQ *t, InstInfo inst);
  * @param exeq the EXEQ
  * @return true if any instructions have completed execution, false otherwise
  */
-bool exeq_check_done(EXEQ *t);
+bool exeq_check_done(EXEQ *exeq);
+
+/**
+ * Find how many cycles of the EXEQ must be simulated before the next
+ * instruction completes execution.
+ * 
+ * @param exeq the EXEQ
+ * @return the number of calls to exeq_cycle after which exeq_check_done will
+ *         next be true, or 0 if the queue is empty or an instruction has
+ *         already completed
+ */
+unsigned int exeq_cycles_to_next_done(EXEQ *exeq);
+
+/**
+ * Advance the EXEQ by several cycles in which no instruction completes.
+ * 
+ * @param exeq the EXEQ
+ * @param cycles the number of cycles to advance; must be less than
+ *               exeq_cycles_to_next_done(exeq)
+ */
+void exeq_skip_cycles(EXEQ *exeq, unsigned int cycles);
 
 /**
  * Get the next instruction that has completed execution and remove it from the
  * queue.
  * 
  * @param exeq the EXEQ
- * @return an instruction that has completed execution.
+ * @return the ROB tag of an instruction that has completed execution.
  */
-InstInfo exeq_remove(EXEQ *exeq);
+int exeq_remove(EXEQ *exeq);
 
 #endif
@@ -0,0 +1,201 @@
+// ingest.cpp
+// Implements streaming trace inputs.
+
+#include "ingest.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Check whether a trace name refers to a stream rather than a regular file.
+ *
+ * @param name the trace name
+ * @return true if the trace is a stream
+ */
+bool ingest_is_stream(const char *name)
+{
+    if (strcmp(name, "-") == 0 ||
+        strncmp(name, INGEST_TCP_PREFIX, strlen(INGEST_TCP_PREFIX)) == 0 ||
+        strncmp(name, INGEST_UNIX_PREFIX, strlen(INGEST_UNIX_PREFIX)) == 0)
+    {
+        return true;
+    }
+
+    struct stat st;
+    return stat(name, &st) == 0 &&
+           (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode) || S_ISCHR(st.st_mode));
+}
+
+/**
+ * Connect to a TCP server, or wait for one client to connect if no host is
+ * given.
+ *
+ * @param addr "<host>:<port>", or ":<port>"
+ * @return the connected socket, or -1 (an error has been printed)
+ */
+static int ingest_open_tcp(const char *addr)
+{
+    const char *colon = strrchr(addr, ':');
+    if (colon == NULL || colon[1] == '\0')
+    {
+        fprintf(stderr, "Error: TCP traces are named tcp:<host>:<port> or tcp::<port>\n");
+        return -1;
+    }
+    std::string host(addr, colon - addr);
+    bool listening = host.empty();
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    struct addrinfo *res;
+    int ret = getaddrinfo(listening ? NULL : host.c_str(), colon + 1, &hints, &res);
+    if (ret != 0)
+    {
+        fprintf(stderr, "Error: couldn't resolve %s: %s\n", addr, gai_strerror(ret));
+        return -1;
+    }
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai != NULL && fd == -1; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+        {
+            continue;
+        }
+        // The receive buffer must be set before connecting (or listening) for
+        // the window scale to take it into account.
+        int size = INGEST_SOCKET_BUF_SIZE;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+        if (listening)
+        {
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0)
+            {
+                continue;
+            }
+        }
+        else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            continue;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd == -1)
+    {
+        perror(listening ? "Couldn't listen for a trace" : "Couldn't connect to trace server");
+        return -1;
+    }
+    if (!listening)
+    {
+        return fd;
+    }
+
+    fprintf(stderr, "Waiting for a trace on port %s\n", colon + 1);
+    int conn;
+    do
+    {
+        conn = accept(fd, NULL, NULL);
+    } while (conn == -1 && errno == EINTR);
+    if (conn == -1)
+    {
+        perror("Couldn't accept a trace connection");
+    }
+    close(fd);
+    return conn;
+}
+
+/**
+ * Connect to a Unix stream socket.
+ *
+ * @param path the path of the socket
+ * @return the connected socket, or -1 (an error has been printed)
+ */
+static int ingest_open_unix(const char *path)
+{
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sun.sun_path))
+    {
+        fprintf(stderr, "Error: Unix socket path is too long: %s\n", path);
+        return -1;
+    }
+    strcpy(sun.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+    {
+        perror("Couldn't create socket");
+        return -1;
+    }
+    int size = INGEST_SOCKET_BUF_SIZE;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+    {
+        perror("Couldn't connect to trace socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Open a stream and enlarge its kernel buffer.
+ *
+ * @param name the trace name
+ * @return a file descriptor to read the stream from, or -1 if it could not be
+ *         opened (an error has been printed)
+ */
+int ingest_open(const char *name)
+{
+    int fd;
+    if (strcmp(name, "-") == 0)
+    {
+        fd = dup(STDIN_FILENO);
+        if (fd == -1)
+        {
+            perror("Couldn't read the trace from standard input");
+        }
+    }
+    else if (strncmp(name, INGEST_TCP_PREFIX, strlen(INGEST_TCP_PREFIX)) == 0)
+    {
+        fd = ingest_open_tcp(name + strlen(INGEST_TCP_PREFIX));
+    }
+    else if (strncmp(name, INGEST_UNIX_PREFIX, strlen(INGEST_UNIX_PREFIX)) == 0)
+    {
+        fd = ingest_open_unix(name + strlen(INGEST_UNIX_PREFIX));
+    }
+    else
+    {
+        // A FIFO blocks here until the producer opens it for writing.
+        fd = open(name, O_RDONLY);
+        if (fd == -1)
+        {
+            perror("Couldn't open trace file");
+        }
+    }
+
+#ifdef F_SETPIPE_SZ
+    struct stat st;
+    if (fd != -1 && fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+    {
+        fcntl(fd, F_SETPIPE_SZ, INGEST_PIPE_SIZE);
+    }
+#endif
+    return fd;
+}
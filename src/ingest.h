@@ -0,0 +1,57 @@
+// ingest.h
+// Declares streaming trace inputs, which let the simulator read a trace as
+// it is being written by another program instead of from a file on disk:
+// standard input, a FIFO, or a TCP or Unix socket.
+//
+// A stream is read with blocking reads only as fast as the simulation
+// consumes it, so a producer that gets ahead blocks once the kernel buffer
+// fills up. The kernel buffers of pipes and sockets are enlarged so that
+// the producer and the simulator trade megabytes at a time rather than a
+// page. Streams may be raw or gzip-compressed, like trace files.
+
+#ifndef _INGEST_H_
+#define _INGEST_H_
+
+/** The prefix of the name of a trace read from a TCP socket. */
+#define INGEST_TCP_PREFIX "tcp:"
+
+/** The prefix of the name of a trace read from a Unix socket. */
+#define INGEST_UNIX_PREFIX "unix:"
+
+/**
+ * The size requested for the kernel buffer of a pipe a trace is read from,
+ * in bytes. Linux caps it at /proc/sys/fs/pipe-max-size for unprivileged
+ * processes, and a refused request leaves the default in place.
+ */
+#define INGEST_PIPE_SIZE (1024 * 1024)
+
+/**
+ * The size requested for the kernel receive buffer of a socket a trace is
+ * read from, in bytes.
+ */
+#define INGEST_SOCKET_BUF_SIZE (4 * 1024 * 1024)
+
+/**
+ * Check whether a trace name refers to a stream rather than a regular file:
+ * "-" for standard input, tcp:<host>:<port> to connect to a TCP server,
+ * tcp::<port> to accept one connection on a port, unix:<path> to connect to
+ * a Unix socket, or the path of a FIFO, socket, or character device.
+ *
+ * Streams can only be read once, from the start.
+ *
+ * @param name the trace name
+ * @return true if the trace is a stream
+ */
+bool ingest_is_stream(const char *name);
+
+/**
+ * Open a stream named as ingest_is_stream describes, and enlarge its kernel
+ * buffer.
+ *
+ * @param name the trace name
+ * @return a file descriptor to read the stream from, or -1 if it could not be
+ *         opened (an error has been printed)
+ */
+int ingest_open(const char *name);
+
+#endif
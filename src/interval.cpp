@@ -0,0 +1,106 @@
+// interval.cpp
+// Implements the interval-parallel simulation mode.
+//
+// In this pipeline model younger instructions never delay older ones, so an
+// interval's last instruction retires in the same cycle whether or not the
+// instructions after it are simulated. The only error in an interval's cycle
+// count therefore comes from the state its pipeline starts in, which the
+// warm-up brings close to that of a serial run.
+
+#include "interval.h"
+#include "sim.h"
+#include "tcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Simulate one interval on the calling worker thread.
+ */
+static void interval_worker(const char *tcache_filename,
+                            const PipelineConfig *config, bool skip_idle,
+                            IntervalResult *res)
+{
+    res->retired_insts = 0;
+    res->num_cycles = 0;
+
+    // Each worker maps the cache itself; the pages are shared.
+    TCache *cache = tcache_open(tcache_filename);
+    if (cache == NULL)
+    {
+        res->status = 1;
+        return;
+    }
+    InstSource *src = source_init_tcache(cache);
+
+    uint64_t skipped;
+    if (source_skip(src, res->first_inst - res->warmup_insts, &skipped) !=
+        SOURCE_OK)
+    {
+        fprintf(stderr, "Error: the trace cache is shorter than its header says\n");
+        source_free(src);
+        res->status = 1;
+        return;
+    }
+
+    InstSource *win = source_init_window(src, res->warmup_insts +
+                                              res->num_insts);
+    Pipeline *p = pipe_init(config, win);
+    if (p == NULL)
+    {
+        source_free(win);
+        source_free(src);
+        res->status = 1;
+        return;
+    }
+    p->skip_idle = skip_idle;
+
+    // Warm up, then measure from the cycle the last warm-up instruction
+    // retired in.
+    res->status = run_pipeline_until(p, res->warmup_insts, false);
+    uint64_t start_cycle = p->stat_num_cycle;
+    if (res->status == 0)
+    {
+        res->status = run_pipeline(p, false);
+    }
+    res->retired_insts = p->stat_retired_inst - res->warmup_insts;
+    res->num_cycles = p->stat_num_cycle - start_cycle;
+
+    pipe_free(p);
+    source_free(win);
+    source_free(src);
+}
+
+/**
+ * Simulate a trace cache as num_intervals intervals in parallel.
+ *
+ * @param tcache_filename the trace cache to simulate
+ * @param num_insts the number of instructions in the trace cache
+ * @param num_intervals the number of intervals to split the trace into
+ * @param warmup the number of warm-up instructions before each interval
+ * @param config the configuration of every pipeline
+ * @param skip_idle whether the pipelines fast-forward through idle cycles
+ * @param results receives the results of each interval
+ */
+void interval_run(const char *tcache_filename, uint64_t num_insts,
+                  unsigned int num_intervals, uint64_t warmup,
+                  const PipelineConfig *config, bool skip_idle,
+                  IntervalResult *results)
+{
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < num_intervals; i++)
+    {
+        IntervalResult *res = &results[i];
+        res->first_inst = num_insts * i / num_intervals;
+        res->num_insts = num_insts * (i + 1) / num_intervals - res->first_inst;
+        res->warmup_insts = res->first_inst < warmup ? res->first_inst : warmup;
+        workers.push_back(std::thread(interval_worker, tcache_filename, config,
+                                      skip_idle, res));
+    }
+
+    for (unsigned int i = 0; i < num_intervals; i++)
+    {
+        workers[i].join();
+    }
+}
@@ -0,0 +1,54 @@
+// interval.h
+// Declares the interval-parallel simulation mode.
+//
+// The trace is split into contiguous intervals of instructions, and each
+// interval is simulated on its own thread with its own pipeline. Before an
+// interval is measured, its pipeline simulates a warm-up stretch of the
+// instructions just before it, so that it starts from (nearly) the state a
+// serial run would be in. The cycles of the intervals add up to an estimate
+// of the cycles of the whole trace. Intervals are positioned by seeking, so
+// the trace must be a trace cache.
+
+#ifndef _INTERVAL_H_
+#define _INTERVAL_H_
+
+#include "pipeline.h"
+#include <inttypes.h>
+
+/** The results of simulating one interval. */
+typedef struct IntervalResultStruct
+{
+    /** The number of the first instruction of the interval (0-based). */
+    uint64_t first_inst;
+    /** The number of instructions in the interval. */
+    uint64_t num_insts;
+    /** The number of warm-up instructions simulated before the interval. */
+    uint64_t warmup_insts;
+    /** The number of instructions of the interval that retired. */
+    uint64_t retired_insts;
+    /** The number of cycles from the end of the warm-up to the end. */
+    uint64_t num_cycles;
+    /** 0 on success, nonzero if the cache could not be opened, the
+     *  pipeline could not be allocated, or it deadlocked. */
+    int status;
+} IntervalResult;
+
+/**
+ * Simulate a trace cache as num_intervals intervals in parallel, one thread
+ * per interval.
+ *
+ * @param tcache_filename the trace cache to simulate
+ * @param num_insts the number of instructions in the trace cache
+ * @param num_intervals the number of intervals to split the trace into
+ * @param warmup the number of instructions before each interval to simulate
+ *               as its warm-up
+ * @param config the configuration of every pipeline
+ * @param skip_idle whether the pipelines fast-forward through idle cycles
+ * @param results receives the results of each interval
+ */
+void interval_run(const char *tcache_filename, uint64_t num_insts,
+                  unsigned int num_intervals, uint64_t warmup,
+                  const PipelineConfig *config, bool skip_idle,
+                  IntervalResult *results);
+
+#endif
@@ -0,0 +1,240 @@
+// lifetrace.cpp
+// Implements the lifecycle tracer.
+//
+// The O3PipeView format is gem5's: seven lines per instruction, one per
+// stage, each with the tick the instruction reached it. This pipeline has
+// fewer stages than gem5's, so the issue stage (ROB insertion and renaming)
+// is reported as both rename and dispatch, scheduling as issue, and
+// writeback as complete; the cycle execution finished is only kept in the
+// binary format. The trace holds no PCs, so every instruction is given a PC
+// of 0 and told apart by its position in the trace.
+
+#include "lifetrace.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** The size of the stdio buffer of the lifecycle file. */
+#define LIFETRACE_FILE_BUFFER (1 << 20)
+
+/** The mnemonic of each OpType in the O3PipeView disassembly. */
+static const char *const LIFETRACE_OP_NAMES[NUM_OP_TYPES] =
+    {"ALU", "LD", "ST", "CBR", "OTHER"};
+
+/**
+ * Parse the name of a lifecycle file format.
+ *
+ * @param name "o3" or "binary"
+ * @param format receives the format
+ * @return true if the name is recognized
+ */
+bool lifetrace_parse_format(const char *name, LifetraceFormat *format)
+{
+    if (strcmp(name, "o3") == 0)
+    {
+        *format = LIFETRACE_O3;
+        return true;
+    }
+    if (strcmp(name, "binary") == 0)
+    {
+        *format = LIFETRACE_BINARY;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Create a lifecycle file for a pipeline.
+ *
+ * @param filename the file to write
+ * @param format the format to write in
+ * @param config the configuration of the pipeline to trace
+ * @param first the position in the trace of the first instruction to record
+ * @param last the position in the trace of the last instruction to record
+ * @param sample record one instruction in this many
+ * @return a pointer to a newly allocated tracer, or NULL if the file could
+ *         not be created (an error has been printed)
+ */
+Lifetrace *lifetrace_open(const char *filename, LifetraceFormat format,
+                          const PipelineConfig *config, uint64_t first,
+                          uint64_t last, uint64_t sample)
+{
+    FILE *out = fopen(filename, format == LIFETRACE_BINARY ? "wb" : "w");
+    if (out == NULL)
+    {
+        perror("Couldn't open lifecycle trace file for writing");
+        return NULL;
+    }
+    setvbuf(out, NULL, _IOFBF, LIFETRACE_FILE_BUFFER);
+
+    if (format == LIFETRACE_BINARY)
+    {
+        LifetraceFileHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, LIFETRACE_MAGIC, sizeof(LIFETRACE_MAGIC));
+        hdr.record_size = sizeof(LifetraceRecord);
+        hdr.num_stages = NUM_LIFETRACE_STAGES;
+        if (fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+        {
+            perror("Couldn't write lifecycle trace file");
+            fclose(out);
+            return NULL;
+        }
+    }
+
+    // Instructions in flight span at most the ROB plus the FE and ID
+    // latches, and their inst_nums are consecutive.
+    uint32_t num_slots = 1;
+    while (num_slots < config->num_rob_entries + 2 * MAX_PIPE_WIDTH + 1)
+    {
+        num_slots *= 2;
+    }
+
+    Lifetrace *t = (Lifetrace *)calloc(1, sizeof(Lifetrace));
+    t->slots = (LifetraceSlot *)calloc(num_slots, sizeof(LifetraceSlot));
+    t->slot_mask = num_slots - 1;
+    t->first = first;
+    t->last = last;
+    t->sample = sample;
+    t->ring = (LifetraceRecord *)calloc(LIFETRACE_RING_RECORDS, sizeof(LifetraceRecord));
+    t->out = out;
+    t->format = format;
+    return t;
+}
+
+/**
+ * Write one record as O3PipeView lines.
+ */
+static bool lifetrace_write_o3(FILE *out, const LifetraceRecord *r)
+{
+    const uint64_t *c = r->cycles;
+    const uint64_t k = LIFETRACE_TICKS_PER_CYCLE;
+    const char *op = r->op_type < NUM_OP_TYPES ? LIFETRACE_OP_NAMES[r->op_type] : "?";
+
+    if (fprintf(out, "O3PipeView:fetch:%lu:0x%08x:0:%lu:%s",
+                (unsigned long)(c[LIFETRACE_FETCH] * k), 0u,
+                (unsigned long)r->seq, op) < 0)
+    {
+        return false;
+    }
+    if (r->dest_reg != -1 && fprintf(out, " r%d <-", r->dest_reg) < 0)
+    {
+        return false;
+    }
+    if (r->src1_reg != -1 && fprintf(out, " r%d", r->src1_reg) < 0)
+    {
+        return false;
+    }
+    if (r->src2_reg != -1 &&
+        fprintf(out, "%s r%d", r->src1_reg != -1 ? "," : "", r->src2_reg) < 0)
+    {
+        return false;
+    }
+
+    return fprintf(out, "\n"
+                        "O3PipeView:decode:%lu\n"
+                        "O3PipeView:rename:%lu\n"
+                        "O3PipeView:dispatch:%lu\n"
+                        "O3PipeView:issue:%lu\n"
+                        "O3PipeView:complete:%lu\n"
+                        "O3PipeView:retire:%lu:store:%lu\n",
+                   (unsigned long)(c[LIFETRACE_DECODE] * k),
+                   (unsigned long)(c[LIFETRACE_ISSUE] * k),
+                   (unsigned long)(c[LIFETRACE_ISSUE] * k),
+                   (unsigned long)(c[LIFETRACE_SCHEDULE] * k),
+                   (unsigned long)(c[LIFETRACE_WRITEBACK] * k),
+                   (unsigned long)(c[LIFETRACE_COMMIT] * k),
+                   (unsigned long)(r->op_type == OP_ST ? c[LIFETRACE_COMMIT] * k : 0)) >= 0;
+}
+
+/**
+ * Write out and empty the ring.
+ */
+static void lifetrace_flush(Lifetrace *t)
+{
+    if (t->format == LIFETRACE_BINARY)
+    {
+        if (fwrite(t->ring, sizeof(LifetraceRecord), t->num_records, t->out) !=
+            t->num_records)
+        {
+            t->failed = true;
+        }
+    }
+    else
+    {
+        for (unsigned int i = 0; i < t->num_records && !t->failed; i++)
+        {
+            t->failed = !lifetrace_write_o3(t->out, &t->ring[i]);
+        }
+    }
+    t->num_records = 0;
+}
+
+/**
+ * End the lifecycle of an instruction that has just been committed, and
+ * record it if it is in the window.
+ *
+ * @param t the tracer
+ * @param inst the instruction
+ * @param cycle the current cycle
+ * @return true once the last instruction of the window has been committed
+ */
+bool lifetrace_commit(Lifetrace *t, const InstInfo *inst, uint64_t cycle)
+{
+    LifetraceSlot *s = &t->slots[inst->inst_num & t->slot_mask];
+    uint64_t seq = s->seq;
+    s->seq = 0;
+
+    // Instructions fetched before the tracer was attached, as when resuming
+    // from a checkpoint, have no stamps.
+    if (seq == 0 || (uint32_t)seq != inst->inst_num)
+    {
+        return false;
+    }
+    if (seq < t->first || seq > t->last || (seq - t->first) % t->sample != 0)
+    {
+        return seq >= t->last;
+    }
+
+    LifetraceRecord *r = &t->ring[t->num_records++];
+    r->seq = seq;
+    memcpy(r->cycles, s->cycles, sizeof(s->cycles));
+    r->cycles[LIFETRACE_COMMIT] = cycle;
+    r->op_type = inst->op_type;
+    r->dest_reg = inst->dest_reg;
+    r->src1_reg = inst->src1_reg;
+    r->src2_reg = inst->src2_reg;
+    r->reserved = 0;
+    t->total_records++;
+
+    if (t->num_records == LIFETRACE_RING_RECORDS)
+    {
+        lifetrace_flush(t);
+    }
+    return seq >= t->last;
+}
+
+/**
+ * Write the records left in the ring, close the file, and free the tracer.
+ *
+ * @param t the tracer
+ * @return 0 on success, nonzero if the file could not be written (an error
+ *         has been printed)
+ */
+int lifetrace_close(Lifetrace *t)
+{
+    lifetrace_flush(t);
+    bool ok = !t->failed;
+    if (fclose(t->out) != 0)
+    {
+        ok = false;
+    }
+    free(t->slots);
+    free(t->ring);
+    free(t);
+    if (!ok)
+    {
+        fprintf(stderr, "Error: couldn't write lifecycle trace file\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+// lifetrace.h
+// Declares the lifecycle tracer, which records the cycle each instruction of
+// a window of the trace passes through each stage of a pipeline, and writes
+// them out in the O3PipeView text format read by pipeline viewers such as
+// Konata, or as raw binary records.
+//
+// The pipeline stamps the stages of every instruction in flight into a slot
+// table with a handful of stores; only at commit is the instruction checked
+// against the window and copied into a preallocated ring of records, which
+// is written out in one go whenever it fills up.
+
+#ifndef _LIFETRACE_H_
+#define _LIFETRACE_H_
+
+#include "pipeline.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+/** The number of records the ring buffer holds. */
+#define LIFETRACE_RING_RECORDS 16384
+
+/**
+ * The number of O3PipeView ticks per cycle; the viewers expect
+ * gem5's picosecond ticks, and this makes a cycle a nanosecond.
+ */
+#define LIFETRACE_TICKS_PER_CYCLE 1000
+
+/**
+ * The magic string at the start of a binary lifecycle file, including the
+ * terminating NUL.
+ */
+#define LIFETRACE_MAGIC "SIMLTR1"
+
+/** The formats a lifecycle file can be written in. */
+typedef enum LifetraceFormatEnum
+{
+    LIFETRACE_O3,     // O3PipeView lines, seven per instruction.
+    LIFETRACE_BINARY, // A LifetraceFileHeader, then raw LifetraceRecords.
+} LifetraceFormat;
+
+/** The stages the tracer stamps, in the order an instruction goes through them. */
+typedef enum LifetraceStageEnum
+{
+    LIFETRACE_FETCH,     // Fetched into the FE latch.
+    LIFETRACE_DECODE,    // Decoded into the ID latch.
+    LIFETRACE_ISSUE,     // Inserted into the ROB and renamed.
+    LIFETRACE_SCHEDULE,  // Scheduled for execution.
+    LIFETRACE_EXE_DONE,  // Finished executing, into the EX latch.
+    LIFETRACE_WRITEBACK, // Written back, waking up its consumers.
+    LIFETRACE_COMMIT,    // Committed.
+    NUM_LIFETRACE_STAGES
+} LifetraceStage;
+
+/** The lifecycle of one instruction. */
+typedef struct LifetraceRecordStruct
+{
+    /** The 1-based position of the instruction in the trace. */
+    uint64_t seq;
+    /** The cycle the instruction passed through each LifetraceStage. */
+    uint64_t cycles[NUM_LIFETRACE_STAGES];
+    /** The OpType of the instruction. */
+    uint8_t op_type;
+    /** The destination register, or -1. */
+    int8_t dest_reg;
+    /** The first source register, or -1. */
+    int8_t src1_reg;
+    /** The second source register, or -1. */
+    int8_t src2_reg;
+    /** Zero. */
+    uint32_t reserved;
+} LifetraceRecord;
+
+/** The header of a binary lifecycle file. */
+typedef struct LifetraceFileHeaderStruct
+{
+    /** LIFETRACE_MAGIC. */
+    char magic[8];
+    /** sizeof(LifetraceRecord), in this host's layout. */
+    uint32_t record_size;
+    /** NUM_LIFETRACE_STAGES. */
+    uint32_t num_stages;
+} LifetraceFileHeader;
+
+/** [Internal] The stamps of one instruction in flight. */
+typedef struct LifetraceSlotStruct
+{
+    /** The position of the instruction in the trace, or 0 if it was fetched
+     *  before the tracer was attached. */
+    uint64_t seq;
+    /** The cycle the instruction passed through each stage so far. */
+    uint64_t cycles[NUM_LIFETRACE_STAGES - 1];
+} LifetraceSlot;
+
+/**
+ * The lifecycle tracer of a pipeline.
+ *
+ * The slot table is indexed by inst_num, and has room for every instruction
+ * that can be in flight at once: the ROB and the FE and ID latches.
+ */
+typedef struct LifetraceStruct
+{
+    /** [Internal] The stamps of the instructions in flight. */
+    LifetraceSlot *slots;
+    /** [Internal] The number of slots minus one; a power of two minus one. */
+    uint32_t slot_mask;
+
+    /** [Internal] The first position in the trace to record. */
+    uint64_t first;
+    /** [Internal] The last position in the trace to record. */
+    uint64_t last;
+    /** [Internal] Record one instruction in this many. */
+    uint64_t sample;
+
+    /** [Internal] The records not yet written. */
+    LifetraceRecord *ring;
+    /** [Internal] The number of records in the ring. */
+    unsigned int num_records;
+    /** [Internal] The number of instructions recorded in total. */
+    uint64_t total_records;
+
+    /** [Internal] The lifecycle file. */
+    FILE *out;
+    /** [Internal] The format of the file. */
+    LifetraceFormat format;
+    /** [Internal] Whether writing to the file has failed. */
+    bool failed;
+} Lifetrace;
+
+/**
+ * Parse the name of a lifecycle file format.
+ *
+ * @param name "o3" or "binary"
+ * @param format receives the format
+ * @return true if the name is recognized
+ */
+bool lifetrace_parse_format(const char *name, LifetraceFormat *format);
+
+/**
+ * Create a lifecycle file for a pipeline.
+ *
+ * Instructions first to last of the trace are recorded, or one in every
+ * sample of them, counting from first.
+ *
+ * @param filename the file to write
+ * @param format the format to write in
+ * @param config the configuration of the pipeline to trace
+ * @param first the position in the trace of the first instruction to record
+ * @param last the position in the trace of the last instruction to record
+ * @param sample record one instruction in this many; 1 records all of them
+ * @return a pointer to a newly allocated tracer, or NULL if the file could
+ *         not be created (an error has been printed)
+ */
+Lifetrace *lifetrace_open(const char *filename, LifetraceFormat format,
+                          const PipelineConfig *config, uint64_t first,
+                          uint64_t last, uint64_t sample);
+
+/**
+ * Start the lifecycle of an instruction that has just been fetched.
+ *
+ * @param t the tracer
+ * @param inst_num the inst_num of the instruction
+ * @param seq the position of the instruction in the trace
+ * @param cycle the current cycle
+ */
+static inline void lifetrace_fetch(Lifetrace *t, uint32_t inst_num,
+                                   uint64_t seq, uint64_t cycle)
+{
+    LifetraceSlot *s = &t->slots[inst_num & t->slot_mask];
+    s->seq = seq;
+    s->cycles[LIFETRACE_FETCH] = cycle;
+}
+
+/**
+ * Stamp the cycle an instruction in flight passed through a stage before
+ * commit.
+ *
+ * @param t the tracer
+ * @param inst_num the inst_num of the instruction
+ * @param stage the stage
+ * @param cycle the current cycle
+ */
+static inline void lifetrace_stamp(Lifetrace *t, uint32_t inst_num,
+                                   LifetraceStage stage, uint64_t cycle)
+{
+    t->slots[inst_num & t->slot_mask].cycles[stage] = cycle;
+}
+
+/**
+ * End the lifecycle of an instruction that has just been committed, and
+ * record it if it is in the window.
+ *
+ * @param t the tracer
+ * @param inst the instruction
+ * @param cycle the current cycle
+ * @return true once the last instruction of the window has been committed,
+ *         after which nothing more needs to be stamped
+ */
+bool lifetrace_commit(Lifetrace *t, const InstInfo *inst, uint64_t cycle);
+
+/**
+ * Write the records left in the ring, close the file, and free the tracer.
+ *
+ * @param t the tracer
+ * @return 0 on success, nonzero if the file could not be written (an error
+ *         has been printed)
+ */
+int lifetrace_close(Lifetrace *t);
+
+#endif
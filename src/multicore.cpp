@@ -0,0 +1,164 @@
+// multicore.cpp
+// Implements the multi-core mode.
+//
+// Every core runs run_pipeline_slice up to the end of the current quantum
+// and then arrives at the barrier. Arriving takes a short lock to count the
+// core in; the last core to arrive starts the next quantum by bumping the
+// barrier's generation, which the others poll without the lock.
+
+#include "multicore.h"
+#include "prefetch.h"
+#include "sim.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** [Internal] The barrier the cores meet at between quanta. */
+typedef struct QuantumBarrierStruct
+{
+    /** Protects arrived and parties. */
+    std::mutex lock;
+    /** The number of cores that have arrived in the current generation. */
+    unsigned int arrived;
+    /** The number of cores still taking part. */
+    unsigned int parties;
+    /** Incremented every time all parties have arrived. */
+    std::atomic<uint64_t> generation;
+} QuantumBarrier;
+
+/**
+ * Release the cores waiting at the barrier if all parties have arrived.
+ * Must be called with the lock held.
+ */
+static void barrier_release_if_full(QuantumBarrier *b)
+{
+    if (b->parties > 0 && b->arrived == b->parties)
+    {
+        b->arrived = 0;
+        b->generation.fetch_add(1, std::memory_order_release);
+    }
+}
+
+/**
+ * Wait at the barrier until every core still taking part has arrived.
+ */
+static void barrier_arrive(QuantumBarrier *b)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> guard(b->lock);
+        generation = b->generation.load(std::memory_order_relaxed);
+        b->arrived++;
+        barrier_release_if_full(b);
+    }
+
+    unsigned int spins = 0;
+    while (b->generation.load(std::memory_order_acquire) == generation)
+    {
+        if (++spins >= MULTICORE_SPIN_LIMIT)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * Stop taking part in the barrier, releasing the other cores if they were
+ * only waiting for this one.
+ */
+static void barrier_leave(QuantumBarrier *b)
+{
+    std::lock_guard<std::mutex> guard(b->lock);
+    b->parties--;
+    barrier_release_if_full(b);
+}
+
+/**
+ * Simulate one core to completion on the calling thread.
+ */
+static void multicore_worker(const char *trace_filename,
+                             const MulticoreConfig *config,
+                             QuantumBarrier *barrier, CoreResult *result)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration waited(0);
+    result->pipeline = NULL;
+    result->status = 1;
+
+    InstSource *src = open_trace_file(trace_filename, config->gz_threads);
+    Pipeline *p = NULL;
+    if (src != NULL)
+    {
+        if (config->prefetch)
+        {
+            src = source_init_prefetch(src, PREFETCH_RING_INSTS);
+        }
+
+        p = pipe_init(&config->config, src);
+        if (p == NULL)
+        {
+            source_free(src);
+        }
+    }
+    if (p != NULL)
+    {
+        p->skip_idle = config->skip_idle;
+        uint64_t last_hbeat_inst = p->stat_retired_inst;
+        int status = 0;
+        for (uint64_t end = config->quantum; status == 0 && !p->halt;
+             end += config->quantum)
+        {
+            status = run_pipeline_slice(p, UINT64_MAX, end, &last_hbeat_inst,
+                                        false);
+            if (status == 0 && !p->halt)
+            {
+                std::chrono::steady_clock::time_point arrive =
+                    std::chrono::steady_clock::now();
+                barrier_arrive(barrier);
+                waited += std::chrono::steady_clock::now() - arrive;
+            }
+        }
+
+        p->src = NULL;
+        source_free(src);
+        result->pipeline = p;
+        result->status = status;
+    }
+    barrier_leave(barrier);
+
+    result->sim_seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    result->wait_seconds = std::chrono::duration<double>(waited).count();
+}
+
+/**
+ * Simulate one core per trace, each on its own thread, in lockstep quanta.
+ *
+ * @param trace_filenames the trace of each core
+ * @param num_cores the number of cores
+ * @param config the options of the simulation
+ * @param results receives the outcome of each core
+ */
+void multicore_run(char *const *trace_filenames, unsigned int num_cores,
+                   const MulticoreConfig *config, CoreResult *results)
+{
+    QuantumBarrier *barrier = new QuantumBarrier();
+    barrier->arrived = 0;
+    barrier->parties = num_cores;
+    barrier->generation = 0;
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < num_cores; i++)
+    {
+        workers.push_back(std::thread(multicore_worker, trace_filenames[i],
+                                      config, barrier, &results[i]));
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    delete barrier;
+}
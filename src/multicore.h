@@ -0,0 +1,68 @@
+// multicore.h
+// Declares the multi-core mode, which simulates several cores, each running
+// its own trace on its own pipeline and host thread. The cores advance in
+// quanta of cycles and wait for each other at a barrier at the end of every
+// quantum, so that no core runs more than one quantum ahead of another.
+
+#ifndef _MULTICORE_H_
+#define _MULTICORE_H_
+
+#include "pipeline.h"
+#include <inttypes.h>
+
+/**
+ * The default number of cycles the cores simulate between barriers.
+ */
+#define MULTICORE_DEFAULT_QUANTUM 1000
+
+/** The number of times a core polls the barrier before yielding its thread. */
+#define MULTICORE_SPIN_LIMIT 64
+
+/** The options of a multi-core simulation. */
+typedef struct MulticoreConfigStruct
+{
+    /** The configuration of every core. */
+    PipelineConfig config;
+    /** The number of cycles the cores simulate between barriers. */
+    uint64_t quantum;
+    /** The number of threads to decompress each BGZF trace with. */
+    unsigned int gz_threads;
+    /** Whether each core reads and decodes its trace on a separate thread. */
+    bool prefetch;
+    /** Whether the cores fast-forward through idle cycles. */
+    bool skip_idle;
+} MulticoreConfig;
+
+/** The outcome of one simulated core. */
+typedef struct CoreResultStruct
+{
+    /**
+     * The finished pipeline of the core, or NULL if its trace could not be
+     * opened or its pipeline allocated. The caller must free it with
+     * pipe_free.
+     */
+    Pipeline *pipeline;
+    /** 0 if the core ran its trace to completion, nonzero otherwise. */
+    int status;
+    /** The host time the core's thread spent simulating, in seconds. */
+    double sim_seconds;
+    /** The part of sim_seconds spent waiting at barriers. */
+    double wait_seconds;
+} CoreResult;
+
+/**
+ * Simulate one core per trace, each on its own thread, in lockstep quanta.
+ * Returns once every core has halted or failed.
+ *
+ * A core that finishes its trace (or deadlocks) stops taking part in the
+ * barrier, and the remaining cores carry on without it.
+ *
+ * @param trace_filenames the trace of each core
+ * @param num_cores the number of cores
+ * @param config the options of the simulation
+ * @param results receives the outcome of each core
+ */
+void multicore_run(char *const *trace_filenames, unsigned int num_cores,
+                   const MulticoreConfig *config, CoreResult *results);
+
+#endif
@@ -2,74 +2,56 @@
 // Implements the out-of-order pipeline.
 
 #include "pipeline.h"
+#include "ckpt.h"
+#include "lifetrace.h"
+#include "profile.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 
 /**
- * The width of the pipeline; that is, the maximum number of instructions that
- * can be processed during any given cycle in each of the issue, schedule, and
- * commit stages of the pipeline.
- * 
- * When the width is 1, the pipeline is scalar.
- * When the width is greater than 1, the pipeline is superscalar.
- */
-extern uint32_t PIPE_WIDTH;
-
-/**
- * The number of entries in the ROB; that is, the maximum number of
- * instructions that can be stored in the ROB at any given time.
+ * [Internal] The kernel template arguments that leave the width or the
+ * scheduling policy to be read from the pipeline's configuration at run time.
  */
-extern uint32_t NUM_ROB_ENTRIES;
+#define PIPE_ANY_WIDTH 0
+#define PIPE_ANY_POLICY -1
 
 /**
- * Whether to use in-order scheduling or out-of-order scheduling.
- * 
- * The possible values are SCHED_IN_ORDER for in-order scheduling and
- * SCHED_OUT_OF_ORDER for out-of-order scheduling.
+ * [Internal] The width a kernel simulates: W if it was fixed at compile time,
+ * the pipeline's width otherwise.
  */
-extern SchedulingPolicy SCHED_POLICY;
+template <unsigned int W>
+static inline unsigned int kernel_width(const Pipeline *p)
+{
+    return W != PIPE_ANY_WIDTH ? W : p->config.pipe_width;
+}
 
 /**
- * The number of cycles an LD instruction should take to execute.
+ * [Internal] The scheduling policy a kernel simulates: P if it was fixed at
+ * compile time, the pipeline's policy otherwise.
  */
-extern uint32_t LOAD_EXE_CYCLES;
+template <int P>
+static inline SchedulingPolicy kernel_policy(const Pipeline *p)
+{
+    return P != PIPE_ANY_POLICY ? (SchedulingPolicy)P : p->config.sched_policy;
+}
 
 /**
- * Read a single trace record from the trace file and use it to populate the
- * given fe_latch.
+ * Fetch a single instruction from the pipeline's source and use it to
+ * populate the given fe_latch.
  * 
- * @param p the pipeline whose trace file should be read
+ * @param p the pipeline whose source should be read
  * @param fe_latch the PipelineLatch struct to populate
  */
 void pipe_fetch_inst(Pipeline *p, PipelineLatch *fe_latch)
 {
     InstInfo *inst = &fe_latch->inst;
-    TraceRec trace_rec;
-    uint8_t *trace_rec_buf = (uint8_t *)&trace_rec;
-    size_t bytes_read_total = 0;
-    ssize_t bytes_read_last = 0;
-    size_t bytes_left = sizeof(TraceRec);
-
-    // Read a total of sizeof(TraceRec) bytes from the trace file.
-    while (bytes_left > 0)
-    {
-        bytes_read_last = read(p->trace_fd, trace_rec_buf, bytes_left);
-        if (bytes_read_last <= 0)
-        {
-            // EOF or error
-            break;
-        }
-
-        trace_rec_buf += bytes_read_last;
-        bytes_read_total += bytes_read_last;
-        bytes_left -= bytes_read_last;
-    }
+    SourceStatus status = source_next(p->src, inst);
 
     // Check for error conditions.
-    if (bytes_left > 0 || trace_rec.op_type >= NUM_OP_TYPES)
+    if (status != SOURCE_OK)
     {
         fe_latch->valid = false;
+        p->trace_done = true;
         p->halt_inst_num = p->last_inst_num;
 
         if (p->stat_retired_inst >= p->halt_inst_num)
@@ -77,14 +59,14 @@ void pipe_fetch_inst(Pipeline *p, PipelineLatch *fe_latch)
             p->halt = true;
         }
 
-        if (bytes_read_last == -1)
+        if (status == SOURCE_ERROR)
         {
             fprintf(stderr, "\n");
-            perror("Couldn't read from pipe");
+            perror("Couldn't read trace file");
             return;
         }
 
-        if (bytes_read_total == 0)
+        if (status == SOURCE_EOF)
         {
             // No more trace records to read
             return;
@@ -99,42 +81,80 @@ void pipe_fetch_inst(Pipeline *p, PipelineLatch *fe_latch)
     // Got a valid trace record!
     fe_latch->valid = true;
     fe_latch->stall = false;
-    inst->inst_num = ++p->last_inst_num;
-    inst->op_type = (OpType)trace_rec.op_type;
+    inst->inst_num = (uint32_t)++p->last_inst_num;
+    if (p->last_inst_num <= CKPT_FINGERPRINT_INSTS)
+    {
+        p->trace_fingerprint = ckpt_fingerprint_add(p->trace_fingerprint, inst);
+    }
+}
+
+static PipeCycleFn pipe_select_kernel(unsigned int width, SchedulingPolicy policy,
+                                      bool traced);
 
-    inst->dest_reg = trace_rec.dest_needed ? trace_rec.dest_reg : -1;
-    inst->src1_reg = trace_rec.src1_needed ? trace_rec.src1_reg : -1;
-    inst->src2_reg = trace_rec.src2_needed ? trace_rec.src2_reg : -1;
+/**
+ * The name of each StallReason, as printed in the statistics.
+ */
+const char *const STALL_REASON_NAMES[NUM_STALL_REASONS] =
+    {"frontend", "schedule", "load", "execute"};
 
-    inst->dr_tag = -1;
-    inst->src1_tag = -1;
-    inst->src2_tag = -1;
-    inst->src1_ready = false;
-    inst->src2_ready = false;
-    inst->exe_wait_cycles = 0;
+/**
+ * Populate a configuration with the defaults.
+ *
+ * @param config the configuration to populate
+ */
+void pipe_default_config(PipelineConfig *config)
+{
+    config->pipe_width = 1;
+    config->num_rob_entries = 32;
+    config->load_exe_cycles = 4;
+    config->sched_policy = SCHED_OUT_OF_ORDER;
+    config->wakeup_engine = WAKEUP_DEPLIST;
 }
 
 /**
  * Allocate and initialize a new pipeline.
  * 
- * @param trace_fd the file descriptor from which to read trace records
- * @return a pointer to a newly allocated pipeline
+ * @param config the configuration of the pipeline
+ * @param src the source from which to fetch instructions
+ * @return a pointer to a newly allocated pipeline, or NULL if it could not be
+ *         allocated (an error has been printed)
  */
-Pipeline *pipe_init(int trace_fd)
+Pipeline *pipe_init(const PipelineConfig *config, InstSource *src)
 {
-    printf("\n** PIPELINE IS %d WIDE **\n\n", PIPE_WIDTH);
-
     // Allocate pipeline.
     Pipeline *p = (Pipeline *)calloc(1, sizeof(Pipeline));
+    if (p == NULL)
+    {
+        perror("Couldn't allocate the pipeline");
+        return NULL;
+    }
 
     // Initialize pipeline.
+    p->config = *config;
     p->rat = rat_init();
-    p->rob = rob_init();
-    p->exeq = exeq_init();
-    p->trace_fd = trace_fd;
+    p->rob = rob_init(config->num_rob_entries, config->wakeup_engine);
+    p->exeq = exeq_init(config->load_exe_cycles);
+    if (p->rob == NULL || p->exeq == NULL)
+    {
+        pipe_free(p);
+        return NULL;
+    }
+    p->stat_rob_occupancy = (uint64_t *)calloc(config->num_rob_entries + 1, sizeof(uint64_t));
+    p->stat_exeq_occupancy = (uint64_t *)calloc(config->num_rob_entries + 1, sizeof(uint64_t));
+    if (p->stat_rob_occupancy == NULL || p->stat_exeq_occupancy == NULL)
+    {
+        perror("Couldn't allocate the pipeline");
+        pipe_free(p);
+        return NULL;
+    }
+    p->src = src;
+    p->next_inst_num = 1;
+    p->trace_fingerprint = CKPT_FINGERPRINT_SEED;
     p->halt_inst_num = (uint64_t)(-1) - 3;
+    p->cycle_fn = pipe_select_kernel(config->pipe_width, config->sched_policy,
+                                     false);
 
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < config->pipe_width; i++)
     {
         p->FE_latch[i].valid = false;
         p->ID_latch[i].valid = false;
@@ -144,10 +164,115 @@ Pipeline *pipe_init(int trace_fd)
     {
         p->EX_latch[i].valid = false;
     }
+    p->num_ex = 0;
 
     return p;
 }
 
+/**
+ * Free a pipeline along with its ROB, RAT, and EXEQ.
+ * 
+ * @param p the pipeline to free, which may be only partly initialized
+ */
+void pipe_free(Pipeline *p)
+{
+    free(p->rat);
+    if (p->rob != NULL)
+    {
+        rob_free(p->rob);
+    }
+    if (p->exeq != NULL)
+    {
+        exeq_free(p->exeq);
+    }
+    free(p->stat_rob_occupancy);
+    free(p->stat_exeq_occupancy);
+    free(p);
+}
+
+/**
+ * Write the state of a pipeline, including its ROB, RAT, and EXEQ, to a
+ * checkpoint.
+ * 
+ * @param p the pipeline
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool pipe_save(Pipeline *p, FILE *f)
+{
+    return ckpt_write(f, p->FE_latch, sizeof(p->FE_latch)) &&
+           ckpt_write(f, p->ID_latch, sizeof(p->ID_latch)) &&
+           ckpt_write(f, p->SC_latch, sizeof(p->SC_latch)) &&
+           ckpt_write(f, &p->num_ex, sizeof(p->num_ex)) &&
+           ckpt_write(f, p->EX_latch, p->num_ex * sizeof(PipelineLatch)) &&
+           ckpt_write(f, &p->stat_retired_inst, sizeof(p->stat_retired_inst)) &&
+           ckpt_write(f, &p->stat_num_cycle, sizeof(p->stat_num_cycle)) &&
+           ckpt_write(f, &p->stat_rob_stall_cycles, sizeof(p->stat_rob_stall_cycles)) &&
+           ckpt_write(f, p->stat_stall_slots, sizeof(p->stat_stall_slots)) &&
+           ckpt_write(f, p->stat_rob_occupancy, (p->config.num_rob_entries + 1) * sizeof(uint64_t)) &&
+           ckpt_write(f, p->stat_exeq_occupancy, (p->config.num_rob_entries + 1) * sizeof(uint64_t)) &&
+           ckpt_write(f, &p->last_inst_num, sizeof(p->last_inst_num)) &&
+           ckpt_write(f, &p->next_inst_num, sizeof(p->next_inst_num)) &&
+           ckpt_write(f, &p->halt_inst_num, sizeof(p->halt_inst_num)) &&
+           ckpt_write(f, &p->halt, sizeof(p->halt)) &&
+           ckpt_write(f, &p->trace_done, sizeof(p->trace_done)) &&
+           rob_save(p->rob, f) &&
+           rat_save(p->rat, f) &&
+           exeq_save(p->exeq, f);
+}
+
+/**
+ * Read the state of a pipeline from a checkpoint written by pipe_save.
+ * 
+ * @param p the pipeline to overwrite
+ * @param f the checkpoint being read
+ * @return true on success
+ */
+bool pipe_load(Pipeline *p, FILE *f)
+{
+    unsigned int num_tags = p->config.num_rob_entries;
+    if (!ckpt_read(f, p->FE_latch, sizeof(p->FE_latch)) ||
+        !ckpt_read(f, p->ID_latch, sizeof(p->ID_latch)) ||
+        !ckpt_read(f, p->SC_latch, sizeof(p->SC_latch)) ||
+        !ckpt_read(f, &p->num_ex, sizeof(p->num_ex)) ||
+        p->num_ex > MAX_WRITEBACKS ||
+        !ckpt_read(f, p->EX_latch, p->num_ex * sizeof(PipelineLatch)))
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < MAX_PIPE_WIDTH; i++)
+    {
+        if (!ckpt_check_inst(&p->FE_latch[i].inst, num_tags) ||
+            !ckpt_check_inst(&p->ID_latch[i].inst, num_tags) ||
+            !ckpt_check_inst(&p->SC_latch[i].inst, num_tags))
+        {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < p->num_ex; i++)
+    {
+        if (!ckpt_check_inst(&p->EX_latch[i].inst, num_tags))
+        {
+            return false;
+        }
+    }
+
+    return ckpt_read(f, &p->stat_retired_inst, sizeof(p->stat_retired_inst)) &&
+           ckpt_read(f, &p->stat_num_cycle, sizeof(p->stat_num_cycle)) &&
+           ckpt_read(f, &p->stat_rob_stall_cycles, sizeof(p->stat_rob_stall_cycles)) &&
+           ckpt_read(f, p->stat_stall_slots, sizeof(p->stat_stall_slots)) &&
+           ckpt_read(f, p->stat_rob_occupancy, (p->config.num_rob_entries + 1) * sizeof(uint64_t)) &&
+           ckpt_read(f, p->stat_exeq_occupancy, (p->config.num_rob_entries + 1) * sizeof(uint64_t)) &&
+           ckpt_read(f, &p->last_inst_num, sizeof(p->last_inst_num)) &&
+           ckpt_read(f, &p->next_inst_num, sizeof(p->next_inst_num)) &&
+           ckpt_read(f, &p->halt_inst_num, sizeof(p->halt_inst_num)) &&
+           ckpt_read(f, &p->halt, sizeof(p->halt)) &&
+           ckpt_read(f, &p->trace_done, sizeof(p->trace_done)) &&
+           rob_load(p->rob, f) &&
+           rat_load(p->rat, f, num_tags) &&
+           exeq_load(p->exeq, f, num_tags);
+}
+
 /**
  * Commit the given instruction.
  * 
@@ -156,11 +281,14 @@ Pipeline *pipe_init(int trace_fd)
  * @param p the pipeline to update.
  * @param inst the instruction to commit.
  */
-void pipe_commit_inst(Pipeline *p, InstInfo inst)
+void pipe_commit_inst(Pipeline *p, const InstInfo *inst)
 {
     p->stat_retired_inst++;
+    p->last_retired_inst_num = inst->inst_num;
 
-    if (inst.inst_num >= p->halt_inst_num)
+    // Instructions commit in fetch order, so this is the last one once as
+    // many have committed as were fetched.
+    if (p->stat_retired_inst >= p->halt_inst_num)
     {
         p->halt = true;
     }
@@ -199,7 +327,7 @@ void pipe_print_state(Pipeline *p)
 
     // Print row for each lane in pipeline width
     unsigned int ex_i = 0;
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
     {
         if (p->FE_latch[i].valid)
         {
@@ -228,19 +356,14 @@ void pipe_print_state(Pipeline *p)
         {
             printf(" ------ ");
         }
-        bool flag = false;
-        for (; ex_i < MAX_WRITEBACKS; ex_i++)
+        if (ex_i < p->num_ex)
         {
-            if (p->EX_latch[ex_i].valid)
-            {
-                printf(" %6lu ",
-                       (unsigned long)p->EX_latch[ex_i].inst.inst_num);
-                ex_i++;
-                flag = true;
-                break;
-            }
+            printf(" %6lu ",
+                   (unsigned long)p->EX_latch[ex_i].inst.inst_num);
+            ex_i++;
         }
-        if (!flag) {
+        else
+        {
             printf(" ------ ");
         }
         printf("\n");
@@ -253,34 +376,167 @@ void pipe_print_state(Pipeline *p)
 }
 
 /**
- * Simulate one cycle of all stages of a pipeline.
+ * Find why the commit stage of a pipeline cannot commit the head of the ROB.
  * 
- * @param p the pipeline to simulate
+ * @param p the pipeline, after its commit stage has committed what it could
+ * @return the reason the remaining commit slots go unused
  */
-void pipe_cycle(Pipeline *p)
+static inline StallReason pipe_stall_reason(Pipeline *p)
 {
-    p->stat_num_cycle++;
+    if (rob_occupancy(p->rob) == 0)
+    {
+        return STALL_FRONTEND;
+    }
 
-    #ifdef DEBUG
-        printf("\n--------------------------------------------\n");
-        printf("Cycle count: %lu, retired instructions: %lu\n\n",
-           (unsigned long)p->stat_num_cycle,
-           (unsigned long)p->stat_retired_inst);
-    #endif
-    
-    // In our simulator, stages are processed in reverse order.
-    pipe_cycle_commit(p);
-    pipe_cycle_writeback(p);
-    pipe_cycle_exe(p);
-    pipe_cycle_schedule(p);
-    pipe_cycle_issue(p);
-    pipe_cycle_decode(p);
-    pipe_cycle_fetch(p);
+    int head = p->rob->head_ptr;
+    if (rob_check_pending(p->rob, head))
+    {
+        return STALL_SCHEDULE;
+    }
+    return p->rob->insts[head].op_type == OP_LD ? STALL_LOAD : STALL_EXECUTE;
+}
 
-    // Compile with "make debug" to have this show!
-    #ifdef DEBUG
-        pipe_print_state(p);
-    #endif
+/**
+ * Count cycles of a pipeline that end in its current state in the occupancy
+ * histograms.
+ * 
+ * @param p the pipeline
+ * @param cycles the number of cycles
+ */
+static inline void pipe_count_occupancy(Pipeline *p, uint64_t cycles)
+{
+    p->stat_rob_occupancy[rob_occupancy(p->rob)] += cycles;
+    p->stat_exeq_occupancy[p->exeq->count] += cycles;
+}
+
+/**
+ * Find how many of the upcoming cycles of a pipeline are guaranteed to be
+ * idle.
+ * 
+ * A cycle is idle if every stage would leave the pipeline exactly as it is:
+ * nothing can commit, write back, enter the EXEQ, be scheduled, be issued,
+ * be decoded, or be fetched, and the issue stage would rewrite the latch
+ * order and stall flags it already holds. Since only an EXEQ completion can
+ * break such a state, every cycle before the next completion is idle too.
+ * 
+ * @param p the pipeline
+ * @return the number of idle cycles that can be skipped
+ */
+uint64_t pipe_idle_cycles(Pipeline *p)
+{
+    // Single-cycle execution has no countdown to skip ahead on.
+    if (p->config.load_exe_cycles == 1 || p->halt || p->num_ex > 0)
+    {
+        return 0;
+    }
+
+    // Commit
+    if (rob_check_head(p->rob))
+    {
+        return 0;
+    }
+
+    // Execute
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (p->SC_latch[i].valid)
+        {
+            return 0;
+        }
+    }
+
+    // Schedule
+    int j = rob_find_oldest_pending(p->rob, p->config.sched_policy != SCHED_IN_ORDER);
+    if (j != -1 && rob_check_operands_ready(p->rob, j))
+    {
+        return 0;
+    }
+
+    // Issue: the latches must already be sorted, and every valid latch must
+    // be stalled the way the issue stage would stall it.
+    for (unsigned int i = 0; i + 1 < p->config.pipe_width; i++)
+    {
+        if (inst_num_before(p->ID_latch[i + 1].inst.inst_num,
+                            p->ID_latch[i].inst.inst_num))
+        {
+            return 0;
+        }
+    }
+    bool rob_full = !rob_check_space(p->rob);
+    bool prev_ID_stall = false;
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        bool stall = prev_ID_stall;
+        if (!stall && p->ID_latch[i].valid)
+        {
+            if (!rob_full)
+            {
+                return 0;
+            }
+            stall = true;
+            prev_ID_stall = true;
+        }
+        if (p->ID_latch[i].stall != stall)
+        {
+            return 0;
+        }
+    }
+
+    // Decode
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (!p->ID_latch[i].stall && !p->ID_latch[i].valid)
+        {
+            for (unsigned int k = 0; k < p->config.pipe_width; k++)
+            {
+                if (p->FE_latch[k].valid &&
+                    p->FE_latch[k].inst.inst_num == (uint32_t)p->next_inst_num)
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    // Fetch: once the trace has ended, fetching again changes nothing.
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (!p->FE_latch[i].stall && !p->FE_latch[i].valid && !p->trace_done)
+        {
+            return 0;
+        }
+    }
+
+    // Everything up to the cycle of the next completion is idle.
+    unsigned int to_done = exeq_cycles_to_next_done(p->exeq);
+    return to_done > 0 ? to_done - 1 : 0;
+}
+
+/**
+ * Advance a pipeline through idle cycles without simulating them.
+ * 
+ * @param p the pipeline
+ * @param cycles the number of cycles to skip
+ */
+void pipe_skip_cycles(Pipeline *p, uint64_t cycles)
+{
+    p->stat_num_cycle += cycles;
+    exeq_skip_cycles(p->exeq, cycles);
+
+    // Every skipped cycle would have stopped committing, and ended, in the
+    // state the pipeline is in now.
+    p->stat_stall_slots[pipe_stall_reason(p)] += cycles * p->config.pipe_width;
+    pipe_count_occupancy(p, cycles);
+
+    // An idle issue stage holding an instruction is stalled on a full ROB.
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (p->ID_latch[i].valid)
+        {
+            p->stat_rob_stall_cycles += cycles;
+            break;
+        }
+    }
 }
 
 /**
@@ -288,40 +544,73 @@ void pipe_cycle(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_fetch(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_fetch(Pipeline *p)
 {
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    const unsigned int width = kernel_width<W>(p);
+
+    for (unsigned int i = 0; i < width; i++)
     {
         if (!p->FE_latch[i].stall && !p->FE_latch[i].valid)
         {
             // No stall and latch empty, so fetch a new instruction.
             pipe_fetch_inst(p, &p->FE_latch[i]);
+            if (T && p->FE_latch[i].valid)
+            {
+                lifetrace_fetch(p->lifetrace, p->FE_latch[i].inst.inst_num,
+                                p->last_inst_num, p->stat_num_cycle);
+            }
         }
     }
 }
 
+/**
+ * Simulate one cycle of the fetch stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_fetch(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
+    {
+        pipe_stage_fetch<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_fetch<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
+    }
+}
+
 /**
  * Simulate one cycle of the instruction decode stage of a pipeline.
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_decode(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_decode(Pipeline *p)
 {
-    static uint64_t next_inst_num = 1;
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    const unsigned int width = kernel_width<W>(p);
+
+    for (unsigned int i = 0; i < width; i++)
     {
         if (!p->ID_latch[i].stall && !p->ID_latch[i].valid)
         {
             // No stall and latch empty, so decode the next instruction.
             // Loop to find the next in-order instruction.
-            for (unsigned int j = 0; j < PIPE_WIDTH; j++)
+            for (unsigned int j = 0; j < width; j++)
             {
                 if (p->FE_latch[j].valid &&
-                    p->FE_latch[j].inst.inst_num == next_inst_num)
+                    p->FE_latch[j].inst.inst_num == (uint32_t)p->next_inst_num)
                 {
                     p->ID_latch[i] = p->FE_latch[j];
                     p->FE_latch[j].valid = false;
-                    next_inst_num++;
+                    p->next_inst_num++;
+                    if (T)
+                    {
+                        lifetrace_stamp(p->lifetrace, p->ID_latch[i].inst.inst_num,
+                                        LIFETRACE_DECODE, p->stat_num_cycle);
+                    }
                     break;
                 }
             }
@@ -329,22 +618,48 @@ void pipe_cycle_decode(Pipeline *p)
     }
 }
 
+/**
+ * Simulate one cycle of the decode stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_decode(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
+    {
+        pipe_stage_decode<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_decode<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
+    }
+}
+
 /**
  * Simulate one cycle of the execute stage of a pipeline. This handles
  * instructions that take multiple cycles to execute.
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_exe(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_exe(Pipeline *p)
 {
+    const unsigned int width = kernel_width<W>(p);
+
     // If all operations are single-cycle, copy SC latches to EX latches.
-    if (LOAD_EXE_CYCLES == 1)
+    if (p->config.load_exe_cycles == 1)
     {
-        for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+        for (unsigned int i = 0; i < width; i++)
         {
             if (p->SC_latch[i].valid)
             {
-                p->EX_latch[i] = p->SC_latch[i];
+                if (T)
+                {
+                    lifetrace_stamp(p->lifetrace, p->SC_latch[i].inst.inst_num,
+                                    LIFETRACE_EXE_DONE, p->stat_num_cycle);
+                }
+                p->EX_latch[p->num_ex++] = p->SC_latch[i];
                 p->SC_latch[i].valid = false;
             }
         }
@@ -353,17 +668,11 @@ void pipe_cycle_exe(Pipeline *p)
 
     // Otherwise, we need to handle multi-cycle instructions with EXEQ.
     // All valid entries from the SC latches are inserted into the EXEQ.
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < width; i++)
     {
         if (p->SC_latch[i].valid)
         {
-            if (!exeq_insert(p->exeq, p->SC_latch[i].inst))
-            {
-                fprintf(stderr, "Error: EXEQ full\n");
-                p->halt = true;
-                return;
-            }
-
+            exeq_insert(p->exeq, &p->SC_latch[i].inst);
             p->SC_latch[i].valid = false;
         }
     }
@@ -372,11 +681,35 @@ void pipe_cycle_exe(Pipeline *p)
     exeq_cycle(p->exeq);
 
     // Transfer all finished entries from the EXEQ to the EX latch.
-    for (unsigned int i = 0; i < MAX_WRITEBACKS && exeq_check_done(p->exeq); i++)
+    while (p->num_ex < MAX_WRITEBACKS && exeq_check_done(p->exeq))
+    {
+        PipelineLatch *ex_latch = &p->EX_latch[p->num_ex++];
+        ex_latch->valid = true;
+        ex_latch->stall = false;
+        ex_latch->inst = p->rob->insts[exeq_remove(p->exeq)];
+        if (T)
+        {
+            lifetrace_stamp(p->lifetrace, ex_latch->inst.inst_num,
+                            LIFETRACE_EXE_DONE, p->stat_num_cycle);
+        }
+    }
+}
+
+/**
+ * Simulate one cycle of the execute stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_exe(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
     {
-        p->EX_latch[i].valid = true;
-        p->EX_latch[i].stall = false;
-        p->EX_latch[i].inst = exeq_remove(p->exeq);
+        pipe_stage_exe<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_exe<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
     }
 }
 
@@ -386,15 +719,19 @@ void pipe_cycle_exe(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_issue(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_issue(Pipeline *p)
 {
+    const unsigned int width = kernel_width<W>(p);
+
     // Perform a bubble sort on the instructions in the ID latch array.
     // This sorts the instructions by their instruction number in ascending order to ensure that instructions are processed in the correct order
-    for (unsigned int i = 0; i < PIPE_WIDTH - 1; i++) 
+    for (unsigned int i = 0; i < width - 1; i++) 
     {
-        for (unsigned int j = 0; j < PIPE_WIDTH - i - 1; j++) 
+        for (unsigned int j = 0; j < width - i - 1; j++) 
         {
-            if ((p->ID_latch[j].inst.inst_num > p->ID_latch[j + 1].inst.inst_num)) 
+            if (inst_num_before(p->ID_latch[j + 1].inst.inst_num,
+                                p->ID_latch[j].inst.inst_num))
             {
                 PipelineLatchStruct temp = p->ID_latch[j];
                 p->ID_latch[j] = p->ID_latch[j + 1];
@@ -406,7 +743,7 @@ void pipe_cycle_issue(Pipeline *p)
     // Flag to indicate whether the previous cycle had a stall in the ID stage.
     bool prev_ID_stall = false;
 
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    for (unsigned int i = 0; i < width; i++)
     {
         p->ID_latch[i].stall = prev_ID_stall;
         if (p->ID_latch[i].stall == true) 
@@ -418,52 +755,64 @@ void pipe_cycle_issue(Pipeline *p)
             if (rob_check_space(p->rob)) 
             {
                 // Checks if there is space in rob, and inserts if there is space
-                int idx = rob_insert(p->rob, p->ID_latch[i].inst);
+                int idx = rob_insert(p->rob, &p->ID_latch[i].inst);
                 
                 if (idx != -1) {
                     // Setting the entry invalid if the inst is added into the ROB
                     p->ID_latch[i].valid = false;
+                    if (T)
+                    {
+                        lifetrace_stamp(p->lifetrace, p->ID_latch[i].inst.inst_num,
+                                        LIFETRACE_ISSUE, p->stat_num_cycle);
+                    }
 
                     // Checking if src1 is ready, and labelling the tag accordingly
-                    if (p->rob->entries[idx].inst.src1_reg != -1) 
+                    if (p->rob->insts[idx].src1_reg != -1) 
                     {
-                        p->rob->entries[idx].inst.src1_tag = rat_get_remap(p->rat, p->rob->entries[idx].inst.src1_reg);
-                        if (p->rob->entries[idx].inst.src1_tag == -1 || rob_check_ready(p->rob, p->rob->entries[idx].inst.src1_tag)) 
+                        p->rob->insts[idx].src1_tag = rat_get_remap(p->rat, p->rob->insts[idx].src1_reg);
+                        if (p->rob->insts[idx].src1_tag == -1 || rob_check_ready(p->rob, p->rob->insts[idx].src1_tag)) 
                         {
-                            p->rob->entries[idx].inst.src1_ready = true;
+                            p->rob->insts[idx].src1_ready = true;
                         }
                         else 
                         {
-                            p->rob->entries[idx].inst.src1_ready = false;
+                            p->rob->insts[idx].src1_ready = false;
+                            // Wait on the producer's writeback
+                            rob_add_consumer(p->rob, p->rob->insts[idx].src1_tag, idx, 0);
                         }
                     }
 
                     // Checking if src2 is ready, and labelling the tag accordingly
-                    if (p->rob->entries[idx].inst.src2_reg != -1) 
+                    if (p->rob->insts[idx].src2_reg != -1) 
                     {
-                        p->rob->entries[idx].inst.src2_tag = rat_get_remap(p->rat, p->rob->entries[idx].inst.src2_reg);
-                        if (p->rob->entries[idx].inst.src2_tag == -1 || rob_check_ready(p->rob, p->rob->entries[idx].inst.src2_tag)) 
+                        p->rob->insts[idx].src2_tag = rat_get_remap(p->rat, p->rob->insts[idx].src2_reg);
+                        if (p->rob->insts[idx].src2_tag == -1 || rob_check_ready(p->rob, p->rob->insts[idx].src2_tag)) 
                         {
-                            p->rob->entries[idx].inst.src2_ready = true;
+                            p->rob->insts[idx].src2_ready = true;
                         }
                         else 
                         {
-                            p->rob->entries[idx].inst.src2_ready = false;
+                            p->rob->insts[idx].src2_ready = false;
+                            // Wait on the producer's writeback
+                            rob_add_consumer(p->rob, p->rob->insts[idx].src2_tag, idx, 1);
                         }
                     }
 
+                    rob_update_ready(p->rob, idx);
+
                     // Register renaming
-                    p->rob->entries[idx].inst.dr_tag = idx; 
+                    p->rob->insts[idx].dr_tag = idx; 
                     // If this instruction writes to a register, update the RAT accordingly.
-                    if (p->rob->entries[idx].inst.dest_reg != -1) 
+                    if (p->rob->insts[idx].dest_reg != -1) 
                     {
-                        rat_set_remap(p->rat, p->rob->entries[idx].inst.dest_reg, p->rob->entries[idx].inst.dr_tag);
+                        rat_set_remap(p->rat, p->rob->insts[idx].dest_reg, p->rob->insts[idx].dr_tag);
                     }       
                 }
             }
             else 
             {
                 p->ID_latch[i].stall = true;
+                p->stat_rob_stall_cycles++;
             }
             // to avoid further loops until stall is resolved
             prev_ID_stall = p->ID_latch[i].stall;
@@ -471,92 +820,94 @@ void pipe_cycle_issue(Pipeline *p)
     }    
 }
 
+/**
+ * Simulate one cycle of the issue stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_issue(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
+    {
+        pipe_stage_issue<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_issue<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
+    }
+}
+
 /**
  * Simulate one cycle of the scheduling stage of a pipeline: schedule
  * instructions to execute if they are ready.
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_schedule(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_schedule(Pipeline *p)
 {
-    // In-order scheduling
-    if (SCHED_POLICY == SCHED_IN_ORDER)
-    {        
-        for (unsigned int i = 0; i < PIPE_WIDTH; i++) 
+    const unsigned int width = kernel_width<W>(p);
+
+    // The oldest candidates are found through the ROB's scheduling bitsets:
+    // in-order scheduling considers the oldest entry that is not already
+    // executing and stops if it is stalled, while out-of-order scheduling
+    // considers the oldest entry that has both source operands ready.
+    bool in_order = (kernel_policy<P>(p) == SCHED_IN_ORDER);
+    for (unsigned int i = 0; i < width; i++) 
+    {
+        int j = rob_find_oldest_pending(p->rob, !in_order);
+        if (j == -1 || !rob_check_operands_ready(p->rob, j)) 
         {
-            int j = p->rob->head_ptr;
-            do 
+            // Stop scheduling instructions
+            for (; i < width; i++)
             {
-                // Find the oldest valid entry in the ROB that is not already executing
-                if (p->rob->entries[j].valid == true && p->rob->entries[j].exec == false) 
-                {
-                    // Check if it is stalled
-                    bool src1_ready = (p->rob->entries[j].inst.src1_reg == -1 || p->rob->entries[j].inst.src1_ready);
-                    bool src2_ready = (p->rob->entries[j].inst.src2_reg == -1 || p->rob->entries[j].inst.src2_ready);
-                    if(src1_ready == false || src2_ready == false) 
-                    {
-                        // Stop scheduling instructions
-                        p->SC_latch[i].valid = false;
-                    }
-                    else 
-                    {
-                        // Send it to the next latch
-                        rob_mark_exec(p->rob, p->rob->entries[j].inst);
-                        p->SC_latch[i].inst = p->rob->entries[j].inst;
-                        p->SC_latch[i].valid = true;
-                    }
-                    // Go to next lane once oldest entry is found
-                    break;
-                }
-                j = (j + 1) % NUM_ROB_ENTRIES;
-            } while(j != p->rob->tail_ptr);
+                p->SC_latch[i].valid = false;
+            }
+            break;
         }
-    }
 
-    // Out-of-order scheduling
-    if (SCHED_POLICY == SCHED_OUT_OF_ORDER)
-    {
-        for (unsigned int i = 0; i < PIPE_WIDTH; i++) 
+        // Send it to the next latch
+        rob_mark_exec(p->rob, &p->rob->insts[j]);
+        p->SC_latch[i].inst = p->rob->insts[j];
+        p->SC_latch[i].valid = true;
+        if (T)
         {
-            int j = p->rob->head_ptr;
-            do 
-            {
-                // Find the oldest valid entry in the ROB that has both source operands ready but is not already executing
-                if (p->rob->entries[j].valid == true && p->rob->entries[j].exec == false) 
-                {
-                    // Check if it is stalled
-                    bool src1_ready = (p->rob->entries[j].inst.src1_reg == -1 || p->rob->entries[j].inst.src1_ready);
-                    bool src2_ready = (p->rob->entries[j].inst.src2_reg == -1 || p->rob->entries[j].inst.src2_ready);
-                    if(src1_ready == false || src2_ready == false) 
-                    {
-                        // Stop scheduling instructions
-                        p->SC_latch[i].valid = false;
-                    }
-                    else 
-                    {
-                        // Send it to the next latch
-                        rob_mark_exec(p->rob, p->rob->entries[j].inst);
-                        p->SC_latch[i].inst = p->rob->entries[j].inst;
-                        p->SC_latch[i].valid = true;
-                        // Go to next lane once oldest entry that is ready is found
-                        break;
-                    }
-                }
-                j = (j + 1) % NUM_ROB_ENTRIES;
-            } while(j != p->rob->tail_ptr);
+            lifetrace_stamp(p->lifetrace, p->SC_latch[i].inst.inst_num,
+                            LIFETRACE_SCHEDULE, p->stat_num_cycle);
         }
     }
 }
 
+/**
+ * Simulate one cycle of the scheduling stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_schedule(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
+    {
+        pipe_stage_schedule<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_schedule<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
+    }
+}
+
 /**
  * Simulate one cycle of the writeback stage of a pipeline: update the ROB
  * with information from instructions that have finished executing.
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_writeback(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_writeback(Pipeline *p)
 {
-    for (unsigned int i = 0; i < MAX_WRITEBACKS; i++) 
+    // Only the first num_ex latches hold completed instructions.
+    for (unsigned int i = 0; i < p->num_ex; i++) 
     {
         // For every valid instruction
         if (p->EX_latch[i].stall == false && p->EX_latch[i].valid == true) 
@@ -564,10 +915,34 @@ void pipe_cycle_writeback(Pipeline *p)
             // Broadcast the result to all ROB entries
             rob_wakeup(p->rob, p->EX_latch[i].inst.dr_tag);
             // Mark the instruction ready to commit
-            rob_mark_ready(p->rob, p->EX_latch[i].inst);
+            rob_mark_ready(p->rob, &p->EX_latch[i].inst);
             p->EX_latch[i].valid = false;
+            if (T)
+            {
+                lifetrace_stamp(p->lifetrace, p->EX_latch[i].inst.inst_num,
+                                LIFETRACE_WRITEBACK, p->stat_num_cycle);
+            }
         }
     }
+    p->num_ex = 0;
+}
+
+/**
+ * Simulate one cycle of the writeback stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_writeback(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
+    {
+        pipe_stage_writeback<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_writeback<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
+    }
 }
 
 /**
@@ -576,20 +951,31 @@ void pipe_cycle_writeback(Pipeline *p)
  * 
  * @param p the pipeline to simulate
  */
-void pipe_cycle_commit(Pipeline *p)
+template <unsigned int W, int P, bool T>
+static inline void pipe_stage_commit(Pipeline *p)
 {
-    for (unsigned int i = 0; i < PIPE_WIDTH; i++)
+    const unsigned int width = kernel_width<W>(p);
+
+    unsigned int committed = 0;
+    for (unsigned int i = 0; i < width; i++)
     {
         // Check if the instruction at the head of the ROB is ready to commit
         if (rob_check_head(p->rob))
         {
+            committed++;
             // Remove head from the rob
             InstInfo headEntry = rob_remove_head(p->rob);
             // Commit that instruction
-            pipe_commit_inst(p, headEntry);
+            pipe_commit_inst(p, &headEntry);
+            if (T && lifetrace_commit(p->lifetrace, &headEntry, p->stat_num_cycle))
+            {
+                // The window is over, so carry on with the untraced kernel.
+                p->cycle_fn = pipe_select_kernel(p->config.pipe_width,
+                                                 p->config.sched_policy, false);
+            }
             // Update rat
-            int idx = rat_get_remap(p->rat, headEntry.dest_reg);
-            if (idx == headEntry.dr_tag) 
+            if (headEntry.dest_reg != -1 &&
+                rat_get_remap(p->rat, headEntry.dest_reg) == headEntry.dr_tag)
             {
                 rat_reset_entry(p->rat, headEntry.dest_reg);
             }
@@ -603,4 +989,137 @@ void pipe_cycle_commit(Pipeline *p)
             }
         }
     }
+
+    // Charge the slots left over to whatever holds up the head.
+    if (committed < width)
+    {
+        p->stat_stall_slots[pipe_stall_reason(p)] += width - committed;
+    }
+}
+
+/**
+ * Simulate one cycle of the commit stage of a pipeline with the generic
+ * kernel.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle_commit(Pipeline *p)
+{
+    if (p->lifetrace != NULL)
+    {
+        pipe_stage_commit<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>(p);
+    }
+    else
+    {
+        pipe_stage_commit<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>(p);
+    }
+}
+
+/**
+ * Simulate one cycle of all stages of a pipeline, with the width and
+ * scheduling policy fixed at compile time unless they are PIPE_ANY_WIDTH and
+ * PIPE_ANY_POLICY. If T is true, every stage also stamps the instructions it
+ * processes into the pipeline's lifecycle tracer.
+ * 
+ * @param p the pipeline to simulate
+ */
+template <unsigned int W, int P, bool T>
+static void pipe_kernel(Pipeline *p)
+{
+    p->stat_num_cycle++;
+
+    #ifdef DEBUG
+        printf("\n--------------------------------------------\n");
+        printf("Cycle count: %lu, retired instructions: %lu\n\n",
+           (unsigned long)p->stat_num_cycle,
+           (unsigned long)p->stat_retired_inst);
+    #endif
+    
+    // In our simulator, stages are processed in reverse order.
+    PROF_STAGE(PROF_COMMIT, pipe_stage_commit<W, P, T>(p));
+    PROF_STAGE(PROF_WRITEBACK, pipe_stage_writeback<W, P, T>(p));
+    PROF_STAGE(PROF_EXE, pipe_stage_exe<W, P, T>(p));
+    PROF_STAGE(PROF_SCHEDULE, pipe_stage_schedule<W, P, T>(p));
+    PROF_STAGE(PROF_ISSUE, pipe_stage_issue<W, P, T>(p));
+    PROF_STAGE(PROF_DECODE, pipe_stage_decode<W, P, T>(p));
+    PROF_STAGE(PROF_FETCH, pipe_stage_fetch<W, P, T>(p));
+
+    pipe_count_occupancy(p, 1);
+
+    // Compile with "make debug" to have this show!
+    #ifdef DEBUG
+        pipe_print_state(p);
+    #endif
+}
+
+/**
+ * Pick the pipe_cycle kernel for a configuration: a specialized kernel for
+ * the widths and policies that have one, the generic kernel otherwise.
+ * 
+ * @param width the width of the pipeline
+ * @param policy the scheduling policy of the pipeline
+ * @param traced whether the kernel stamps the pipeline's lifecycle tracer
+ * @return the kernel to simulate cycles with
+ */
+static PipeCycleFn pipe_select_kernel(unsigned int width, SchedulingPolicy policy,
+                                      bool traced)
+{
+    static const PipeCycleFn kernels[2][4][NUM_SCHED_POLICIES] = {
+        {
+            {pipe_kernel<1, SCHED_IN_ORDER, false>, pipe_kernel<1, SCHED_OUT_OF_ORDER, false>},
+            {pipe_kernel<2, SCHED_IN_ORDER, false>, pipe_kernel<2, SCHED_OUT_OF_ORDER, false>},
+            {pipe_kernel<4, SCHED_IN_ORDER, false>, pipe_kernel<4, SCHED_OUT_OF_ORDER, false>},
+            {pipe_kernel<8, SCHED_IN_ORDER, false>, pipe_kernel<8, SCHED_OUT_OF_ORDER, false>},
+        },
+        {
+            {pipe_kernel<1, SCHED_IN_ORDER, true>, pipe_kernel<1, SCHED_OUT_OF_ORDER, true>},
+            {pipe_kernel<2, SCHED_IN_ORDER, true>, pipe_kernel<2, SCHED_OUT_OF_ORDER, true>},
+            {pipe_kernel<4, SCHED_IN_ORDER, true>, pipe_kernel<4, SCHED_OUT_OF_ORDER, true>},
+            {pipe_kernel<8, SCHED_IN_ORDER, true>, pipe_kernel<8, SCHED_OUT_OF_ORDER, true>},
+        },
+    };
+
+    int w;
+    switch (width)
+    {
+    case 1:
+        w = 0;
+        break;
+    case 2:
+        w = 1;
+        break;
+    case 4:
+        w = 2;
+        break;
+    case 8:
+        w = 3;
+        break;
+    default:
+        return traced ? pipe_kernel<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, true>
+                      : pipe_kernel<PIPE_ANY_WIDTH, PIPE_ANY_POLICY, false>;
+    }
+    return kernels[traced][w][policy];
+}
+
+/**
+ * Attach a lifecycle tracer to a pipeline, or detach it.
+ * 
+ * @param p the pipeline
+ * @param t the tracer, or NULL
+ */
+void pipe_set_lifetrace(Pipeline *p, struct LifetraceStruct *t)
+{
+    p->lifetrace = t;
+    p->cycle_fn = pipe_select_kernel(p->config.pipe_width, p->config.sched_policy,
+                                     t != NULL);
+}
+
+/**
+ * Simulate one cycle of all stages of a pipeline.
+ * 
+ * @param p the pipeline to simulate
+ */
+void pipe_cycle(Pipeline *p)
+{
+    p->cycle_fn(p);
 }
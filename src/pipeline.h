@@ -9,7 +9,9 @@
 #include "rat.h"
 #include "rob.h"
 #include "exeq.h"
+#include "source.h"
 #include <inttypes.h>
+#include <stdio.h>
 
 /**
  * The maximum allowed width of the pipeline.
@@ -30,6 +32,68 @@ typedef enum SchedulingPolicyEnum
     NUM_SCHED_POLICIES
 } SchedulingPolicy;
 
+/**
+ * Why a commit slot went unused, judged by the state of the ROB when the
+ * commit stage stops. The head of the ROB never waits on its operands, as
+ * their producers are older and have committed, so time spent waiting on
+ * operands shows up as the latency of the producer that was at the head.
+ * A full ROB is not a reason of its own: it is a symptom of whatever holds
+ * up the head, and is counted on the issue side in stat_rob_stall_cycles.
+ */
+typedef enum StallReasonEnum
+{
+    STALL_FRONTEND, // The ROB is empty: nothing has been delivered to commit.
+    STALL_SCHEDULE, // The head has been issued but not yet scheduled.
+    STALL_LOAD,     // The head is a load that is still executing.
+    STALL_EXECUTE,  // The head is another instruction still executing.
+    NUM_STALL_REASONS
+} StallReason;
+
+/** The name of each StallReason, as printed in the statistics. */
+extern const char *const STALL_REASON_NAMES[NUM_STALL_REASONS];
+
+/**
+ * A complete set of the tunable parameters of a pipeline.
+ *
+ * Every pipeline keeps its own copy, so pipelines with different
+ * configurations can be simulated side by side, on one thread or several.
+ */
+typedef struct PipelineConfigStruct
+{
+    /**
+     * The width of the pipeline; that is, the maximum number of instructions
+     * that can be processed during any given cycle in each of the issue,
+     * schedule, and commit stages of the pipeline.
+     *
+     * When the width is 1, the pipeline is scalar.
+     * When the width is greater than 1, the pipeline is superscalar.
+     */
+    uint32_t pipe_width;
+    /**
+     * The number of entries in the ROB; that is, the maximum number of
+     * instructions that can be stored in the ROB at any given time.
+     */
+    uint32_t num_rob_entries;
+    /** The number of cycles an LD instruction takes to execute. */
+    uint32_t load_exe_cycles;
+    /** Whether to use in-order or out-of-order scheduling. */
+    SchedulingPolicy sched_policy;
+    /**
+     * The way the ROB wakes up waiting instructions. This is a choice of host
+     * algorithm and does not change the simulated results.
+     */
+    WakeupEngine wakeup_engine;
+} PipelineConfig;
+
+struct Pipeline;
+struct TelemetryStruct;
+struct LifetraceStruct;
+
+/**
+ * A function simulating one cycle of all stages of a pipeline.
+ */
+typedef void (*PipeCycleFn)(struct Pipeline *p);
+
 /**
  * One of the latches in the pipeline. Each one of these can contain one
  * instruction to be processed by the next pipeline stage.
@@ -59,6 +123,11 @@ typedef struct PipelineLatchStruct
  */
 typedef struct Pipeline
 {
+    /**
+     * The configuration the pipeline was initialized with.
+     */
+    PipelineConfig config;
+
     /**
      * The pipeline latch holding fetched instructions.
      */
@@ -76,9 +145,17 @@ typedef struct Pipeline
 
     /**
      * The pipeline latch holding instructions that have completed execution.
+     * 
+     * Completed instructions are packed densely from index 0; only the first
+     * num_ex entries are in use.
      */
     PipelineLatch EX_latch[MAX_WRITEBACKS];
 
+    /**
+     * The number of instructions in EX_latch waiting for writeback.
+     */
+    unsigned int num_ex;
+
     /**
      * The re-order buffer, containing instructions that have been issued but
      * have not yet been committed.
@@ -106,31 +183,166 @@ typedef struct Pipeline
      */
     uint64_t stat_num_cycle;
 
-    /** [Internal] The file descriptor from which to read trace records. */
-    int trace_fd;
-    /** [Internal] The last inst_num assigned. */
+    /**
+     * The number of cycles in which the issue stage stalled because the ROB
+     * was full.
+     */
+    uint64_t stat_rob_stall_cycles;
+
+    /**
+     * The number of commit slots left unused for each StallReason. With one
+     * slot per retired instruction, they add up to pipe_width slots per
+     * cycle.
+     */
+    uint64_t stat_stall_slots[NUM_STALL_REASONS];
+
+    /**
+     * The number of cycles that ended with each number of instructions, from
+     * 0 to num_rob_entries, in the ROB.
+     */
+    uint64_t *stat_rob_occupancy;
+
+    /**
+     * The number of cycles that ended with each number of instructions, from
+     * 0 to num_rob_entries, executing in the EXEQ.
+     */
+    uint64_t *stat_exeq_occupancy;
+
+    /** [Internal] The source from which to fetch instructions. */
+    InstSource *src;
+    /** [Internal] The last inst_num assigned, before wrapping to 32 bits. */
     uint64_t last_inst_num;
-    /** [Internal] The inst_num of the last instruction in the trace. */
+    /**
+     * [Internal] The fingerprint of the first CKPT_FINGERPRINT_INSTS
+     * instructions fetched, which checkpoints record.
+     */
+    uint64_t trace_fingerprint;
+    /**
+     * [Internal] The inst_num the decode stage should pass on next, before
+     * wrapping to 32 bits.
+     */
+    uint64_t next_inst_num;
+    /** [Internal] The number of instructions in the trace, once known. */
     uint64_t halt_inst_num;
+    /** [Internal] The inst_num of the last instruction retired. */
+    uint32_t last_retired_inst_num;
     /** [Internal] Whether the pipeline is done. */
     bool halt;
+    /** [Internal] Whether the source has reported the end of the trace. */
+    bool trace_done;
+    /**
+     * [Internal] The kernel pipe_cycle runs, specialized for the width and
+     * scheduling policy the pipeline was initialized with.
+     */
+    PipeCycleFn cycle_fn;
+
+    /**
+     * Whether run_pipeline may fast-forward through cycles in which only the
+     * EXEQ makes progress. This does not change the simulated results.
+     */
+    bool skip_idle;
+
+    /**
+     * The telemetry channel run_pipeline records periodic snapshots of this
+     * pipeline to, or NULL.
+     */
+    struct TelemetryStruct *telemetry;
+
+    /**
+     * [Internal] The lifecycle tracer the stages stamp instructions into, or
+     * NULL; set with pipe_set_lifetrace.
+     */
+    struct LifetraceStruct *lifetrace;
 } Pipeline;
 
+/**
+ * Populate a configuration with the defaults: a scalar out-of-order pipeline
+ * with a 32-entry ROB and 4-cycle loads.
+ *
+ * @param config the configuration to populate
+ */
+void pipe_default_config(PipelineConfig *config);
+
 /**
  * Allocate and initialize a new pipeline.
  * 
- * @param trace_fd the file descriptor from which to read trace records
- * @return a pointer to a newly allocated pipeline
+ * @param config the configuration of the pipeline, which is copied
+ * @param src the source from which to fetch instructions
+ * @return a pointer to a newly allocated pipeline, or NULL if it could not be
+ *         allocated (an error has been printed)
+ */
+Pipeline *pipe_init(const PipelineConfig *config, InstSource *src);
+
+/**
+ * Free a pipeline along with its ROB, RAT, and EXEQ. The pipeline's source is
+ * not freed.
+ * 
+ * @param p the pipeline to free
+ */
+void pipe_free(Pipeline *p);
+
+/**
+ * Write the state of a pipeline, including its ROB, RAT, and EXEQ, to a
+ * checkpoint.
+ * 
+ * @param p the pipeline
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool pipe_save(Pipeline *p, FILE *f);
+
+/**
+ * Read the state of a pipeline from a checkpoint written by pipe_save. The
+ * pipeline must be freshly initialized with the configuration it was saved
+ * with.
+ * 
+ * @param p the pipeline to overwrite
+ * @param f the checkpoint being read
+ * @return true on success
  */
-Pipeline *pipe_init(int trace_fd);
+bool pipe_load(Pipeline *p, FILE *f);
+
+/**
+ * Attach a lifecycle tracer to a pipeline, or detach it. While a tracer is
+ * attached, pipe_cycle runs kernels that stamp every instruction into it;
+ * once the last instruction of the tracer's window commits, it goes back to
+ * the untraced kernels. The tracer remains owned by the caller.
+ * 
+ * @param p the pipeline
+ * @param t the tracer, or NULL
+ */
+void pipe_set_lifetrace(Pipeline *p, struct LifetraceStruct *t);
 
 /**
  * Simulate one cycle of all stages of a pipeline.
  * 
+ * Widths 1, 2, 4, and 8 run a kernel compiled for that width and the
+ * pipeline's scheduling policy; other widths run the generic stage functions
+ * below.
+ * 
  * @param p the pipeline to simulate
  */
 void pipe_cycle(Pipeline *p);
 
+/**
+ * Find how many of the upcoming cycles of a pipeline are guaranteed to change
+ * nothing but the cycle count and the EXEQ's countdown, because no stage can
+ * make progress before the next EXEQ completion.
+ * 
+ * @param p the pipeline
+ * @return the number of idle cycles that can be skipped, or 0 if the next
+ *         cycle may make progress
+ */
+uint64_t pipe_idle_cycles(Pipeline *p);
+
+/**
+ * Advance a pipeline through idle cycles without simulating them.
+ * 
+ * @param p the pipeline
+ * @param cycles the number of cycles to skip; at most pipe_idle_cycles(p)
+ */
+void pipe_skip_cycles(Pipeline *p, uint64_t cycles);
+
 /**
  * Simulate one cycle of the fetch stage of a pipeline.
  * 
@@ -193,7 +405,7 @@ void pipe_cycle_commit(Pipeline *p);
  * @param p the pipeline to update.
  * @param inst the instruction to commit.
  */
-void pipe_commit_inst(Pipeline *p, InstInfo inst);
+void pipe_commit_inst(Pipeline *p, const InstInfo *inst);
 
 /**
  * Print out the state of the pipeline for debugging purposes.
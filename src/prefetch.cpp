@@ -0,0 +1,319 @@
+// prefetch.cpp
+// Implements the prefetching source.
+//
+// The producer thread decodes batches of instructions straight into the ring
+// and publishes them by advancing head; the consumer hands them out and
+// returns their slots by advancing tail. The two positions are the only
+// shared state on the fast path. A side that finds the ring full or empty
+// sleeps on a condition variable, and the other side only takes the lock to
+// wake it if it has flagged that it is sleeping.
+
+#include "prefetch.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <errno.h>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+
+/** [Internal] The state shared by the producer thread and the consumer. */
+typedef struct PrefetchRingStruct
+{
+    /** The source being prefetched from; only used by the producer. */
+    InstSource *src;
+    /** The ring; instruction n lives in ring[n & mask]. */
+    InstInfo *ring;
+    /** The number of instructions in the ring, minus one. */
+    uint64_t mask;
+
+    /** Keeps head, tail, and the consumer's fields on separate cache lines. */
+    char pad0[64];
+    /** The number of instructions published by the producer. */
+    std::atomic<uint64_t> head;
+    char pad1[64];
+    /** The number of instructions whose slots the consumer has returned. */
+    std::atomic<uint64_t> tail;
+    char pad2[64];
+
+    /** [Consumer] The number of instructions handed out. */
+    uint64_t pos;
+    /** [Consumer] The last value of head seen. */
+    uint64_t limit;
+    /** [Consumer] Whether the end of the trace has been reported. */
+    bool reported;
+
+    /** Set once the producer has published its last instruction. */
+    std::atomic<bool> done;
+    /** How the trace ended; valid once done is set. */
+    SourceStatus end_status;
+    /** The errno of a SOURCE_ERROR; valid once done is set. */
+    int end_errno;
+    /** Set to have the producer exit. */
+    std::atomic<bool> stop;
+
+    /** Protects stats, and is held to wake a sleeping side. */
+    std::mutex lock;
+    /** Signalled when the consumer returns slots or stop is set. */
+    std::condition_variable room;
+    /** Signalled when the producer publishes instructions. */
+    std::condition_variable filled;
+    /** Whether the producer is (about to be) sleeping on room. */
+    std::atomic<bool> producer_waiting;
+    /** Whether the consumer is (about to be) sleeping on filled. */
+    std::atomic<bool> consumer_waiting;
+    /** The counters of src as of the last batch. */
+    SourceStats stats;
+
+    /** The producer thread. */
+    std::thread producer;
+} PrefetchRing;
+
+/**
+ * How long a sleeping side waits before checking the ring again, in case a
+ * wake-up was missed.
+ */
+static const std::chrono::milliseconds PREFETCH_MAX_SLEEP(1);
+
+/**
+ * Fill the ring from the source until the trace ends or the consumer stops.
+ */
+static void prefetch_producer(PrefetchRing *r)
+{
+    uint64_t head = 0;
+    while (!r->stop.load(std::memory_order_acquire))
+    {
+        // Wait until a whole batch fits.
+        uint64_t tail = r->tail.load(std::memory_order_acquire);
+        if (head - tail > r->mask + 1 - PREFETCH_BATCH_INSTS)
+        {
+            std::unique_lock<std::mutex> guard(r->lock);
+            r->producer_waiting.store(true);
+            if (head - r->tail.load() > r->mask + 1 - PREFETCH_BATCH_INSTS &&
+                !r->stop.load())
+            {
+                r->room.wait_for(guard, PREFETCH_MAX_SLEEP);
+            }
+            r->producer_waiting.store(false);
+            continue;
+        }
+
+        unsigned int n = 0;
+        SourceStatus status = SOURCE_OK;
+        for (; n < PREFETCH_BATCH_INSTS; n++)
+        {
+            status = source_next(r->src, &r->ring[(head + n) & r->mask]);
+            if (status != SOURCE_OK)
+            {
+                break;
+            }
+        }
+        if (status != SOURCE_OK)
+        {
+            r->end_status = status;
+            r->end_errno = errno;
+        }
+
+        SourceStats stats;
+        source_get_stats(r->src, &stats);
+        {
+            std::lock_guard<std::mutex> guard(r->lock);
+            r->stats = stats;
+        }
+
+        head += n;
+        r->head.store(head);
+        if (status != SOURCE_OK)
+        {
+            r->done.store(true);
+        }
+        if (r->consumer_waiting.load())
+        {
+            std::lock_guard<std::mutex> guard(r->lock);
+            r->filled.notify_one();
+        }
+        if (status != SOURCE_OK)
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * Return the slots of every instruction handed out so far to the producer.
+ */
+static void prefetch_release_slots(PrefetchRing *r)
+{
+    r->tail.store(r->pos);
+    if (r->producer_waiting.load())
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        r->room.notify_one();
+    }
+}
+
+/**
+ * Wait until the producer has published instructions beyond those handed
+ * out, or has reached the end of the trace.
+ *
+ * @return SOURCE_OK if there are instructions to hand out, otherwise how the
+ *         trace ended (reported once, then SOURCE_EOF)
+ */
+static SourceStatus prefetch_refill(PrefetchRing *r)
+{
+    prefetch_release_slots(r);
+    while (true)
+    {
+        r->limit = r->head.load(std::memory_order_acquire);
+        if (r->limit > r->pos)
+        {
+            return SOURCE_OK;
+        }
+
+        if (r->done.load(std::memory_order_acquire))
+        {
+            r->limit = r->head.load(std::memory_order_acquire);
+            if (r->limit > r->pos)
+            {
+                return SOURCE_OK;
+            }
+            if (r->reported)
+            {
+                return SOURCE_EOF;
+            }
+            r->reported = true;
+            errno = r->end_errno;
+            return r->end_status;
+        }
+
+        std::unique_lock<std::mutex> guard(r->lock);
+        r->consumer_waiting.store(true);
+        if (r->head.load() == r->pos && !r->done.load())
+        {
+            r->filled.wait_for(guard, PREFETCH_MAX_SLEEP);
+        }
+        r->consumer_waiting.store(false);
+    }
+}
+
+/**
+ * Hand out the next prefetched instruction.
+ */
+static SourceStatus prefetch_source_next(InstSource *src, InstInfo *inst)
+{
+    PrefetchRing *r = (PrefetchRing *)src->ctx;
+    if (r->pos == r->limit)
+    {
+        SourceStatus status = prefetch_refill(r);
+        if (status != SOURCE_OK)
+        {
+            return status;
+        }
+    }
+
+    *inst = r->ring[r->pos & r->mask];
+    r->pos++;
+    if ((r->pos & (PREFETCH_BATCH_INSTS - 1)) == 0)
+    {
+        prefetch_release_slots(r);
+    }
+    return SOURCE_OK;
+}
+
+/**
+ * Discard up to n prefetched instructions.
+ */
+static SourceStatus prefetch_source_skip(InstSource *src, uint64_t n,
+                                         uint64_t *skipped)
+{
+    PrefetchRing *r = (PrefetchRing *)src->ctx;
+    *skipped = 0;
+    while (*skipped < n)
+    {
+        if (r->pos == r->limit)
+        {
+            SourceStatus status = prefetch_refill(r);
+            if (status != SOURCE_OK)
+            {
+                return status;
+            }
+        }
+
+        uint64_t count = r->limit - r->pos;
+        if (count > n - *skipped)
+        {
+            count = n - *skipped;
+        }
+        r->pos += count;
+        *skipped += count;
+    }
+    prefetch_release_slots(r);
+    return SOURCE_OK;
+}
+
+/**
+ * Stop the producer thread and free the ring and the underlying source.
+ */
+static void prefetch_source_release(InstSource *src)
+{
+    PrefetchRing *r = (PrefetchRing *)src->ctx;
+    {
+        std::lock_guard<std::mutex> guard(r->lock);
+        r->stop.store(true);
+        r->room.notify_one();
+    }
+    r->producer.join();
+
+    source_free(r->src);
+    free(r->ring);
+    delete r;
+}
+
+/**
+ * Report the counters of the underlying source as of the last batch.
+ */
+static void prefetch_source_stats(InstSource *src, SourceStats *stats)
+{
+    PrefetchRing *r = (PrefetchRing *)src->ctx;
+    std::lock_guard<std::mutex> guard(r->lock);
+    *stats = r->stats;
+}
+
+/**
+ * Create a source that fetches instructions from another source on a
+ * producer thread.
+ *
+ * @param src the source to prefetch from; owned by the new source
+ * @param ring_insts the number of instructions the ring holds
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_prefetch(InstSource *src, unsigned int ring_insts)
+{
+    PrefetchRing *r = new PrefetchRing();
+    r->src = src;
+    r->ring = (InstInfo *)calloc(ring_insts, sizeof(InstInfo));
+    r->mask = ring_insts - 1;
+    r->head = 0;
+    r->tail = 0;
+    r->pos = 0;
+    r->limit = 0;
+    r->reported = false;
+    r->done = false;
+    r->end_status = SOURCE_OK;
+    r->end_errno = 0;
+    r->stop = false;
+    r->producer_waiting = false;
+    r->consumer_waiting = false;
+    r->stats.bytes_read = 0;
+    r->stats.reads = 0;
+    r->stats.read_ns = 0;
+    r->producer = std::thread(prefetch_producer, r);
+
+    InstSource *prefetch_src = (InstSource *)calloc(1, sizeof(InstSource));
+    prefetch_src->next = prefetch_source_next;
+    prefetch_src->skip = prefetch_source_skip;
+    prefetch_src->release = prefetch_source_release;
+    prefetch_src->stats = prefetch_source_stats;
+    prefetch_src->ctx = r;
+    return prefetch_src;
+}
@@ -0,0 +1,38 @@
+// prefetch.h
+// Declares the prefetching source, which reads, decompresses, and decodes a
+// trace on a producer thread, ahead of the pipeline consuming it.
+
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+#include "source.h"
+
+/**
+ * The default number of decoded instructions the producer may run ahead of
+ * the pipeline; a power of two.
+ */
+#define PREFETCH_RING_INSTS 16384
+
+/**
+ * The number of instructions the producer decodes, and the consumer hands
+ * out, between updates of the shared positions in the ring.
+ */
+#define PREFETCH_BATCH_INSTS 256
+
+/**
+ * Create a source that fetches instructions from another source on a
+ * producer thread, through a lock-free single-producer, single-consumer ring
+ * of decoded instructions.
+ *
+ * The new source must only be used from one thread at a time, and src must
+ * not be used by anything else while the new source is alive.
+ *
+ * @param src the source to prefetch from; the new source takes ownership of
+ *            it and frees it when freed
+ * @param ring_insts the number of instructions the ring holds; a power of
+ *                   two no smaller than 2 * PREFETCH_BATCH_INSTS
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_prefetch(InstSource *src, unsigned int ring_insts);
+
+#endif
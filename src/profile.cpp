@@ -0,0 +1,124 @@
+// profile.cpp
+// Implements the host-side stage profiler. Everything here is compiled only
+// when STAGE_PROFILE is defined.
+
+#include "profile.h"
+
+#ifdef STAGE_PROFILE
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+
+thread_local StageProfile *prof_local = NULL;
+
+/** [Internal] Protects prof_threads and the calibration below. */
+static std::mutex prof_lock;
+
+/** [Internal] The counters of every thread that has used the profiler. */
+static StageProfile *prof_threads = NULL;
+
+/** [Internal] The clocks when the first thread registered. */
+static uint64_t prof_start_ticks;
+static std::chrono::steady_clock::time_point prof_start_time;
+
+/** [Internal] The names of the stages, as printed. */
+static const char *const prof_stage_names[NUM_PROF_STAGES] = {
+    "commit", "writeback", "exe", "schedule", "issue", "decode", "fetch",
+};
+
+/**
+ * Allocate the calling thread's counters.
+ *
+ * @return the counters
+ */
+StageProfile *prof_register()
+{
+    StageProfile *prof = (StageProfile *)calloc(1, sizeof(StageProfile));
+
+    std::lock_guard<std::mutex> guard(prof_lock);
+    if (prof_threads == NULL)
+    {
+        prof_start_ticks = prof_ticks();
+        prof_start_time = std::chrono::steady_clock::now();
+    }
+    prof->next = prof_threads;
+    prof_threads = prof;
+    return prof;
+}
+
+/**
+ * Print the totals of every thread's counters to stderr.
+ */
+void prof_report()
+{
+    std::lock_guard<std::mutex> guard(prof_lock);
+    if (prof_threads == NULL)
+    {
+        return;
+    }
+
+    // Sum the threads. Any workers have been joined by now.
+    StageProfile total = {};
+    for (StageProfile *prof = prof_threads; prof != NULL; prof = prof->next)
+    {
+        for (int s = 0; s < NUM_PROF_STAGES; s++)
+        {
+            total.stage_ticks[s] += prof->stage_ticks[s];
+            total.stage_calls[s] += prof->stage_calls[s];
+        }
+        total.rob_searches += prof->rob_searches;
+        total.rob_search_words += prof->rob_search_words;
+        total.rob_wakeups += prof->rob_wakeups;
+        total.rob_wakeup_consumers += prof->rob_wakeup_consumers;
+        total.exeq_checks += prof->exeq_checks;
+        total.exeq_removes += prof->exeq_removes;
+    }
+
+    // Convert ticks to nanoseconds by comparing both clocks over the run.
+    double elapsed_ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - prof_start_time).count();
+    uint64_t elapsed_ticks = prof_ticks() - prof_start_ticks;
+    double ns_per_tick = elapsed_ticks > 0 ? elapsed_ns / elapsed_ticks : 0.0;
+
+    uint64_t total_ticks = 0;
+    for (int s = 0; s < NUM_PROF_STAGES; s++)
+    {
+        total_ticks += total.stage_ticks[s];
+    }
+
+    fprintf(stderr, "\n** STAGE PROFILE (host time, all threads) **\n");
+    fprintf(stderr, "%-10s %14s %12s %9s %7s\n",
+            "stage", "calls", "ms", "ns/call", "share");
+    for (int s = 0; s < NUM_PROF_STAGES; s++)
+    {
+        double ns = total.stage_ticks[s] * ns_per_tick;
+        fprintf(stderr, "%-10s %14lu %12.1f %9.1f %6.1f%%\n",
+                prof_stage_names[s], (unsigned long)total.stage_calls[s],
+                ns / 1e6,
+                total.stage_calls[s] > 0 ? ns / total.stage_calls[s] : 0.0,
+                total_ticks > 0 ? 100.0 * total.stage_ticks[s] / total_ticks
+                                : 0.0);
+    }
+    fprintf(stderr, "%-10s %14s %12.1f\n", "total", "",
+            total_ticks * ns_per_tick / 1e6);
+
+    fprintf(stderr, "ROB oldest-pending searches: %lu, words examined: %lu (%.2f per search)\n",
+            (unsigned long)total.rob_searches,
+            (unsigned long)total.rob_search_words,
+            total.rob_searches > 0
+                ? (double)total.rob_search_words / total.rob_searches
+                : 0.0);
+    fprintf(stderr, "ROB wakeups: %lu, consumers visited: %lu (%.2f per wakeup)\n",
+            (unsigned long)total.rob_wakeups,
+            (unsigned long)total.rob_wakeup_consumers,
+            total.rob_wakeups > 0
+                ? (double)total.rob_wakeup_consumers / total.rob_wakeups
+                : 0.0);
+    fprintf(stderr, "EXEQ completion checks: %lu, entries completed: %lu\n",
+            (unsigned long)total.exeq_checks,
+            (unsigned long)total.exeq_removes);
+}
+
+#endif
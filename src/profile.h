@@ -0,0 +1,132 @@
+// profile.h
+// Declares the host-side stage profiler, which measures where the simulator
+// itself spends its time.
+//
+// The profiler is compiled in only when STAGE_PROFILE is defined (see "make
+// stageprofile"). It times every stage called from pipe_cycle with the
+// time-stamp counter (or steady_clock where there is none) and counts the
+// work done by the ROB and EXEQ searches. Each thread accumulates into its own
+// counters, and the totals over all threads are printed to stderr at exit.
+// Without STAGE_PROFILE every PROF_* macro expands to nothing but the code it
+// wraps.
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <inttypes.h>
+
+/** The stages timed by the profiler, in the order they are printed. */
+typedef enum ProfStageEnum
+{
+    PROF_COMMIT,
+    PROF_WRITEBACK,
+    PROF_EXE,
+    PROF_SCHEDULE,
+    PROF_ISSUE,
+    PROF_DECODE,
+    PROF_FETCH,
+    NUM_PROF_STAGES,
+} ProfStage;
+
+/** The counters of one thread. */
+typedef struct StageProfileStruct
+{
+    /** The host ticks spent in each stage. */
+    uint64_t stage_ticks[NUM_PROF_STAGES];
+    /** The number of calls to each stage. */
+    uint64_t stage_calls[NUM_PROF_STAGES];
+    /** The number of searches for the oldest pending ROB entry. */
+    uint64_t rob_searches;
+    /** The number of bitset words those searches examined. */
+    uint64_t rob_search_words;
+    /** The number of ROB wakeups. */
+    uint64_t rob_wakeups;
+    /** The number of consumers those wakeups visited. */
+    uint64_t rob_wakeup_consumers;
+    /** The number of checks for a finished EXEQ entry. */
+    uint64_t exeq_checks;
+    /** The number of EXEQ entries removed as finished. */
+    uint64_t exeq_removes;
+    /** [Internal] The next thread's counters. */
+    struct StageProfileStruct *next;
+} StageProfile;
+
+#ifdef STAGE_PROFILE
+
+#include <stdlib.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * [Internal] Allocate the calling thread's counters.
+ *
+ * @return the counters, which live until the process exits
+ */
+StageProfile *prof_register();
+
+/** [Internal] The calling thread's counters, or NULL before the first use. */
+extern thread_local StageProfile *prof_local;
+
+/**
+ * Get the calling thread's counters.
+ *
+ * @return the counters
+ */
+static inline StageProfile *prof_get()
+{
+    if (prof_local == NULL)
+    {
+        prof_local = prof_register();
+    }
+    return prof_local;
+}
+
+/**
+ * Read the host clock.
+ *
+ * @return the current time, in ticks
+ */
+static inline uint64_t prof_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * Print the totals of every thread's counters to stderr.
+ */
+void prof_report();
+
+/** Time a call to a stage. */
+#define PROF_STAGE(stage, ...)                                   \
+    do                                                           \
+    {                                                            \
+        uint64_t prof_start = prof_ticks();                      \
+        __VA_ARGS__;                                             \
+        StageProfile *prof = prof_get();                         \
+        prof->stage_ticks[stage] += prof_ticks() - prof_start;   \
+        prof->stage_calls[stage]++;                              \
+    } while (0)
+
+/** Add n to one of the counters. */
+#define PROF_COUNT(counter, n) (prof_get()->counter += (n))
+
+/** Arrange for the profile to be printed when the process exits. */
+#define PROF_REPORT_AT_EXIT() atexit(prof_report)
+
+#else
+
+#define PROF_STAGE(stage, ...) __VA_ARGS__
+#define PROF_COUNT(counter, n) ((void)0)
+#define PROF_REPORT_AT_EXIT() ((void)0)
+
+#endif
+
+#endif
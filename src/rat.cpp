@@ -7,6 +7,7 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "rat.h"
+#include "ckpt.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -25,6 +26,43 @@ RAT *rat_init()
     return rat;
 }
 
+/**
+ * Write the state of the RAT to a checkpoint
+ * 
+ * @param rat the RAT
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool rat_save(RAT *rat, FILE *f)
+{
+    return ckpt_write(f, rat, sizeof(RAT));
+}
+
+/**
+ * Read the state of the RAT from a checkpoint written by rat_save
+ * 
+ * @param rat the RAT to overwrite
+ * @param f the checkpoint being read
+ * @param num_tags the number of ROB entries the RAT may map registers to
+ * @return true on success, false if the checkpoint is truncated or maps a
+ *         register to a tag out of range
+ */
+bool rat_load(RAT *rat, FILE *f, unsigned int num_tags)
+{
+    if (!ckpt_read(f, rat, sizeof(RAT)))
+    {
+        return false;
+    }
+    for (int i = 0; i < MAX_ARF_REGS; i++)
+    {
+        if (rat->entries[i].valid && rat->entries[i].prf_id >= num_tags)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * Print out the state of the RAT for debugging purposes
  * 
@@ -5,6 +5,7 @@
 #define _RAT_H_
 
 #include <inttypes.h>
+#include <stdio.h>
 
 /** The number of registers in the architecture as defined by the ISA. */
 #define MAX_ARF_REGS 32
@@ -48,6 +49,26 @@ typedef struct RAT
  */
 RAT *rat_init();
 
+/**
+ * Write the state of the RAT to a checkpoint
+ * 
+ * @param rat the RAT
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool rat_save(RAT *rat, FILE *f);
+
+/**
+ * Read the state of the RAT from a checkpoint written by rat_save
+ * 
+ * @param rat the RAT to overwrite
+ * @param f the checkpoint being read
+ * @param num_tags the number of ROB entries the RAT may map registers to
+ * @return true on success, false if the checkpoint is truncated or maps a
+ *         register to a tag out of range
+ */
+bool rat_load(RAT *rat, FILE *f, unsigned int num_tags);
+
 /**
  * Print out the state of the RAT for debugging purposes
  * 
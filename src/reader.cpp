@@ -0,0 +1,233 @@
+// reader.cpp
+// Implements the block-buffered TraceReader.
+
+#include "reader.h"
+#include "rat.h"
+#include <chrono>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** [Internal] Read from the descriptor of a plain stream. */
+static ssize_t fd_stream_read(ByteStream *stream, void *buf, size_t n)
+{
+    return read((int)(intptr_t)stream->ctx, buf, n);
+}
+
+/** [Internal] Close the descriptor of a plain stream and free it. */
+static void fd_stream_close(ByteStream *stream)
+{
+    close((int)(intptr_t)stream->ctx);
+    free(stream);
+}
+
+/**
+ * Create a stream that reads bytes from a file descriptor as they are.
+ *
+ * @param fd the file descriptor to read
+ * @return a pointer to a newly allocated stream
+ */
+ByteStream *byte_stream_fd(int fd)
+{
+    ByteStream *stream = (ByteStream *)calloc(1, sizeof(ByteStream));
+    stream->read = fd_stream_read;
+    stream->close = fd_stream_close;
+    stream->ctx = (void *)(intptr_t)fd;
+    return stream;
+}
+
+/**
+ * Allocate and initialize a new TraceReader.
+ *
+ * @param stream the stream from which to read trace records
+ * @param buf_size the size of the reader's buffer, in bytes
+ * @return a pointer to a newly allocated TraceReader
+ */
+TraceReader *trace_reader_init(ByteStream *stream, size_t buf_size)
+{
+    // Keep whole records in the buffer so batches never straddle a refill.
+    if (buf_size < sizeof(TraceRec))
+    {
+        buf_size = sizeof(TraceRec);
+    }
+    buf_size -= buf_size % sizeof(TraceRec);
+
+    TraceReader *reader = (TraceReader *)calloc(1, sizeof(TraceReader));
+    reader->stream = stream;
+    reader->buf = (uint8_t *)malloc(buf_size);
+    reader->buf_size = buf_size;
+    reader->pos = 0;
+    reader->len = 0;
+    reader->drained = false;
+    reader->read_errno = 0;
+    reader->end_status = SOURCE_OK;
+    reader->end_reported = false;
+    return reader;
+}
+
+/**
+ * Close the reader's stream and free the reader.
+ *
+ * @param reader the reader
+ */
+void trace_reader_free(TraceReader *reader)
+{
+    reader->stream->close(reader->stream);
+    free(reader->buf);
+    free(reader);
+}
+
+/**
+ * Move any partial record to the front of the buffer and read more bytes
+ * after it.
+ *
+ * Reading stops once the buffer is full, at EOF or on error, or once at
+ * least one whole record is buffered and the stream has no more data
+ * immediately available (signalled by a short read).
+ */
+static void trace_reader_fill(TraceReader *reader)
+{
+    size_t leftover = reader->len - reader->pos;
+    if (leftover > 0 && reader->pos > 0)
+    {
+        memmove(reader->buf, reader->buf + reader->pos, leftover);
+    }
+    reader->pos = 0;
+    reader->len = leftover;
+
+    while (!reader->drained && reader->len < reader->buf_size)
+    {
+        size_t want = reader->buf_size - reader->len;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        ssize_t got = reader->stream->read(reader->stream,
+                                           reader->buf + reader->len, want);
+        reader->stat_read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        reader->stat_reads++;
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            // EOF or error
+            reader->read_errno = got < 0 ? errno : 0;
+            reader->drained = true;
+            break;
+        }
+
+        reader->len += got;
+        reader->stat_bytes_read += got;
+        if ((size_t)got < want && reader->len >= sizeof(TraceRec))
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Check that a record can be decoded: its op_type is known, and each
+ * register it uses is an architectural register.
+ *
+ * @param rec the record
+ * @return true if the record is valid
+ */
+static bool trace_rec_valid(const TraceRec *rec)
+{
+    return rec->op_type < NUM_OP_TYPES &&
+           (!rec->dest_needed || rec->dest_reg < MAX_ARF_REGS) &&
+           (!rec->src1_needed || rec->src1_reg < MAX_ARF_REGS) &&
+           (!rec->src2_needed || rec->src2_reg < MAX_ARF_REGS);
+}
+
+/**
+ * Hand out a batch of consecutive, valid records directly from the buffer.
+ *
+ * @param reader the reader
+ * @param recs receives a pointer to the first record of the batch
+ * @param max_recs the maximum number of records to hand out
+ * @param status receives SOURCE_OK if records were handed out, otherwise how
+ *               the trace ended
+ * @return the number of records in the batch, or 0 at the end of the trace
+ */
+size_t trace_reader_batch(TraceReader *reader, const TraceRec **recs,
+                          size_t max_recs, SourceStatus *status)
+{
+    if (reader->end_status == SOURCE_OK &&
+        reader->len - reader->pos < sizeof(TraceRec))
+    {
+        trace_reader_fill(reader);
+    }
+
+    size_t avail = (reader->len - reader->pos) / sizeof(TraceRec);
+    if (reader->end_status == SOURCE_OK && avail == 0)
+    {
+        // Check for error conditions.
+        if (reader->read_errno != 0)
+        {
+            reader->end_status = SOURCE_ERROR;
+        }
+        else if (reader->len > reader->pos)
+        {
+            // Too few bytes read
+            reader->end_status = SOURCE_INVALID;
+        }
+        else
+        {
+            // No more trace records to read
+            reader->end_status = SOURCE_EOF;
+        }
+    }
+
+    if (reader->end_status != SOURCE_OK && avail == 0)
+    {
+        *status = reader->end_reported ? SOURCE_EOF : reader->end_status;
+        reader->end_reported = true;
+        errno = reader->read_errno;
+        return 0;
+    }
+
+    // Stop the batch at the first record with an invalid op_type or register.
+    const TraceRec *first = (const TraceRec *)(reader->buf + reader->pos);
+    size_t count = avail < max_recs ? avail : max_recs;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!trace_rec_valid(&first[i]))
+        {
+            count = i;
+            reader->end_status = SOURCE_INVALID;
+            reader->len = reader->pos + i * sizeof(TraceRec);
+            break;
+        }
+    }
+
+    if (count == 0)
+    {
+        return trace_reader_batch(reader, recs, max_recs, status);
+    }
+
+    reader->pos += count * sizeof(TraceRec);
+    *recs = first;
+    *status = SOURCE_OK;
+    return count;
+}
+
+/**
+ * Copy the next record out of the reader.
+ *
+ * @param reader the reader
+ * @param rec the record to populate
+ * @return SOURCE_OK if a record was read, otherwise how the trace ended
+ */
+SourceStatus trace_reader_next(TraceReader *reader, TraceRec *rec)
+{
+    const TraceRec *batch;
+    SourceStatus status;
+    if (trace_reader_batch(reader, &batch, 1, &status) == 1)
+    {
+        *rec = *batch;
+    }
+    return status;
+}
@@ -0,0 +1,127 @@
+// reader.h
+// Declares the TraceReader, a block-buffered reader of raw trace records.
+//
+// The reader owns the ByteStream it reads from (a plain file descriptor or an
+// in-process decompressor) and refills a large buffer with as few reads as
+// possible. Records are handed out either one at a time or in batches that
+// point directly into the buffer. Detection of short reads, EOF, and
+// malformed records all happens here.
+
+#ifndef _READER_H_
+#define _READER_H_
+
+#include "source.h"
+#include "trace.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * The default size of a TraceReader's buffer, in bytes.
+ */
+#define TRACE_READER_BUF_SIZE (4 * 1024 * 1024)
+
+/** A stream of raw (uncompressed) trace bytes. */
+typedef struct ByteStreamStruct
+{
+    /**
+     * Read up to n bytes into buf, like read(2).
+     *
+     * @return the number of bytes read, 0 at the end of the stream, or -1 on
+     *         error with errno set
+     */
+    ssize_t (*read)(struct ByteStreamStruct *stream, void *buf, size_t n);
+
+    /** Release the stream and everything it owns. */
+    void (*close)(struct ByteStreamStruct *stream);
+
+    /** [Internal] Implementation-specific state. */
+    void *ctx;
+} ByteStream;
+
+/** A block-buffered reader of TraceRec records. */
+typedef struct TraceReaderStruct
+{
+    /** [Internal] The stream from which to read trace records. */
+    ByteStream *stream;
+    /** [Internal] The buffer holding records read but not yet handed out. */
+    uint8_t *buf;
+    /** [Internal] The size of buf, in bytes. */
+    size_t buf_size;
+    /** [Internal] The offset of the next record to hand out. */
+    size_t pos;
+    /** [Internal] The number of valid bytes in buf. */
+    size_t len;
+    /** [Internal] Whether read() has reported EOF or an error. */
+    bool drained;
+    /** [Internal] The errno of the failed read(), or 0 if none failed. */
+    int read_errno;
+    /** [Internal] How the trace ended, once the end has been reached. */
+    SourceStatus end_status;
+    /** [Internal] Whether end_status has been reported to the caller. */
+    bool end_reported;
+
+    /** The total number of bytes read from stream. */
+    uint64_t stat_bytes_read;
+    /** The total number of reads made on stream. */
+    uint64_t stat_reads;
+    /**
+     * The total time spent waiting on reads from stream, including any
+     * decompression, in nanoseconds.
+     */
+    uint64_t stat_read_ns;
+} TraceReader;
+
+/**
+ * Create a stream that reads bytes from a file descriptor as they are.
+ *
+ * @param fd the file descriptor to read; the stream takes ownership of it
+ *           and closes it when closed
+ * @return a pointer to a newly allocated stream
+ */
+ByteStream *byte_stream_fd(int fd);
+
+/**
+ * Allocate and initialize a new TraceReader.
+ *
+ * @param stream the stream from which to read trace records; the reader
+ *               takes ownership of it and closes it when freed
+ * @param buf_size the size of the reader's buffer, in bytes
+ * @return a pointer to a newly allocated TraceReader
+ */
+TraceReader *trace_reader_init(ByteStream *stream, size_t buf_size);
+
+/**
+ * Close the reader's stream and free the reader.
+ *
+ * @param reader the reader
+ */
+void trace_reader_free(TraceReader *reader);
+
+/**
+ * Hand out a batch of consecutive, valid records directly from the buffer,
+ * refilling it if it is empty.
+ *
+ * The records stay valid until the next call on the reader.
+ *
+ * @param reader the reader
+ * @param recs receives a pointer to the first record of the batch
+ * @param max_recs the maximum number of records to hand out
+ * @param status receives SOURCE_OK if records were handed out, otherwise how
+ *               the trace ended (reported once, then SOURCE_EOF)
+ * @return the number of records in the batch, or 0 at the end of the trace
+ */
+size_t trace_reader_batch(TraceReader *reader, const TraceRec **recs,
+                          size_t max_recs, SourceStatus *status);
+
+/**
+ * Copy the next record out of the reader.
+ *
+ * @param reader the reader
+ * @param rec the record to populate
+ * @return SOURCE_OK if a record was read, otherwise how the trace ended
+ *         (reported once, then SOURCE_EOF)
+ */
+SourceStatus trace_reader_next(TraceReader *reader, TraceRec *rec);
+
+#endif
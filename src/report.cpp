@@ -0,0 +1,232 @@
+// report.cpp
+// Implements the machine-readable statistics report.
+
+#include "report.h"
+#include "simulator.h"
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+/**
+ * Parse the name of a report format.
+ *
+ * @param name "json" or "csv"
+ * @return the format, or REPORT_NONE if the name is not recognized
+ */
+ReportFormat report_parse_format(const char *name)
+{
+    if (strcmp(name, "json") == 0)
+    {
+        return REPORT_JSON;
+    }
+    if (strcmp(name, "csv") == 0)
+    {
+        return REPORT_CSV;
+    }
+    return REPORT_NONE;
+}
+
+/**
+ * Fill in the host metrics that can be measured once a simulation has
+ * finished.
+ *
+ * @param host the metrics to fill in
+ * @param trace_filename the trace file
+ * @param src the source the trace was read through
+ */
+void report_collect_host(HostStats *host, const char *trace_filename,
+                         InstSource *src)
+{
+    // ru_maxrss is in KiB on Linux, and covers every thread of the process.
+    struct rusage usage;
+    host->process_peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+
+    struct stat st;
+    host->trace_file_bytes = stat(trace_filename, &st) == 0 ? st.st_size : 0;
+
+    source_get_stats(src, &host->src);
+}
+
+/**
+ * Write a string as a JSON string literal.
+ */
+static void report_json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+        {
+            fprintf(out, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(out, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * Write a string as a CSV field, quoting it if it needs to be.
+ */
+static void report_csv_string(FILE *out, const char *s)
+{
+    if (strpbrk(s, ",\"\r\n") == NULL)
+    {
+        fputs(s, out);
+        return;
+    }
+
+    fputc('"', out);
+    for (; *s != '\0'; s++)
+    {
+        if (*s == '"')
+        {
+            fputc('"', out);
+        }
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * Write an occupancy histogram as a JSON member: an array of the number of
+ * cycles at each occupancy, up to the largest that occurred.
+ */
+static void report_json_histogram(FILE *out, const char *name,
+                                  const uint64_t *hist, unsigned int max)
+{
+    unsigned int top = 0;
+    for (unsigned int i = 0; i <= max; i++)
+    {
+        if (hist[i] > 0)
+        {
+            top = i;
+        }
+    }
+
+    fprintf(out, ", \"%s\": [", name);
+    for (unsigned int i = 0; i <= top; i++)
+    {
+        fprintf(out, i > 0 ? ", %lu" : "%lu", (unsigned long)hist[i]);
+    }
+    fprintf(out, "]");
+}
+
+/**
+ * Write the report of one finished simulation.
+ *
+ * @param out the file to write to
+ * @param format the format to write in
+ * @param header whether to write the CSV header line first
+ * @param trace_filename the trace file that was simulated
+ * @param config the configuration that was simulated
+ * @param p the finished pipeline
+ * @param host the host metrics of the simulation
+ */
+void report_write(FILE *out, ReportFormat format, bool header,
+                  const char *trace_filename, const PipelineConfig *config,
+                  const Pipeline *p, const HostStats *host)
+{
+    const char *policy = config->sched_policy == SCHED_IN_ORDER
+                             ? "in-order" : "out-of-order";
+    double cpi = p->stat_retired_inst > 0
+                     ? (double)p->stat_num_cycle / (double)p->stat_retired_inst
+                     : 0.0;
+    double kips = host->sim_seconds > 0.0
+                      ? p->stat_retired_inst / host->sim_seconds / 1e3 : 0.0;
+    double read_seconds = host->src.read_ns * 1e-9;
+
+    // The CPI stack, from the commit slots (see fprint_stats).
+    double slot_cpi = p->stat_retired_inst > 0
+                          ? 1.0 / ((double)config->pipe_width * (double)p->stat_retired_inst)
+                          : 0.0;
+    double stack[NUM_STALL_REASONS];
+    for (int r = 0; r < NUM_STALL_REASONS; r++)
+    {
+        stack[r] = p->stat_stall_slots[r] * slot_cpi;
+    }
+    double rob_mean = occupancy_mean(p->stat_rob_occupancy, config->num_rob_entries);
+    double exeq_mean = occupancy_mean(p->stat_exeq_occupancy, config->num_rob_entries);
+
+    if (format == REPORT_JSON)
+    {
+        fprintf(out, "{\"trace\": ");
+        report_json_string(out, trace_filename);
+        fprintf(out, ", \"config\": {\"pipe_width\": %u, \"sched_policy\": \"%s\", "
+                     "\"load_exe_cycles\": %u, \"num_rob_entries\": %u}",
+                config->pipe_width, policy, config->load_exe_cycles,
+                config->num_rob_entries);
+        fprintf(out, ", \"stats\": {\"num_inst\": %lu, \"num_cycles\": %lu, "
+                     "\"cpi\": %.6f",
+                (unsigned long)p->stat_retired_inst,
+                (unsigned long)p->stat_num_cycle, cpi);
+        fprintf(out, ", \"cpi_stack\": {\"base\": %.6f",
+                p->stat_retired_inst * slot_cpi);
+        for (int r = 0; r < NUM_STALL_REASONS; r++)
+        {
+            fprintf(out, ", \"%s\": %.6f", STALL_REASON_NAMES[r], stack[r]);
+        }
+        fprintf(out, "}, \"rob_stall_cycles\": %lu", (unsigned long)p->stat_rob_stall_cycles);
+        fprintf(out, ", \"rob_occupancy_mean\": %.6f, \"exeq_occupancy_mean\": %.6f",
+                rob_mean, exeq_mean);
+        report_json_histogram(out, "rob_occupancy", p->stat_rob_occupancy,
+                              config->num_rob_entries);
+        report_json_histogram(out, "exeq_occupancy", p->stat_exeq_occupancy,
+                              config->num_rob_entries);
+        fprintf(out, "}");
+        fprintf(out, ", \"host\": {\"wall_seconds\": %.6f, \"sim_seconds\": %.6f, "
+                     "\"sim_kips\": %.1f, \"sim_mips\": %.3f, \"process_peak_rss_kb\": %lu, "
+                     "\"trace_file_bytes\": %lu, \"trace_bytes_read\": %lu, "
+                     "\"trace_reads\": %lu, \"read_seconds\": %.6f, "
+                     "\"compute_seconds\": %.6f}}\n",
+                host->wall_seconds, host->sim_seconds, kips, kips / 1e3,
+                (unsigned long)host->process_peak_rss_kb,
+                (unsigned long)host->trace_file_bytes,
+                (unsigned long)host->src.bytes_read,
+                (unsigned long)host->src.reads, read_seconds,
+                host->sim_seconds - read_seconds);
+    }
+    else if (format == REPORT_CSV)
+    {
+        if (header)
+        {
+            fprintf(out, "trace,pipe_width,sched_policy,load_exe_cycles,"
+                         "num_rob_entries,num_inst,num_cycles,cpi,wall_seconds,"
+                         "sim_seconds,sim_kips,sim_mips,process_peak_rss_kb,"
+                         "trace_file_bytes,trace_bytes_read,trace_reads,"
+                         "read_seconds,compute_seconds,cpi_base");
+            for (int r = 0; r < NUM_STALL_REASONS; r++)
+            {
+                fprintf(out, ",cpi_%s", STALL_REASON_NAMES[r]);
+            }
+            fprintf(out, ",rob_occupancy_mean,exeq_occupancy_mean,rob_stall_cycles\n");
+        }
+        report_csv_string(out, trace_filename);
+        fprintf(out, ",%u,%s,%u,%u,%lu,%lu,%.6f,%.6f,%.6f,%.1f,%.3f,%lu,%lu,"
+                     "%lu,%lu,%.6f,%.6f",
+                config->pipe_width, policy, config->load_exe_cycles,
+                config->num_rob_entries, (unsigned long)p->stat_retired_inst,
+                (unsigned long)p->stat_num_cycle, cpi, host->wall_seconds,
+                host->sim_seconds, kips, kips / 1e3,
+                (unsigned long)host->process_peak_rss_kb,
+                (unsigned long)host->trace_file_bytes,
+                (unsigned long)host->src.bytes_read,
+                (unsigned long)host->src.reads, read_seconds,
+                host->sim_seconds - read_seconds);
+        fprintf(out, ",%.6f", p->stat_retired_inst * slot_cpi);
+        for (int r = 0; r < NUM_STALL_REASONS; r++)
+        {
+            fprintf(out, ",%.6f", stack[r]);
+        }
+        fprintf(out, ",%.6f,%.6f,%lu\n", rob_mean, exeq_mean,
+                (unsigned long)p->stat_rob_stall_cycles);
+    }
+    fflush(out);
+}
@@ -0,0 +1,77 @@
+// report.h
+// Declares the machine-readable statistics report, which writes every
+// counter of a finished simulation together with its configuration and
+// host-side metrics (time taken, simulated instructions per second, memory
+// used, and how the trace was read) as JSON or CSV.
+
+#ifndef _REPORT_H_
+#define _REPORT_H_
+
+#include "pipeline.h"
+#include "source.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+/** The formats the report can be written in. */
+typedef enum ReportFormatEnum
+{
+    REPORT_NONE, // No report; only the LAB3_* text is printed.
+    REPORT_JSON, // One JSON object per simulation, on a single line.
+    REPORT_CSV,  // A header line, then one line per simulation.
+} ReportFormat;
+
+/** Host-side metrics of a simulation. */
+typedef struct HostStatsStruct
+{
+    /** The time the whole process has taken, in seconds. */
+    double wall_seconds;
+    /** The time spent simulating, in seconds. */
+    double sim_seconds;
+    /**
+     * The peak resident set size of the whole process so far, in KiB. It is
+     * not per simulation: every configuration of -sweep and every job of
+     * -batch shares the process, and so this high-water mark.
+     */
+    uint64_t process_peak_rss_kb;
+    /** The size of the trace file, in bytes. */
+    uint64_t trace_file_bytes;
+    /** How the trace was read. */
+    SourceStats src;
+} HostStats;
+
+/**
+ * Parse the name of a report format.
+ *
+ * @param name "json" or "csv"
+ * @return the format, or REPORT_NONE if the name is not recognized
+ */
+ReportFormat report_parse_format(const char *name);
+
+/**
+ * Fill in the host metrics that can be measured once a simulation has
+ * finished: the peak RSS, the size of the trace file, and the counters of the
+ * source it was read through.
+ *
+ * @param host the metrics to fill in; the times are left untouched
+ * @param trace_filename the trace file
+ * @param src the source the trace was read through
+ */
+void report_collect_host(HostStats *host, const char *trace_filename,
+                         InstSource *src);
+
+/**
+ * Write the report of one finished simulation.
+ *
+ * @param out the file to write to
+ * @param format the format to write in
+ * @param header whether to write the CSV header line first
+ * @param trace_filename the trace file that was simulated
+ * @param config the configuration that was simulated
+ * @param p the finished pipeline
+ * @param host the host metrics of the simulation
+ */
+void report_write(FILE *out, ReportFormat format, bool header,
+                  const char *trace_filename, const PipelineConfig *config,
+                  const Pipeline *p, const HostStats *host);
+
+#endif
@@ -2,49 +2,274 @@
 
 ////////////////////////////////////////////////////////////////////////
 // Contains the following implementation to simulate re-order buffer: //
+// - unsigned int rob_occupancy(ROB *rob)                             //
 // - bool rob_check_space(ROB *rob)                                   //
-// - int rob_insert(ROB *rob, InstInfo inst)                          //
-// - void rob_mark_exec(ROB *rob, InstInfo inst)                      //
-// - void rob_mark_ready(ROB *rob, InstInfo inst)                     //
+// - int rob_insert(ROB *rob, const InstInfo *inst)                   //
+// - void rob_mark_exec(ROB *rob, const InstInfo *inst)               //
+// - void rob_mark_ready(ROB *rob, const InstInfo *inst)              //
 // - bool rob_check_ready(ROB *rob, int tag)                          //
 // - bool rob_check_head(ROB *rob)                                    //
+// - void rob_update_ready(ROB *rob, int tag)                         //
+// - int rob_find_oldest_pending(ROB *rob, bool need_ready)           //
+// - bool rob_check_operands_ready(ROB *rob, int tag)                 //
+// - bool rob_check_pending(ROB *rob, int tag)                        //
+// - void rob_add_consumer(ROB *rob, int tag, int consumer, int n)    //
 // - void rob_wakeup(ROB *rob, int tag)                               //
+// - bool rob_simd_supported()                                        //
 // - InstInfo rob_remove_head(ROB *rob)                               //
+// - void rob_free(ROB *rob)                                          //
 ////////////////////////////////////////////////////////////////////////
 
 
 #include "rob.h"
+#include "ckpt.h"
+#include "profile.h"
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ROB_SIMD_AVX2
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define ROB_SIMD_NEON
+#endif
+
+const char *const WAKEUP_ENGINE_NAMES[NUM_WAKEUP_ENGINES] = {
+    "deplist", "scan", "simd"};
+
+/** The number of scheduling bitsets, which share one allocation. */
+#define ROB_NUM_BITSETS 4
+
+static_assert(2 * MAX_ROB_ENTRIES - 1 <= INT16_MAX,
+              "wakeup links must fit in an int16_t");
+
+/** Set bit i of a scheduling bitset. */
+static inline void bitset_set(uint64_t *bits, int i)
+{
+    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+/** Clear bit i of a scheduling bitset. */
+static inline void bitset_clear(uint64_t *bits, int i)
+{
+    bits[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+/** Check bit i of a scheduling bitset. */
+static inline bool bitset_test(const uint64_t *bits, int i)
+{
+    return (bits[i >> 6] >> (i & 63)) & 1;
+}
+
 /**
- * The number of entries in the ROB; that is, the maximum number of
- * instructions that can be stored in the ROB at any given time.
+ * Advance a ROB pointer by one entry, wrapping it around to 0 at the end
+ * 
+ * @param rob the ROB
+ * @param ptr the pointer to advance
+ * @return the next pointer
  */
-extern uint32_t NUM_ROB_ENTRIES;
+static inline int rob_next(const ROB *rob, int ptr)
+{
+    if (rob->index_mask != 0)
+    {
+        return (ptr + 1) & rob->index_mask;
+    }
+    return (ptr + 1) % rob->num_entries;
+}
+
+static void (*rob_pick_wakeup(WakeupEngine engine))(ROB *, int);
 
 /**
  * Allocate and initialize a new ROB
  * 
- * @return a pointer to a newly allocated ROB
+ * The entries and bitsets are sized for the given number of entries, so a
+ * small ROB only takes the memory it needs.
+ * 
+ * @param num_entries the number of entries
+ * @param engine the way the ROB wakes up waiting entries
+ * @return a pointer to a newly allocated ROB, or NULL if it could not be
+ *         allocated (an error has been printed)
  */
-ROB *rob_init()
+ROB *rob_init(unsigned int num_entries, WakeupEngine engine)
 {
     ROB *rob = (ROB *)calloc(1, sizeof(ROB));
+    if (rob == NULL)
+    {
+        perror("Couldn't allocate the ROB");
+        return NULL;
+    }
+
+    rob->num_entries = num_entries;
+    rob->index_mask = (num_entries & (num_entries - 1)) == 0
+                          ? num_entries - 1 : 0;
+    rob->bitset_words = (num_entries + 63) / 64;
+    rob->insts = (InstInfo *)calloc(rob->num_entries, sizeof(InstInfo));
+
+    rob->valid_bits = (uint64_t *)calloc(ROB_NUM_BITSETS * rob->bitset_words,
+                                         sizeof(uint64_t));
+    rob->waiting = (uint8_t *)calloc(rob->num_entries, sizeof(uint8_t));
+    rob->wake_head = (int16_t *)malloc(rob->num_entries * sizeof(int16_t));
+    rob->wake_next = (int16_t *)malloc(2 * rob->num_entries * sizeof(int16_t));
+
+    // The waiting tags share an allocation aligned for the vector kernels.
+    // posix_memalign returns the error rather than setting errno.
+    unsigned int lanes = 64 * rob->bitset_words;
+    int align_err = posix_memalign((void **)&rob->src1_wait, 64,
+                                   2 * lanes * sizeof(int16_t));
+    if (align_err != 0)
+    {
+        rob->src1_wait = NULL;
+        errno = align_err;
+    }
+    if (rob->insts == NULL || rob->valid_bits == NULL ||
+        rob->waiting == NULL || rob->wake_head == NULL ||
+        rob->wake_next == NULL || rob->src1_wait == NULL)
+    {
+        perror("Couldn't allocate the ROB");
+        rob_free(rob);
+        return NULL;
+    }
+
+    rob->pending_bits = rob->valid_bits + rob->bitset_words;
+    rob->ready_bits = rob->pending_bits + rob->bitset_words;
+    rob->done_bits = rob->ready_bits + rob->bitset_words;
+    rob->src2_wait = rob->src1_wait + lanes;
 
     rob->head_ptr = 0;
     rob->tail_ptr = 0;
 
-    for (int i = 0; i < MAX_ROB_ENTRIES; i++)
+    for (unsigned int i = 0; i < rob->num_entries; i++)
     {
-        rob->entries[i].valid = false;
-        rob->entries[i].ready = false;
-        rob->entries[i].exec = false;
+        rob->wake_head[i] = -1;
+        rob->wake_next[2 * i] = -1;
+        rob->wake_next[2 * i + 1] = -1;
+    }
+    for (unsigned int i = 0; i < 2 * lanes; i++)
+    {
+        rob->src1_wait[i] = -1;
     }
 
+    rob->wakeup_fn = rob_pick_wakeup(engine);
     return rob;
 }
 
+/**
+ * Free a ROB and everything it owns
+ * 
+ * @param rob the ROB
+ */
+void rob_free(ROB *rob)
+{
+    free(rob->insts);
+    free(rob->valid_bits);
+    free(rob->waiting);
+    free(rob->wake_head);
+    free(rob->wake_next);
+    free(rob->src1_wait);
+    free(rob);
+}
+
+/**
+ * Write the state of the ROB to a checkpoint
+ * 
+ * @param rob the ROB
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool rob_save(ROB *rob, FILE *f)
+{
+    return ckpt_write(f, &rob->num_entries, sizeof(rob->num_entries)) &&
+           ckpt_write(f, &rob->head_ptr, sizeof(rob->head_ptr)) &&
+           ckpt_write(f, &rob->tail_ptr, sizeof(rob->tail_ptr)) &&
+           ckpt_write(f, rob->insts, rob->num_entries * sizeof(InstInfo)) &&
+           ckpt_write(f, rob->valid_bits,
+                      ROB_NUM_BITSETS * rob->bitset_words * sizeof(uint64_t)) &&
+           ckpt_write(f, rob->waiting, rob->num_entries * sizeof(uint8_t)) &&
+           ckpt_write(f, rob->wake_head, rob->num_entries * sizeof(int16_t)) &&
+           ckpt_write(f, rob->wake_next, 2 * rob->num_entries * sizeof(int16_t)) &&
+           ckpt_write(f, rob->src1_wait, rob->num_entries * sizeof(int16_t)) &&
+           ckpt_write(f, rob->src2_wait, rob->num_entries * sizeof(int16_t));
+}
+
+/**
+ * Read the state of the ROB from a checkpoint written by rob_save
+ * 
+ * @param rob the ROB to overwrite, which must have as many entries as the
+ *            saved one
+ * @param f the checkpoint being read
+ * @return true on success, false if the checkpoint is truncated or holds
+ *         an index out of range
+ */
+bool rob_load(ROB *rob, FILE *f)
+{
+    unsigned int num_entries;
+    if (!ckpt_read(f, &num_entries, sizeof(num_entries)) ||
+        num_entries != rob->num_entries ||
+        !ckpt_read(f, &rob->head_ptr, sizeof(rob->head_ptr)) ||
+        !ckpt_read(f, &rob->tail_ptr, sizeof(rob->tail_ptr)) ||
+        (unsigned int)rob->head_ptr >= num_entries ||
+        (unsigned int)rob->tail_ptr >= num_entries)
+    {
+        return false;
+    }
+
+    if (!ckpt_read(f, rob->insts, num_entries * sizeof(InstInfo)) ||
+        !ckpt_read(f, rob->valid_bits,
+                   ROB_NUM_BITSETS * rob->bitset_words * sizeof(uint64_t)) ||
+        !ckpt_read(f, rob->waiting, num_entries * sizeof(uint8_t)) ||
+        !ckpt_read(f, rob->wake_head, num_entries * sizeof(int16_t)) ||
+        !ckpt_read(f, rob->wake_next, 2 * num_entries * sizeof(int16_t)) ||
+        !ckpt_read(f, rob->src1_wait, num_entries * sizeof(int16_t)) ||
+        !ckpt_read(f, rob->src2_wait, num_entries * sizeof(int16_t)))
+    {
+        return false;
+    }
+
+    // Everything used as an index must be in range.
+    for (unsigned int i = 0; i < num_entries; i++)
+    {
+        if (!ckpt_check_inst(&rob->insts[i], num_entries) || rob->waiting[i] > 3 ||
+            !ckpt_check_index(rob->wake_head[i], 2 * num_entries) ||
+            !ckpt_check_index(rob->wake_next[2 * i], 2 * num_entries) ||
+            !ckpt_check_index(rob->wake_next[2 * i + 1], 2 * num_entries) ||
+            !ckpt_check_index(rob->src1_wait[i], num_entries) ||
+            !ckpt_check_index(rob->src2_wait[i], num_entries))
+        {
+            return false;
+        }
+    }
+
+    // The bits past the last entry of each bitset must be clear.
+    if (num_entries % 64 != 0)
+    {
+        uint64_t spare = ~0ULL << (num_entries % 64);
+        for (unsigned int b = 0; b < ROB_NUM_BITSETS; b++)
+        {
+            if (rob->valid_bits[(b + 1) * rob->bitset_words - 1] & spare)
+            {
+                return false;
+            }
+        }
+    }
+
+    // Each link belongs to at most one wakeup list, so a link seen twice
+    // means the lists are corrupt (and could loop forever).
+    bool *seen = (bool *)calloc(2 * num_entries, sizeof(bool));
+    bool ok = true;
+    for (unsigned int i = 0; ok && i < num_entries; i++)
+    {
+        for (int link = rob->wake_head[i]; ok && link != -1; link = rob->wake_next[link])
+        {
+            ok = !seen[link];
+            seen[link] = true;
+        }
+    }
+    free(seen);
+    return ok;
+}
+
 /**
  * Print out the state of the ROB for debugging purposes
  * 
@@ -54,21 +279,23 @@ void rob_print_state(ROB *rob)
 {
     printf("Current ROB state:\n");
     printf("Entry\t\tInst\tValid\tExec\tReady\tsrc1_reg\tsrc1_ready\tsrc1_tag\tsrc2_reg\tsrc2_ready\tsrc2_tag\tdest_reg\tdr_tag\n");
-    for (unsigned int i = 0; i < NUM_ROB_ENTRIES; i++)
-    {
-        printf("%5d ::  %5d", i, (int)rob->entries[i].inst.inst_num);
-        printf(" %5d", rob->entries[i].valid);
-        printf(" %7d", rob->entries[i].exec);
-        printf(" %7d", rob->entries[i].ready);
-        printf(" %8d", rob->entries[i].inst.src1_reg);
-        printf(" %10d", rob->entries[i].inst.src1_ready);
-        printf(" %12d", rob->entries[i].inst.src1_tag);
-        printf(" %11d", rob->entries[i].inst.src2_reg);
-        printf(" %10d", rob->entries[i].inst.src2_ready);
-        printf(" %12d", rob->entries[i].inst.src2_tag);
-        printf(" %11d", rob->entries[i].inst.dest_reg);
-        printf(" %10d", rob->entries[i].inst.dr_tag);
-        printf(" %10d", rob->entries[i].inst.op_type);
+    for (unsigned int i = 0; i < rob->num_entries; i++)
+    {
+        const InstInfo *inst = &rob->insts[i];
+        bool valid = bitset_test(rob->valid_bits, i);
+        printf("%5d ::  %5d", i, (int)inst->inst_num);
+        printf(" %5d", valid);
+        printf(" %7d", valid && !bitset_test(rob->pending_bits, i));
+        printf(" %7d", bitset_test(rob->done_bits, i));
+        printf(" %8d", inst->src1_reg);
+        printf(" %10d", inst->src1_reg != -1 && !(rob->waiting[i] & 1));
+        printf(" %12d", inst->src1_tag);
+        printf(" %11d", inst->src2_reg);
+        printf(" %10d", inst->src2_reg != -1 && !(rob->waiting[i] & 2));
+        printf(" %12d", inst->src2_tag);
+        printf(" %11d", inst->dest_reg);
+        printf(" %10d", inst->dr_tag);
+        printf(" %10d", inst->op_type);
         if (i == (unsigned int) rob->head_ptr && i == (unsigned int) rob->tail_ptr) {
             printf(" (head/tail)");
         } else if (i == (unsigned int) rob->head_ptr) {
@@ -81,6 +308,21 @@ void rob_print_state(ROB *rob)
     printf("\n");
 }
 
+/**
+ * Count the valid instructions in the ROB
+ * 
+ * @param rob the ROB
+ * @return the number of instructions between the head and tail pointers
+ */
+unsigned int rob_occupancy(ROB *rob)
+{
+    if (rob->tail_ptr == rob->head_ptr)
+    {
+        return bitset_test(rob->valid_bits, rob->head_ptr) ? rob->num_entries : 0;
+    }
+    return (rob->tail_ptr - rob->head_ptr + rob->num_entries) % rob->num_entries;
+}
+
 /**
  * Check if there is space available to insert another instruction into the ROB
  * 
@@ -92,7 +334,7 @@ bool rob_check_space(ROB *rob)
     // Return true if there is space to insert another instruction into the ROB, false otherwise.
     if ((unsigned int)rob->tail_ptr == (unsigned int)rob->head_ptr) 
     {
-        if (rob->entries[rob->head_ptr].valid == false)
+        if (!bitset_test(rob->valid_bits, rob->head_ptr))
         {
             return true;
         }
@@ -115,18 +357,25 @@ bool rob_check_space(ROB *rob)
  * @return the ID (index) of the newly inserted instruction in the ROB, or -1
  *         if there is no more space in the ROB
  */
-int rob_insert(ROB *rob, InstInfo inst)
+int rob_insert(ROB *rob, const InstInfo *inst)
 {
     // Check if there is space available in the ROB
     if (rob_check_space(rob)) 
     {
         // Create an entry
         int idx = rob->tail_ptr;
-        rob->entries[idx].valid = true;
-        rob->entries[idx].exec = false;
-        rob->entries[idx].ready = false;
-        rob->entries[idx].inst = inst;
-        rob->tail_ptr = (rob->tail_ptr + 1) % NUM_ROB_ENTRIES;
+        rob->insts[idx] = *inst;
+        rob->waiting[idx] = 0;
+        rob->wake_head[idx] = -1;
+        rob->wake_next[2 * idx] = -1;
+        rob->wake_next[2 * idx + 1] = -1;
+        rob->src1_wait[idx] = -1;
+        rob->src2_wait[idx] = -1;
+        bitset_set(rob->valid_bits, idx);
+        bitset_set(rob->pending_bits, idx);
+        bitset_clear(rob->ready_bits, idx);
+        bitset_clear(rob->done_bits, idx);
+        rob->tail_ptr = rob_next(rob, rob->tail_ptr);
         return idx;
     }
     else 
@@ -141,10 +390,16 @@ int rob_insert(ROB *rob, InstInfo inst)
  * @param rob the ROB
  * @param inst the instruction that is now executing
  */
-void rob_mark_exec(ROB *rob, InstInfo inst)
+void rob_mark_exec(ROB *rob, const InstInfo *inst)
 {
-    // Update rob entry containing the given instruction
-    rob->entries[inst.dr_tag].exec = true;
+    // Update rob entry containing the given instruction. Wakeups only
+    // update the waiting bits, so bring the instruction's own ready flags up
+    // to date as it leaves for execution.
+    int tag = inst->dr_tag;
+    InstInfo *entry = &rob->insts[tag];
+    entry->src1_ready = entry->src1_reg != -1 && !(rob->waiting[tag] & 1);
+    entry->src2_ready = entry->src2_reg != -1 && !(rob->waiting[tag] & 2);
+    bitset_clear(rob->pending_bits, tag);
 }
 
 /**
@@ -153,10 +408,10 @@ void rob_mark_exec(ROB *rob, InstInfo inst)
  * @param rob the ROB
  * @param inst the instruction whose output is ready
  */
-void rob_mark_ready(ROB *rob, InstInfo inst)
+void rob_mark_ready(ROB *rob, const InstInfo *inst)
 {
     // Update rob entry containing the given instruction
-    rob->entries[inst.dr_tag].ready = true;
+    bitset_set(rob->done_bits, inst->dr_tag);
 }
 
 /**
@@ -171,7 +426,7 @@ bool rob_check_ready(ROB *rob, int tag)
 {
     // Return true if the instruction at this tag (ID/index) is valid and
     //       has its output ready (i.e., is ready to commit), false otherwise.
-    if (rob->entries[tag].valid && rob->entries[tag].ready) 
+    if (bitset_test(rob->done_bits, tag)) 
     {
         return true;
     }
@@ -204,29 +459,376 @@ bool rob_check_head(ROB *rob)
 }
 
 /**
- * Wake up instructions that are dependent on the instruction with the given tag
+ * Recompute whether both source operands of the instruction with the given
+ * tag are ready
+ * 
+ * This reads the instruction's src1_ready and src2_ready fields into the
+ * waiting bits, which rob_wakeup updates from then on.
  * 
  * @param rob the ROB
- * @param tag the tag of the instruction that has finished executing
+ * @param tag the tag of the instruction to update
  */
-void rob_wakeup(ROB *rob, int tag)
+void rob_update_ready(ROB *rob, int tag)
+{
+    const InstInfo *inst = &rob->insts[tag];
+    bool src1_ready = (inst->src1_reg == -1 || inst->src1_ready);
+    bool src2_ready = (inst->src2_reg == -1 || inst->src2_ready);
+    rob->waiting[tag] = (src1_ready ? 0 : 1) | (src2_ready ? 0 : 2);
+    if (src1_ready && src2_ready)
+    {
+        bitset_set(rob->ready_bits, tag);
+    }
+    else
+    {
+        bitset_clear(rob->ready_bits, tag);
+    }
+}
+
+/**
+ * Find the oldest valid instruction in the ROB that has not started executing
+ * 
+ * Entries from head_ptr to the end of the ROB are older than those before
+ * head_ptr, so the bitsets are searched from head_ptr onwards first and then
+ * from 0 up to head_ptr.
+ * 
+ * @param rob the ROB
+ * @param need_ready whether to skip instructions whose source operands are
+ *                   not all ready
+ * @return the tag of the instruction, or -1 if there is none
+ */
+int rob_find_oldest_pending(ROB *rob, bool need_ready)
+{
+    unsigned int num_words = rob->bitset_words;
+    unsigned int w = rob->head_ptr >> 6;
+    uint64_t head_mask = ~(uint64_t)0 << (rob->head_ptr & 63);
+    PROF_COUNT(rob_searches, 1);
+    for (unsigned int n = 0; n <= num_words; n++, w++)
+    {
+        PROF_COUNT(rob_search_words, 1);
+        if (w == num_words)
+        {
+            w = 0;
+        }
+        uint64_t bits = rob->valid_bits[w] & rob->pending_bits[w];
+        if (need_ready)
+        {
+            bits &= rob->ready_bits[w];
+        }
+
+        // The head word is split: its upper part is searched first and its
+        // lower part last.
+        if (n == 0)
+        {
+            bits &= head_mask;
+        }
+        else if (n == num_words)
+        {
+            bits &= ~head_mask;
+        }
+
+        if (bits != 0)
+        {
+            return w * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Check if both source operands of the instruction with the given tag are
+ * ready or not needed
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction to check
+ * @return true if the instruction's source operands are ready
+ */
+bool rob_check_operands_ready(ROB *rob, int tag)
+{
+    return bitset_test(rob->ready_bits, tag);
+}
+
+/**
+ * Check if the instruction with the given tag is valid and has not started
+ * executing
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction to check
+ * @return true if the instruction is waiting to be scheduled
+ */
+bool rob_check_pending(ROB *rob, int tag)
+{
+    return bitset_test(rob->pending_bits, tag);
+}
+
+/**
+ * Register one operand of an instruction as waiting on the result of the
+ * instruction with the given tag
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction producing the operand
+ * @param consumer the tag of the instruction waiting on the operand
+ * @param operand which operand is waiting: 0 for src1, 1 for src2
+ */
+void rob_add_consumer(ROB *rob, int tag, int consumer, int operand)
+{
+    // Push the operand onto the front of the producer's list, and record the
+    // tag for the engines that compare tags instead. Both are kept whatever
+    // the engine, so that a checkpoint can be resumed with any engine.
+    rob->wake_next[2 * consumer + operand] = rob->wake_head[tag];
+    rob->wake_head[tag] = 2 * consumer + operand;
+    (operand == 0 ? rob->src1_wait : rob->src2_wait)[consumer] = tag;
+}
+
+/**
+ * [WAKEUP_DEPLIST] Wake up the operands registered with rob_add_consumer as
+ * waiting on the given tag, rather than visiting every entry of the ROB.
+ */
+static void rob_wakeup_deplist(ROB *rob, int tag)
+{
+    int link = rob->wake_head[tag];
+    PROF_COUNT(rob_wakeups, 1);
+    while (link != -1)
+    {
+        PROF_COUNT(rob_wakeup_consumers, 1);
+        int consumer = link >> 1;
+
+        // Clear the operand's waiting bit; once neither operand waits, the
+        // consumer is ready
+        rob->waiting[consumer] &= ~(1 << (link & 1));
+        ((link & 1) == 0 ? rob->src1_wait : rob->src2_wait)[consumer] = -1;
+        if (rob->waiting[consumer] == 0)
+        {
+            bitset_set(rob->ready_bits, consumer);
+        }
+        link = rob->wake_next[link];
+    }
+    rob->wake_head[tag] = -1;
+}
+
+/**
+ * Finish waking up the entries of one bitset word found by a scanning kernel,
+ * whose waiting tags have already been cleared.
+ * 
+ * @param rob the ROB
+ * @param w the bitset word
+ * @param woken bit j is set if an operand of entry 64 * w + j was woken
+ * @param ready bit j is set if neither operand of entry 64 * w + j waits
+ */
+static inline void rob_wake_word(ROB *rob, unsigned int w, uint64_t woken,
+                                 uint64_t ready)
+{
+    rob->ready_bits[w] |= woken & ready;
+    while (woken != 0)
+    {
+        int i = w * 64 + __builtin_ctzll(woken);
+        PROF_COUNT(rob_wakeup_consumers, 1);
+        rob->waiting[i] = (rob->src1_wait[i] != -1 ? 1 : 0) |
+                          (rob->src2_wait[i] != -1 ? 2 : 0);
+        woken &= woken - 1;
+    }
+}
+
+/**
+ * [WAKEUP_SCAN] Wake up the operands waiting on the given tag by comparing it
+ * with the waiting tags of every entry, one entry at a time.
+ */
+static void rob_wakeup_scan(ROB *rob, int tag)
 {
-    unsigned int tail= rob->tail_ptr, head = rob->head_ptr;
-    unsigned int i = head;
-    do
+    PROF_COUNT(rob_wakeups, 1);
+    for (unsigned int w = 0; w < rob->bitset_words; w++)
     {
-        if (rob->entries[i].valid && rob->entries[i].inst.src1_tag == tag) 
+        uint64_t woken = 0;
+        uint64_t ready = 0;
+        for (unsigned int j = 0; j < 64; j++)
         {
-            // Update the src1 ready bits
-            rob->entries[i].inst.src1_ready = true;
+            unsigned int i = w * 64 + j;
+            bool match1 = rob->src1_wait[i] == tag;
+            bool match2 = rob->src2_wait[i] == tag;
+            if (match1)
+            {
+                rob->src1_wait[i] = -1;
+            }
+            if (match2)
+            {
+                rob->src2_wait[i] = -1;
+            }
+            woken |= (uint64_t)(match1 || match2) << j;
+            ready |= (uint64_t)(rob->src1_wait[i] == -1 &&
+                                rob->src2_wait[i] == -1) << j;
         }
-        if (rob->entries[i].valid && rob->entries[i].inst.src2_tag == tag) 
+        rob_wake_word(rob, w, woken, ready);
+    }
+    rob->wake_head[tag] = -1;
+}
+
+#if defined(ROB_SIMD_AVX2)
+/**
+ * [WAKEUP_SIMD] Wake up the operands waiting on the given tag by comparing it
+ * with the waiting tags of 32 entries at a time, in two AVX2 vectors of 16
+ * tags per operand.
+ */
+__attribute__((target("avx2")))
+static void rob_wakeup_simd(ROB *rob, int tag)
+{
+    PROF_COUNT(rob_wakeups, 1);
+    const __m256i tags = _mm256_set1_epi16((int16_t)tag);
+    const __m256i none = _mm256_set1_epi16(-1);
+    for (unsigned int w = 0; w < rob->bitset_words; w++)
+    {
+        uint64_t woken = 0;
+        uint64_t ready = 0;
+        for (unsigned int half = 0; half < 2; half++)
         {
-            // Update the src2 ready bits
-            rob->entries[i].inst.src2_ready = true;
+            unsigned int base = w * 64 + half * 32;
+            __m256i *src1 = (__m256i *)&rob->src1_wait[base];
+            __m256i *src2 = (__m256i *)&rob->src2_wait[base];
+            __m256i a0 = _mm256_load_si256(src1);
+            __m256i a1 = _mm256_load_si256(src1 + 1);
+            __m256i b0 = _mm256_load_si256(src2);
+            __m256i b1 = _mm256_load_si256(src2 + 1);
+            __m256i match_a0 = _mm256_cmpeq_epi16(a0, tags);
+            __m256i match_a1 = _mm256_cmpeq_epi16(a1, tags);
+            __m256i match_b0 = _mm256_cmpeq_epi16(b0, tags);
+            __m256i match_b1 = _mm256_cmpeq_epi16(b1, tags);
+            __m256i match0 = _mm256_or_si256(match_a0, match_b0);
+            __m256i match1 = _mm256_or_si256(match_a1, match_b1);
+            if (_mm256_testz_si256(_mm256_or_si256(match0, match1),
+                                   _mm256_or_si256(match0, match1)))
+            {
+                continue;
+            }
+
+            // A matching tag becomes -1 (all ones) by or-ing in its match.
+            a0 = _mm256_or_si256(a0, match_a0);
+            a1 = _mm256_or_si256(a1, match_a1);
+            b0 = _mm256_or_si256(b0, match_b0);
+            b1 = _mm256_or_si256(b1, match_b1);
+            _mm256_store_si256(src1, a0);
+            _mm256_store_si256(src1 + 1, a1);
+            _mm256_store_si256(src2, b0);
+            _mm256_store_si256(src2 + 1, b1);
+            __m256i ready0 = _mm256_and_si256(_mm256_cmpeq_epi16(a0, none),
+                                              _mm256_cmpeq_epi16(b0, none));
+            __m256i ready1 = _mm256_and_si256(_mm256_cmpeq_epi16(a1, none),
+                                              _mm256_cmpeq_epi16(b1, none));
+
+            // Narrow the 16-bit lanes to bytes, which packs interleaves by
+            // 128-bit halves, so that movemask gives one bit per entry.
+            __m256i woken8 = _mm256_permute4x64_epi64(
+                _mm256_packs_epi16(match0, match1), 0xd8);
+            __m256i ready8 = _mm256_permute4x64_epi64(
+                _mm256_packs_epi16(ready0, ready1), 0xd8);
+            woken |= (uint64_t)(uint32_t)_mm256_movemask_epi8(woken8) << (half * 32);
+            ready |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ready8) << (half * 32);
         }
-        i = (i+1)%NUM_ROB_ENTRIES;
-    } while( i != tail );
+        rob_wake_word(rob, w, woken, ready);
+    }
+    rob->wake_head[tag] = -1;
+}
+
+bool rob_simd_supported()
+{
+    return __builtin_cpu_supports("avx2");
+}
+#elif defined(ROB_SIMD_NEON)
+/**
+ * [Internal] The bits of the entries of a vector of 8 lanes whose lane is
+ * all ones.
+ */
+static inline unsigned int rob_neon_mask(uint16x8_t lanes)
+{
+    static const uint16_t bits[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+    return vaddvq_u16(vandq_u16(lanes, vld1q_u16(bits)));
+}
+
+/**
+ * [WAKEUP_SIMD] Wake up the operands waiting on the given tag by comparing it
+ * with the waiting tags of 32 entries at a time, in four NEON vectors of 8
+ * tags per operand.
+ */
+static void rob_wakeup_simd(ROB *rob, int tag)
+{
+    PROF_COUNT(rob_wakeups, 1);
+    const int16x8_t tags = vdupq_n_s16((int16_t)tag);
+    const int16x8_t none = vdupq_n_s16(-1);
+    for (unsigned int w = 0; w < rob->bitset_words; w++)
+    {
+        uint64_t woken = 0;
+        uint64_t ready = 0;
+        for (unsigned int quarter = 0; quarter < 8; quarter++)
+        {
+            unsigned int base = w * 64 + quarter * 8;
+            int16x8_t a = vld1q_s16(&rob->src1_wait[base]);
+            int16x8_t b = vld1q_s16(&rob->src2_wait[base]);
+            uint16x8_t match_a = vceqq_s16(a, tags);
+            uint16x8_t match_b = vceqq_s16(b, tags);
+            uint16x8_t match = vorrq_u16(match_a, match_b);
+            if (vmaxvq_u16(match) == 0)
+            {
+                continue;
+            }
+
+            // A matching tag becomes -1 (all ones) by or-ing in its match.
+            a = vorrq_s16(a, vreinterpretq_s16_u16(match_a));
+            b = vorrq_s16(b, vreinterpretq_s16_u16(match_b));
+            vst1q_s16(&rob->src1_wait[base], a);
+            vst1q_s16(&rob->src2_wait[base], b);
+            uint16x8_t rdy = vandq_u16(vceqq_s16(a, none), vceqq_s16(b, none));
+            woken |= (uint64_t)rob_neon_mask(match) << (quarter * 8);
+            ready |= (uint64_t)rob_neon_mask(rdy) << (quarter * 8);
+        }
+        rob_wake_word(rob, w, woken, ready);
+    }
+    rob->wake_head[tag] = -1;
+}
+
+bool rob_simd_supported()
+{
+    return true;
+}
+#else
+bool rob_simd_supported()
+{
+    return false;
+}
+#endif
+
+/**
+ * Pick the wakeup kernel of an engine, falling back from WAKEUP_SIMD to
+ * WAKEUP_SCAN on hosts without the vector instructions it needs.
+ * 
+ * @param engine the engine
+ * @return the kernel
+ */
+static void (*rob_pick_wakeup(WakeupEngine engine))(ROB *, int)
+{
+    switch (engine)
+    {
+    case WAKEUP_SCAN:
+        return rob_wakeup_scan;
+    case WAKEUP_SIMD:
+#if defined(ROB_SIMD_AVX2) || defined(ROB_SIMD_NEON)
+        if (rob_simd_supported())
+        {
+            return rob_wakeup_simd;
+        }
+#endif
+        return rob_wakeup_scan;
+    default:
+        return rob_wakeup_deplist;
+    }
+}
+
+/**
+ * Wake up instructions that are dependent on the instruction with the given
+ * tag, with the ROB's wakeup engine
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction that has finished executing
+ */
+void rob_wakeup(ROB *rob, int tag)
+{
+    rob->wakeup_fn(rob, tag);
 }
 
 /**
@@ -240,14 +842,14 @@ InstInfo rob_remove_head(ROB *rob)
 {
     InstInfo headEntry;
     // Check if the head entry is ready to commit
-    if(rob->entries[rob->head_ptr].valid && rob->entries[rob->head_ptr].ready) 
+    if (bitset_test(rob->done_bits, rob->head_ptr)) 
     {
         // Remove that entry
-        headEntry = rob->entries[rob->head_ptr].inst;
-        rob->entries[rob->head_ptr].valid = false;
-        rob->entries[rob->head_ptr].exec = false;
-        rob->entries[rob->head_ptr].ready = false;
-        rob->head_ptr = (rob->head_ptr + 1) % NUM_ROB_ENTRIES;
+        headEntry = rob->insts[rob->head_ptr];
+        bitset_clear(rob->valid_bits, rob->head_ptr);
+        bitset_clear(rob->pending_bits, rob->head_ptr);
+        bitset_clear(rob->done_bits, rob->head_ptr);
+        rob->head_ptr = rob_next(rob, rob->head_ptr);
     }
     return headEntry;
 }
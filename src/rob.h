@@ -6,46 +6,58 @@
 
 #include "trace.h"
 #include <inttypes.h>
+#include <stdio.h>
 
 /**
  * The maximum allowed number of ROB entries.
  */
-#define MAX_ROB_ENTRIES 256
+#define MAX_ROB_ENTRIES 4096
 
-/** A single entry of the ROB that can hold one instruction. */
-typedef struct ROBEntryStruct
+/** The way rob_wakeup finds the operands waiting on a result. */
+typedef enum WakeupEngineEnum
 {
-    /**
-     * If the enrty containa a valid instruction
-     */
-    bool valid;
-
-    /** If the instruction has started executing */
-    bool exec;
-
-    /**
-     * If the instruction's output ready? 
-     */
-    bool ready;
+    WAKEUP_DEPLIST, // Follow the list of operands waiting on the producer.
+    WAKEUP_SCAN,    // Compare the tag with every entry's waiting tags.
+    WAKEUP_SIMD,    // The same, 32 entries at a time with AVX2 or NEON.
+    NUM_WAKEUP_ENGINES
+} WakeupEngine;
 
-    /**
-     * The instruction that this entry holds.
-     */
-    InstInfo inst;
-} ROBEntry;
+/** The name of each wakeup engine, as the -wakeup option takes it. */
+extern const char *const WAKEUP_ENGINE_NAMES[NUM_WAKEUP_ENGINES];
 
 /**
  * The re-order buffer.
  * 
  * The ROB should be used as a circular buffer: when the head or tail pointers
- * reach NUM_ROB_ENTRIES, they should be wrapped around to 0.
+ * reach num_entries, they should be wrapped around to 0.
+ * 
+ * The entries are stored as parallel arrays. The state the scheduler and
+ * wakeup touch every cycle is kept in bitsets and small per-entry arrays,
+ * apart from the instructions themselves, which are only read when an
+ * instruction is issued, scheduled, or committed.
  */
 typedef struct ROB
 {
     /**
-     * An array of entries in the ROB. Each can hold one instruction.
+     * The instruction each entry holds.
+     */
+    InstInfo *insts;
+
+    /**
+     * The number of entries in the arrays.
      */
-    ROBEntry entries[MAX_ROB_ENTRIES];
+    unsigned int num_entries;
+
+    /**
+     * num_entries - 1 if num_entries is a power of two, so that pointers can
+     * be wrapped with a mask instead of a division; 0 otherwise.
+     */
+    unsigned int index_mask;
+
+    /**
+     * The number of 64-bit words in each of the scheduling bitsets.
+     */
+    unsigned int bitset_words;
 
     /**
      * The index of the head entry of the ROB
@@ -56,14 +68,110 @@ typedef struct ROB
      * The index of the tail entry of the ROB
      */
     int tail_ptr;
+
+    /**
+     * Bit i is set if entry i is valid.
+     */
+    uint64_t *valid_bits;
+
+    /**
+     * Bit i is set if entry i is valid and has not started executing.
+     */
+    uint64_t *pending_bits;
+
+    /**
+     * Bit i is set if both source operands of entry i are ready or not
+     * needed. Only meaningful for valid entries.
+     */
+    uint64_t *ready_bits;
+
+    /**
+     * Bit i is set if entry i is valid and its output is ready.
+     */
+    uint64_t *done_bits;
+
+    /**
+     * For each entry, bit n is set while operand n (0 for src1, 1 for src2)
+     * waits on the result of another entry.
+     */
+    uint8_t *waiting;
+
+    /**
+     * For each entry, the first link of the list of operands waiting on its
+     * result, or -1 if none are. A link names an operand of a consumer
+     * entry: link (2 * id + n) is operand n of entry id.
+     */
+    int16_t *wake_head;
+
+    /**
+     * For each link, the next link of the list of the producer its operand
+     * waits on, or -1 at the end of that list.
+     */
+    int16_t *wake_next;
+
+    /**
+     * For each entry, the tag its src1 operand waits on, or -1 if it does not
+     * wait. Padded with -1 to a whole number of bitset words, so that the
+     * wakeup kernels compare whole vectors.
+     */
+    int16_t *src1_wait;
+
+    /**
+     * The same for the src2 operand.
+     */
+    int16_t *src2_wait;
+
+    /**
+     * The wakeup kernel of the ROB, picked at rob_init from its wakeup engine
+     * and the instruction sets the host supports.
+     */
+    void (*wakeup_fn)(struct ROB *rob, int tag);
 } ROB;
 
 /**
  * Allocate and initialize a new ROB
  * 
- * @return a pointer to a newly allocated ROB
+ * @param num_entries the number of entries, up to MAX_ROB_ENTRIES
+ * @param engine the way the ROB wakes up waiting entries, which does not
+ *               change the simulated results
+ * @return a pointer to a newly allocated ROB, or NULL if it could not be
+ *         allocated (an error has been printed)
  */
-ROB *rob_init();
+ROB *rob_init(unsigned int num_entries, WakeupEngine engine);
+
+/**
+ * Check if the host supports the vector instructions of WAKEUP_SIMD. Without
+ * them, a WAKEUP_SIMD ROB uses the WAKEUP_SCAN kernel.
+ * 
+ * @return true if WAKEUP_SIMD runs vector kernels on this host
+ */
+bool rob_simd_supported();
+
+/**
+ * Free a ROB and everything it owns
+ * 
+ * @param rob the ROB
+ */
+void rob_free(ROB *rob);
+
+/**
+ * Write the state of the ROB to a checkpoint
+ * 
+ * @param rob the ROB
+ * @param f the checkpoint being written
+ * @return true on success
+ */
+bool rob_save(ROB *rob, FILE *f);
+
+/**
+ * Read the state of the ROB from a checkpoint written by rob_save
+ * 
+ * @param rob the ROB to overwrite
+ * @param f the checkpoint being read
+ * @return true on success, false if the checkpoint is truncated or holds
+ *         an index out of range
+ */
+bool rob_load(ROB *rob, FILE *f);
 
 /**
  * Print out the state of the ROB for debugging purposes
@@ -72,6 +180,14 @@ ROB *rob_init();
  */
 void rob_print_state(ROB *rob);
 
+/**
+ * Count the valid instructions in the ROB
+ * 
+ * @param rob the ROB
+ * @return the number of instructions between the head and tail pointers
+ */
+unsigned int rob_occupancy(ROB *rob);
+
 /**
  * Check if there is space available to insert another instruction into the ROB
  * 
@@ -88,7 +204,7 @@ bool rob_check_space(ROB *rob);
  * @return the ID (index) of the newly inserted instruction in the ROB, or -1
  *         if there is no more space in the ROB
  */
-int rob_insert(ROB *rob, InstInfo inst);
+int rob_insert(ROB *rob, const InstInfo *inst);
 
 /**
  * Find the given instruction in the ROB and mark it as executing
@@ -96,7 +212,7 @@ int rob_insert(ROB *rob, InstInfo inst);
  * @param rob the ROB
  * @param inst the instruction that is now executing
  */
-void rob_mark_exec(ROB *rob, InstInfo inst);
+void rob_mark_exec(ROB *rob, const InstInfo *inst);
 
 /**
  * Find the given instruction in the ROB and mark it as having its output ready (i.e., being ready to commit)
@@ -104,7 +220,7 @@ void rob_mark_exec(ROB *rob, InstInfo inst);
  * @param rob the ROB
  * @param inst the instruction whose output is ready
  */
-void rob_mark_ready(ROB *rob, InstInfo inst);
+void rob_mark_ready(ROB *rob, const InstInfo *inst);
 
 /**
  * Check if the instruction with the given tag (ID/index) has its output ready
@@ -127,7 +243,59 @@ bool rob_check_ready(ROB *rob, int tag);
 bool rob_check_head(ROB *rob);
 
 /**
- * Wake up instructions that are dependent on the instruction with the given tag
+ * Recompute whether both source operands of the instruction with the given
+ * tag are ready, after its src1_ready or src2_ready fields have changed
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction to update
+ */
+void rob_update_ready(ROB *rob, int tag);
+
+/**
+ * Find the oldest valid instruction in the ROB that has not started executing
+ * 
+ * @param rob the ROB
+ * @param need_ready whether to skip instructions whose source operands are
+ *                   not all ready
+ * @return the tag of the instruction, or -1 if there is none
+ */
+int rob_find_oldest_pending(ROB *rob, bool need_ready);
+
+/**
+ * Check if both source operands of the instruction with the given tag are
+ * ready or not needed
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction to check
+ * @return true if the instruction's source operands are ready
+ */
+bool rob_check_operands_ready(ROB *rob, int tag);
+
+/**
+ * Check if the instruction with the given tag is valid and has not started
+ * executing
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction to check
+ * @return true if the instruction is waiting to be scheduled
+ */
+bool rob_check_pending(ROB *rob, int tag);
+
+/**
+ * Register one operand of an instruction as waiting on the result of the
+ * instruction with the given tag, so that rob_wakeup only visits the actual
+ * consumers of a result
+ * 
+ * @param rob the ROB
+ * @param tag the tag of the instruction producing the operand
+ * @param consumer the tag of the instruction waiting on the operand
+ * @param operand which operand is waiting: 0 for src1, 1 for src2
+ */
+void rob_add_consumer(ROB *rob, int tag, int consumer, int operand);
+
+/**
+ * Wake up instructions that are dependent on the instruction with the given
+ * tag, with the ROB's wakeup engine
  * 
  * @param rob the ROB
  * @param tag the tag of the instruction that has finished executing
@@ -0,0 +1,125 @@
+// sample.cpp
+// Implements the sampled simulation mode.
+//
+// In this pipeline model the only state a stretch of instructions leaves for
+// the ones after it is the contents of the ROB, RAT, and EXEQ. Once a
+// pipeline has drained, every register is committed and none of that state
+// remains, so fast-forwarding only has to consume records, and each detailed
+// window can start on a fresh pipeline.
+
+#include "sample.h"
+#include "sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Report how a trace ended in the middle of a fast-forward, the same way the
+ * fetch stage does.
+ */
+static void sample_report_end(SourceStatus status)
+{
+    if (status == SOURCE_ERROR)
+    {
+        fprintf(stderr, "\n");
+        perror("Couldn't read trace file");
+    }
+    else if (status == SOURCE_INVALID)
+    {
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Error: Invalid trace file\n");
+    }
+}
+
+/**
+ * Simulate a trace by sampling.
+ *
+ * @param src the source to simulate
+ * @param pipe_config the configuration of every detailed window's pipeline
+ * @param config the sampling parameters
+ * @param skip_idle whether detailed windows fast-forward through idle cycles
+ * @param stats receives the results
+ * @return 0 on success, -1 if a pipeline could not be allocated (an error
+ *         has been printed), or another nonzero value if a detailed window
+ *         deadlocked
+ */
+int sample_run(InstSource *src, const PipelineConfig *pipe_config,
+               const SampleConfig *config, bool skip_idle, SampleStats *stats)
+{
+    uint64_t ff_insts = config->period - config->warmup - config->window;
+    double sum_cpi = 0.0;
+    double sum_cpi_sq = 0.0;
+
+    stats->num_insts = 0;
+    stats->detailed_insts = 0;
+    stats->num_samples = 0;
+
+    int status = 0;
+    while (status == 0)
+    {
+        // Fast-forward to the warm-up window.
+        uint64_t skipped;
+        SourceStatus ff_status = source_skip(src, ff_insts, &skipped);
+        stats->num_insts += skipped;
+        if (ff_status != SOURCE_OK)
+        {
+            sample_report_end(ff_status);
+            break;
+        }
+
+        // Simulate the warm-up and measurement windows in detail on a drained
+        // pipeline.
+        InstSource *win = source_init_window(src, config->warmup +
+                                                  config->window);
+        Pipeline *p = pipe_init(pipe_config, win);
+        if (p == NULL)
+        {
+            source_free(win);
+            return -1;
+        }
+        p->skip_idle = skip_idle;
+
+        status = run_pipeline_until(p, config->warmup, false);
+        uint64_t start_cycle = p->stat_num_cycle;
+        uint64_t start_inst = p->stat_retired_inst;
+        if (status == 0)
+        {
+            status = run_pipeline(p, false);
+        }
+
+        // Only whole measurement windows are sampled.
+        uint64_t measured = p->stat_retired_inst - start_inst;
+        if (status == 0 && measured > 0 &&
+            p->stat_retired_inst == config->warmup + config->window)
+        {
+            double cpi = (double)(p->stat_num_cycle - start_cycle) /
+                         (double)measured;
+            sum_cpi += cpi;
+            sum_cpi_sq += cpi * cpi;
+            stats->num_samples++;
+        }
+
+        stats->num_insts += p->stat_retired_inst;
+        stats->detailed_insts += p->stat_retired_inst;
+        pipe_free(p);
+
+        SourceStatus win_status = source_window_status(win);
+        source_free(win);
+        if (win_status != SOURCE_OK)
+        {
+            break;
+        }
+    }
+
+    // Every window is the same size, so the mean of the window CPIs is the
+    // estimate of the CPI, and their spread gives its confidence interval.
+    uint64_t n = stats->num_samples;
+    stats->cpi = n > 0 ? sum_cpi / n : 0.0;
+    stats->cpi_ci95 = 0.0;
+    if (n > 1)
+    {
+        double var = (sum_cpi_sq - n * stats->cpi * stats->cpi) / (n - 1);
+        stats->cpi_ci95 = 1.96 * sqrt(var > 0.0 ? var : 0.0) / sqrt((double)n);
+    }
+    return status;
+}
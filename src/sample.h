@@ -0,0 +1,61 @@
+// sample.h
+// Declares the sampled simulation mode.
+//
+// The trace is divided into sampling units of a fixed number of
+// instructions. Most of each unit is fast-forwarded: its records are consumed
+// without being simulated. The instructions at the end of the unit are
+// simulated in detail on a drained pipeline, first as a warm-up window that
+// refills the ROB and then as a measurement window whose CPI is recorded.
+// The whole-trace CPI is estimated from the mean of the measured windows,
+// with a confidence interval from their spread.
+
+#ifndef _SAMPLE_H_
+#define _SAMPLE_H_
+
+#include "pipeline.h"
+#include "source.h"
+#include <inttypes.h>
+
+/** The sampling parameters. */
+typedef struct SampleConfigStruct
+{
+    /** The number of instructions in each sampling unit. */
+    uint64_t period;
+    /** The number of instructions simulated before each measurement. */
+    uint64_t warmup;
+    /** The number of instructions measured in each sampling unit. */
+    uint64_t window;
+} SampleConfig;
+
+/** The results of a sampled simulation. */
+typedef struct SampleStatsStruct
+{
+    /** The number of instructions in the trace. */
+    uint64_t num_insts;
+    /** The number of instructions simulated in detail. */
+    uint64_t detailed_insts;
+    /** The number of measurement windows. */
+    uint64_t num_samples;
+    /** The estimated CPI of the whole trace. */
+    double cpi;
+    /** The half-width of the 95% confidence interval of cpi. */
+    double cpi_ci95;
+} SampleStats;
+
+/**
+ * Simulate a trace by sampling.
+ *
+ * @param src the source to simulate
+ * @param pipe_config the configuration of every detailed window's pipeline
+ * @param config the sampling parameters; warmup + window must not exceed
+ *               period
+ * @param skip_idle whether detailed windows fast-forward through idle cycles
+ * @param stats receives the results
+ * @return 0 on success, -1 if a pipeline could not be allocated (an error
+ *         has been printed), or another nonzero value if a detailed window
+ *         deadlocked
+ */
+int sample_run(InstSource *src, const PipelineConfig *pipe_config,
+               const SampleConfig *config, bool skip_idle, SampleStats *stats);
+
+#endif
@@ -1,176 +1,1376 @@
 // sim.cpp
 // Performs a timing simulation of an out-of-order pipelined CPU
 
-#include "pipeline.h"
+#include "sim.h"
+#include "batch.h"
+#include "ckpt.h"
+#include "decomp.h"
+#include "estimate.h"
+#include "ingest.h"
+#include "interval.h"
+#include "lifetrace.h"
+#include "multicore.h"
+#include "prefetch.h"
+#include "profile.h"
+#include "report.h"
+#include "sample.h"
+#include "sweep.h"
+#include "tcache.h"
+#include "telemetry.h"
+#include "verify.h"
+#include <chrono>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <unistd.h>
+#include <thread>
+#include <vector>
+
+/** The options selected on the command line. */
+typedef struct SimOptionsStruct
+{
+    /** The configuration of the pipeline(s) to simulate. */
+    PipelineConfig config;
+    /** The trace file to simulate. */
+    char *trace_filename;
+    /** Every trace file given, the first being trace_filename. */
+    char **trace_filenames;
+    /** The number of trace files given. */
+    unsigned int num_traces;
+    /** Whether to simulate one core per trace file. */
+    bool multicore;
+    /** The number of cycles the cores of a multi-core run simulate between barriers. */
+    uint64_t quantum;
+    /** If not NULL, the file listing the configurations to sweep. */
+    char *sweep_filename;
+    /** The number of threads to decompress BGZF traces with. */
+    unsigned int gz_threads;
+    /** If not NULL, build a trace cache of trace_filename in this file. */
+    char *tcache_filename;
+    /** Whether the trace cache to build holds the optional columns. */
+    bool tcache_extra;
+    /** Whether to fast-forward through idle cycles. */
+    bool skip_idle;
+    /** Whether to read and decode the trace on a separate thread. */
+    bool prefetch;
+    /** Whether to check the pipeline against the reference engine. */
+    bool verify;
+    /** Whether to estimate the CPI analytically instead of simulating. */
+    bool estimate;
+    /** Whether to also simulate the estimated configurations and report the error. */
+    bool estimate_check;
+    /** The sampling parameters; a period of 0 simulates every instruction. */
+    SampleConfig sample;
+    /** If not NULL, save a checkpoint to this file during the run. */
+    char *ckpt_filename;
+    /** The number of retired instructions at which to save the checkpoint. */
+    uint64_t ckpt_inst;
+    /** If not NULL, resume from the checkpoint in this file. */
+    char *restore_filename;
+    /**
+     * The last of -pipewidth, -loadlatency, -schedpolicy, and -robsize given,
+     * or NULL if none was.
+     */
+    const char *config_option;
+    /** If not 0, simulate the trace as this many intervals in parallel. */
+    unsigned int num_intervals;
+    /** The number of warm-up instructions before each interval. */
+    uint64_t interval_warmup;
+    /** Whether to also simulate the trace serially and report the error. */
+    bool interval_check;
+    /** The format of the machine-readable report, if any. */
+    ReportFormat report_format;
+    /** If not NULL, write the report to this file instead of stdout. */
+    char *report_filename;
+    /** If not NULL, the jobs file to run as a batch. */
+    char *batch_filename;
+    /** The directory batch results are written to. */
+    char *batch_out_dir;
+    /** The number of worker threads of a batch. */
+    unsigned int batch_threads;
+    /** If not NULL, write a telemetry time series to this file. */
+    char *telemetry_filename;
+    /** The format of the telemetry time series. */
+    TelemetryFormat telemetry_format;
+    /** The number of cycles between telemetry snapshots. */
+    uint32_t telemetry_interval;
+    /** How often the telemetry writer drains its ring, in milliseconds. */
+    unsigned int telemetry_flush_ms;
+    /** If not NULL, write the lifecycles of instructions to this file. */
+    char *lifetrace_filename;
+    /** The format of the lifecycle file. */
+    LifetraceFormat lifetrace_format;
+    /** The position in the trace of the first instruction to trace. */
+    uint64_t lifetrace_first;
+    /** The position in the trace of the last instruction to trace. */
+    uint64_t lifetrace_last;
+    /** Trace one instruction in this many. */
+    uint64_t lifetrace_sample;
+} SimOptions;
+
+/** The time the simulator started. */
+static std::chrono::steady_clock::time_point sim_start_time;
+
+int parse_args(int argc, char *argv[], SimOptions *opts);
+InstSource *open_trace(const SimOptions *opts);
+int run_sweep(InstSource *src, const SimOptions *opts);
+int run_sampled(InstSource *src, const SimOptions *opts);
+int run_verify(InstSource *src, const SimOptions *opts);
+int run_estimate(InstSource *src, const SimOptions *opts);
+int run_intervals(const SimOptions *opts);
+int run_multicore(const SimOptions *opts);
+double seconds_since(std::chrono::steady_clock::time_point start);
+int write_reports(const SimOptions *opts, const PipelineConfig *configs,
+                  Pipeline *const *pipelines, const int *statuses,
+                  size_t num_configs, const HostStats *host);
+void print_usage(char *program_name);
+
+int main(int argc, char *argv[])
+{
+    int status;
+    sim_start_time = std::chrono::steady_clock::now();
+
+    // Parse the command-line arguments.
+    SimOptions opts;
+    status = parse_args(argc, argv, &opts);
+    if (status != 0)
+    {
+        return status;
+    }
+
+    // Compile with "make stageprofile" to have this show!
+    PROF_REPORT_AT_EXIT();
+
+    // Build a trace cache instead of simulating, if asked to.
+    if (opts.tcache_filename != NULL)
+    {
+        return tcache_build(opts.trace_filename, opts.tcache_filename,
+                            opts.tcache_extra, opts.gz_threads);
+    }
+
+    // Batch mode runs a whole matrix of traces and configurations.
+    if (opts.batch_filename != NULL)
+    {
+        return batch_run(opts.batch_filename, opts.batch_out_dir,
+                         opts.batch_threads, opts.gz_threads, opts.skip_idle,
+                         &opts.config);
+    }
+
+    // Interval mode opens the trace on every worker thread.
+    if (opts.num_intervals != 0)
+    {
+        return run_intervals(&opts);
+    }
+
+    // Multi-core mode opens each core's trace on the core's thread.
+    if (opts.multicore)
+    {
+        return run_multicore(&opts);
+    }
+
+    InstSource *src = open_trace(&opts);
+    if (src == NULL)
+    {
+        return 1;
+    }
+
+    // Estimate mode profiles the trace instead of simulating it.
+    if (opts.estimate)
+    {
+        return run_estimate(src, &opts);
+    }
+
+    // Sweep mode drives one pipeline per configuration from the same trace.
+    if (opts.sweep_filename != NULL)
+    {
+        return run_sweep(src, &opts);
+    }
+
+    // Sampling mode simulates only windows of the trace in detail.
+    if (opts.sample.period != 0)
+    {
+        return run_sampled(src, &opts);
+    }
+
+    // Verify mode runs the reference engine alongside the pipeline.
+    if (opts.verify)
+    {
+        return run_verify(src, &opts);
+    }
+
+    // Resume from a checkpoint, or start from the beginning of the trace.
+    Pipeline *pipeline;
+    if (opts.restore_filename != NULL)
+    {
+        pipeline = ckpt_restore(opts.restore_filename, src,
+                                opts.config.wakeup_engine);
+        if (pipeline == NULL)
+        {
+            source_free(src);
+            return 1;
+        }
+        printf("Restored checkpoint %s at instruction %lu, cycle %lu (",
+               opts.restore_filename,
+               (unsigned long)pipeline->stat_retired_inst,
+               (unsigned long)pipeline->stat_num_cycle);
+        opts.config = pipeline->config;
+        print_config(stdout, &opts.config);
+        printf(")\n");
+    }
+    else
+    {
+        pipeline = pipe_init(&opts.config, src);
+        if (pipeline == NULL)
+        {
+            source_free(src);
+            return 1;
+        }
+    }
+    pipeline->skip_idle = opts.skip_idle;
+    if (opts.telemetry_filename != NULL)
+    {
+        pipeline->telemetry = telemetry_open(opts.telemetry_filename,
+                                             opts.telemetry_format,
+                                             opts.telemetry_interval,
+                                             opts.telemetry_flush_ms,
+                                             pipeline->config.pipe_width);
+        if (pipeline->telemetry == NULL)
+        {
+            source_free(src);
+            return 1;
+        }
+    }
+    if (opts.lifetrace_filename != NULL)
+    {
+        Lifetrace *lifetrace = lifetrace_open(opts.lifetrace_filename,
+                                              opts.lifetrace_format,
+                                              &pipeline->config,
+                                              opts.lifetrace_first,
+                                              opts.lifetrace_last,
+                                              opts.lifetrace_sample);
+        if (lifetrace == NULL)
+        {
+            source_free(src);
+            return 1;
+        }
+        pipe_set_lifetrace(pipeline, lifetrace);
+    }
+
+    // Simulate the pipeline.
+    printf("\n** PIPELINE IS %u WIDE **\n\n", opts.config.pipe_width);
+    std::chrono::steady_clock::time_point sim_time = std::chrono::steady_clock::now();
+    status = 0;
+    if (opts.ckpt_filename != NULL)
+    {
+        status = run_pipeline_until(pipeline, opts.ckpt_inst, true);
+        if (status == 0 && !pipeline->halt)
+        {
+            status = ckpt_save(opts.ckpt_filename, pipeline);
+            printf("\nSaved checkpoint %s at instruction %lu, cycle %lu\n",
+                   opts.ckpt_filename,
+                   (unsigned long)pipeline->stat_retired_inst,
+                   (unsigned long)pipeline->stat_num_cycle);
+        }
+    }
+    if (status == 0)
+    {
+        status = run_pipeline(pipeline, true);
+    }
+
+    HostStats host;
+    host.sim_seconds = seconds_since(sim_time);
+    report_collect_host(&host, opts.trace_filename, src);
+    source_free(src);
+    if (pipeline->telemetry != NULL &&
+        telemetry_close(pipeline->telemetry, pipeline) != 0 && status == 0)
+    {
+        status = 1;
+    }
+    if (pipeline->lifetrace != NULL)
+    {
+        uint64_t traced = pipeline->lifetrace->total_records;
+        if (lifetrace_close(pipeline->lifetrace) != 0 && status == 0)
+        {
+            status = 1;
+        }
+        pipe_set_lifetrace(pipeline, NULL);
+        if (status == 0)
+        {
+            printf("\nWrote the lifecycles of %lu instructions to %s\n",
+                   (unsigned long)traced, opts.lifetrace_filename);
+        }
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+
+    // Print statistics.
+    print_stats(pipeline);
+    return write_reports(&opts, &pipeline->config, &pipeline, &status, 1, &host);
+}
+
+/**
+ * Get the time elapsed since a point in time.
+ *
+ * @param start the point in time
+ * @return the elapsed time, in seconds
+ */
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start).count();
+}
+
+/**
+ * Write the machine-readable report of every configuration that finished, if
+ * one was asked for.
+ *
+ * @return 0 on success, nonzero if the report file could not be written
+ */
+int write_reports(const SimOptions *opts, const PipelineConfig *configs,
+                  Pipeline *const *pipelines, const int *statuses,
+                  size_t num_configs, const HostStats *host)
+{
+    if (opts->report_format == REPORT_NONE)
+    {
+        return 0;
+    }
+
+    FILE *out = stdout;
+    if (opts->report_filename != NULL)
+    {
+        out = fopen(opts->report_filename, "w");
+        if (out == NULL)
+        {
+            perror("Couldn't open stats file");
+            return 1;
+        }
+    }
+
+    HostStats final_host = *host;
+    final_host.wall_seconds = seconds_since(sim_start_time);
+    bool header = true;
+    for (size_t i = 0; i < num_configs; i++)
+    {
+        if (statuses[i] != 0)
+        {
+            continue;
+        }
+        report_write(out, opts->report_format, header, opts->trace_filename,
+                     &configs[i], pipelines[i], &final_host);
+        header = false;
+    }
+
+    if (out != stdout && fclose(out) != 0)
+    {
+        perror("Couldn't write stats file");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Open the trace file selected on the command line as a source of
+ * instructions.
+ */
+InstSource *open_trace(const SimOptions *opts)
+{
+    printf("Opening trace file: %s\n", opts->trace_filename);
+    InstSource *src = open_trace_file(opts->trace_filename, opts->gz_threads);
+    if (src != NULL && opts->prefetch)
+    {
+        src = source_init_prefetch(src, PREFETCH_RING_INSTS);
+    }
+    return src;
+}
+
+/**
+ * Simulate every configuration listed in a sweep file on the same trace and
+ * print one block of statistics per configuration.
+ */
+int run_sweep(InstSource *src, const SimOptions *opts)
+{
+    int status;
+
+    std::vector<PipelineConfig> configs;
+    status = sweep_read_configs(opts->sweep_filename, &opts->config, &configs);
+    if (status != 0)
+    {
+        source_free(src);
+        return status;
+    }
+
+    printf("\n** SWEEPING %u CONFIGURATIONS **\n", (unsigned int)configs.size());
+    std::vector<Pipeline *> pipelines(configs.size());
+    std::vector<int> statuses(configs.size());
+    std::chrono::steady_clock::time_point sim_time = std::chrono::steady_clock::now();
+    sweep_run(src, configs.data(), configs.size(), opts->skip_idle,
+              pipelines.data(), statuses.data());
+    HostStats host;
+    host.sim_seconds = seconds_since(sim_time);
+    report_collect_host(&host, opts->trace_filename, src);
+    source_free(src);
+
+    // Print statistics.
+    status = 0;
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        printf("\n== Configuration %u: ", (unsigned int)i + 1);
+        print_config(stdout, &configs[i]);
+        printf(" ==");
+        if (pipelines[i] == NULL)
+        {
+            printf("\n");
+            status = statuses[i];
+            continue;
+        }
+        if (statuses[i] != 0)
+        {
+            printf("\nError: pipeline is deadlocked\n");
+            status = statuses[i];
+            continue;
+        }
+        print_stats(pipelines[i]);
+    }
+
+    int report_status = write_reports(opts, configs.data(), pipelines.data(),
+                                      statuses.data(), configs.size(), &host);
+    return status != 0 ? status : report_status;
+}
+
+/**
+ * Simulate a trace by sampling and print the estimated statistics.
+ */
+int run_sampled(InstSource *src, const SimOptions *opts)
+{
+    printf("\n** PIPELINE IS %u WIDE, SAMPLING %lu OF EVERY %lu INSTRUCTIONS **\n",
+           opts->config.pipe_width, (unsigned long)opts->sample.window,
+           (unsigned long)opts->sample.period);
+
+    SampleStats stats;
+    int status = sample_run(src, &opts->config, &opts->sample, opts->skip_idle,
+                            &stats);
+    source_free(src);
+    if (status == -1)
+    {
+        return 1;
+    }
+    if (status != 0)
+    {
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Error: pipeline is deadlocked\n");
+        return status;
+    }
+    if (stats.num_samples == 0)
+    {
+        fprintf(stderr, "Error: the trace is too short to take a sample\n");
+        return 1;
+    }
+
+    unsigned long est_cycles = (unsigned long)(stats.cpi * stats.num_insts + 0.5);
+    printf("\n\n");
+    printf("LAB3_NUM_INST           \t : %10lu\n", (unsigned long)stats.num_insts);
+    printf("LAB3_NUM_CYCLES         \t : %10lu\n", est_cycles);
+    printf("LAB3_CPI                \t : %10.3f\n", stats.cpi);
+    printf("LAB3_CPI_CI95           \t : %10.3f\n", stats.cpi_ci95);
+    printf("LAB3_NUM_SAMPLES        \t : %10lu\n", (unsigned long)stats.num_samples);
+    printf("LAB3_DETAILED_INST      \t : %10lu\n", (unsigned long)stats.detailed_insts);
+    printf("\n");
+    return 0;
+}
+
+/**
+ * Simulate a trace in lockstep with the reference engine and print the
+ * statistics if every commit matched.
+ */
+int run_verify(InstSource *src, const SimOptions *opts)
+{
+    InstSource *ref_src = open_trace_file(opts->trace_filename, opts->gz_threads);
+    if (ref_src == NULL)
+    {
+        source_free(src);
+        return 1;
+    }
+
+    printf("\n** PIPELINE IS %u WIDE, VERIFYING AGAINST THE REFERENCE ENGINE **\n",
+           opts->config.pipe_width);
+    Pipeline *p = pipe_init(&opts->config, src);
+    if (p == NULL)
+    {
+        source_free(ref_src);
+        source_free(src);
+        return 1;
+    }
+    p->skip_idle = opts->skip_idle;
+    std::chrono::steady_clock::time_point sim_time = std::chrono::steady_clock::now();
+    int status = verify_run(p, ref_src);
+    HostStats host;
+    host.sim_seconds = seconds_since(sim_time);
+    report_collect_host(&host, opts->trace_filename, src);
+    source_free(ref_src);
+    source_free(src);
+    if (status != 0)
+    {
+        pipe_free(p);
+        return status;
+    }
+
+    printf("\nAll %lu commits matched the reference engine\n",
+           (unsigned long)p->stat_retired_inst);
+    print_stats(p);
+    status = write_reports(opts, &p->config, &p, &status, 1, &host);
+    pipe_free(p);
+    return status;
+}
+
+/**
+ * Estimate the CPI of every configuration listed in the sweep file, or of the
+ * default grid, from a profile of the trace, and print the estimates (and
+ * their error against detailed simulation, if asked to).
+ */
+int run_estimate(InstSource *src, const SimOptions *opts)
+{
+    int status;
+
+    std::vector<PipelineConfig> configs;
+    if (opts->sweep_filename != NULL)
+    {
+        status = sweep_read_configs(opts->sweep_filename, &opts->config, &configs);
+        if (status != 0)
+        {
+            source_free(src);
+            return status;
+        }
+    }
+    else
+    {
+        estimate_default_configs(&configs);
+    }
+
+    printf("\n** ESTIMATING %u CONFIGURATIONS **\n\n", (unsigned int)configs.size());
+    EstProfile *prof = (EstProfile *)malloc(sizeof(EstProfile));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    status = estimate_profile(src, prof);
+    double profile_seconds = seconds_since(start);
+    source_free(src);
+    if (status != 0)
+    {
+        free(prof);
+        return status;
+    }
+    estimate_print_profile(stdout, prof);
+
+    start = std::chrono::steady_clock::now();
+    EstModel *model = estimate_model_init(prof);
+    std::vector<double> est_cpis(configs.size());
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        est_cpis[i] = estimate_cpi(model, &configs[i]);
+    }
+    double model_seconds = seconds_since(start);
+    uint64_t num_insts = prof->num_insts;
+    estimate_model_free(model);
+    free(prof);
+
+    // Simulate every configuration in detail for comparison.
+    std::vector<Pipeline *> pipelines(configs.size(), NULL);
+    std::vector<int> statuses(configs.size(), 0);
+    if (opts->estimate_check)
+    {
+        src = open_trace_file(opts->trace_filename, opts->gz_threads);
+        if (src == NULL)
+        {
+            return 1;
+        }
+        sweep_run(src, configs.data(), configs.size(), opts->skip_idle,
+                  pipelines.data(), statuses.data());
+        source_free(src);
+    }
+
+    printf("\n");
+    double sum_error = 0;
+    double max_error = 0;
+    for (size_t i = 0; i < configs.size(); i++)
+    {
+        printf("Configuration %3u: ", (unsigned int)i + 1);
+        print_config(stdout, &configs[i]);
+        printf("\tEst. CPI: %6.3f", est_cpis[i]);
+        if (opts->estimate_check)
+        {
+            if (pipelines[i] == NULL)
+            {
+                printf("\n");
+                status = statuses[i];
+                continue;
+            }
+            if (statuses[i] != 0)
+            {
+                printf("\n");
+                fprintf(stderr, "Error: pipeline is deadlocked\n");
+                status = statuses[i];
+                pipe_free(pipelines[i]);
+                continue;
+            }
+            double cpi = (double)pipelines[i]->stat_num_cycle /
+                         (double)pipelines[i]->stat_retired_inst;
+            double error = 100.0 * (est_cpis[i] - cpi) / cpi;
+            printf("\tCPI: %6.3f\tError: %+6.1f%%", cpi, error);
+            sum_error += error < 0 ? -error : error;
+            max_error = error < 0 ? (-error > max_error ? -error : max_error)
+                                  : (error > max_error ? error : max_error);
+            pipe_free(pipelines[i]);
+        }
+        printf("\n");
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+
+    printf("\n\n");
+    printf("LAB3_NUM_INST           \t : %10lu\n", (unsigned long)num_insts);
+    printf("LAB3_EST_NUM_CONFIGS    \t : %10u\n", (unsigned int)configs.size());
+    printf("LAB3_EST_PROFILE_SEC    \t : %10.3f\n", profile_seconds);
+    printf("LAB3_EST_MODEL_SEC      \t : %10.3f\n", model_seconds);
+    if (opts->estimate_check)
+    {
+        printf("LAB3_EST_MEAN_ERROR_PCT \t : %10.1f\n", sum_error / configs.size());
+        printf("LAB3_EST_MAX_ERROR_PCT  \t : %10.1f\n", max_error);
+    }
+    printf("\n");
+    return 0;
+}
+
+/**
+ * Simulate one core per trace file, each on its own thread, and print the
+ * statistics of every core along with the combined throughput.
+ */
+int run_multicore(const SimOptions *opts)
+{
+    MulticoreConfig config;
+    config.config = opts->config;
+    config.quantum = opts->quantum;
+    config.gz_threads = opts->gz_threads;
+    config.prefetch = opts->prefetch;
+    config.skip_idle = opts->skip_idle;
+
+    printf("\n** SIMULATING %u CORES, EACH %u WIDE, IN QUANTA OF %lu CYCLES **\n\n",
+           opts->num_traces, opts->config.pipe_width, (unsigned long)opts->quantum);
+    std::vector<CoreResult> results(opts->num_traces);
+    multicore_run(opts->trace_filenames, opts->num_traces, &config,
+                  results.data());
+
+    int status = 0;
+    uint64_t stat_num_inst = 0;
+    uint64_t stat_num_cycle = 0;
+    double sum_ipc = 0.0;
+    for (unsigned int i = 0; i < opts->num_traces; i++)
+    {
+        const CoreResult *res = &results[i];
+        Pipeline *p = res->pipeline;
+        if (p == NULL)
+        {
+            fprintf(stderr, "Error: core %u could not start on %s\n", i,
+                    opts->trace_filenames[i]);
+            status = 1;
+            continue;
+        }
+
+        double ipc = p->stat_num_cycle > 0
+                         ? (double)p->stat_retired_inst / (double)p->stat_num_cycle
+                         : 0.0;
+        printf("Core %4u: instructions %10lu\tCycles: %10lu\tIPC: %5.3f\t"
+               "Barrier wait: %4.1f%%\t%s\n",
+               i, (unsigned long)p->stat_retired_inst,
+               (unsigned long)p->stat_num_cycle, ipc,
+               res->sim_seconds > 0.0 ? 100.0 * res->wait_seconds / res->sim_seconds : 0.0,
+               opts->trace_filenames[i]);
+        if (res->status != 0)
+        {
+            fprintf(stderr, "Error: core %u is deadlocked\n", i);
+            status = res->status;
+        }
+        stat_num_inst += p->stat_retired_inst;
+        if (p->stat_num_cycle > stat_num_cycle)
+        {
+            stat_num_cycle = p->stat_num_cycle;
+        }
+        sum_ipc += ipc;
+        pipe_free(p);
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+
+    printf("\n\n");
+    printf("LAB3_NUM_CORES          \t : %10u\n", opts->num_traces);
+    printf("LAB3_NUM_INST           \t : %10lu\n", (unsigned long)stat_num_inst);
+    printf("LAB3_NUM_CYCLES         \t : %10lu\n", (unsigned long)stat_num_cycle);
+    printf("LAB3_IPC                \t : %10.3f\n",
+           (double)stat_num_inst / (double)stat_num_cycle);
+    printf("LAB3_MEAN_CORE_IPC      \t : %10.3f\n", sum_ipc / opts->num_traces);
+    printf("\n");
+    return 0;
+}
 
 /**
- * The width of the pipeline; that is, the maximum number of instructions that
- * can be processed during any given cycle in each of the issue, schedule, and
- * commit stages of the pipeline.
- * 
- * When the width is 1, the pipeline is scalar.
- * When the width is greater than 1, the pipeline is superscalar.
+ * Simulate a trace cache as several intervals in parallel and print the
+ * combined statistics, along with the error against a serial run if asked.
  */
-uint32_t PIPE_WIDTH = 1;
+int run_intervals(const SimOptions *opts)
+{
+    printf("Opening trace file: %s\n", opts->trace_filename);
+    if (!tcache_probe(opts->trace_filename))
+    {
+        fprintf(stderr, "Error: -intervals needs a trace cache (see -mktracecache)\n");
+        return 1;
+    }
+    TCache *cache = tcache_open(opts->trace_filename);
+    if (cache == NULL)
+    {
+        return 1;
+    }
+    uint64_t num_insts = cache->hdr->num_insts;
+    tcache_close(cache);
+    if (num_insts < opts->num_intervals)
+    {
+        fprintf(stderr, "Error: the trace has fewer instructions than intervals\n");
+        return 1;
+    }
+
+    printf("\n** PIPELINE IS %u WIDE, SIMULATING %u INTERVALS IN PARALLEL **\n\n",
+           opts->config.pipe_width, opts->num_intervals);
+    std::vector<IntervalResult> results(opts->num_intervals);
+    interval_run(opts->trace_filename, num_insts, opts->num_intervals,
+                 opts->interval_warmup, &opts->config, opts->skip_idle,
+                 results.data());
+
+    // Combine the intervals.
+    int status = 0;
+    uint64_t stat_num_inst = 0;
+    uint64_t stat_num_cycle = 0;
+    for (unsigned int i = 0; i < opts->num_intervals; i++)
+    {
+        const IntervalResult *res = &results[i];
+        printf("Interval %4u: instructions %10lu-%10lu\tCycles: %10lu\tCPI: %5.3f\n",
+               i + 1, (unsigned long)res->first_inst,
+               (unsigned long)(res->first_inst + res->num_insts - 1),
+               (unsigned long)res->num_cycles,
+               (double)res->num_cycles / (double)res->num_insts);
+        if (res->status != 0)
+        {
+            fprintf(stderr, "Error: interval %u failed\n", i + 1);
+            status = res->status;
+        }
+        stat_num_inst += res->retired_insts;
+        stat_num_cycle += res->num_cycles;
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+
+    double cpi = (double)stat_num_cycle / (double)stat_num_inst;
+    printf("\n\n");
+    printf("LAB3_NUM_INST           \t : %10lu\n", (unsigned long)stat_num_inst);
+    printf("LAB3_NUM_CYCLES         \t : %10lu\n", (unsigned long)stat_num_cycle);
+    printf("LAB3_CPI                \t : %10.3f\n", cpi);
+    printf("LAB3_NUM_INTERVALS      \t : %10u\n", opts->num_intervals);
+    printf("\n");
+
+    if (!opts->interval_check)
+    {
+        return 0;
+    }
+
+    // Simulate the whole trace serially for comparison.
+    cache = tcache_open(opts->trace_filename);
+    if (cache == NULL)
+    {
+        return 1;
+    }
+    Simulator *serial = Simulator::create(opts->config, source_init_tcache(cache));
+    if (serial == NULL)
+    {
+        return 1;
+    }
+    serial->pipeline()->skip_idle = opts->skip_idle;
+    status = serial->run();
+    SimulatorStats serial_stats = serial->stats();
+    delete serial;
+    if (status != 0)
+    {
+        fprintf(stderr, "Error: pipeline is deadlocked\n");
+        return status;
+    }
+
+    double error = 100.0 * ((double)stat_num_cycle - (double)serial_stats.cycles) /
+                   (double)serial_stats.cycles;
+    printf("LAB3_SERIAL_NUM_CYCLES  \t : %10lu\n", (unsigned long)serial_stats.cycles);
+    printf("LAB3_SERIAL_CPI         \t : %10.3f\n", serial_stats.cpi);
+    printf("LAB3_CYCLES_ERROR_PCT   \t : %+10.4f\n", error);
+    printf("\n");
+    return 0;
+}
+
+int parse_config_option(int argc, char *argv[], int *i, PipelineConfig *config)
+{
+    if (strcmp(argv[*i], "-pipewidth") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -pipewidth\n");
+            return 2;
+        }
+
+        int pipe_width = atoi(argv[*i]);
+        if (pipe_width < 1 || pipe_width > MAX_PIPE_WIDTH)
+        {
+            fprintf(stderr, "Error: pipe width must be between 1 and %d\n", MAX_PIPE_WIDTH);
+            return 2;
+        }
+
+        config->pipe_width = pipe_width;
+    }
+    else if (strcmp(argv[*i], "-loadlatency") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -loadlatency\n");
+            return 2;
+        }
+
+        int load_exe_cycles = atoi(argv[*i]);
+        if (load_exe_cycles < 1)
+        {
+            fprintf(stderr, "Error: load latency must be a positive integer number of cycles\n");
+            return 2;
+        }
+
+        config->load_exe_cycles = load_exe_cycles;
+    }
+    else if (strcmp(argv[*i], "-schedpolicy") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -schedpolicy\n");
+            return 2;
+        }
+
+        int policy = atoi(argv[*i]);
+        if (policy < 0 || policy >= NUM_SCHED_POLICIES)
+        {
+            fprintf(stderr, "Error: invalid argument for -schedpolicy\n");
+            return 2;
+        }
+
+        config->sched_policy = (SchedulingPolicy)policy;
+    }
+    else if (strcmp(argv[*i], "-robsize") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -robsize\n");
+            return 2;
+        }
+
+        int num_rob_entries = atoi(argv[*i]);
+        if (num_rob_entries < 1 || num_rob_entries > MAX_ROB_ENTRIES)
+        {
+            fprintf(stderr, "Error: ROB size must be between 1 and %d\n", MAX_ROB_ENTRIES);
+            return 2;
+        }
+
+        config->num_rob_entries = num_rob_entries;
+    }
+    else if (strcmp(argv[*i], "-wakeup") == 0)
+    {
+        if (++*i >= argc)
+        {
+            fprintf(stderr, "Error: missing argument to -wakeup\n");
+            return 2;
+        }
+
+        int engine = 0;
+        while (engine < NUM_WAKEUP_ENGINES &&
+               strcmp(argv[*i], WAKEUP_ENGINE_NAMES[engine]) != 0)
+        {
+            engine++;
+        }
+        if (engine == NUM_WAKEUP_ENGINES)
+        {
+            fprintf(stderr, "Error: -wakeup must be deplist, scan, or simd\n");
+            return 2;
+        }
+
+        config->wakeup_engine = (WakeupEngine)engine;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+void print_config(FILE *out, const PipelineConfig *config)
+{
+    fprintf(out, "-pipewidth %u -schedpolicy %d -loadlatency %u -robsize %u",
+            config->pipe_width, (int)config->sched_policy,
+            config->load_exe_cycles, config->num_rob_entries);
+
+    // The wakeup engine leaves the results unchanged, so the default is not
+    // printed.
+    if (config->wakeup_engine != WAKEUP_DEPLIST)
+    {
+        fprintf(out, " -wakeup %s", WAKEUP_ENGINE_NAMES[config->wakeup_engine]);
+    }
+}
+
+int parse_args(int argc, char *argv[], SimOptions *opts)
+{
+    pipe_default_config(&opts->config);
+    opts->trace_filename = NULL;
+    opts->trace_filenames = (char **)calloc(argc, sizeof(char *));
+    opts->num_traces = 0;
+    opts->multicore = false;
+    opts->quantum = MULTICORE_DEFAULT_QUANTUM;
+    opts->sweep_filename = NULL;
+    opts->gz_threads = 1;
+    opts->prefetch = false;
+    opts->verify = false;
+    opts->estimate = false;
+    opts->estimate_check = false;
+    opts->tcache_filename = NULL;
+    opts->tcache_extra = false;
+    opts->skip_idle = false;
+    opts->sample.period = 0;
+    opts->sample.warmup = 2000;
+    opts->sample.window = 1000;
+    opts->ckpt_filename = NULL;
+    opts->ckpt_inst = 0;
+    opts->restore_filename = NULL;
+    opts->config_option = NULL;
+    opts->num_intervals = 0;
+    opts->interval_warmup = 10000;
+    opts->interval_check = false;
+    opts->report_format = REPORT_NONE;
+    opts->report_filename = NULL;
+    opts->batch_filename = NULL;
+    opts->batch_out_dir = (char *)"results";
+    opts->batch_threads = std::thread::hardware_concurrency();
+    if (opts->batch_threads == 0)
+    {
+        opts->batch_threads = 1;
+    }
+    opts->telemetry_filename = NULL;
+    opts->telemetry_format = TELEMETRY_CSV;
+    opts->telemetry_interval = HEARTBEAT_CYCLES;
+    opts->telemetry_flush_ms = 100;
+    opts->lifetrace_filename = NULL;
+    opts->lifetrace_format = LIFETRACE_O3;
+    opts->lifetrace_first = 1;
+    opts->lifetrace_last = UINT64_MAX;
+    opts->lifetrace_sample = 1;
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        // A lone "-" is standard input, not an option.
+        if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            // Parse options.
+            const char *option = argv[i];
+            int status = parse_config_option(argc, argv, &i, &opts->config);
+            if (status > 0)
+            {
+                return status;
+            }
+            else if (status == 0)
+            {
+                if (strcmp(option, "-wakeup") != 0)
+                {
+                    opts->config_option = option;
+                }
+                continue;
+            }
+
+            if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+            {
+                print_usage(argv[0]);
+                return 2;
+            }
+            else if (strcmp(argv[i], "-sweep") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -sweep\n");
+                    return 2;
+                }
+
+                opts->sweep_filename = argv[i];
+            }
+            else if (strcmp(argv[i], "-gzthreads") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -gzthreads\n");
+                    return 2;
+                }
+
+                int gz_threads = atoi(argv[i]);
+                if (gz_threads < 1)
+                {
+                    fprintf(stderr, "Error: -gzthreads must be a positive number of threads\n");
+                    return 2;
+                }
+
+                opts->gz_threads = gz_threads;
+            }
+            else if (strcmp(argv[i], "-mktracecache") == 0)
+            {
+                if (i + 2 >= argc)
+                {
+                    fprintf(stderr, "Error: -mktracecache needs an input trace and an output file\n");
+                    return 2;
+                }
+                if (opts->trace_filename != NULL)
+                {
+                    fprintf(stderr, "Error: only one trace file may be specified\n");
+                    return 2;
+                }
 
-/**
- * The number of entries in the ROB; that is, the maximum number of
- * instructions that can be stored in the ROB at any given time.
- */
-uint32_t NUM_ROB_ENTRIES = 32;
+                opts->trace_filename = argv[++i];
+                opts->tcache_filename = argv[++i];
+            }
+            else if (strcmp(argv[i], "-cacheextra") == 0)
+            {
+                opts->tcache_extra = true;
+            }
+            else if (strcmp(argv[i], "-skipidle") == 0)
+            {
+                opts->skip_idle = true;
+            }
+            else if (strcmp(argv[i], "-prefetch") == 0)
+            {
+                opts->prefetch = true;
+            }
+            else if (strcmp(argv[i], "-verify") == 0)
+            {
+                opts->verify = true;
+            }
+            else if (strcmp(argv[i], "-estimate") == 0)
+            {
+                opts->estimate = true;
+            }
+            else if (strcmp(argv[i], "-estimatecheck") == 0)
+            {
+                opts->estimate_check = true;
+            }
+            else if (strcmp(argv[i], "-multicore") == 0)
+            {
+                opts->multicore = true;
+            }
+            else if (strcmp(argv[i], "-quantum") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -quantum\n");
+                    return 2;
+                }
 
-/**
- * The number of cycles an LD instruction should take to execute.
- */
-uint32_t LOAD_EXE_CYCLES = 4;
+                char *end;
+                long long n = strtoll(argv[i], &end, 10);
+                if (*end != '\0' || n < 1)
+                {
+                    fprintf(stderr, "Error: quantum must be a positive number of cycles\n");
+                    return 2;
+                }
 
-/**
- * Whether to use in-order scheduling or out-of-order scheduling.
- * 
- * The possible values are SCHED_IN_ORDER for in-order scheduling and
- * SCHED_OUT_OF_ORDER for out-of-order scheduling.
- */
-SchedulingPolicy SCHED_POLICY = SCHED_OUT_OF_ORDER;
+                opts->quantum = n;
+            }
+            else if (strcmp(argv[i], "-intervals") == 0 ||
+                     strcmp(argv[i], "-intervalwarmup") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to %s\n", argv[i - 1]);
+                    return 2;
+                }
 
-#define HEARTBEAT_CYCLES 10000
-#define STAT_CYCLES (HEARTBEAT_CYCLES * 50)
+                char *end;
+                long long n = strtoll(argv[i], &end, 10);
+                if (*end != '\0' || n < 0 ||
+                    (strcmp(argv[i - 1], "-intervals") == 0 &&
+                     (n < 1 || n > 4096)))
+                {
+                    fprintf(stderr, "Error: invalid argument for %s\n", argv[i - 1]);
+                    return 2;
+                }
 
-Pipeline *pipeline;
-uint64_t last_hbeat_inst = 0;
+                if (strcmp(argv[i - 1], "-intervals") == 0)
+                {
+                    opts->num_intervals = n;
+                }
+                else
+                {
+                    opts->interval_warmup = n;
+                }
+            }
+            else if (strcmp(argv[i], "-batch") == 0 ||
+                     strcmp(argv[i], "-batchout") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to %s\n", argv[i - 1]);
+                    return 2;
+                }
 
-int parse_args(int argc, char *argv[], char **trace_filename);
-int open_gunzip_pipe(const char *filename, int *fd, pid_t *pid);
-int check_heartbeat();
-void print_stats();
-void print_usage(char *program_name);
+                if (strcmp(argv[i - 1], "-batch") == 0)
+                {
+                    opts->batch_filename = argv[i];
+                }
+                else
+                {
+                    opts->batch_out_dir = argv[i];
+                }
+            }
+            else if (strcmp(argv[i], "-batchthreads") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -batchthreads\n");
+                    return 2;
+                }
 
-int main(int argc, char *argv[])
-{
-    int status;
+                int batch_threads = atoi(argv[i]);
+                if (batch_threads < 1)
+                {
+                    fprintf(stderr, "Error: invalid argument for -batchthreads\n");
+                    return 2;
+                }
 
-    // Parse the command-line arguments.
-    char *trace_filename = NULL;
-    status = parse_args(argc, argv, &trace_filename);
-    if (status != 0)
-    {
-        return status;
-    }
+                opts->batch_threads = batch_threads;
+            }
+            else if (strcmp(argv[i], "-stats") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -stats\n");
+                    return 2;
+                }
 
-    // Open the trace file using gunzip.
-    int trace_fd;
-    pid_t pid;
-    printf("Opening trace file with gunzip: %s\n", trace_filename);
-    status = open_gunzip_pipe(trace_filename, &trace_fd, &pid);
-    if (status != 0)
-    {
-        return status;
-    }
+                opts->report_format = report_parse_format(argv[i]);
+                if (opts->report_format == REPORT_NONE)
+                {
+                    fprintf(stderr, "Error: invalid argument for -stats (json or csv)\n");
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "-statsfile") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -statsfile\n");
+                    return 2;
+                }
 
-    // Simulate the pipeline.
-    pipeline = pipe_init(trace_fd);
-    status = 0;
-    while (status == 0 && !pipeline->halt)
-    {
-        pipe_cycle(pipeline);
-        status = check_heartbeat();
-    }
-    close(trace_fd);
-    if (status != 0)
-    {
-        waitpid(pid, NULL, 0);
-        return status;
-    }
+                opts->report_filename = argv[i];
+            }
+            else if (strcmp(argv[i], "-telemetry") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -telemetry\n");
+                    return 2;
+                }
 
-    // Wait for the child process to finish.
-    waitpid(pid, &status, 0);
-    status = WEXITSTATUS(status);
-    if (status == 127)
-    {
-        return 1;
-    }
+                opts->telemetry_filename = argv[i];
+            }
+            else if (strcmp(argv[i], "-telemetryformat") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -telemetryformat\n");
+                    return 2;
+                }
 
-    // Print statistics.
-    print_stats();
-    return 0;
-}
+                if (!telemetry_parse_format(argv[i], &opts->telemetry_format))
+                {
+                    fprintf(stderr, "Error: invalid argument for -telemetryformat (csv or binary)\n");
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "-telemetryinterval") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -telemetryinterval\n");
+                    return 2;
+                }
 
-int parse_args(int argc, char *argv[], char **trace_filename)
-{
-    *trace_filename = NULL;
+                int interval = atoi(argv[i]);
+                if (interval < 1)
+                {
+                    fprintf(stderr, "Error: telemetry interval must be a positive number of cycles\n");
+                    return 2;
+                }
 
-    if (argc < 2)
-    {
-        print_usage(argv[0]);
-        return 2;
-    }
+                opts->telemetry_interval = interval;
+            }
+            else if (strcmp(argv[i], "-telemetryflush") == 0)
+            {
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -telemetryflush\n");
+                    return 2;
+                }
 
-    for (int i = 1; i < argc; i++)
-    {
-        if (argv[i][0] == '-')
-        {
-            // Parse options.
-            if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "-help") == 0)
+                int flush_ms = atoi(argv[i]);
+                if (flush_ms < 1)
+                {
+                    fprintf(stderr, "Error: telemetry flush period must be a positive number of milliseconds\n");
+                    return 2;
+                }
+
+                opts->telemetry_flush_ms = flush_ms;
+            }
+            else if (strcmp(argv[i], "-lifetrace") == 0)
             {
-                print_usage(argv[0]);
-                return 2;
+                if (++i >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to -lifetrace\n");
+                    return 2;
+                }
+
+                opts->lifetrace_filename = argv[i];
             }
-            else if (strcmp(argv[i], "-pipewidth") == 0)
+            else if (strcmp(argv[i], "-lifetraceformat") == 0)
             {
                 if (++i >= argc)
                 {
-                    fprintf(stderr, "Error: missing argument to -pipewidth\n");
+                    fprintf(stderr, "Error: missing argument to -lifetraceformat\n");
+                    return 2;
+                }
+
+                if (!lifetrace_parse_format(argv[i], &opts->lifetrace_format))
+                {
+                    fprintf(stderr, "Error: invalid argument for -lifetraceformat (o3 or binary)\n");
+                    return 2;
+                }
+            }
+            else if (strcmp(argv[i], "-lifetracerange") == 0)
+            {
+                if (i + 2 >= argc)
+                {
+                    fprintf(stderr, "Error: -lifetracerange needs a first and a last instruction\n");
                     return 2;
                 }
 
-                int pipe_width = atoi(argv[i]);
-                if (pipe_width < 1 || pipe_width > MAX_PIPE_WIDTH)
+                char *end1, *end2;
+                long long first = strtoll(argv[i + 1], &end1, 10);
+                long long last = strtoll(argv[i + 2], &end2, 10);
+                if (*end1 != '\0' || *end2 != '\0' || first < 1 || last < first)
                 {
-                    fprintf(stderr, "Error: pipe width must be between 1 and %d\n", MAX_PIPE_WIDTH);
+                    fprintf(stderr, "Error: invalid argument for -lifetracerange\n");
                     return 2;
                 }
 
-                PIPE_WIDTH = pipe_width;
+                opts->lifetrace_first = first;
+                opts->lifetrace_last = last;
+                i += 2;
             }
-            else if (strcmp(argv[i], "-loadlatency") == 0)
+            else if (strcmp(argv[i], "-lifetracesample") == 0)
             {
                 if (++i >= argc)
                 {
-                    fprintf(stderr, "Error: missing argument to -loadlatency\n");
+                    fprintf(stderr, "Error: missing argument to -lifetracesample\n");
+                    return 2;
+                }
+
+                char *end;
+                long long n = strtoll(argv[i], &end, 10);
+                if (*end != '\0' || n < 1)
+                {
+                    fprintf(stderr, "Error: lifetrace sampling rate must be a positive number of instructions\n");
+                    return 2;
+                }
+
+                opts->lifetrace_sample = n;
+            }
+            else if (strcmp(argv[i], "-intervalcheck") == 0)
+            {
+                opts->interval_check = true;
+            }
+            else if (strcmp(argv[i], "-checkpoint-at") == 0)
+            {
+                if (i + 2 >= argc)
+                {
+                    fprintf(stderr, "Error: -checkpoint-at needs an instruction count and an output file\n");
                     return 2;
                 }
 
-                int load_exe_cycles = atoi(argv[i]);
-                if (load_exe_cycles < 1)
+                char *end;
+                long long n = strtoll(argv[i + 1], &end, 10);
+                if (*end != '\0' || n < 1)
                 {
-                    fprintf(stderr, "Error: load latency must be a positive integer number of cycles\n");
+                    fprintf(stderr, "Error: invalid argument for -checkpoint-at\n");
                     return 2;
                 }
 
-                LOAD_EXE_CYCLES = load_exe_cycles;
+                opts->ckpt_inst = n;
+                opts->ckpt_filename = argv[i + 2];
+                i += 2;
             }
-            else if (strcmp(argv[i], "-schedpolicy") == 0)
+            else if (strcmp(argv[i], "-restore") == 0)
             {
                 if (++i >= argc)
                 {
-                    fprintf(stderr, "Error: missing argument to -schedpolicy\n");
+                    fprintf(stderr, "Error: missing argument to -restore\n");
+                    return 2;
+                }
+
+                opts->restore_filename = argv[i];
+            }
+            else if (strcmp(argv[i], "-sample") == 0 ||
+                     strcmp(argv[i], "-samplewarmup") == 0 ||
+                     strcmp(argv[i], "-samplewindow") == 0)
+            {
+                if (i + 1 >= argc)
+                {
+                    fprintf(stderr, "Error: missing argument to %s\n", argv[i]);
                     return 2;
                 }
 
-                int policy = atoi(argv[i]);
-                if (policy < 0 || policy >= NUM_SCHED_POLICIES)
+                char *end;
+                long long n = strtoll(argv[i + 1], &end, 10);
+                if (*end != '\0' || n < 0 ||
+                    (n == 0 && strcmp(argv[i], "-samplewarmup") != 0))
                 {
-                    fprintf(stderr, "Error: invalid argument for -schedpolicy\n");
+                    fprintf(stderr, "Error: invalid argument for %s\n", argv[i]);
                     return 2;
                 }
 
-                SCHED_POLICY = (SchedulingPolicy)policy;
+                if (strcmp(argv[i], "-sample") == 0)
+                {
+                    opts->sample.period = n;
+                }
+                else if (strcmp(argv[i], "-samplewarmup") == 0)
+                {
+                    opts->sample.warmup = n;
+                }
+                else
+                {
+                    opts->sample.window = n;
+                }
+                i++;
             }
             else
             {
@@ -179,116 +1379,162 @@ int parse_args(int argc, char *argv[], char **trace_filename)
         }
         else
         {
-            // Parse trace file name.
-            if (*trace_filename != NULL)
+            // Parse trace file name; several are checked for -multicore
+            // below.
+            if (opts->tcache_filename != NULL)
             {
                 fprintf(stderr, "Error: only one trace file may be specified\n");
                 return 2;
             }
 
-            *trace_filename = argv[i];
+            if (opts->trace_filename == NULL)
+            {
+                opts->trace_filename = argv[i];
+            }
+            opts->trace_filenames[opts->num_traces++] = argv[i];
         }
     }
 
-    if (*trace_filename == NULL)
+    if (opts->num_traces > 1 && !opts->multicore)
     {
-        fprintf(stderr, "Error: no trace file specified\n");
+        fprintf(stderr, "Error: only one trace file may be specified (without -multicore)\n");
         return 2;
     }
 
-    return 0;
-}
-
-int open_gunzip_pipe(const char *filename, int *fd, pid_t *pid)
-{
-    int status;
-    int pipefd[2];
+    if (opts->batch_filename != NULL)
+    {
+        if (opts->trace_filename != NULL || opts->sweep_filename != NULL ||
+            opts->sample.period != 0 || opts->num_intervals != 0 ||
+            opts->ckpt_filename != NULL || opts->restore_filename != NULL ||
+            opts->report_format != REPORT_NONE || opts->telemetry_filename != NULL ||
+            opts->lifetrace_filename != NULL || opts->verify || opts->multicore ||
+            opts->estimate)
+        {
+            fprintf(stderr, "Error: -batch takes its traces from the jobs file and "
+                            "cannot be combined with other modes\n");
+            return 2;
+        }
+        return 0;
+    }
 
-    status = pipe(pipefd);
-    if (status != 0)
+    if (opts->trace_filename == NULL)
     {
-        perror("Couldn't create pipe");
-        return 1;
+        fprintf(stderr, "Error: no trace file specified\n");
+        return 2;
     }
 
-    *pid = fork();
-    if (*pid == -1)
+    if (opts->sample.period != 0)
     {
-        perror("Couldn't fork");
-        close(pipefd[0]);
-        close(pipefd[1]);
-        return 1;
+        if (opts->sample.warmup + opts->sample.window > opts->sample.period)
+        {
+            fprintf(stderr, "Error: the sample warm-up and window must fit in the sample period\n");
+            return 2;
+        }
+        if (opts->sweep_filename != NULL)
+        {
+            fprintf(stderr, "Error: -sample cannot be combined with -sweep\n");
+            return 2;
+        }
     }
 
-    if (*pid == 0)
+    if ((opts->ckpt_filename != NULL || opts->restore_filename != NULL) &&
+        (opts->sweep_filename != NULL || opts->sample.period != 0))
     {
-        // Child process: exec gunzip.
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[0]);
-        close(pipefd[1]);
-        execlp("gunzip", "gunzip", "-c", filename, NULL);
-        perror("Couldn't exec gunzip");
-        fprintf(stderr, "Is gunzip installed?\n");
-        return 127;
+        fprintf(stderr, "Error: checkpoints cannot be combined with -sweep or -sample\n");
+        return 2;
     }
 
-    // Parent process: return the read end of the pipe.
-    *fd = pipefd[0];
-    close(pipefd[1]);
-    return 0;
-}
+    // A restored pipeline keeps the configuration it was saved with.
+    if (opts->restore_filename != NULL && opts->config_option != NULL)
+    {
+        fprintf(stderr, "Error: %s cannot be combined with -restore, which uses the "
+                        "configuration saved in the checkpoint\n", opts->config_option);
+        return 2;
+    }
 
-int check_heartbeat()
-{
-    if (pipeline->stat_num_cycle % HEARTBEAT_CYCLES == 0)
+    if (opts->num_intervals != 0 &&
+        (opts->sweep_filename != NULL || opts->sample.period != 0 ||
+         opts->ckpt_filename != NULL || opts->restore_filename != NULL))
     {
-        // Print a heartbeat.
-        printf(".");
-        fflush(stdout);
+        fprintf(stderr, "Error: -intervals cannot be combined with -sweep, -sample, or checkpoints\n");
+        return 2;
+    }
 
-        // Check for deadlock.
-        if (pipeline->stat_retired_inst == last_hbeat_inst)
-        {
-            fprintf(stderr, "\n");
-            fprintf(stderr, "Error: pipeline is deadlocked: no instructions "
-                            "committed in %u cycles %ld\n",
-                    HEARTBEAT_CYCLES, pipeline->stat_retired_inst);
-            return 1;
-        }
+    if (opts->report_filename != NULL && opts->report_format == REPORT_NONE)
+    {
+        fprintf(stderr, "Error: -statsfile needs -stats\n");
+        return 2;
+    }
+    if (opts->report_format != REPORT_NONE &&
+        (opts->sample.period != 0 || opts->num_intervals != 0))
+    {
+        fprintf(stderr, "Error: -stats cannot be combined with -sample or -intervals\n");
+        return 2;
+    }
+    if (opts->telemetry_filename != NULL &&
+        (opts->sweep_filename != NULL || opts->sample.period != 0 ||
+         opts->num_intervals != 0))
+    {
+        fprintf(stderr, "Error: -telemetry cannot be combined with -sweep, -sample, or -intervals\n");
+        return 2;
+    }
+    if (opts->lifetrace_filename != NULL &&
+        (opts->sweep_filename != NULL || opts->sample.period != 0 ||
+         opts->num_intervals != 0 || opts->verify || opts->multicore ||
+         opts->estimate))
+    {
+        fprintf(stderr, "Error: -lifetrace cannot be combined with -sweep, -sample, -intervals, "
+                        "-verify, -multicore, or -estimate\n");
+        return 2;
+    }
+    if (opts->verify &&
+        (opts->sweep_filename != NULL || opts->sample.period != 0 ||
+         opts->num_intervals != 0 || opts->ckpt_filename != NULL ||
+         opts->restore_filename != NULL || opts->telemetry_filename != NULL))
+    {
+        fprintf(stderr, "Error: -verify cannot be combined with -sweep, -sample, -intervals, "
+                        "checkpoints, or -telemetry\n");
+        return 2;
+    }
+    if (opts->multicore &&
+        (opts->tcache_filename != NULL || opts->sweep_filename != NULL ||
+         opts->sample.period != 0 || opts->num_intervals != 0 ||
+         opts->ckpt_filename != NULL || opts->restore_filename != NULL ||
+         opts->report_format != REPORT_NONE || opts->telemetry_filename != NULL ||
+         opts->verify || opts->estimate))
+    {
+        fprintf(stderr, "Error: -multicore cannot be combined with other modes, "
+                        "checkpoints, -stats, or -telemetry\n");
+        return 2;
+    }
 
-        // Update the heartbeat info.
-        last_hbeat_inst = pipeline->stat_retired_inst;
+    if (opts->estimate_check && !opts->estimate)
+    {
+        fprintf(stderr, "Error: -estimatecheck needs -estimate\n");
+        return 2;
     }
-    
-    if (pipeline->stat_num_cycle % STAT_CYCLES == 0)
+    if (opts->estimate &&
+        (opts->sample.period != 0 || opts->num_intervals != 0 ||
+         opts->ckpt_filename != NULL || opts->restore_filename != NULL ||
+         opts->report_format != REPORT_NONE || opts->telemetry_filename != NULL ||
+         opts->verify))
     {
-        // Print statistics.
-        uint64_t stat_num_inst = pipeline->stat_num_cycle;
-        uint64_t stat_num_cycle = pipeline->stat_retired_inst;
-        double cpi = (double)stat_num_inst / (double)stat_num_cycle;
+        fprintf(stderr, "Error: -estimate cannot be combined with -sample, -intervals, "
+                        "checkpoints, -stats, -telemetry, or -verify\n");
+        return 2;
+    }
 
-        printf("\n");
-        printf("(Inst: %7lu\tCycle: %7lu\tCPI: %5.3f)\n",
-               (unsigned long)stat_num_cycle, (unsigned long)stat_num_inst,
-               cpi);
+    // Streams can only be read once.
+    if ((opts->verify || opts->estimate_check) && ingest_is_stream(opts->trace_filename))
+    {
+        fprintf(stderr, "Error: %s reads the trace twice and cannot read it from a stream\n",
+                opts->verify ? "-verify" : "-estimatecheck");
+        return 2;
     }
 
     return 0;
 }
 
-void print_stats()
-{
-    unsigned long stat_num_inst = pipeline->stat_retired_inst;
-    unsigned long stat_num_cycle = pipeline->stat_num_cycle;
-    double cpi = (double)stat_num_cycle / (double)stat_num_inst;
-
-    printf("\n\n");
-    printf("LAB3_NUM_INST           \t : %10lu\n", stat_num_inst);
-    printf("LAB3_NUM_CYCLES         \t : %10lu\n", stat_num_cycle);
-    printf("LAB3_CPI                \t : %10.3f\n", cpi);
-    printf("\n");
-}
-
 void print_usage(char *program_name)
 {
     fprintf(stderr, "Usage: %s [options] <trace file>\n\n", program_name);
@@ -298,4 +1544,116 @@ void print_usage(char *program_name)
     fprintf(stderr, "    -schedpolicy <num>  Set scheduling policy [0: in-order, 1: out-of-order]\n");
     fprintf(stderr, "                        (default: 1)\n");
     fprintf(stderr, "    -loadlatency <num>  Set number of cycles for LD to execute (default: 4)\n");
+    fprintf(stderr, "    -robsize <num>      Set number of ROB entries, up to %d (default: 32)\n",
+            MAX_ROB_ENTRIES);
+    fprintf(stderr, "    -wakeup <engine>    Wake up ROB entries by following dependency lists\n");
+    fprintf(stderr, "                        (deplist), by comparing tags with every entry\n");
+    fprintf(stderr, "                        (scan), or by comparing them with AVX2 or NEON\n");
+    fprintf(stderr, "                        (simd); results are unchanged (default: deplist)\n");
+    fprintf(stderr, "    -sweep <file>       Simulate every configuration listed in <file> (one\n");
+    fprintf(stderr, "                        line of the options above per configuration) on\n");
+    fprintf(stderr, "                        the same trace, decoding it only once\n");
+    fprintf(stderr, "    -gzthreads <num>    Decompress BGZF (bgzip) traces on <num> threads\n");
+    fprintf(stderr, "                        (default: 1)\n");
+    fprintf(stderr, "    -prefetch           Read, decompress, and decode the trace on its own\n");
+    fprintf(stderr, "                        thread, ahead of the simulation\n");
+    fprintf(stderr, "    -skipidle           Fast-forward through cycles in which only loads\n");
+    fprintf(stderr, "                        make progress (results are unchanged)\n");
+    fprintf(stderr, "    -verify             Also simulate the trace on the reference engine and\n");
+    fprintf(stderr, "                        stop at the first commit on which they differ\n");
+    fprintf(stderr, "    -stats <format>     Also report every statistic, the configuration, and\n");
+    fprintf(stderr, "                        host metrics as machine-readable json or csv\n");
+    fprintf(stderr, "    -statsfile <file>   Write the -stats report to <file> instead of stdout\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Telemetry:\n");
+    fprintf(stderr, "    -telemetry <file>   Write a time series of the retired instructions,\n");
+    fprintf(stderr, "                        interval CPI, ROB and EXEQ occupancy, and ROB\n");
+    fprintf(stderr, "                        stalls to <file> from a background thread\n");
+    fprintf(stderr, "    -telemetryformat <format>\n");
+    fprintf(stderr, "                        Write the time series as csv or binary\n");
+    fprintf(stderr, "                        (default: csv)\n");
+    fprintf(stderr, "    -telemetryinterval <num>\n");
+    fprintf(stderr, "                        Take a snapshot every <num> cycles\n");
+    fprintf(stderr, "                        (default: %d)\n", HEARTBEAT_CYCLES);
+    fprintf(stderr, "    -telemetryflush <ms>\n");
+    fprintf(stderr, "                        Write the snapshots out every <ms> milliseconds\n");
+    fprintf(stderr, "                        (default: 100)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Lifecycle tracing:\n");
+    fprintf(stderr, "    -lifetrace <file>   Write the cycle each traced instruction was fetched,\n");
+    fprintf(stderr, "                        decoded, issued, scheduled, executed, written back,\n");
+    fprintf(stderr, "                        and committed to <file>\n");
+    fprintf(stderr, "    -lifetraceformat <format>\n");
+    fprintf(stderr, "                        Write the lifecycles as o3 (O3PipeView, for Konata)\n");
+    fprintf(stderr, "                        or binary (default: o3)\n");
+    fprintf(stderr, "    -lifetracerange <first> <last>\n");
+    fprintf(stderr, "                        Trace only instructions <first> to <last> of the\n");
+    fprintf(stderr, "                        trace, counting from 1 (default: all of them)\n");
+    fprintf(stderr, "    -lifetracesample <num>\n");
+    fprintf(stderr, "                        Trace one instruction in every <num> (default: 1)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Sampling:\n");
+    fprintf(stderr, "    -sample <num>       Estimate the CPI by simulating in detail only the\n");
+    fprintf(stderr, "                        end of every <num> instructions and fast-forwarding\n");
+    fprintf(stderr, "                        through the rest (default: simulate everything)\n");
+    fprintf(stderr, "    -samplewarmup <num> Instructions simulated before each measurement\n");
+    fprintf(stderr, "                        (default: 2000)\n");
+    fprintf(stderr, "    -samplewindow <num> Instructions measured per sample (default: 1000)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Batches:\n");
+    fprintf(stderr, "    -batch <file>       Run every configuration listed in the jobs <file>\n");
+    fprintf(stderr, "                        on every trace it lists, on a pool of threads,\n");
+    fprintf(stderr, "                        writing one <config>.<trace>.res per job and a\n");
+    fprintf(stderr, "                        batch.csv report (no trace file is given)\n");
+    fprintf(stderr, "    -batchout <dir>     Write batch results to <dir> (default: results)\n");
+    fprintf(stderr, "    -batchthreads <num> Run batch jobs on <num> threads (default: one per\n");
+    fprintf(stderr, "                        hardware thread)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Analytical estimates:\n");
+    fprintf(stderr, "    -estimate           Profile the trace in one pass and estimate the CPI\n");
+    fprintf(stderr, "                        of every configuration of the -sweep file, or of a\n");
+    fprintf(stderr, "                        default grid, from the profile without simulating\n");
+    fprintf(stderr, "    -estimatecheck      Also simulate every configuration in detail and\n");
+    fprintf(stderr, "                        report the error of each estimate\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Multi-core simulation:\n");
+    fprintf(stderr, "    -multicore          Simulate one core per trace file given, each on its\n");
+    fprintf(stderr, "                        own thread, and report the combined throughput\n");
+    fprintf(stderr, "    -quantum <num>      Synchronize the cores every <num> cycles\n");
+    fprintf(stderr, "                        (default: %d)\n", MULTICORE_DEFAULT_QUANTUM);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Interval-parallel simulation:\n");
+    fprintf(stderr, "    -intervals <num>    Split a trace cache into <num> intervals and\n");
+    fprintf(stderr, "                        simulate each on its own thread\n");
+    fprintf(stderr, "    -intervalwarmup <num>\n");
+    fprintf(stderr, "                        Instructions before each interval simulated to\n");
+    fprintf(stderr, "                        warm up its pipeline (default: 10000)\n");
+    fprintf(stderr, "    -intervalcheck      Also simulate the trace serially and report the\n");
+    fprintf(stderr, "                        error of the combined cycle count\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Checkpoints:\n");
+    fprintf(stderr, "    -checkpoint-at <num> <file>\n");
+    fprintf(stderr, "                        Save the complete pipeline state to <file> once\n");
+    fprintf(stderr, "                        <num> instructions have retired, then carry on\n");
+    fprintf(stderr, "    -restore <file>     Resume from the checkpoint in <file>, with the\n");
+    fprintf(stderr, "                        configuration it was saved with; resuming is\n");
+    fprintf(stderr, "                        fastest from a trace cache\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Trace caches:\n");
+    fprintf(stderr, "    -mktracecache <trace file> <cache file>\n");
+    fprintf(stderr, "                        Decode <trace file> once into a pre-decoded,\n");
+    fprintf(stderr, "                        memory-mappable <cache file> and exit. A cache\n");
+    fprintf(stderr, "                        can be given in place of any trace file.\n");
+    fprintf(stderr, "    -cacheextra         Also store instruction/memory/branch addresses\n");
+    fprintf(stderr, "                        and flags in the cache being built\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Trace streams (raw or gzip-compressed, read as they are produced):\n");
+    fprintf(stderr, "    -                   Read the trace from standard input\n");
+    fprintf(stderr, "    tcp:<host>:<port>   Connect to <host>:<port> and read the trace from it\n");
+    fprintf(stderr, "    tcp::<port>         Wait for one connection on <port> and read the\n");
+    fprintf(stderr, "                        trace from it\n");
+    fprintf(stderr, "    unix:<path>         Connect to the Unix socket <path> and read the\n");
+    fprintf(stderr, "                        trace from it\n");
+    fprintf(stderr, "    The path of a FIFO can be given like a trace file. Streams cannot be\n");
+    fprintf(stderr, "    used with -verify or -estimatecheck, which read the trace twice.\n");
 }
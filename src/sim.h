@@ -0,0 +1,35 @@
+// sim.h
+// Declares the driver helpers shared by the simulation modes of sim.cpp:
+// parsing and printing pipeline configuration options. Running pipelines and
+// printing their statistics are declared in simulator.h, which this includes.
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include "pipeline.h"
+#include "simulator.h"
+#include "source.h"
+#include <stdio.h>
+
+/**
+ * Try to parse argv[*i] as a pipeline configuration option, such as
+ * -pipewidth, consuming its argument if it has one.
+ *
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @param i the index of the option; advanced past any consumed argument
+ * @param config the configuration to update
+ * @return 0 if the option was parsed, -1 if argv[*i] is not a configuration
+ *         option, or 2 if the option is malformed (an error has been printed)
+ */
+int parse_config_option(int argc, char *argv[], int *i, PipelineConfig *config);
+
+/**
+ * Print a configuration as the command-line options that would select it.
+ *
+ * @param out the stream to print to
+ * @param config the configuration
+ */
+void print_config(FILE *out, const PipelineConfig *config);
+
+#endif
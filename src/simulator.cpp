@@ -0,0 +1,319 @@
+// simulator.cpp
+// Implements the loop that runs pipelines and the Simulator class.
+
+#include "simulator.h"
+#include "decomp.h"
+#include "tcache.h"
+#include "telemetry.h"
+#include <ctype.h>
+#include <stdio.h>
+
+/**
+ * Print a heartbeat and check for deadlock every HEARTBEAT_CYCLES cycles, and
+ * print the CPI so far every STAT_CYCLES cycles. Progress goes to stderr, so
+ * that stdout only holds the results.
+ *
+ * @param p the pipeline
+ * @param last_hbeat_inst the number of instructions retired at the last
+ *                        heartbeat, which is updated
+ * @param show_progress whether to print heartbeats and CPI lines
+ * @return 0, or nonzero if the pipeline is deadlocked
+ */
+static int check_heartbeat(Pipeline *p, uint64_t *last_hbeat_inst, bool show_progress)
+{
+    if (p->stat_num_cycle % HEARTBEAT_CYCLES == 0)
+    {
+        // Print a heartbeat.
+        if (show_progress)
+        {
+            fputc('.', stderr);
+        }
+
+        // Check for deadlock.
+        if (p->stat_retired_inst == *last_hbeat_inst)
+        {
+            fprintf(stderr, "\n");
+            fprintf(stderr, "Error: pipeline is deadlocked: no instructions "
+                            "committed in %u cycles %ld\n",
+                    HEARTBEAT_CYCLES, p->stat_retired_inst);
+            return 1;
+        }
+
+        // Update the heartbeat info.
+        *last_hbeat_inst = p->stat_retired_inst;
+    }
+    
+    if (show_progress && p->stat_num_cycle % STAT_CYCLES == 0)
+    {
+        // Print statistics.
+        uint64_t stat_num_inst = p->stat_retired_inst;
+        uint64_t stat_num_cycle = p->stat_num_cycle;
+        double cpi = (double)stat_num_cycle / (double)stat_num_inst;
+
+        fprintf(stderr, "\n");
+        fprintf(stderr, "(Inst: %7lu\tCycle: %7lu\tCPI: %5.3f)\n",
+                (unsigned long)stat_num_inst, (unsigned long)stat_num_cycle,
+                cpi);
+    }
+
+    return 0;
+}
+
+int run_pipeline(Pipeline *p, bool show_progress)
+{
+    return run_pipeline_until(p, UINT64_MAX, show_progress);
+}
+
+int run_pipeline_until(Pipeline *p, uint64_t max_retired, bool show_progress)
+{
+    uint64_t last_hbeat_inst = p->stat_retired_inst;
+    int status = run_pipeline_slice(p, max_retired, UINT64_MAX, &last_hbeat_inst,
+                                    show_progress);
+    if (show_progress)
+    {
+        // End the line of heartbeats.
+        fputc('\n', stderr);
+    }
+    return status;
+}
+
+int run_pipeline_slice(Pipeline *p, uint64_t max_retired, uint64_t max_cycle,
+                       uint64_t *last_hbeat_inst, bool show_progress)
+{
+    uint64_t next_sample = p->telemetry != NULL
+                               ? telemetry_next_cycle(p->telemetry, p->stat_num_cycle)
+                               : UINT64_MAX;
+    int status = 0;
+    while (status == 0 && !p->halt && p->stat_retired_inst < max_retired &&
+           p->stat_num_cycle < max_cycle)
+    {
+        if (p->skip_idle)
+        {
+            uint64_t idle = pipe_idle_cycles(p);
+            if (idle > 0)
+            {
+                // Never skip past a heartbeat, a telemetry snapshot, or the
+                // end of the slice, so deadlock detection, progress output,
+                // and telemetry see the same cycles as without skipping.
+                uint64_t to_stop = HEARTBEAT_CYCLES -
+                                   p->stat_num_cycle % HEARTBEAT_CYCLES;
+                if (next_sample - p->stat_num_cycle < to_stop)
+                {
+                    to_stop = next_sample - p->stat_num_cycle;
+                }
+                if (max_cycle - p->stat_num_cycle < to_stop)
+                {
+                    to_stop = max_cycle - p->stat_num_cycle;
+                }
+                pipe_skip_cycles(p, idle < to_stop ? idle : to_stop);
+            }
+            else
+            {
+                pipe_cycle(p);
+            }
+        }
+        else
+        {
+            pipe_cycle(p);
+        }
+
+        if (p->stat_num_cycle >= next_sample)
+        {
+            next_sample = telemetry_record(p->telemetry, p);
+        }
+        status = check_heartbeat(p, last_hbeat_inst, show_progress);
+    }
+    return status;
+}
+
+void print_stats(Pipeline *p)
+{
+    fprint_stats(stdout, p);
+}
+
+double occupancy_mean(const uint64_t *hist, unsigned int max)
+{
+    uint64_t cycles = 0;
+    double sum = 0.0;
+    for (unsigned int i = 0; i <= max; i++)
+    {
+        cycles += hist[i];
+        sum += (double)i * (double)hist[i];
+    }
+    return cycles > 0 ? sum / (double)cycles : 0.0;
+}
+
+/**
+ * Print an occupancy histogram as OCC_HIST_BUCKETS buckets of equal width,
+ * up to the largest occupancy that occurred.
+ */
+static void fprint_occupancy(FILE *out, const char *name, const uint64_t *hist,
+                             unsigned int max)
+{
+    uint64_t cycles = 0;
+    unsigned int top = 0;
+    for (unsigned int i = 0; i <= max; i++)
+    {
+        cycles += hist[i];
+        if (hist[i] > 0)
+        {
+            top = i;
+        }
+    }
+    if (cycles == 0)
+    {
+        return;
+    }
+
+    fprintf(out, "%s occupancy (%% of cycles):\n", name);
+    unsigned int width = (top + OCC_HIST_BUCKETS) / OCC_HIST_BUCKETS;
+    for (unsigned int lo = 0; lo <= top; lo += width)
+    {
+        unsigned int hi = lo + width - 1 < top ? lo + width - 1 : top;
+        uint64_t n = 0;
+        for (unsigned int i = lo; i <= hi; i++)
+        {
+            n += hist[i];
+        }
+        fprintf(out, "  %4u-%-4u %6.2f%%\n", lo, hi, 100.0 * (double)n / (double)cycles);
+    }
+}
+
+void fprint_stats(FILE *out, Pipeline *p)
+{
+    unsigned long stat_num_inst = p->stat_retired_inst;
+    unsigned long stat_num_cycle = p->stat_num_cycle;
+    double cpi = (double)stat_num_cycle / (double)stat_num_inst;
+
+    fprintf(out, "\n\n");
+    fprintf(out, "LAB3_NUM_INST           \t : %10lu\n", stat_num_inst);
+    fprintf(out, "LAB3_NUM_CYCLES         \t : %10lu\n", stat_num_cycle);
+    fprintf(out, "LAB3_CPI                \t : %10.3f\n", cpi);
+    fprintf(out, "\n");
+
+    // The CPI stack: each retired instruction takes one commit slot, and
+    // each unused slot is charged to a stall reason, pipe_width slots per
+    // cycle.
+    double slot_cpi = 1.0 / ((double)p->config.pipe_width * (double)stat_num_inst);
+    fprintf(out, "LAB3_STACK_BASE         \t : %10.3f\n", stat_num_inst * slot_cpi);
+    for (int r = 0; r < NUM_STALL_REASONS; r++)
+    {
+        char label[32];
+        int n = snprintf(label, sizeof(label), "LAB3_STACK_%s", STALL_REASON_NAMES[r]);
+        for (int i = 0; i < n; i++)
+        {
+            label[i] = toupper(label[i]);
+        }
+        fprintf(out, "%-24s\t : %10.3f\n", label, p->stat_stall_slots[r] * slot_cpi);
+    }
+    fprintf(out, "\n");
+
+    // Stalls behind a full ROB are charged to the head above; this shows
+    // how often they also held up the issue stage.
+    fprintf(out, "LAB3_ROB_FULL_STALL_PCT \t : %10.3f\n",
+            stat_num_cycle > 0 ? 100.0 * (double)p->stat_rob_stall_cycles / (double)stat_num_cycle
+                               : 0.0);
+    fprintf(out, "\n");
+
+    fprintf(out, "LAB3_ROB_OCC_MEAN       \t : %10.3f\n",
+            occupancy_mean(p->stat_rob_occupancy, p->config.num_rob_entries));
+    fprintf(out, "LAB3_EXEQ_OCC_MEAN      \t : %10.3f\n",
+            occupancy_mean(p->stat_exeq_occupancy, p->config.num_rob_entries));
+    fprintf(out, "\n");
+    fprint_occupancy(out, "ROB", p->stat_rob_occupancy, p->config.num_rob_entries);
+    fprint_occupancy(out, "EXEQ", p->stat_exeq_occupancy, p->config.num_rob_entries);
+    fprintf(out, "\n");
+}
+
+InstSource *open_trace_file(const char *filename, unsigned int gz_threads)
+{
+    if (tcache_probe(filename))
+    {
+        TCache *cache = tcache_open(filename);
+        return cache == NULL ? NULL : source_init_tcache(cache);
+    }
+
+    ByteStream *stream = decomp_open(filename, gz_threads);
+    return stream == NULL ? NULL : source_init_stream(stream);
+}
+
+Simulator::Simulator(Pipeline *pipe, InstSource *src)
+    : pipe(pipe), src(src), last_hbeat_inst(0), status(0)
+{
+}
+
+Simulator::~Simulator()
+{
+    pipe_free(pipe);
+    source_free(src);
+}
+
+Simulator *Simulator::open(const PipelineConfig &config,
+                           const char *trace_filename, unsigned int gz_threads)
+{
+    InstSource *src = open_trace_file(trace_filename, gz_threads);
+    return src == NULL ? NULL : create(config, src);
+}
+
+Simulator *Simulator::create(const PipelineConfig &config, InstSource *src)
+{
+    Pipeline *pipe = pipe_init(&config, src);
+    if (pipe == NULL)
+    {
+        source_free(src);
+        return NULL;
+    }
+    return new Simulator(pipe, src);
+}
+
+int Simulator::run_cycles(uint64_t cycles)
+{
+    if (status == 0)
+    {
+        uint64_t end = pipe->stat_num_cycle + cycles;
+        if (end < cycles)
+        {
+            end = UINT64_MAX;
+        }
+        status = run_pipeline_slice(pipe, UINT64_MAX, end, &last_hbeat_inst,
+                                    false);
+    }
+    return status;
+}
+
+int Simulator::run()
+{
+    if (status == 0)
+    {
+        status = run_pipeline_slice(pipe, UINT64_MAX, UINT64_MAX,
+                                    &last_hbeat_inst, false);
+    }
+    return status;
+}
+
+bool Simulator::done() const
+{
+    return pipe->halt || status != 0;
+}
+
+SimulatorStats Simulator::stats() const
+{
+    SimulatorStats stats;
+    stats.retired_insts = pipe->stat_retired_inst;
+    stats.cycles = pipe->stat_num_cycle;
+    stats.rob_stall_cycles = pipe->stat_rob_stall_cycles;
+    stats.cpi = stats.retired_insts > 0
+                    ? (double)stats.cycles / (double)stats.retired_insts
+                    : 0.0;
+    return stats;
+}
+
+const PipelineConfig &Simulator::config() const
+{
+    return pipe->config;
+}
+
+Pipeline *Simulator::pipeline() const
+{
+    return pipe;
+}
@@ -0,0 +1,229 @@
+// simulator.h
+// Declares the embeddable core of the simulator: the loop that runs a
+// pipeline with deadlock detection and progress output, and the Simulator
+// class, which owns a pipeline and its trace for programs that drive the
+// simulator in-process.
+//
+// Every pipeline carries its own configuration and state, so any number of
+// Simulators and pipelines can exist at once, on one thread or several.
+// Nothing here depends on sim.cpp, which only parses the command line.
+
+#ifndef _SIMULATOR_H_
+#define _SIMULATOR_H_
+
+#include "pipeline.h"
+#include "source.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+/**
+ * The number of cycles between heartbeats. A pipeline that retires nothing
+ * from one heartbeat to the next is deadlocked.
+ */
+#define HEARTBEAT_CYCLES 10000
+
+/** The number of cycles between the CPI lines of the progress output. */
+#define STAT_CYCLES (HEARTBEAT_CYCLES * 50)
+
+/**
+ * Simulate a pipeline until it halts or deadlocks.
+ *
+ * @param p the pipeline to simulate
+ * @param show_progress whether to print heartbeats and periodic CPI lines to
+ *                      stderr
+ * @return 0 if the pipeline ran to completion, nonzero if it deadlocked
+ */
+int run_pipeline(Pipeline *p, bool show_progress);
+
+/**
+ * Simulate a pipeline until it has retired at least a given number of
+ * instructions in total, or until it halts or deadlocks.
+ *
+ * Deadlock detection restarts from the instructions retired when this is
+ * called.
+ *
+ * @param p the pipeline to simulate
+ * @param max_retired the number of retired instructions at which to stop
+ * @param show_progress whether to print heartbeats and periodic CPI lines to
+ *                      stderr
+ * @return 0 if the pipeline stopped or ran to completion, nonzero if it
+ *         deadlocked
+ */
+int run_pipeline_until(Pipeline *p, uint64_t max_retired, bool show_progress);
+
+/**
+ * Simulate one slice of a pipeline's run: until it has retired at least a
+ * given number of instructions or reached a given cycle, or until it halts or
+ * deadlocks.
+ *
+ * Unlike run_pipeline_until, deadlock detection carries over from one slice
+ * to the next through last_hbeat_inst.
+ *
+ * @param p the pipeline to simulate
+ * @param max_retired the number of retired instructions at which to stop
+ * @param max_cycle the cycle at which to stop
+ * @param last_hbeat_inst the number of instructions retired at the last
+ *                        heartbeat; initialize it to p->stat_retired_inst
+ *                        before the first slice
+ * @param show_progress whether to print heartbeats and periodic CPI lines to
+ *                      stderr
+ * @return 0 if the pipeline stopped or ran to completion, nonzero if it
+ *         deadlocked
+ */
+int run_pipeline_slice(Pipeline *p, uint64_t max_retired, uint64_t max_cycle,
+                       uint64_t *last_hbeat_inst, bool show_progress);
+
+/** The number of buckets the statistics split occupancy histograms into. */
+#define OCC_HIST_BUCKETS 8
+
+/**
+ * Find the mean of an occupancy histogram, such as a pipeline's
+ * stat_rob_occupancy.
+ *
+ * @param hist the number of cycles at each occupancy
+ * @param max the largest occupancy
+ * @return the mean occupancy, or 0 if the histogram is empty
+ */
+double occupancy_mean(const uint64_t *hist, unsigned int max);
+
+/**
+ * Print the final statistics of a pipeline.
+ *
+ * @param p the pipeline
+ */
+void print_stats(Pipeline *p);
+
+/**
+ * Print the final statistics of a pipeline to a stream: the instructions,
+ * cycles, and CPI, the CPI stack, and the ROB and EXEQ occupancy.
+ *
+ * @param out the stream to print to
+ * @param p the pipeline
+ */
+void fprint_stats(FILE *out, Pipeline *p);
+
+/**
+ * Open a trace file as a source of instructions: trace caches are mapped
+ * into memory, and anything else is decompressed in-process.
+ *
+ * @param filename the trace file or trace cache to open
+ * @param gz_threads the number of threads to decompress BGZF traces with
+ * @return a pointer to a newly allocated source, or NULL if the trace could
+ *         not be opened (an error has been printed)
+ */
+InstSource *open_trace_file(const char *filename, unsigned int gz_threads);
+
+/** The statistics of a simulation so far. */
+typedef struct SimulatorStatsStruct
+{
+    /** The number of instructions retired. */
+    uint64_t retired_insts;
+    /** The number of cycles simulated. */
+    uint64_t cycles;
+    /** The number of cycles the issue stage stalled on a full ROB. */
+    uint64_t rob_stall_cycles;
+    /** The cycles per retired instruction, or 0 before the first retires. */
+    double cpi;
+} SimulatorStats;
+
+/**
+ * A pipeline simulating one trace, for embedding the simulator in another
+ * program. Simulators are independent of each other, so several can be run
+ * in the same process, including on different threads (one thread per
+ * Simulator at a time).
+ *
+ * Nothing is printed while simulating, but for errors reading the trace and
+ * deadlocks, which are printed to stderr.
+ */
+class Simulator
+{
+public:
+    /** Free the pipeline and the source. */
+    ~Simulator();
+
+    /**
+     * Create a simulator of the trace read from a source.
+     *
+     * @param config the configuration of the pipeline
+     * @param src the source of the trace, which the simulator takes over and
+     *            frees
+     * @return a newly allocated simulator, or NULL if the pipeline could not
+     *         be allocated (an error has been printed, and src freed)
+     */
+    static Simulator *create(const PipelineConfig &config, InstSource *src);
+
+    /**
+     * Create a simulator of a trace file or trace cache.
+     *
+     * @param config the configuration of the pipeline
+     * @param trace_filename the trace to simulate
+     * @param gz_threads the number of threads to decompress BGZF traces with
+     * @return a newly allocated simulator, or NULL if the trace could not be
+     *         opened or the pipeline allocated (an error has been printed)
+     */
+    static Simulator *open(const PipelineConfig &config,
+                           const char *trace_filename,
+                           unsigned int gz_threads = 1);
+
+    /**
+     * Simulate up to a given number of cycles, stopping early if the
+     * pipeline halts or deadlocks.
+     *
+     * @param cycles the number of cycles to simulate
+     * @return 0 if the pipeline is not deadlocked, nonzero otherwise
+     */
+    int run_cycles(uint64_t cycles);
+
+    /**
+     * Simulate until the pipeline halts or deadlocks.
+     *
+     * @return 0 if the pipeline ran to completion, nonzero if it deadlocked
+     */
+    int run();
+
+    /**
+     * Check if the simulation is over: the trace has been retired, or the
+     * pipeline has deadlocked.
+     *
+     * @return true if running further does nothing
+     */
+    bool done() const;
+
+    /**
+     * Read the statistics so far.
+     *
+     * @return the statistics
+     */
+    SimulatorStats stats() const;
+
+    /**
+     * Get the configuration of the pipeline.
+     *
+     * @return the configuration
+     */
+    const PipelineConfig &config() const;
+
+    /**
+     * Get the pipeline, for the statistics and options it has that the
+     * simulator does not wrap, such as skip_idle and telemetry.
+     *
+     * @return the pipeline
+     */
+    Pipeline *pipeline() const;
+
+private:
+    Simulator(Pipeline *pipe, InstSource *src);
+    Simulator(const Simulator &);
+    Simulator &operator=(const Simulator &);
+
+    /** The pipeline. */
+    Pipeline *pipe;
+    /** The source of the trace. */
+    InstSource *src;
+    /** The instructions retired at the last heartbeat. */
+    uint64_t last_hbeat_inst;
+    /** 0, or the status of the run that deadlocked. */
+    int status;
+};
+
+#endif
@@ -0,0 +1,285 @@
+// source.cpp
+// Implements trace record decoding and the stream-backed InstSource, which
+// decodes records in batches taken from a TraceReader.
+
+#include "source.h"
+#include "reader.h"
+#include <stdlib.h>
+
+/** [Internal] The number of records a stream source takes from its reader at once. */
+#define STREAM_SOURCE_BATCH_RECS 4096
+
+/** [Internal] State of a source reading trace records from a byte stream. */
+typedef struct StreamSourceStruct
+{
+    /** The buffered reader that owns the stream. */
+    TraceReader *reader;
+    /** The current batch of records, pointing into the reader's buffer. */
+    const TraceRec *batch;
+    /** The number of records in batch. */
+    size_t batch_len;
+    /** The index of the next record of batch to decode. */
+    size_t batch_pos;
+} StreamSource;
+
+/**
+ * Convert a raw trace record into a freshly fetched instruction.
+ *
+ * @param rec the raw trace record
+ * @param inst the instruction to populate
+ */
+void trace_decode(const TraceRec *rec, InstInfo *inst)
+{
+    inst->op_type = (OpType)rec->op_type;
+
+    inst->dest_reg = rec->dest_needed ? rec->dest_reg : -1;
+    inst->src1_reg = rec->src1_needed ? rec->src1_reg : -1;
+    inst->src2_reg = rec->src2_needed ? rec->src2_reg : -1;
+
+    inst->dr_tag = -1;
+    inst->src1_tag = -1;
+    inst->src2_tag = -1;
+    inst->src1_ready = false;
+    inst->src2_ready = false;
+}
+
+/**
+ * Decode the next trace record of the reader's current batch, taking a new
+ * batch from the reader when the current one runs out.
+ *
+ * @param src the source to read from
+ * @param inst the instruction to populate
+ * @return the status of the read
+ */
+static SourceStatus stream_source_next(InstSource *src, InstInfo *inst)
+{
+    StreamSource *fs = (StreamSource *)src->ctx;
+    if (fs->batch_pos == fs->batch_len)
+    {
+        SourceStatus status;
+        fs->batch_len = trace_reader_batch(fs->reader, &fs->batch,
+                                           STREAM_SOURCE_BATCH_RECS, &status);
+        fs->batch_pos = 0;
+        if (status != SOURCE_OK)
+        {
+            return status;
+        }
+    }
+
+    trace_decode(&fs->batch[fs->batch_pos++], inst);
+    return SOURCE_OK;
+}
+
+/**
+ * Discard trace records of a stream source without decoding them.
+ *
+ * @param src the source to read from
+ * @param n the number of records to discard
+ * @param skipped receives the number of records discarded
+ * @return SOURCE_OK if all n records were discarded, otherwise how the trace
+ *         ended
+ */
+static SourceStatus stream_source_skip(InstSource *src, uint64_t n,
+                                       uint64_t *skipped)
+{
+    StreamSource *fs = (StreamSource *)src->ctx;
+    *skipped = 0;
+    while (*skipped < n)
+    {
+        if (fs->batch_pos == fs->batch_len)
+        {
+            SourceStatus status;
+            fs->batch_len = trace_reader_batch(fs->reader, &fs->batch,
+                                               STREAM_SOURCE_BATCH_RECS, &status);
+            fs->batch_pos = 0;
+            if (status != SOURCE_OK)
+            {
+                return status;
+            }
+        }
+
+        size_t avail = fs->batch_len - fs->batch_pos;
+        size_t take = n - *skipped < avail ? (size_t)(n - *skipped) : avail;
+        fs->batch_pos += take;
+        *skipped += take;
+    }
+    return SOURCE_OK;
+}
+
+/**
+ * Close the stream of a stream source and free its reader.
+ *
+ * @param src the source to release
+ */
+static void stream_source_release(InstSource *src)
+{
+    StreamSource *fs = (StreamSource *)src->ctx;
+    trace_reader_free(fs->reader);
+    free(fs);
+}
+
+/**
+ * Report how much of the byte stream a stream source has read.
+ */
+static void stream_source_stats(InstSource *src, SourceStats *stats)
+{
+    const TraceReader *reader = ((StreamSource *)src->ctx)->reader;
+    stats->bytes_read = reader->stat_bytes_read;
+    stats->reads = reader->stat_reads;
+    stats->read_ns = reader->stat_read_ns;
+}
+
+/**
+ * Create a source that reads trace records from a byte stream.
+ *
+ * @param stream the stream from which to read trace records
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_stream(ByteStream *stream)
+{
+    StreamSource *fs = (StreamSource *)calloc(1, sizeof(StreamSource));
+    fs->reader = trace_reader_init(stream, TRACE_READER_BUF_SIZE);
+    fs->batch = NULL;
+    fs->batch_len = 0;
+    fs->batch_pos = 0;
+
+    InstSource *src = (InstSource *)calloc(1, sizeof(InstSource));
+    src->next = stream_source_next;
+    src->skip = stream_source_skip;
+    src->release = stream_source_release;
+    src->stats = stream_source_stats;
+    src->ctx = fs;
+    return src;
+}
+
+/** [Internal] A source handing out a limited number of instructions. */
+typedef struct WindowSourceStruct
+{
+    /** The source the instructions come from. */
+    InstSource *src;
+    /** The number of instructions left to hand out. */
+    uint64_t remaining;
+    /** SOURCE_OK, or how the trace ended if it ended inside the window. */
+    SourceStatus end_status;
+} WindowSource;
+
+/**
+ * Hand out the next instruction of a window, reporting the end of the trace
+ * once the window is used up.
+ */
+static SourceStatus window_source_next(InstSource *src, InstInfo *inst)
+{
+    WindowSource *win = (WindowSource *)src->ctx;
+    if (win->remaining == 0 || win->end_status != SOURCE_OK)
+    {
+        return SOURCE_EOF;
+    }
+
+    SourceStatus status = source_next(win->src, inst);
+    if (status != SOURCE_OK)
+    {
+        win->end_status = status;
+        return status;
+    }
+    win->remaining--;
+    return SOURCE_OK;
+}
+
+/**
+ * Create a source that hands out at most n instructions from another source.
+ *
+ * @param src the source to take instructions from
+ * @param n the number of instructions in the window
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_window(InstSource *src, uint64_t n)
+{
+    WindowSource *win = (WindowSource *)calloc(1, sizeof(WindowSource));
+    win->src = src;
+    win->remaining = n;
+    win->end_status = SOURCE_OK;
+
+    InstSource *win_src = (InstSource *)calloc(1, sizeof(InstSource));
+    win_src->next = window_source_next;
+    win_src->skip = NULL;
+    win_src->release = NULL;
+    win_src->stats = NULL;
+    win_src->ctx = win;
+    return win_src;
+}
+
+/**
+ * Check whether the trace underlying a window ended inside it.
+ *
+ * @param win a source created by source_init_window
+ * @return SOURCE_OK, or how the trace ended
+ */
+SourceStatus source_window_status(InstSource *win)
+{
+    return ((WindowSource *)win->ctx)->end_status;
+}
+
+/**
+ * Discard instructions from a source without simulating them.
+ *
+ * @param src the source
+ * @param n the number of instructions to discard
+ * @param skipped receives the number of instructions discarded
+ * @return SOURCE_OK if all n instructions were discarded, otherwise how the
+ *         trace ended
+ */
+SourceStatus source_skip(InstSource *src, uint64_t n, uint64_t *skipped)
+{
+    if (src->skip != NULL)
+    {
+        return src->skip(src, n, skipped);
+    }
+
+    InstInfo inst;
+    *skipped = 0;
+    while (*skipped < n)
+    {
+        SourceStatus status = source_next(src, &inst);
+        if (status != SOURCE_OK)
+        {
+            return status;
+        }
+        (*skipped)++;
+    }
+    return SOURCE_OK;
+}
+
+/**
+ * Get the counters describing how a source has read its trace.
+ *
+ * @param src the source
+ * @param stats receives the counters
+ */
+void source_get_stats(InstSource *src, SourceStats *stats)
+{
+    stats->bytes_read = 0;
+    stats->reads = 0;
+    stats->read_ns = 0;
+    if (src->stats != NULL)
+    {
+        src->stats(src, stats);
+    }
+}
+
+/**
+ * Release a source created by one of the source_init_* functions.
+ *
+ * @param src the source to free
+ */
+void source_free(InstSource *src)
+{
+    if (src->release != NULL)
+    {
+        src->release(src);
+    }
+    else
+    {
+        free(src->ctx);
+    }
+    free(src);
+}
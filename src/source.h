@@ -0,0 +1,157 @@
+// source.h
+// Declares the InstSource interface, through which the fetch stage pulls
+// decoded instructions, along with the helpers that decode raw trace records.
+//
+// Decoupling fetch from the trace file lets the same pipeline be driven by a
+// trace file, by a block of instructions decoded once and shared between
+// several pipelines, or by any other producer of InstInfo structs.
+
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include "trace.h"
+#include <inttypes.h>
+
+/** The outcome of asking an InstSource for its next instruction. */
+typedef enum SourceStatusEnum
+{
+    SOURCE_OK,      // An instruction was produced.
+    SOURCE_EOF,     // There are no more instructions in the trace.
+    SOURCE_ERROR,   // The underlying stream could not be read; see errno.
+    SOURCE_INVALID, // The trace contains a truncated or malformed record.
+} SourceStatus;
+
+/** Counters describing how a source has read its trace. */
+typedef struct SourceStatsStruct
+{
+    /** The number of bytes of (uncompressed) trace data read. */
+    uint64_t bytes_read;
+    /** The number of reads made on the underlying stream. */
+    uint64_t reads;
+    /** The time spent waiting on those reads, including decompression. */
+    uint64_t read_ns;
+} SourceStats;
+
+/**
+ * A producer of decoded instructions.
+ *
+ * Once a source has returned something other than SOURCE_OK, it must return
+ * SOURCE_EOF on every subsequent call, so that an error is reported once.
+ */
+typedef struct InstSourceStruct
+{
+    /**
+     * Produce the next instruction of the trace.
+     *
+     * Every field of inst except inst_num is filled in; numbering
+     * instructions is left to the fetch stage.
+     */
+    SourceStatus (*next)(struct InstSourceStruct *src, InstInfo *inst);
+
+    /**
+     * Discard up to n instructions without producing them, storing the
+     * number discarded in *skipped. Returns SOURCE_OK if all n were
+     * discarded, otherwise how the trace ended. May be NULL, in which case
+     * source_skip falls back to calling next.
+     */
+    SourceStatus (*skip)(struct InstSourceStruct *src, uint64_t n,
+                         uint64_t *skipped);
+
+    /**
+     * Free whatever state the source owns. May be NULL if the source owns
+     * nothing beyond the InstSource itself.
+     */
+    void (*release)(struct InstSourceStruct *src);
+
+    /**
+     * Fill in the counters describing how the trace has been read so far.
+     * May be NULL, in which case every counter is zero.
+     */
+    void (*stats)(struct InstSourceStruct *src, SourceStats *stats);
+
+    /** [Internal] Implementation-specific state. */
+    void *ctx;
+} InstSource;
+
+/**
+ * Convert a raw trace record into a freshly fetched instruction.
+ *
+ * Unused registers are mapped to -1 and all renaming state is cleared. The
+ * inst_num field is left untouched.
+ *
+ * @param rec the raw trace record
+ * @param inst the instruction to populate
+ */
+void trace_decode(const TraceRec *rec, InstInfo *inst);
+
+struct ByteStreamStruct;
+
+/**
+ * Create a source that reads trace records from a byte stream through a
+ * block-buffered TraceReader.
+ *
+ * @param stream the stream from which to read trace records; the source
+ *               takes ownership of it and closes it when freed
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_stream(struct ByteStreamStruct *stream);
+
+/**
+ * Create a source that hands out at most n instructions from another source
+ * and then reports SOURCE_EOF.
+ *
+ * @param src the source to take instructions from; it is not owned by the
+ *            window and may be used again after the window is freed
+ * @param n the number of instructions in the window
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_window(InstSource *src, uint64_t n);
+
+/**
+ * Check whether the trace underlying a window ended inside it.
+ *
+ * @param win a source created by source_init_window
+ * @return SOURCE_OK if every instruction asked of the underlying source was
+ *         produced, otherwise how the trace ended
+ */
+SourceStatus source_window_status(InstSource *win);
+
+/**
+ * Release a source created by one of the source_init_* functions.
+ *
+ * @param src the source to free
+ */
+void source_free(InstSource *src);
+
+/**
+ * Discard instructions from a source without simulating them.
+ *
+ * @param src the source
+ * @param n the number of instructions to discard
+ * @param skipped receives the number of instructions discarded
+ * @return SOURCE_OK if all n instructions were discarded, otherwise how the
+ *         trace ended
+ */
+SourceStatus source_skip(InstSource *src, uint64_t n, uint64_t *skipped);
+
+/**
+ * Get the counters describing how a source has read its trace.
+ *
+ * @param src the source
+ * @param stats receives the counters
+ */
+void source_get_stats(InstSource *src, SourceStats *stats);
+
+/**
+ * Produce the next instruction from a source.
+ *
+ * @param src the source
+ * @param inst the instruction to populate
+ * @return the status reported by the source
+ */
+static inline SourceStatus source_next(InstSource *src, InstInfo *inst)
+{
+    return src->next(src, inst);
+}
+
+#endif
@@ -0,0 +1,298 @@
+// sweep.cpp
+// Implements the multi-configuration sweep mode.
+//
+// The calling thread decodes the trace into a small ring of blocks. Each
+// pipeline runs on a worker thread and fetches through a cursor that walks
+// the ring; a block is recycled once every pipeline still running has moved
+// past it.
+
+#include "sweep.h"
+#include "sim.h"
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+/** [Internal] A block of decoded instructions shared by every pipeline. */
+typedef struct SweepBlockStruct
+{
+    /** The decoded instructions. */
+    InstInfo insts[SWEEP_BLOCK_INSTS];
+    /** The number of valid entries in insts. */
+    unsigned int count;
+    /** SOURCE_OK if more blocks follow, otherwise how the trace ended. */
+    SourceStatus end_status;
+    /** The number of pipelines that have yet to move past this block. */
+    unsigned int pending;
+} SweepBlock;
+
+/** [Internal] The ring of blocks shared between the decoder and pipelines. */
+typedef struct SweepFeedStruct
+{
+    /** Protects everything below except the contents of unpublished blocks. */
+    std::mutex lock;
+    /** Signalled when a new block is published. */
+    std::condition_variable published;
+    /** Signalled when a pipeline moves past a block or stops running. */
+    std::condition_variable released;
+    /** The ring of blocks; block number n lives in blocks[n % SWEEP_NUM_BLOCKS]. */
+    SweepBlock blocks[SWEEP_NUM_BLOCKS];
+    /** The number of blocks published so far. */
+    uint64_t num_published;
+    /** The number of pipelines still consuming blocks. */
+    unsigned int num_active;
+} SweepFeed;
+
+/** [Internal] One pipeline's position in the shared ring. */
+typedef struct SweepCursorStruct
+{
+    /** The ring being read. */
+    SweepFeed *feed;
+    /** The number of the block held, or of the next block to acquire. */
+    uint64_t seq;
+    /** The block currently held, or NULL if none has been acquired yet. */
+    SweepBlock *block;
+    /** The index of the next instruction to hand out from the block. */
+    unsigned int pos;
+    /** Whether the cursor has already reported the end of the trace. */
+    bool done;
+} SweepCursor;
+
+/**
+ * Hand out the next decoded instruction of the shared trace, waiting for the
+ * decoder if the pipeline has caught up with it.
+ */
+static SourceStatus sweep_cursor_next(InstSource *src, InstInfo *inst)
+{
+    SweepCursor *cur = (SweepCursor *)src->ctx;
+    SweepFeed *feed = cur->feed;
+
+    while (cur->block == NULL || cur->pos == cur->block->count)
+    {
+        if (cur->done)
+        {
+            return SOURCE_EOF;
+        }
+
+        if (cur->block != NULL && cur->block->end_status != SOURCE_OK)
+        {
+            // Keep holding the last block until the pipeline finishes.
+            cur->done = true;
+            return cur->block->end_status;
+        }
+
+        std::unique_lock<std::mutex> guard(feed->lock);
+        if (cur->block != NULL)
+        {
+            // Move past the current block.
+            if (--cur->block->pending == 0)
+            {
+                feed->released.notify_all();
+            }
+            cur->seq++;
+        }
+        while (feed->num_published <= cur->seq)
+        {
+            feed->published.wait(guard);
+        }
+        cur->block = &feed->blocks[cur->seq % SWEEP_NUM_BLOCKS];
+        cur->pos = 0;
+    }
+
+    *inst = cur->block->insts[cur->pos++];
+    return SOURCE_OK;
+}
+
+/**
+ * Stop consuming blocks, releasing the held block and every published block
+ * the cursor has not reached yet.
+ */
+static void sweep_cursor_detach(SweepCursor *cur)
+{
+    SweepFeed *feed = cur->feed;
+    std::lock_guard<std::mutex> guard(feed->lock);
+    for (uint64_t seq = cur->seq; seq < feed->num_published; seq++)
+    {
+        feed->blocks[seq % SWEEP_NUM_BLOCKS].pending--;
+    }
+    feed->num_active--;
+    feed->released.notify_all();
+}
+
+/**
+ * Simulate one configuration to completion on the calling worker thread.
+ */
+static void sweep_worker(const PipelineConfig *config, SweepCursor *cur,
+                         bool skip_idle, Pipeline **pipeline, int *status)
+{
+    InstSource *src = (InstSource *)calloc(1, sizeof(InstSource));
+    src->next = sweep_cursor_next;
+    src->release = NULL;
+    src->ctx = cur;
+
+    *pipeline = pipe_init(config, src);
+    if (*pipeline == NULL)
+    {
+        *status = 1;
+        sweep_cursor_detach(cur);
+        free(src);
+        return;
+    }
+    (*pipeline)->skip_idle = skip_idle;
+    *status = run_pipeline(*pipeline, false);
+    sweep_cursor_detach(cur);
+
+    // The cursor does not outlive the sweep.
+    (*pipeline)->src = NULL;
+    free(src);
+}
+
+/**
+ * Read a sweep file into a list of configurations.
+ *
+ * @param filename the sweep file to read
+ * @param defaults the configuration each line starts from
+ * @param configs the vector to append the parsed configurations to
+ * @return 0 on success, nonzero if the file could not be read or parsed
+ */
+int sweep_read_configs(const char *filename, const PipelineConfig *defaults,
+                       std::vector<PipelineConfig> *configs)
+{
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        perror("Couldn't open sweep file");
+        return 1;
+    }
+
+    char line[1024];
+    unsigned int line_num = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        line_num++;
+
+        // Split the line into words.
+        char *words[64];
+        int num_words = 0;
+        for (char *word = strtok(line, " \t\r\n"); word != NULL && num_words < 64;
+             word = strtok(NULL, " \t\r\n"))
+        {
+            words[num_words++] = word;
+        }
+        if (num_words == 0 || words[0][0] == '#')
+        {
+            continue;
+        }
+
+        PipelineConfig config = *defaults;
+        for (int i = 0; i < num_words; i++)
+        {
+            int status = parse_config_option(num_words, words, &i, &config);
+            if (status != 0)
+            {
+                if (status < 0)
+                {
+                    fprintf(stderr, "Error: unrecognized option: %s\n", words[i]);
+                }
+                fprintf(stderr, "Error: %s:%u: invalid configuration\n",
+                        filename, line_num);
+                fclose(file);
+                return 2;
+            }
+        }
+        configs->push_back(config);
+    }
+    fclose(file);
+
+    if (configs->empty())
+    {
+        fprintf(stderr, "Error: %s lists no configurations\n", filename);
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * Simulate one pipeline per configuration, all fed from a single pass over
+ * src.
+ *
+ * @param src the source to decode instructions from
+ * @param configs the configurations to simulate
+ * @param num_configs the number of configurations
+ * @param skip_idle whether the pipelines fast-forward through idle cycles
+ * @param pipelines receives the finished pipeline of each configuration, or
+ *                  NULL if it could not be allocated (an error has been
+ *                  printed)
+ * @param statuses receives the run_pipeline status of each configuration,
+ *                 or 1 if its pipeline could not be allocated
+ */
+void sweep_run(InstSource *src, const PipelineConfig *configs,
+               size_t num_configs, bool skip_idle, Pipeline **pipelines,
+               int *statuses)
+{
+    SweepFeed *feed = new SweepFeed();
+    feed->num_published = 0;
+    feed->num_active = num_configs;
+    for (unsigned int i = 0; i < SWEEP_NUM_BLOCKS; i++)
+    {
+        feed->blocks[i].pending = 0;
+    }
+
+    std::vector<SweepCursor> cursors(num_configs);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_configs; i++)
+    {
+        cursors[i].feed = feed;
+        cursors[i].seq = 0;
+        cursors[i].block = NULL;
+        cursors[i].pos = 0;
+        cursors[i].done = false;
+        workers.push_back(std::thread(sweep_worker, &configs[i], &cursors[i],
+                                      skip_idle, &pipelines[i], &statuses[i]));
+    }
+
+    // Decode the trace on this thread, one block at a time.
+    SourceStatus status = SOURCE_OK;
+    while (status == SOURCE_OK)
+    {
+        SweepBlock *block = &feed->blocks[feed->num_published % SWEEP_NUM_BLOCKS];
+        {
+            // Wait until every pipeline has moved past the block's last use.
+            std::unique_lock<std::mutex> guard(feed->lock);
+            while (block->pending > 0 && feed->num_active > 0)
+            {
+                feed->released.wait(guard);
+            }
+            if (feed->num_active == 0)
+            {
+                break;
+            }
+        }
+
+        block->count = 0;
+        while (block->count < SWEEP_BLOCK_INSTS)
+        {
+            status = source_next(src, &block->insts[block->count]);
+            if (status != SOURCE_OK)
+            {
+                break;
+            }
+            block->count++;
+        }
+
+        std::lock_guard<std::mutex> guard(feed->lock);
+        block->end_status = status;
+        block->pending = feed->num_active;
+        feed->num_published++;
+        feed->published.notify_all();
+    }
+
+    for (size_t i = 0; i < num_configs; i++)
+    {
+        workers[i].join();
+    }
+    delete feed;
+}
@@ -0,0 +1,56 @@
+// sweep.h
+// Declares the multi-configuration sweep mode, which decodes a trace once and
+// fans each block of decoded instructions out to several independent
+// pipelines, each simulated on its own worker thread.
+
+#ifndef _SWEEP_H_
+#define _SWEEP_H_
+
+#include "pipeline.h"
+#include <stddef.h>
+#include <vector>
+
+/**
+ * The number of decoded instructions carried by each block handed to the
+ * sweep's pipelines.
+ */
+#define SWEEP_BLOCK_INSTS 4096
+
+/**
+ * The number of blocks the decoder may run ahead of the slowest pipeline.
+ */
+#define SWEEP_NUM_BLOCKS 8
+
+/**
+ * Read a sweep file: one configuration per line, written as the same options
+ * accepted on the command line (e.g. "-pipewidth 2 -schedpolicy 1"). Options
+ * not given on a line keep their value from defaults. Blank lines and lines
+ * starting with '#' are ignored.
+ *
+ * @param filename the sweep file to read
+ * @param defaults the configuration each line starts from
+ * @param configs the vector to append the parsed configurations to
+ * @return 0 on success, nonzero if the file could not be read or parsed
+ */
+int sweep_read_configs(const char *filename, const PipelineConfig *defaults,
+                       std::vector<PipelineConfig> *configs);
+
+/**
+ * Simulate one pipeline per configuration, all fed from a single pass over
+ * src. Returns once every pipeline has halted or deadlocked.
+ *
+ * @param src the source to decode instructions from
+ * @param configs the configurations to simulate
+ * @param num_configs the number of configurations
+ * @param skip_idle whether the pipelines fast-forward through idle cycles
+ * @param pipelines receives the finished pipeline of each configuration, or
+ *                  NULL if it could not be allocated (an error has been
+ *                  printed)
+ * @param statuses receives the run_pipeline status of each configuration,
+ *                 or 1 if its pipeline could not be allocated
+ */
+void sweep_run(InstSource *src, const PipelineConfig *configs,
+               size_t num_configs, bool skip_idle, Pipeline **pipelines,
+               int *statuses);
+
+#endif
@@ -0,0 +1,475 @@
+// tcache.cpp
+// Implements building, mapping, and fetching from trace caches.
+
+#include "tcache.h"
+#include "decomp.h"
+#include "reader.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** [Internal] The largest register number an int8 column can hold. */
+#define TCACHE_MAX_REG 127
+
+/** [Internal] Byte offsets of the columns of a block of B instructions. */
+#define TCACHE_COL_OP(B) 0
+#define TCACHE_COL_DEST(B) (1 * (uint64_t)(B))
+#define TCACHE_COL_SRC1(B) (2 * (uint64_t)(B))
+#define TCACHE_COL_SRC2(B) (3 * (uint64_t)(B))
+#define TCACHE_CORE_BYTES(B) (4 * (uint64_t)(B))
+#define TCACHE_COL_INST_ADDR(B) (4 * (uint64_t)(B))
+#define TCACHE_COL_MEM_ADDR(B) (12 * (uint64_t)(B))
+#define TCACHE_COL_BR_TARGET(B) (20 * (uint64_t)(B))
+#define TCACHE_COL_MEM_FLAGS(B) (28 * (uint64_t)(B))
+#define TCACHE_COL_BR_DIR(B) (29 * (uint64_t)(B))
+#define TCACHE_EXTRA_BYTES(B) (30 * (uint64_t)(B))
+
+/** [Internal] State of a source fetching from a trace cache. */
+typedef struct TCacheSourceStruct
+{
+    /** The mapped cache. */
+    TCache *cache;
+    /** The index of the next instruction to fetch. */
+    uint64_t pos;
+    /** The op_type column of the current block. */
+    const uint8_t *op;
+    /** The dest_reg column of the current block. */
+    const int8_t *dest;
+    /** The src1_reg column of the current block. */
+    const int8_t *src1;
+    /** The src2_reg column of the current block. */
+    const int8_t *src2;
+    /** The index within the current block of the next instruction. */
+    uint32_t block_pos;
+    /** Whether the end of the cache has been reported. */
+    bool end_reported;
+} TCacheSource;
+
+/**
+ * Store the register of a raw trace record in an int8 column entry.
+ *
+ * @return false if the register is used but does not fit in the column
+ */
+static bool tcache_pack_reg(uint8_t needed, uint8_t reg, int8_t *out)
+{
+    if (!needed)
+    {
+        *out = -1;
+        return true;
+    }
+    if (reg > TCACHE_MAX_REG)
+    {
+        return false;
+    }
+    *out = (int8_t)reg;
+    return true;
+}
+
+/**
+ * Write a buffer to the trace cache, printing an error if it fails.
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int tcache_write(FILE *out, const void *buf, size_t n)
+{
+    if (fwrite(buf, n, 1, out) != 1)
+    {
+        perror("Couldn't write trace cache");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Decode a trace file once and write it out as a trace cache.
+ *
+ * @param in_filename the trace file to read
+ * @param out_filename the trace cache to write
+ * @param extra whether to include the optional address and flag columns
+ * @param gz_threads the number of threads to decompress BGZF traces with
+ * @return 0 on success, nonzero on failure
+ */
+int tcache_build(const char *in_filename, const char *out_filename, bool extra,
+                 unsigned int gz_threads)
+{
+    ByteStream *stream = decomp_open(in_filename, gz_threads);
+    if (stream == NULL)
+    {
+        return 1;
+    }
+
+    FILE *out = fopen(out_filename, "wb");
+    if (out == NULL)
+    {
+        perror("Couldn't open trace cache for writing");
+        stream->close(stream);
+        return 1;
+    }
+
+    const uint32_t B = TCACHE_BLOCK_INSTS;
+    TCacheHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TCACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TCACHE_VERSION;
+    hdr.flags = extra ? TCACHE_EXTRA : 0;
+    hdr.block_insts = B;
+    hdr.block_bytes = extra ? TCACHE_EXTRA_BYTES(B) : TCACHE_CORE_BYTES(B);
+
+    // Reserve room for the header; it is rewritten once the size is known.
+    int ret = tcache_write(out, &hdr, sizeof(hdr));
+
+    uint8_t *block = (uint8_t *)calloc(1, hdr.block_bytes);
+    uint32_t fill = 0;
+    TraceReader *reader = trace_reader_init(stream, TRACE_READER_BUF_SIZE);
+    SourceStatus status = SOURCE_OK;
+    while (ret == 0)
+    {
+        const TraceRec *recs;
+        size_t n = trace_reader_batch(reader, &recs, B - fill, &status);
+        if (status != SOURCE_OK)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < n && ret == 0; i++, fill++)
+        {
+            const TraceRec *rec = &recs[i];
+            block[TCACHE_COL_OP(B) + fill] = rec->op_type;
+            int8_t *dest = (int8_t *)(block + TCACHE_COL_DEST(B));
+            int8_t *src1 = (int8_t *)(block + TCACHE_COL_SRC1(B));
+            int8_t *src2 = (int8_t *)(block + TCACHE_COL_SRC2(B));
+            if (!tcache_pack_reg(rec->dest_needed, rec->dest_reg, &dest[fill]) ||
+                !tcache_pack_reg(rec->src1_needed, rec->src1_reg, &src1[fill]) ||
+                !tcache_pack_reg(rec->src2_needed, rec->src2_reg, &src2[fill]))
+            {
+                fprintf(stderr, "Error: Instruction %" PRIu64 " uses a register "
+                        "above %d, which a trace cache cannot hold\n",
+                        hdr.num_insts + 1, TCACHE_MAX_REG);
+                ret = 1;
+                break;
+            }
+
+            if (extra)
+            {
+                uint64_t *inst_addr = (uint64_t *)(block + TCACHE_COL_INST_ADDR(B));
+                uint64_t *mem_addr = (uint64_t *)(block + TCACHE_COL_MEM_ADDR(B));
+                uint64_t *br_target = (uint64_t *)(block + TCACHE_COL_BR_TARGET(B));
+                inst_addr[fill] = rec->inst_addr;
+                mem_addr[fill] = rec->mem_addr;
+                br_target[fill] = rec->br_target;
+                block[TCACHE_COL_MEM_FLAGS(B) + fill] =
+                    (rec->mem_read ? TCACHE_MEM_READ : 0) |
+                    (rec->mem_write ? TCACHE_MEM_WRITE : 0);
+                block[TCACHE_COL_BR_DIR(B) + fill] = rec->br_dir;
+            }
+            hdr.num_insts++;
+        }
+
+        if (ret == 0 && fill == B)
+        {
+            ret = tcache_write(out, block, hdr.block_bytes);
+            fill = 0;
+        }
+    }
+
+    if (ret == 0 && status == SOURCE_ERROR)
+    {
+        perror("Couldn't read trace file");
+        ret = 1;
+    }
+
+    // Pad out the last block so every block has the same stride.
+    if (ret == 0 && fill > 0)
+    {
+        ret = tcache_write(out, block, hdr.block_bytes);
+    }
+
+    if (ret == 0)
+    {
+        hdr.end_status = status;
+        if (fseek(out, 0, SEEK_SET) != 0)
+        {
+            perror("Couldn't write trace cache");
+            ret = 1;
+        }
+        else
+        {
+            ret = tcache_write(out, &hdr, sizeof(hdr));
+        }
+    }
+
+    if (fclose(out) != 0 && ret == 0)
+    {
+        perror("Couldn't write trace cache");
+        ret = 1;
+    }
+    if (ret != 0)
+    {
+        unlink(out_filename);
+    }
+    else
+    {
+        printf("Wrote %" PRIu64 " instructions to trace cache %s\n",
+               hdr.num_insts, out_filename);
+        if (status == SOURCE_INVALID)
+        {
+            printf("Warning: trace ends in an invalid record; the cache "
+                   "reproduces the error\n");
+        }
+    }
+
+    trace_reader_free(reader);
+    free(block);
+    return ret;
+}
+
+/**
+ * Check whether a file is a trace cache.
+ *
+ * Only regular files are opened, so that probing a FIFO or device does not
+ * block on it or eat the start of the trace.
+ *
+ * @param filename the file to check
+ * @return true if the file starts with TCACHE_MAGIC
+ */
+bool tcache_probe(const char *filename)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    char magic[8];
+    bool match = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                 memcmp(magic, TCACHE_MAGIC, sizeof(magic)) == 0;
+    close(fd);
+    return match;
+}
+
+/**
+ * Map a trace cache into memory.
+ *
+ * @param filename the trace cache to open
+ * @return a pointer to a newly allocated TCache, or NULL on failure
+ */
+TCache *tcache_open(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Couldn't open trace cache");
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        perror("Couldn't open trace cache");
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = MAP_FAILED;
+    if (size >= sizeof(TCacheHeader))
+    {
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Invalid trace cache\n");
+        return NULL;
+    }
+
+    // Check the header against the size of the file.
+    const TCacheHeader *hdr = (const TCacheHeader *)map;
+    uint64_t num_blocks = hdr->block_insts == 0 ? 0 :
+        (hdr->num_insts + hdr->block_insts - 1) / hdr->block_insts;
+    uint64_t min_bytes = hdr->flags & TCACHE_EXTRA ?
+        TCACHE_EXTRA_BYTES(hdr->block_insts) :
+        TCACHE_CORE_BYTES(hdr->block_insts);
+    if (memcmp(hdr->magic, TCACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != TCACHE_VERSION || hdr->block_insts == 0 ||
+        hdr->block_bytes < min_bytes ||
+        sizeof(TCacheHeader) + num_blocks * hdr->block_bytes > size)
+    {
+        fprintf(stderr, "Error: Invalid trace cache\n");
+        munmap(map, size);
+        return NULL;
+    }
+
+    // Fetch reads the cache front to back.
+    madvise(map, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    TCache *cache = (TCache *)calloc(1, sizeof(TCache));
+    cache->map = (const uint8_t *)map;
+    cache->map_size = size;
+    cache->hdr = hdr;
+    return cache;
+}
+
+/**
+ * Unmap a trace cache and free it.
+ *
+ * @param cache the cache
+ */
+void tcache_close(TCache *cache)
+{
+    munmap((void *)cache->map, cache->map_size);
+    free(cache);
+}
+
+/**
+ * Point a trace cache source at the columns of the block holding its next
+ * instruction.
+ *
+ * @param ts the source
+ */
+static void tcache_source_load_block(TCacheSource *ts)
+{
+    const TCacheHeader *hdr = ts->cache->hdr;
+    const uint32_t B = hdr->block_insts;
+    const uint8_t *block = ts->cache->map + sizeof(TCacheHeader) +
+                           (ts->pos / B) * hdr->block_bytes;
+    ts->op = block + TCACHE_COL_OP(B);
+    ts->dest = (const int8_t *)(block + TCACHE_COL_DEST(B));
+    ts->src1 = (const int8_t *)(block + TCACHE_COL_SRC1(B));
+    ts->src2 = (const int8_t *)(block + TCACHE_COL_SRC2(B));
+    ts->block_pos = ts->pos % B;
+}
+
+/**
+ * Fetch the next instruction from a trace cache.
+ *
+ * @param src the source to read from
+ * @param inst the instruction to populate
+ * @return the status of the read
+ */
+static SourceStatus tcache_source_next(InstSource *src, InstInfo *inst)
+{
+    TCacheSource *ts = (TCacheSource *)src->ctx;
+    const TCacheHeader *hdr = ts->cache->hdr;
+    if (ts->pos >= hdr->num_insts)
+    {
+        SourceStatus status = ts->end_reported ? SOURCE_EOF :
+                              (SourceStatus)hdr->end_status;
+        ts->end_reported = true;
+        return status;
+    }
+    if (ts->block_pos == hdr->block_insts)
+    {
+        tcache_source_load_block(ts);
+    }
+
+    uint32_t i = ts->block_pos++;
+    ts->pos++;
+    inst->op_type = (OpType)ts->op[i];
+    inst->dest_reg = ts->dest[i];
+    inst->src1_reg = ts->src1[i];
+    inst->src2_reg = ts->src2[i];
+
+    inst->dr_tag = -1;
+    inst->src1_tag = -1;
+    inst->src2_tag = -1;
+    inst->src1_ready = false;
+    inst->src2_ready = false;
+    return SOURCE_OK;
+}
+
+/**
+ * Discard instructions of a trace cache by moving the cursor past them.
+ *
+ * @param src the source to read from
+ * @param n the number of instructions to discard
+ * @param skipped receives the number of instructions discarded
+ * @return SOURCE_OK if all n instructions were discarded, otherwise how the
+ *         trace ended
+ */
+static SourceStatus tcache_source_skip(InstSource *src, uint64_t n,
+                                       uint64_t *skipped)
+{
+    TCacheSource *ts = (TCacheSource *)src->ctx;
+    const TCacheHeader *hdr = ts->cache->hdr;
+    uint64_t left = hdr->num_insts - ts->pos;
+    *skipped = n < left ? n : left;
+    ts->pos += *skipped;
+
+    // At the end of the cache there is no block to point at, and
+    // tcache_source_next will not read one.
+    if (ts->pos < hdr->num_insts)
+    {
+        tcache_source_load_block(ts);
+    }
+
+    if (*skipped < n)
+    {
+        SourceStatus status = ts->end_reported ? SOURCE_EOF :
+                              (SourceStatus)hdr->end_status;
+        ts->end_reported = true;
+        return status;
+    }
+    return SOURCE_OK;
+}
+
+/**
+ * Report how much of the cache a trace cache source has fetched.
+ *
+ * @param src the source
+ * @param stats receives the counters
+ */
+static void tcache_source_stats(InstSource *src, SourceStats *stats)
+{
+    // The cache is mapped, so there are no reads to count or time.
+    TCacheSource *ts = (TCacheSource *)src->ctx;
+    const TCacheHeader *hdr = ts->cache->hdr;
+    stats->bytes_read = ts->pos * hdr->block_bytes / hdr->block_insts;
+    stats->reads = 0;
+    stats->read_ns = 0;
+}
+
+/**
+ * Unmap the cache of a trace cache source.
+ *
+ * @param src the source to release
+ */
+static void tcache_source_release(InstSource *src)
+{
+    TCacheSource *ts = (TCacheSource *)src->ctx;
+    tcache_close(ts->cache);
+    free(ts);
+}
+
+/**
+ * Create a source that fetches instructions from a trace cache.
+ *
+ * @param cache the cache to fetch from
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_tcache(TCache *cache)
+{
+    TCacheSource *ts = (TCacheSource *)calloc(1, sizeof(TCacheSource));
+    ts->cache = cache;
+    ts->pos = 0;
+    ts->end_reported = false;
+    tcache_source_load_block(ts);
+
+    InstSource *src = (InstSource *)calloc(1, sizeof(InstSource));
+    src->next = tcache_source_next;
+    src->skip = tcache_source_skip;
+    src->release = tcache_source_release;
+    src->stats = tcache_source_stats;
+    src->ctx = ts;
+    return src;
+}
@@ -0,0 +1,115 @@
+// tcache.h
+// Declares the trace cache: a pre-decoded, uncompressed, memory-mapped form
+// of a trace file.
+//
+// A trace cache is a 64-byte header followed by fixed-size blocks of
+// TCACHE_BLOCK_INSTS instructions each. Within a block, every field is kept in
+// its own column (structure of arrays): op_type, then the dest/src1/src2
+// registers as int8 with unused registers already mapped to -1, then, if the
+// cache was built with TCACHE_EXTRA, the inst_addr/mem_addr/br_target
+// columns (uint64) and the mem_read/mem_write and br_dir flag columns (uint8).
+// Fetching from a cache is a pointer bump with no system calls and no
+// decompression, and any number of simulator processes can share the same
+// cache through the page cache.
+
+#ifndef _TCACHE_H_
+#define _TCACHE_H_
+
+#include "source.h"
+#include <inttypes.h>
+#include <stddef.h>
+
+/** The magic number at the start of every trace cache. */
+#define TCACHE_MAGIC "PTRCACHE"
+
+/** The version of the trace cache format. */
+#define TCACHE_VERSION 1
+
+/** The number of instructions in each block of a trace cache. */
+#define TCACHE_BLOCK_INSTS 65536
+
+/** Header flag: the cache holds the optional address and flag columns. */
+#define TCACHE_EXTRA 0x1
+
+/** Bits of the mem_flags column. */
+#define TCACHE_MEM_READ 0x1
+#define TCACHE_MEM_WRITE 0x2
+
+/** The header at the start of a trace cache. */
+typedef struct TCacheHeaderStruct
+{
+    /** TCACHE_MAGIC, without the terminating NUL. */
+    char magic[8];
+    /** TCACHE_VERSION. */
+    uint32_t version;
+    /** A combination of TCACHE_* header flags. */
+    uint32_t flags;
+    /** The number of instructions in the cache. */
+    uint64_t num_insts;
+    /** The number of instructions per block. */
+    uint32_t block_insts;
+    /** How the original trace ended (SOURCE_EOF or SOURCE_INVALID). */
+    uint32_t end_status;
+    /** The size of each block, in bytes. */
+    uint64_t block_bytes;
+    /** Reserved; zero. */
+    uint8_t reserved[24];
+} TCacheHeader;
+
+/** A trace cache mapped into memory. */
+typedef struct TCacheStruct
+{
+    /** [Internal] The mapped file. */
+    const uint8_t *map;
+    /** [Internal] The size of the mapping. */
+    size_t map_size;
+    /** The header of the cache. */
+    const TCacheHeader *hdr;
+} TCache;
+
+/**
+ * Decode a trace file once and write it out as a trace cache.
+ *
+ * @param in_filename the (possibly gzip-compressed) trace file to read
+ * @param out_filename the trace cache to write
+ * @param extra whether to include the optional address and flag columns
+ * @param gz_threads the number of threads to decompress BGZF traces with
+ * @return 0 on success, nonzero on failure (an error has been printed)
+ */
+int tcache_build(const char *in_filename, const char *out_filename, bool extra,
+                 unsigned int gz_threads);
+
+/**
+ * Check whether a file is a trace cache.
+ *
+ * @param filename the file to check
+ * @return true if the file starts with TCACHE_MAGIC
+ */
+bool tcache_probe(const char *filename);
+
+/**
+ * Map a trace cache into memory.
+ *
+ * @param filename the trace cache to open
+ * @return a pointer to a newly allocated TCache, or NULL if the file could not
+ *         be opened or is not a valid trace cache (an error has been printed)
+ */
+TCache *tcache_open(const char *filename);
+
+/**
+ * Unmap a trace cache and free it.
+ *
+ * @param cache the cache
+ */
+void tcache_close(TCache *cache);
+
+/**
+ * Create a source that fetches instructions from a trace cache.
+ *
+ * @param cache the cache to fetch from; the source takes ownership of it and
+ *              closes it when freed
+ * @return a pointer to a newly allocated source
+ */
+InstSource *source_init_tcache(TCache *cache);
+
+#endif
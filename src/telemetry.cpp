@@ -0,0 +1,320 @@
+// telemetry.cpp
+// Implements the telemetry channel.
+//
+// The simulation thread is the only producer and the writer thread the only
+// consumer of the ring, so the two only share a pair of atomic counters. The
+// writer sleeps between drains, and is only woken early once the ring is
+// half full.
+
+#include "telemetry.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+/** [Internal] The telemetry channel. */
+struct TelemetryStruct
+{
+    /** The number of cycles between snapshots. */
+    uint32_t interval;
+    /** The width of the pipeline. */
+    uint32_t pipe_width;
+    /** The time-series file. */
+    FILE *out;
+    /** The format of the file. */
+    TelemetryFormat format;
+    /** How often the writer drains the ring. */
+    std::chrono::milliseconds flush_period;
+
+    /** The ring of snapshots; snapshot n lives in ring[n % TELEMETRY_RING_SAMPLES]. */
+    TelemetrySample ring[TELEMETRY_RING_SAMPLES];
+    /** The number of snapshots recorded so far. */
+    std::atomic<uint64_t> head;
+    /** The number of snapshots written so far. */
+    std::atomic<uint64_t> tail;
+    /** The cycle of the last snapshot recorded. */
+    uint64_t last_cycle;
+
+    /** Protects stop. */
+    std::mutex lock;
+    /** Signalled to have the writer drain the ring now. */
+    std::condition_variable wake;
+    /** Whether the writer should drain the ring one last time and exit. */
+    bool stop;
+    /** The writer thread. */
+    std::thread writer;
+
+    /** [Writer] The snapshot written before the current one. */
+    TelemetrySample prev;
+    /** [Writer] Whether writing to the file has failed. */
+    bool failed;
+};
+
+/**
+ * Parse the name of a time-series format.
+ *
+ * @param name "csv" or "binary"
+ * @param format receives the format
+ * @return true if the name is recognized
+ */
+bool telemetry_parse_format(const char *name, TelemetryFormat *format)
+{
+    if (strcmp(name, "csv") == 0)
+    {
+        *format = TELEMETRY_CSV;
+        return true;
+    }
+    if (strcmp(name, "binary") == 0)
+    {
+        *format = TELEMETRY_BINARY;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Write one snapshot to the time-series file.
+ *
+ * The CSV format holds the CPI, ROB stall cycles, and CPI stack of the
+ * interval ending at the snapshot rather than the totals, as those are what
+ * get plotted.
+ */
+static void telemetry_write_sample(Telemetry *t, const TelemetrySample *s)
+{
+    if (t->format == TELEMETRY_BINARY)
+    {
+        if (fwrite(s, sizeof(*s), 1, t->out) != 1)
+        {
+            t->failed = true;
+        }
+        return;
+    }
+
+    uint64_t cycles = s->cycle - t->prev.cycle;
+    uint64_t insts = s->retired_inst - t->prev.retired_inst;
+    double cpi = insts > 0 ? (double)cycles / (double)insts : 0.0;
+    if (fprintf(t->out, "%lu,%lu,%.4f,%u,%u,%lu", (unsigned long)s->cycle,
+                (unsigned long)s->retired_inst, cpi, s->rob_occupancy,
+                s->exeq_occupancy,
+                (unsigned long)(s->rob_stall_cycles - t->prev.rob_stall_cycles)) < 0)
+    {
+        t->failed = true;
+    }
+
+    double slot_cpi = insts > 0 ? 1.0 / ((double)t->pipe_width * (double)insts) : 0.0;
+    if (fprintf(t->out, ",%.4f", insts * slot_cpi) < 0)
+    {
+        t->failed = true;
+    }
+    for (int r = 0; r < NUM_STALL_REASONS; r++)
+    {
+        uint64_t slots = s->stall_slots[r] - t->prev.stall_slots[r];
+        if (fprintf(t->out, ",%.4f", slots * slot_cpi) < 0)
+        {
+            t->failed = true;
+        }
+    }
+    if (fprintf(t->out, "\n") < 0)
+    {
+        t->failed = true;
+    }
+    t->prev = *s;
+}
+
+/**
+ * Write every snapshot recorded so far.
+ */
+static void telemetry_drain(Telemetry *t)
+{
+    uint64_t head = t->head.load(std::memory_order_acquire);
+    uint64_t tail = t->tail.load(std::memory_order_relaxed);
+    if (head == tail)
+    {
+        return;
+    }
+
+    for (; tail < head; tail++)
+    {
+        telemetry_write_sample(t, &t->ring[tail % TELEMETRY_RING_SAMPLES]);
+    }
+    t->tail.store(tail, std::memory_order_release);
+    if (fflush(t->out) != 0)
+    {
+        t->failed = true;
+    }
+}
+
+/**
+ * Drain the ring every flush period until asked to stop.
+ */
+static void telemetry_writer(Telemetry *t)
+{
+    std::unique_lock<std::mutex> guard(t->lock);
+    while (!t->stop)
+    {
+        t->wake.wait_for(guard, t->flush_period);
+        guard.unlock();
+        telemetry_drain(t);
+        guard.lock();
+    }
+    guard.unlock();
+    telemetry_drain(t);
+}
+
+/**
+ * Create a time-series file and start the thread that writes to it.
+ *
+ * @param filename the file to write
+ * @param format the format to write in
+ * @param interval the number of cycles between snapshots
+ * @param flush_ms how often the writer thread drains the ring, in
+ *                 milliseconds
+ * @param pipe_width the width of the pipeline that will be recorded
+ * @return a pointer to a newly allocated channel, or NULL if the file could
+ *         not be created (an error has been printed)
+ */
+Telemetry *telemetry_open(const char *filename, TelemetryFormat format,
+                          uint32_t interval, unsigned int flush_ms,
+                          uint32_t pipe_width)
+{
+    FILE *out = fopen(filename, format == TELEMETRY_BINARY ? "wb" : "w");
+    if (out == NULL)
+    {
+        perror("Couldn't open telemetry file for writing");
+        return NULL;
+    }
+
+    bool ok;
+    if (format == TELEMETRY_BINARY)
+    {
+        TelemetryFileHeader hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+        hdr.sample_size = sizeof(TelemetrySample);
+        hdr.interval = interval;
+        hdr.pipe_width = pipe_width;
+        ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1;
+    }
+    else
+    {
+        ok = fprintf(out, "cycle,retired_inst,cpi,rob_occupancy,"
+                          "exeq_occupancy,rob_stall_cycles,cpi_base") >= 0;
+        for (int r = 0; r < NUM_STALL_REASONS && ok; r++)
+        {
+            ok = fprintf(out, ",cpi_%s", STALL_REASON_NAMES[r]) >= 0;
+        }
+        ok = ok && fprintf(out, "\n") >= 0;
+    }
+    if (!ok)
+    {
+        perror("Couldn't write telemetry file");
+        fclose(out);
+        return NULL;
+    }
+
+    Telemetry *t = new Telemetry();
+    t->interval = interval;
+    t->pipe_width = pipe_width;
+    t->out = out;
+    t->format = format;
+    t->flush_period = std::chrono::milliseconds(flush_ms);
+    t->head = 0;
+    t->tail = 0;
+    t->last_cycle = 0;
+    t->stop = false;
+    memset(&t->prev, 0, sizeof(t->prev));
+    t->failed = false;
+    t->writer = std::thread(telemetry_writer, t);
+    return t;
+}
+
+/**
+ * Find the cycle at which the next snapshot of a pipeline is due.
+ *
+ * @param t the channel
+ * @param cycle the current cycle of the pipeline
+ * @return the first multiple of the interval after cycle
+ */
+uint64_t telemetry_next_cycle(const Telemetry *t, uint64_t cycle)
+{
+    return (cycle / t->interval + 1) * t->interval;
+}
+
+/**
+ * Record a snapshot of a pipeline.
+ *
+ * @param t the channel
+ * @param p the pipeline
+ * @return the cycle at which the next snapshot is due
+ */
+uint64_t telemetry_record(Telemetry *t, const Pipeline *p)
+{
+    uint64_t head = t->head.load(std::memory_order_relaxed);
+    if (head - t->tail.load(std::memory_order_acquire) == TELEMETRY_RING_SAMPLES)
+    {
+        // The writer has fallen a whole ring behind; wait for it rather
+        // than lose snapshots.
+        t->wake.notify_one();
+        while (head - t->tail.load(std::memory_order_acquire) == TELEMETRY_RING_SAMPLES)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    TelemetrySample *s = &t->ring[head % TELEMETRY_RING_SAMPLES];
+    s->cycle = p->stat_num_cycle;
+    s->retired_inst = p->stat_retired_inst;
+    s->rob_stall_cycles = p->stat_rob_stall_cycles;
+    s->rob_occupancy = rob_occupancy(p->rob);
+    s->exeq_occupancy = p->exeq->count;
+    memcpy(s->stall_slots, p->stat_stall_slots, sizeof(s->stall_slots));
+    t->head.store(head + 1, std::memory_order_release);
+    t->last_cycle = p->stat_num_cycle;
+
+    if (head - t->tail.load(std::memory_order_relaxed) == TELEMETRY_RING_SAMPLES / 2)
+    {
+        t->wake.notify_one();
+    }
+    return telemetry_next_cycle(t, p->stat_num_cycle);
+}
+
+/**
+ * Stop the writer thread once it has written every snapshot, close the file,
+ * and free the channel.
+ *
+ * @param t the channel
+ * @param p the pipeline, of which a last snapshot is recorded if it has
+ *          simulated any cycles since the previous one; or NULL
+ * @return 0 on success, nonzero if the file could not be written (an error
+ *         has been printed)
+ */
+int telemetry_close(Telemetry *t, const Pipeline *p)
+{
+    if (p != NULL && p->stat_num_cycle > t->last_cycle)
+    {
+        telemetry_record(t, p);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        t->stop = true;
+    }
+    t->wake.notify_one();
+    t->writer.join();
+
+    bool ok = !t->failed;
+    if (fclose(t->out) != 0)
+    {
+        ok = false;
+    }
+    delete t;
+    if (!ok)
+    {
+        fprintf(stderr, "Error: couldn't write telemetry file\n");
+        return 1;
+    }
+    return 0;
+}
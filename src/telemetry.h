@@ -0,0 +1,124 @@
+// telemetry.h
+// Declares the telemetry channel, which records periodic snapshots of a
+// running pipeline into a preallocated ring buffer and has a background
+// thread write them to a time-series file, so that phase behaviour can be
+// plotted without slowing down the simulation.
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include "pipeline.h"
+#include <inttypes.h>
+
+/**
+ * The number of snapshots the ring buffer holds; a power of two.
+ */
+#define TELEMETRY_RING_SAMPLES 4096
+
+/**
+ * The magic string at the start of a binary time-series file, including the
+ * terminating NUL.
+ */
+#define TELEMETRY_MAGIC "SIMTLM3"
+
+/** The formats a time-series file can be written in. */
+typedef enum TelemetryFormatEnum
+{
+    TELEMETRY_CSV,    // A header line, then one line per snapshot.
+    TELEMETRY_BINARY, // A TelemetryFileHeader, then raw TelemetrySamples.
+} TelemetryFormat;
+
+/** One snapshot of a pipeline. All counters are totals since cycle 0. */
+typedef struct TelemetrySampleStruct
+{
+    /** The cycle the snapshot was taken at. */
+    uint64_t cycle;
+    /** The number of instructions retired. */
+    uint64_t retired_inst;
+    /** The number of cycles the issue stage stalled on a full ROB. */
+    uint64_t rob_stall_cycles;
+    /** The number of instructions in the ROB. */
+    uint32_t rob_occupancy;
+    /** The number of instructions executing in the EXEQ. */
+    uint32_t exeq_occupancy;
+    /** The number of commit slots left unused for each StallReason. */
+    uint64_t stall_slots[NUM_STALL_REASONS];
+} TelemetrySample;
+
+/** The header of a binary time-series file. */
+typedef struct TelemetryFileHeaderStruct
+{
+    /** TELEMETRY_MAGIC. */
+    char magic[8];
+    /** sizeof(TelemetrySample), in this host's layout. */
+    uint32_t sample_size;
+    /** The number of cycles between snapshots. */
+    uint32_t interval;
+    /** The width of the pipeline, which has that many commit slots a cycle. */
+    uint32_t pipe_width;
+    /** Zero. */
+    uint32_t reserved;
+} TelemetryFileHeader;
+
+/** [Internal] The telemetry channel; defined in telemetry.cpp. */
+typedef struct TelemetryStruct Telemetry;
+
+/**
+ * Parse the name of a time-series format.
+ *
+ * @param name "csv" or "binary"
+ * @param format receives the format
+ * @return true if the name is recognized
+ */
+bool telemetry_parse_format(const char *name, TelemetryFormat *format);
+
+/**
+ * Create a time-series file and start the thread that writes to it.
+ *
+ * @param filename the file to write
+ * @param format the format to write in
+ * @param interval the number of cycles between snapshots
+ * @param flush_ms how often the writer thread drains the ring, in
+ *                 milliseconds
+ * @param pipe_width the width of the pipeline that will be recorded
+ * @return a pointer to a newly allocated channel, or NULL if the file could
+ *         not be created (an error has been printed)
+ */
+Telemetry *telemetry_open(const char *filename, TelemetryFormat format,
+                          uint32_t interval, unsigned int flush_ms,
+                          uint32_t pipe_width);
+
+/**
+ * Find the cycle at which the next snapshot of a pipeline is due.
+ *
+ * @param t the channel
+ * @param cycle the current cycle of the pipeline
+ * @return the first multiple of the interval after cycle
+ */
+uint64_t telemetry_next_cycle(const Telemetry *t, uint64_t cycle);
+
+/**
+ * Record a snapshot of a pipeline.
+ *
+ * This only copies the snapshot into the ring; if the writer thread has
+ * fallen a whole ring behind, it waits for the writer to catch up.
+ *
+ * @param t the channel
+ * @param p the pipeline
+ * @return the cycle at which the next snapshot is due
+ */
+uint64_t telemetry_record(Telemetry *t, const Pipeline *p);
+
+/**
+ * Stop the writer thread once it has written every snapshot, close the file,
+ * and free the channel.
+ *
+ * @param t the channel
+ * @param p the pipeline, of which a last snapshot is recorded if it has
+ *          simulated any cycles since the previous one; or NULL
+ * @return 0 on success, nonzero if the file could not be written (an error
+ *         has been printed)
+ */
+int telemetry_close(Telemetry *t, const Pipeline *p);
+
+#endif
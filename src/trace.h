@@ -61,43 +61,21 @@ typedef struct TraceRecStruct
  * An in-flight instruction in the out-of-order processor.
  * 
  * This structure is passed through the pipeline latches and used in each ROB
- * entry.
+ * entry. It is kept to 16 bytes, so that copying one between stages costs
+ * two register moves: registers fit in 8 bits (see MAX_ARF_REGS) and tags in
+ * 16 bits (see MAX_ROB_ENTRIES).
  */
 typedef struct InstInfoStruct
 {
     /**
-     * A unique, monotonically increasing ID for this instruction.
+     * A unique, monotonically increasing ID for this instruction, modulo
+     * 2^32.
      * 
-     * This is guaranteed to be unique for each operation in the trace file.
+     * This is unique among the instructions in flight, which is all it is
+     * used for; compare two IDs with inst_num_before rather than <, so that
+     * the order survives the ID wrapping around.
      */
-    uint64_t inst_num;
-
-    /**
-     * The type of operation performed by this instruction, as indicated by the
-     * OpType enum.
-     */
-    OpType op_type;
-
-    /**
-     * The destination register this instruction writes to.
-     * 
-     * This is set to -1 if no destination register is used.
-     */
-    int dest_reg;
-
-    /**
-     * The first source register this instruction reads from.
-     * 
-     * This is set to -1 if no first source register is used.
-     */
-    int src1_reg;
-
-    /**
-     * The second source register this instruction reads from.
-     * 
-     * This is set to -1 if no second source register is used.
-     */
-    int src2_reg;
+    uint32_t inst_num;
 
     /**
      * The tag of this instruction's destination register after renaming.
@@ -110,7 +88,7 @@ typedef struct InstInfoStruct
      * destination register can be considered synonymous with the tag (ID) of
      * the instruction that produces it.)
      */
-    int dr_tag;
+    int16_t dr_tag;
 
     /**
      * The tag of this instruction's first source register after renaming.
@@ -121,7 +99,7 @@ typedef struct InstInfoStruct
      * If this instruction's first operand is not needed or already ready, this
      * field should be set to -1.
      */
-    int src1_tag;
+    int16_t src1_tag;
 
     /**
      * The tag of this instruction's second source register after renaming.
@@ -132,7 +110,34 @@ typedef struct InstInfoStruct
      * If this instruction's second operand is not needed or already ready,
      * this field should be set to -1.
      */
-    int src2_tag;
+    int16_t src2_tag;
+
+    /**
+     * The destination register this instruction writes to.
+     * 
+     * This is set to -1 if no destination register is used.
+     */
+    int8_t dest_reg;
+
+    /**
+     * The first source register this instruction reads from.
+     * 
+     * This is set to -1 if no first source register is used.
+     */
+    int8_t src1_reg;
+
+    /**
+     * The second source register this instruction reads from.
+     * 
+     * This is set to -1 if no second source register is used.
+     */
+    int8_t src2_reg;
+
+    /**
+     * The type of operation performed by this instruction, as indicated by the
+     * OpType enum.
+     */
+    uint8_t op_type;
 
     /**
      * Whether this instruction's first operand is ready or not needed.
@@ -143,11 +148,23 @@ typedef struct InstInfoStruct
      * Whether this instruction's second operand is ready or not needed.
      */
     bool src2_ready;
-
-    /**
-     * The number of cycles this instruction will take to execute.
-     */
-    int exe_wait_cycles;
 } InstInfo;
 
+static_assert(sizeof(InstInfo) == 16, "InstInfo should stay 16 bytes");
+
+/**
+ * Check whether one instruction was fetched before another.
+ * 
+ * Correct as long as fewer than 2^31 instructions separate the two, which
+ * always holds for instructions in flight together.
+ * 
+ * @param a the inst_num of the first instruction
+ * @param b the inst_num of the second instruction
+ * @return true if a was fetched before b
+ */
+static inline bool inst_num_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
 #endif
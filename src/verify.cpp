@@ -0,0 +1,636 @@
+// verify.cpp
+// Implements the lockstep verification mode.
+//
+// The reference engine below is deliberately kept as simple as the machine it
+// models: every structure is a plain array that is scanned when searched, as
+// in the original implementation of the pipeline. It is the specification
+// the pipeline's fast paths are checked against, so it should not be
+// optimized; changes to the modelled machine must be made to both engines.
+
+#include "verify.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/** [Internal] An entry of the reference engine's ROB. */
+typedef struct RefROBEntryStruct
+{
+    /** If this entry is valid. */
+    bool valid;
+    /** If the instruction has been scheduled for execution. */
+    bool exec;
+    /** If the instruction has its output ready. */
+    bool ready;
+    /** The instruction. */
+    InstInfo inst;
+} RefROBEntry;
+
+/** [Internal] An entry of the reference engine's EXEQ. */
+typedef struct RefEXEQEntryStruct
+{
+    /** If this entry is valid. */
+    bool valid;
+    /** The instruction executing. */
+    InstInfo inst;
+    /** The number of cycles until the instruction finishes executing. */
+    int wait_cycles;
+} RefEXEQEntry;
+
+/** [Internal] The reference engine. */
+typedef struct RefPipelineStruct
+{
+    /** The configuration of the engine, that of the pipeline verified. */
+    PipelineConfig config;
+    /** The ROB, of config.num_rob_entries entries. */
+    RefROBEntry *rob;
+    /** The oldest entry of the ROB. */
+    unsigned int rob_head;
+    /** The entry of the ROB the next instruction is inserted into. */
+    unsigned int rob_tail;
+    /**
+     * The EXEQ, of config.num_rob_entries entries, as every instruction
+     * executing is also in the ROB.
+     */
+    RefEXEQEntry *exeq;
+    /** The RAT. */
+    RAT *rat;
+
+    /** The fetch latches. */
+    PipelineLatch FE_latch[MAX_PIPE_WIDTH];
+    /** The decode latches. */
+    PipelineLatch ID_latch[MAX_PIPE_WIDTH];
+    /** The schedule latches. */
+    PipelineLatch SC_latch[MAX_PIPE_WIDTH];
+    /** The execute latches. */
+    PipelineLatch EX_latch[MAX_WRITEBACKS];
+
+    /** The source from which to fetch instructions. */
+    InstSource *src;
+    /** The last inst_num assigned. */
+    uint64_t last_inst_num;
+    /** The inst_num the decode stage should pass on next. */
+    uint64_t next_inst_num;
+    /** The number of instructions in the trace, once known. */
+    uint64_t halt_inst_num;
+    /** Whether the engine is done. */
+    bool halt;
+
+    /** The number of instructions retired. */
+    uint64_t stat_retired_inst;
+    /** The number of cycles simulated. */
+    uint64_t stat_num_cycle;
+    /** The inst_num of the last instruction retired. */
+    uint32_t last_retired_inst_num;
+} RefPipeline;
+
+/**
+ * Allocate and initialize a reference engine with the given configuration.
+ */
+static RefPipeline *ref_init(const PipelineConfig *config, InstSource *src)
+{
+    RefPipeline *p = (RefPipeline *)calloc(1, sizeof(RefPipeline));
+    p->config = *config;
+    p->rob = (RefROBEntry *)calloc(config->num_rob_entries, sizeof(RefROBEntry));
+    p->exeq = (RefEXEQEntry *)calloc(config->num_rob_entries, sizeof(RefEXEQEntry));
+    p->rat = rat_init();
+    p->src = src;
+    p->next_inst_num = 1;
+    p->halt_inst_num = (uint64_t)(-1) - 3;
+    return p;
+}
+
+/**
+ * Free a reference engine; its source is not freed.
+ */
+static void ref_free(RefPipeline *p)
+{
+    free(p->rob);
+    free(p->exeq);
+    free(p->rat);
+    free(p);
+}
+
+/**
+ * Check if the reference ROB has space for another instruction.
+ */
+static bool ref_rob_check_space(RefPipeline *p)
+{
+    return p->rob_tail != p->rob_head || !p->rob[p->rob_head].valid;
+}
+
+/**
+ * Check if the instruction with the given tag is valid and has its output
+ * ready.
+ */
+static bool ref_rob_check_ready(RefPipeline *p, int tag)
+{
+    return p->rob[tag].valid && p->rob[tag].ready;
+}
+
+/**
+ * Mark every operand waiting on the instruction with the given tag as ready,
+ * scanning the whole ROB from head to tail.
+ */
+static void ref_rob_wakeup(RefPipeline *p, int tag)
+{
+    unsigned int i = p->rob_head;
+    do
+    {
+        if (p->rob[i].valid && p->rob[i].inst.src1_tag == tag)
+        {
+            p->rob[i].inst.src1_ready = true;
+        }
+        if (p->rob[i].valid && p->rob[i].inst.src2_tag == tag)
+        {
+            p->rob[i].inst.src2_ready = true;
+        }
+        i = (i + 1) % p->config.num_rob_entries;
+    } while (i != p->rob_tail);
+}
+
+/**
+ * Fetch the next instruction of the trace into a latch.
+ */
+static void ref_fetch_inst(RefPipeline *p, PipelineLatch *fe_latch)
+{
+    if (source_next(p->src, &fe_latch->inst) != SOURCE_OK)
+    {
+        fe_latch->valid = false;
+        p->halt_inst_num = p->last_inst_num;
+        if (p->stat_retired_inst >= p->halt_inst_num)
+        {
+            p->halt = true;
+        }
+        return;
+    }
+
+    fe_latch->valid = true;
+    fe_latch->stall = false;
+    fe_latch->inst.inst_num = (uint32_t)++p->last_inst_num;
+}
+
+/**
+ * Simulate one cycle of the fetch stage of the reference engine.
+ */
+static void ref_cycle_fetch(RefPipeline *p)
+{
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (!p->FE_latch[i].stall && !p->FE_latch[i].valid)
+        {
+            ref_fetch_inst(p, &p->FE_latch[i]);
+        }
+    }
+}
+
+/**
+ * Simulate one cycle of the decode stage of the reference engine, which
+ * passes the fetched instructions on in program order.
+ */
+static void ref_cycle_decode(RefPipeline *p)
+{
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (!p->ID_latch[i].stall && !p->ID_latch[i].valid)
+        {
+            for (unsigned int j = 0; j < p->config.pipe_width; j++)
+            {
+                if (p->FE_latch[j].valid &&
+                    p->FE_latch[j].inst.inst_num == (uint32_t)p->next_inst_num)
+                {
+                    p->ID_latch[i] = p->FE_latch[j];
+                    p->FE_latch[j].valid = false;
+                    p->next_inst_num++;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Simulate one cycle of the issue stage of the reference engine: insert
+ * decoded instructions into the ROB in program order and rename their
+ * registers.
+ */
+static void ref_cycle_issue(RefPipeline *p)
+{
+    for (unsigned int i = 0; i + 1 < p->config.pipe_width; i++)
+    {
+        for (unsigned int j = 0; j + i + 1 < p->config.pipe_width; j++)
+        {
+            if (inst_num_before(p->ID_latch[j + 1].inst.inst_num,
+                                p->ID_latch[j].inst.inst_num))
+            {
+                PipelineLatch temp = p->ID_latch[j];
+                p->ID_latch[j] = p->ID_latch[j + 1];
+                p->ID_latch[j + 1] = temp;
+            }
+        }
+    }
+
+    bool prev_ID_stall = false;
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        p->ID_latch[i].stall = prev_ID_stall;
+        if (p->ID_latch[i].stall || !p->ID_latch[i].valid)
+        {
+            continue;
+        }
+
+        if (!ref_rob_check_space(p))
+        {
+            p->ID_latch[i].stall = true;
+            prev_ID_stall = true;
+            continue;
+        }
+
+        int idx = p->rob_tail;
+        RefROBEntry *entry = &p->rob[idx];
+        entry->valid = true;
+        entry->exec = false;
+        entry->ready = false;
+        entry->inst = p->ID_latch[i].inst;
+        p->rob_tail = (p->rob_tail + 1) % p->config.num_rob_entries;
+        p->ID_latch[i].valid = false;
+
+        InstInfo *inst = &entry->inst;
+        if (inst->src1_reg != -1)
+        {
+            inst->src1_tag = rat_get_remap(p->rat, inst->src1_reg);
+            inst->src1_ready = inst->src1_tag == -1 ||
+                               ref_rob_check_ready(p, inst->src1_tag);
+        }
+        if (inst->src2_reg != -1)
+        {
+            inst->src2_tag = rat_get_remap(p->rat, inst->src2_reg);
+            inst->src2_ready = inst->src2_tag == -1 ||
+                               ref_rob_check_ready(p, inst->src2_tag);
+        }
+
+        inst->dr_tag = idx;
+        if (inst->dest_reg != -1)
+        {
+            rat_set_remap(p->rat, inst->dest_reg, idx);
+        }
+    }
+}
+
+/**
+ * Simulate one cycle of the schedule stage of the reference engine.
+ *
+ * Each lane scans the ROB from the head for the oldest instruction not yet
+ * executing: with in-order scheduling that instruction is scheduled if its
+ * operands are ready, and with out-of-order scheduling the scan goes on to
+ * the oldest one whose operands are ready.
+ */
+static void ref_cycle_schedule(RefPipeline *p)
+{
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        unsigned int j = p->rob_head;
+        do
+        {
+            RefROBEntry *entry = &p->rob[j];
+            if (entry->valid && !entry->exec)
+            {
+                bool ready = (entry->inst.src1_reg == -1 || entry->inst.src1_ready) &&
+                             (entry->inst.src2_reg == -1 || entry->inst.src2_ready);
+                if (ready)
+                {
+                    entry->exec = true;
+                    p->SC_latch[i].inst = entry->inst;
+                    p->SC_latch[i].valid = true;
+                    break;
+                }
+                p->SC_latch[i].valid = false;
+                if (p->config.sched_policy == SCHED_IN_ORDER)
+                {
+                    break;
+                }
+            }
+            j = (j + 1) % p->config.num_rob_entries;
+        } while (j != p->rob_tail);
+    }
+}
+
+/**
+ * Simulate one cycle of the execute stage of the reference engine.
+ */
+static void ref_cycle_exe(RefPipeline *p)
+{
+    // Single-cycle execution bypasses the EXEQ.
+    if (p->config.load_exe_cycles == 1)
+    {
+        for (unsigned int i = 0; i < p->config.pipe_width; i++)
+        {
+            if (p->SC_latch[i].valid)
+            {
+                p->EX_latch[i] = p->SC_latch[i];
+                p->SC_latch[i].valid = false;
+            }
+        }
+        return;
+    }
+
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (!p->SC_latch[i].valid)
+        {
+            continue;
+        }
+        for (unsigned int k = 0; k < p->config.num_rob_entries; k++)
+        {
+            if (!p->exeq[k].valid)
+            {
+                p->exeq[k].valid = true;
+                p->exeq[k].inst = p->SC_latch[i].inst;
+                p->exeq[k].wait_cycles = p->SC_latch[i].inst.op_type == OP_LD
+                                             ? p->config.load_exe_cycles : 1;
+                break;
+            }
+        }
+        p->SC_latch[i].valid = false;
+    }
+
+    for (unsigned int k = 0; k < p->config.num_rob_entries; k++)
+    {
+        if (p->exeq[k].valid)
+        {
+            p->exeq[k].wait_cycles--;
+        }
+    }
+
+    unsigned int n = 0;
+    for (unsigned int k = 0; k < p->config.num_rob_entries && n < MAX_WRITEBACKS; k++)
+    {
+        if (p->exeq[k].valid && p->exeq[k].wait_cycles == 0)
+        {
+            p->exeq[k].valid = false;
+            p->EX_latch[n].valid = true;
+            p->EX_latch[n].stall = false;
+            p->EX_latch[n].inst = p->exeq[k].inst;
+            n++;
+        }
+    }
+}
+
+/**
+ * Simulate one cycle of the writeback stage of the reference engine.
+ */
+static void ref_cycle_writeback(RefPipeline *p)
+{
+    for (unsigned int i = 0; i < MAX_WRITEBACKS; i++)
+    {
+        if (!p->EX_latch[i].stall && p->EX_latch[i].valid)
+        {
+            ref_rob_wakeup(p, p->EX_latch[i].inst.dr_tag);
+            p->rob[p->EX_latch[i].inst.dr_tag].ready = true;
+            p->EX_latch[i].valid = false;
+        }
+    }
+}
+
+/**
+ * Simulate one cycle of the commit stage of the reference engine.
+ */
+static void ref_cycle_commit(RefPipeline *p)
+{
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        if (!ref_rob_check_ready(p, p->rob_head))
+        {
+            continue;
+        }
+
+        RefROBEntry *entry = &p->rob[p->rob_head];
+        entry->valid = false;
+        entry->exec = false;
+        entry->ready = false;
+        p->rob_head = (p->rob_head + 1) % p->config.num_rob_entries;
+
+        p->stat_retired_inst++;
+        p->last_retired_inst_num = entry->inst.inst_num;
+        if (p->stat_retired_inst >= p->halt_inst_num)
+        {
+            p->halt = true;
+        }
+
+        if (entry->inst.dest_reg != -1 &&
+            rat_get_remap(p->rat, entry->inst.dest_reg) == entry->inst.dr_tag)
+        {
+            rat_reset_entry(p->rat, entry->inst.dest_reg);
+        }
+        p->ID_latch[i].stall = !ref_rob_check_space(p);
+    }
+}
+
+/**
+ * Simulate one cycle of all stages of the reference engine.
+ */
+static void ref_cycle(RefPipeline *p)
+{
+    p->stat_num_cycle++;
+
+    // As in the pipeline, stages are processed in reverse order.
+    ref_cycle_commit(p);
+    ref_cycle_writeback(p);
+    ref_cycle_exe(p);
+    ref_cycle_schedule(p);
+    ref_cycle_issue(p);
+    ref_cycle_decode(p);
+    ref_cycle_fetch(p);
+}
+
+/**
+ * Print one latch of the reference engine's state table.
+ */
+static void ref_print_latch(const PipelineLatch *latch)
+{
+    if (latch->valid)
+    {
+        printf(" %6lu ", (unsigned long)latch->inst.inst_num);
+    }
+    else
+    {
+        printf(" ------ ");
+    }
+}
+
+/**
+ * Print out the state of the reference engine, in the layout of
+ * pipe_print_state.
+ */
+static void ref_print_state(RefPipeline *p)
+{
+    printf("\n FE:     ID:     SCH:    EX:    \n");
+    unsigned int ex_i = 0;
+    for (unsigned int i = 0; i < p->config.pipe_width; i++)
+    {
+        ref_print_latch(&p->FE_latch[i]);
+        ref_print_latch(&p->ID_latch[i]);
+        ref_print_latch(&p->SC_latch[i]);
+        while (ex_i < MAX_WRITEBACKS && !p->EX_latch[ex_i].valid)
+        {
+            ex_i++;
+        }
+        if (ex_i < MAX_WRITEBACKS)
+        {
+            ref_print_latch(&p->EX_latch[ex_i++]);
+        }
+        else
+        {
+            printf(" ------ ");
+        }
+        printf("\n");
+    }
+    printf("\n");
+
+    rat_print_state(p->rat);
+
+    printf("Current EXEQ state:\n");
+    printf("Entry  Valid  Tag   Wait Cycles\n");
+    for (unsigned int k = 0; k < p->config.num_rob_entries; k++)
+    {
+        if (p->exeq[k].valid)
+        {
+            printf("%5d ::  %d ", k, p->exeq[k].valid);
+            printf("%5d \t", p->exeq[k].inst.dr_tag);
+            printf("%5d \n", p->exeq[k].wait_cycles);
+        }
+    }
+    printf("\n");
+
+    printf("Current ROB state:\n");
+    printf("Entry\t\tInst\tValid\tExec\tReady\tsrc1_reg\tsrc1_ready\tsrc1_tag\tsrc2_reg\tsrc2_ready\tsrc2_tag\tdest_reg\tdr_tag\n");
+    for (unsigned int i = 0; i < p->config.num_rob_entries; i++)
+    {
+        const RefROBEntry *entry = &p->rob[i];
+        printf("%5d ::  %5d", i, (int)entry->inst.inst_num);
+        printf(" %5d", entry->valid);
+        printf(" %7d", entry->exec);
+        printf(" %7d", entry->ready);
+        printf(" %8d", entry->inst.src1_reg);
+        printf(" %10d", entry->inst.src1_ready);
+        printf(" %12d", entry->inst.src1_tag);
+        printf(" %11d", entry->inst.src2_reg);
+        printf(" %10d", entry->inst.src2_ready);
+        printf(" %12d", entry->inst.src2_tag);
+        printf(" %11d", entry->inst.dest_reg);
+        printf(" %10d", entry->inst.dr_tag);
+        printf(" %10d", entry->inst.op_type);
+        if (i == p->rob_head && i == p->rob_tail)
+        {
+            printf(" (head/tail)");
+        }
+        else if (i == p->rob_head)
+        {
+            printf(" (head)");
+        }
+        else if (i == p->rob_tail)
+        {
+            printf(" (tail)");
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+/**
+ * Report the first divergence between the engines and dump both.
+ *
+ * @param p the pipeline
+ * @param ref the reference engine
+ * @param retired the number of instructions the pipeline had retired by the
+ *                reference engine's current cycle
+ */
+static void verify_report(Pipeline *p, RefPipeline *ref, uint64_t retired)
+{
+    fflush(stdout);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Error: the pipeline diverged from the reference engine in cycle %lu\n",
+            (unsigned long)ref->stat_num_cycle);
+    fprintf(stderr, "    pipeline:  %lu instructions retired, last inst_num %lu%s\n",
+            (unsigned long)retired, (unsigned long)p->last_retired_inst_num,
+            p->halt ? ", halted" : "");
+    fprintf(stderr, "    reference: %lu instructions retired, last inst_num %lu%s\n",
+            (unsigned long)ref->stat_retired_inst,
+            (unsigned long)ref->last_retired_inst_num,
+            ref->halt ? ", halted" : "");
+    fflush(stderr);
+
+    printf("\n== Pipeline state (cycle %lu) ==\n", (unsigned long)p->stat_num_cycle);
+    pipe_print_state(p);
+    printf("== Reference engine state (cycle %lu) ==\n",
+           (unsigned long)ref->stat_num_cycle);
+    ref_print_state(ref);
+}
+
+/**
+ * Simulate a pipeline to completion in lockstep with the reference engine,
+ * stopping at the first commit on which they disagree.
+ *
+ * @param p the pipeline to verify
+ * @param ref_src a second source of the same trace
+ * @return 0 if every commit matched, nonzero if the engines diverged or
+ *         deadlocked (an error has been printed)
+ */
+int verify_run(Pipeline *p, InstSource *ref_src)
+{
+    RefPipeline *ref = ref_init(&p->config, ref_src);
+    uint64_t last_retired = 0;
+    uint64_t last_commit_cycle = 0;
+    int status = 0;
+    while (status == 0 && !p->halt)
+    {
+        uint64_t retired = p->stat_retired_inst;
+        uint64_t idle = p->skip_idle ? pipe_idle_cycles(p) : 0;
+        if (idle > 0)
+        {
+            pipe_skip_cycles(p, idle);
+        }
+        else
+        {
+            pipe_cycle(p);
+        }
+
+        // The pipeline retires nothing in the cycles it skips, so the
+        // reference engine must retire nothing before it reaches the same
+        // cycle, and then exactly what the pipeline did.
+        while (ref->stat_num_cycle < p->stat_num_cycle)
+        {
+            ref_cycle(ref);
+            bool caught_up = ref->stat_num_cycle == p->stat_num_cycle;
+            if (caught_up)
+            {
+                retired = p->stat_retired_inst;
+            }
+            if (ref->stat_retired_inst != retired ||
+                (caught_up && retired > 0 &&
+                 ref->last_retired_inst_num != p->last_retired_inst_num) ||
+                (caught_up && ref->halt != p->halt))
+            {
+                verify_report(p, ref, retired);
+                status = 1;
+                break;
+            }
+        }
+
+        if (p->stat_retired_inst != last_retired)
+        {
+            last_retired = p->stat_retired_inst;
+            last_commit_cycle = p->stat_num_cycle;
+        }
+        else if (status == 0 &&
+                 p->stat_num_cycle - last_commit_cycle >= VERIFY_DEADLOCK_CYCLES)
+        {
+            fprintf(stderr, "\n");
+            fprintf(stderr, "Error: both engines are deadlocked: no instructions "
+                            "committed in %u cycles %lu\n",
+                    VERIFY_DEADLOCK_CYCLES, (unsigned long)last_retired);
+            status = 1;
+        }
+    }
+
+    ref_free(ref);
+    return status;
+}
@@ -0,0 +1,40 @@
+// verify.h
+// Declares the lockstep verification mode.
+//
+// The pipeline is simulated side by side with a reference engine: a plain
+// implementation of the same machine, with a ROB that is scanned from head to
+// tail, an EXEQ whose entries count down every cycle, and none of the
+// pipeline's specialized kernels, scheduling bitsets, wakeup lists, or idle
+// cycle skipping. Both engines are fed the same trace and stepped cycle by
+// cycle, and every commit of the pipeline must match the reference engine's,
+// instruction for instruction and cycle for cycle.
+
+#ifndef _VERIFY_H_
+#define _VERIFY_H_
+
+#include "pipeline.h"
+#include "source.h"
+
+/**
+ * The number of cycles without a commit after which both engines are
+ * considered deadlocked.
+ */
+#define VERIFY_DEADLOCK_CYCLES 10000
+
+/**
+ * Simulate a pipeline to completion in lockstep with the reference engine,
+ * stopping at the first commit on which they disagree.
+ *
+ * On a divergence, the cycle and the commits of both engines are printed,
+ * followed by the state of both.
+ *
+ * @param p the pipeline to verify; freshly initialized, and fast-forwarded
+ *          through idle cycles if its skip_idle is set
+ * @param ref_src a second source of the same trace, which the reference
+ *                engine reads
+ * @return 0 if every commit matched, nonzero if the engines diverged or
+ *         deadlocked (an error has been printed)
+ */
+int verify_run(Pipeline *p, InstSource *ref_src);
+
+#endif